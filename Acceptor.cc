@@ -4,12 +4,19 @@
 
 #include <sys/types.h>          
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 
-static int createNonblocking()
+static int createNonblocking(sa_family_t family)
 {
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if(family == AF_UNSPEC)
+    {
+        LOG_FATAL("%s:%s:%d invalid listen address \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    int protocol = family == AF_UNIX ? 0 : IPPROTO_TCP;
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
     if(sockfd < 0)
     {
         LOG_FATAL("%s:%s:%d listen socket create err: %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
@@ -17,38 +24,124 @@ static int createNonblocking()
     return sockfd;
 }
 
+// 上一次运行留下的socket文件会让bind失败，删掉它；abstract namespace的地址没有文件
+// 只删没有人在监听的socket文件：普通文件、目录等不是我们的，还在监听的是另一个服务器，都交给bind报错
+static void removeStaleSocketFile(const InetAddress &listenAddr)
+{
+    std::string path = listenAddr.toIp();
+    struct stat st;
+    if(path.empty() || path[0] == '@' || ::lstat(path.c_str(), &st) != 0 || !S_ISSOCK(st.st_mode))
+    {
+        return;
+    }
+    int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(probe < 0)
+    {
+        return;
+    }
+    // 非阻塞connect：ECONNREFUSED说明没有人在监听；成功或者EAGAIN（backlog满了）说明还在用
+    int ret = ::connect(probe, listenAddr.getSockAddr(), listenAddr.getSockAddrLen());
+    int savedErrno = errno;
+    ::close(probe);
+    if(ret != 0 && savedErrno == ECONNREFUSED)
+    {
+        ::unlink(path.c_str());
+    }
+    else if(ret == 0 || savedErrno == EAGAIN)
+    {
+        LOG_ERROR("Acceptor %s is in use by another server \n", path.c_str());
+    }
+}
+
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop)
-    , acceptSocket_(createNonblocking())
-    , acceptChannel_(loop, acceptSocket_.fd())
+    , acceptSocket_(new Socket(createNonblocking(listenAddr.family())))
+    , acceptChannel_(loop, acceptSocket_->fd())
     , listenning_(false)
 {
-    acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
-    acceptSocket_.bindAddress(listenAddr);
+    if(listenAddr.isUnix())
+    {
+        removeStaleSocketFile(listenAddr);
+    }
+    else
+    {
+        acceptSocket_->setReuseAddr(true);
+        acceptSocket_->setReusePort(true);
+    }
+    if(listenAddr.family() == AF_INET6)
+    {
+        // 不依赖net.ipv6.bindv6only的系统默认值，"::"同时接受IPv4连接
+        acceptSocket_->setV6Only(false);
+    }
+    acceptSocket_->bindAddress(listenAddr);
     // TcpSever::start() Acceptor.listen 有新用户的连接，要执行一个回调
     // connfd -> channel -> subloop
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
 }
 
+Acceptor::Acceptor(EventLoop *loop, int listenFd)
+    : loop_(loop)
+    , acceptSocket_(new Socket(listenFd))
+    , acceptChannel_(loop, listenFd)
+    , listenning_(false)
+{
+    // 继承来的fd不一定带有非阻塞和close-on-exec标志
+    int flags = ::fcntl(listenFd, F_GETFL, 0);
+    ::fcntl(listenFd, F_SETFL, flags | O_NONBLOCK);
+    flags = ::fcntl(listenFd, F_GETFD, 0);
+    ::fcntl(listenFd, F_SETFD, flags | FD_CLOEXEC);
+    acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+}
+
 Acceptor::~Acceptor()
 {
-    acceptChannel_.disableAll();
-    acceptChannel_.remove();
+    if(acceptSocket_)
+    {
+        acceptChannel_.disableAll();
+        acceptChannel_.remove();
+    }
 }
 
 void Acceptor::listen()
 {
     listenning_ = true;
-    acceptSocket_.listen();
+    acceptSocket_->listen();
     acceptChannel_.enableReading();     // 把acceptor注册到channel里
 }
 
+void Acceptor::stop(bool acceptBacklog)
+{
+    if(!acceptSocket_)
+    {
+        return;
+    }
+    listenning_ = false;
+
+    // listenfd是非阻塞的，把已经在backlog中的连接都接收下来，避免关闭时被reset
+    InetAddress peerAddr;
+    int connfd;
+    while(acceptBacklog && (connfd = acceptSocket_->accept(&peerAddr)) >= 0)
+    {
+        if(newConnectionCallback_)
+        {
+            newConnectionCallback_(connfd, peerAddr);
+        }
+        else
+        {
+            ::close(connfd);
+        }
+    }
+
+    acceptChannel_.disableAll();
+    acceptChannel_.remove();
+    acceptSocket_.reset();      // 关闭listenfd
+}
+
 // listenfd有事件发生了，有新用户连接了
 void Acceptor::handleRead()
 {
     InetAddress peerAddr;
-    int connfd = acceptSocket_.accept(&peerAddr);
+    int connfd = acceptSocket_->accept(&peerAddr);
     if(connfd >= 0)
     {
         if(newConnectionCallback_)
@@ -5,6 +5,7 @@
 #include "Channel.h"
 
 #include <functional>
+#include <memory>
 
 class EventLoop;
 class InetAddress;
@@ -15,6 +16,8 @@ public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress&)>;
     
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
+    // 用继承来的listenfd创建（热重启），listenfd已经bind并listen过
+    Acceptor(EventLoop *loop, int listenFd);
     ~Acceptor();
 
     void setNewConentionCallback(const NewConnectionCallback& cb)
@@ -24,11 +27,18 @@ public:
 
     bool listenning() const { return listenning_; }
     void listen();
+    // 停止监听并关闭listenfd，之后的新连接会被拒绝
+    // acceptBacklog为true时先接收完backlog中已完成握手的连接，避免它们被reset；
+    // listenfd已经交给新进程时不需要，backlog由新进程继续accept
+    void stop(bool acceptBacklog = true);
+
+    // stop之后返回-1
+    int listenFd() const { return acceptSocket_ ? acceptSocket_->fd() : -1; }
 private:
     void handleRead();
 
     EventLoop* loop_;   // 用的就是用户定义的baseloop， 也就是mainloop
-    Socket acceptSocket_;
+    std::unique_ptr<Socket> acceptSocket_;   // stop之后为空
     Channel acceptChannel_;
     NewConnectionCallback newConnectionCallback_;
     bool listenning_;
@@ -38,9 +38,9 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
     return n;
 }
 
-ssize_t Buffer::writeFd(int fd, int *saveErrno)
+ssize_t Buffer::writeFd(int fd, int *saveErrno, size_t maxBytes)
 {
-    ssize_t n = ::write(fd, peek(), readableBytes());
+    ssize_t n = ::write(fd, peek(), std::min(readableBytes(), maxBytes));
     if(n < 0)
     {
         *saveErrno = errno;
@@ -5,6 +5,7 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <stdint.h>
 
 // 网络库底层的缓冲器类型定义
 // kCheapPrepend | reader | writer
@@ -40,6 +41,12 @@ public:
         return begin() + readerIndex_;
     }
 
+    // 可读数据的可写视图，协议层原地变换数据时使用（比如WebSocket去掩码）
+    char* beginRead()
+    {
+        return begin() + readerIndex_;
+    }
+
     // onMessage string <- Buffer
     void retrieve(size_t len)
     {
@@ -102,10 +109,16 @@ public:
         return begin() + writerIndex_;
     }
 
+    // 直接写进beginWrite()之后，移动写位置
+    void hasWritten(size_t len)
+    {
+        writerIndex_ += len;
+    }
+
     // 从fd上读取数据
     ssize_t readFd(int fd, int *saveErrno);
-    // 通过fd发送数据
-    ssize_t writeFd(int fd, int *saveErrno);
+    // 通过fd发送数据，最多maxBytes
+    ssize_t writeFd(int fd, int *saveErrno, size_t maxBytes = SIZE_MAX);
 
 private:
     char* begin()
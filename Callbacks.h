@@ -2,12 +2,15 @@
 
 #include <memory>
 #include <functional>
+#include <string>
 
 class Buffer;
 class TcpConnection;
 class Timestamp;
 
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+// 只读的共享数据，广播给多个连接时只保存一份，各连接的发送队列只持有引用
+using SharedPayload = std::shared_ptr<const std::string>;
 using ConnectionCallback = std::function<void (const TcpConnectionPtr&)>;
 using CloseCallback = std::function<void (const TcpConnectionPtr&)>;
 using WriteCompleteCallback = std::function<void (const TcpConnectionPtr&)>;
@@ -16,4 +19,7 @@ using MessageCallback = std::function<void (const TcpConnectionPtr&,
                                     Buffer*,
                                     Timestamp)>;
 
-using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
\ No newline at end of file
+using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
+
+// 连接迁移到新的loop上完成后的回调，在新的loop线程中执行
+using MigrateCallback = std::function<void (const TcpConnectionPtr&)>;
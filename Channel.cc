@@ -34,6 +34,14 @@ void Channel::update(){
     loop_->updateChannel(this);
 }
 
+std::string Channel::describe() const{
+    std::string desc = "fd=" + std::to_string(fd_);
+    if(describeCallback_){
+        desc += " " + describeCallback_();
+    }
+    return desc;
+}
+
 // 在channel所属的eventloop中删，每个eventloop包含一个poller和很多channel
 void Channel::remove(){
     loop_->removeChannel(this);
@@ -54,7 +62,7 @@ void Channel::handleEvent(Timestamp receiveTime){
 // 根据poller接收到的事件，由channel执行相应回调
 void Channel::handleEventWithGuard(Timestamp receiveTime){
     // 打印log
-    LOG_INFO("channel handleEvent revents:%d\n", revents_);
+    LOG_DEBUG("channel handleEvent revents:%d\n", revents_);
 
 
     if((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN)){
@@ -5,6 +5,7 @@
 
 #include <functional>
 #include <memory>
+#include <string>
 
 class EventLoop;    // 前置类型，暴露少
 
@@ -21,6 +22,7 @@ class Channel : noncopyable
 public:
     using EventCallback = std::function<void()>;
     using ReadEventCallback = std::function<void(Timestamp)>;
+    using DescribeCallback = std::function<std::string()>;
 
     Channel(EventLoop *loop, int fd);
     ~Channel();
@@ -33,6 +35,10 @@ public:
     void setWriteCallback(EventCallback cb) { writeCallback_ = std::move(cb); }
     void setCloseCallback(EventCallback cb) { closeCallback_ = std::move(cb); }
     void setErrorCallback(EventCallback cb) { errorCallback_ = std::move(cb); }
+    // 卡顿报告里用来描述channel的属主，比如连接的名字
+    void setDescribeCallback(DescribeCallback cb) { describeCallback_ = std::move(cb); }
+
+    std::string describe() const;
 
     // 防止当channel被手动remove掉，channel还在执行回调操作
     void tie(const std::shared_ptr<void>&);
@@ -84,5 +90,6 @@ private:
     EventCallback writeCallback_;
     EventCallback closeCallback_;
     EventCallback errorCallback_;
+    DescribeCallback describeCallback_;
     
 };
\ No newline at end of file
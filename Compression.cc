@@ -0,0 +1,184 @@
+#include "Compression.h"
+#include "Logger.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <endian.h>
+#include <string.h>
+
+const size_t Compression::kHeaderLen;
+const size_t Compression::kMaxFrameSize;
+
+static const uint32_t kCompressedFlag = 0x80000000u;
+
+// 每个loop线程一对z_stream，所有连接复用，每帧开始时reset
+// 线程退出时不释放，loop线程和进程的生命周期一样长
+namespace
+{
+struct ZlibContext
+{
+    ZlibContext()
+        : deflateLevel(Z_DEFAULT_COMPRESSION)
+        , deflateReady(false)
+        , inflateReady(false)
+    {
+        ::memset(&deflater, 0, sizeof deflater);
+        ::memset(&inflater, 0, sizeof inflater);
+    }
+
+    z_stream* resetDeflater(int level)
+    {
+        if(!deflateReady)
+        {
+            // 负的windowBits：raw deflate，没有zlib头和校验和，帧头里已经有长度
+            if(deflateInit2(&deflater, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            {
+                LOG_FATAL("deflateInit2 fail \n");
+            }
+            deflateReady = true;
+            deflateLevel = level;
+        }
+        else
+        {
+            deflateReset(&deflater);
+            if(level != deflateLevel)
+            {
+                deflateParams(&deflater, level, Z_DEFAULT_STRATEGY);
+                deflateLevel = level;
+            }
+        }
+        return &deflater;
+    }
+
+    z_stream* resetInflater()
+    {
+        if(!inflateReady)
+        {
+            if(inflateInit2(&inflater, -15) != Z_OK)
+            {
+                LOG_FATAL("inflateInit2 fail \n");
+            }
+            inflateReady = true;
+        }
+        else
+        {
+            inflateReset(&inflater);
+        }
+        return &inflater;
+    }
+
+    z_stream deflater;
+    z_stream inflater;
+    int deflateLevel;
+    bool deflateReady;
+    bool inflateReady;
+};
+
+thread_local ZlibContext t_zlib;
+}
+
+static void appendHeader(Buffer *out, uint32_t storedAndFlags, uint32_t originalLen)
+{
+    uint32_t header[2] = { htobe32(storedAndFlags), htobe32(originalLen) };
+    out->append(reinterpret_cast<const char*>(header), sizeof header);
+}
+
+Compression::Compression(int level, size_t minCompressSize)
+    : level_(level)
+    , minCompressSize_(minCompressSize)
+    , rawBytesOut_(0)
+    , wireBytesOut_(0)
+    , rawBytesIn_(0)
+    , wireBytesIn_(0)
+{
+}
+
+void Compression::compress(const void *data, size_t len, Buffer *out)
+{
+    const char *p = static_cast<const char*>(data);
+    size_t before = out->readableBytes();
+    rawBytesOut_ += len;
+    while(len > 0)
+    {
+        size_t n = std::min(len, kMaxFrameSize);
+        bool compressed = false;
+        if(n >= minCompressSize_)
+        {
+            // 先预留帧头，直接压缩到out的可写空间；压不小时退回原文
+            z_stream *zs = t_zlib.resetDeflater(level_);
+            size_t bound = deflateBound(zs, n);
+            out->ensureWritableBytes(kHeaderLen + bound);
+            char *frame = out->beginWrite();
+            zs->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(p));
+            zs->avail_in = static_cast<uInt>(n);
+            zs->next_out = reinterpret_cast<Bytef*>(frame + kHeaderLen);
+            zs->avail_out = static_cast<uInt>(bound);
+            int ret = deflate(zs, Z_FINISH);
+            size_t stored = bound - zs->avail_out;
+            if(ret == Z_STREAM_END && stored < n)
+            {
+                uint32_t header[2] = { htobe32(static_cast<uint32_t>(stored) | kCompressedFlag),
+                                       htobe32(static_cast<uint32_t>(n)) };
+                ::memcpy(frame, header, sizeof header);
+                out->hasWritten(kHeaderLen + stored);
+                compressed = true;
+            }
+        }
+        if(!compressed)
+        {
+            appendHeader(out, static_cast<uint32_t>(n), static_cast<uint32_t>(n));
+            out->append(p, n);
+        }
+        p += n;
+        len -= n;
+    }
+    wireBytesOut_ += out->readableBytes() - before;
+}
+
+bool Compression::decompress(Buffer *in, Buffer *plain)
+{
+    while(in->readableBytes() >= kHeaderLen)
+    {
+        uint32_t header[2];
+        ::memcpy(header, in->peek(), sizeof header);
+        uint32_t word = be32toh(header[0]);
+        bool compressed = (word & kCompressedFlag) != 0;
+        size_t stored = word & ~kCompressedFlag;
+        size_t original = be32toh(header[1]);
+        if(original > kMaxFrameSize || stored > kMaxFrameSize || (!compressed && stored != original))
+        {
+            LOG_ERROR("Compression::decompress bad frame header \n");
+            return false;
+        }
+        if(in->readableBytes() < kHeaderLen + stored)
+        {
+            break;
+        }
+
+        const char *data = in->peek() + kHeaderLen;
+        if(compressed)
+        {
+            z_stream *zs = t_zlib.resetInflater();
+            plain->ensureWritableBytes(original);
+            zs->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            zs->avail_in = static_cast<uInt>(stored);
+            zs->next_out = reinterpret_cast<Bytef*>(plain->beginWrite());
+            zs->avail_out = static_cast<uInt>(original);
+            int ret = inflate(zs, Z_FINISH);
+            if(ret != Z_STREAM_END || zs->avail_out != 0 || zs->avail_in != 0)
+            {
+                LOG_ERROR("Compression::decompress corrupt frame, inflate=%d \n", ret);
+                return false;
+            }
+            plain->hasWritten(original);
+        }
+        else
+        {
+            plain->append(data, stored);
+        }
+        rawBytesIn_ += original;
+        wireBytesIn_ += kHeaderLen + stored;
+        in->retrieve(kHeaderLen + stored);
+    }
+    return true;
+}
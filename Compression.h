@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ConnectionFilter.h"
+
+#include <stdint.h>
+
+// 连接上的透明压缩（zlib raw deflate），只在连接所属的loop线程中使用
+// 发送的数据切成最多kMaxFrameSize的帧分别压缩，帧之间互相独立：
+//   | flags+storedLen u32 | originalLen u32 | data |
+// flags是最高位，置位表示data是压缩过的，否则是原文（太短或者压不小的数据原样发送）
+// 帧独立意味着连接上不需要保存压缩字典，z_stream每个loop线程一对，所有连接复用，
+// 一个连接占用的内存只有收发缓冲区；代价是小消息之间没有共享的历史，压缩率比整条流压缩低一些
+// 作为连接上的一级filter安装（TcpConnection::startCompression），在TLS之上
+class Compression : public ConnectionFilter
+{
+public:
+    static const size_t kHeaderLen = 8;
+    static const size_t kMaxFrameSize = 256 * 1024;
+
+    // level是zlib的压缩级别，-1是默认(6)；短于minCompressSize的数据不压缩
+    explicit Compression(int level = -1, size_t minCompressSize = 64);
+
+    int level() const { return level_; }
+
+    // 把data压缩成帧追加到out
+    void compress(const void *data, size_t len, Buffer *out);
+    // 解压in中完整的帧，原文直接解压到plain的可写空间；返回false表示数据损坏
+    bool decompress(Buffer *in, Buffer *plain);
+
+    bool onInput(Buffer *in, Buffer *out) override { return decompress(in, out); }
+    bool onOutput(const char *data, size_t len, Buffer *out) override { compress(data, len, out); return true; }
+
+    // 统计，原文和压缩后（含帧头）的字节数
+    uint64_t rawBytesOut() const { return rawBytesOut_; }
+    uint64_t wireBytesOut() const { return wireBytesOut_; }
+    uint64_t rawBytesIn() const { return rawBytesIn_; }
+    uint64_t wireBytesIn() const { return wireBytesIn_; }
+
+private:
+    const int level_;
+    const size_t minCompressSize_;
+    uint64_t rawBytesOut_;
+    uint64_t wireBytesOut_;
+    uint64_t rawBytesIn_;
+    uint64_t wireBytesIn_;
+};
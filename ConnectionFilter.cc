@@ -0,0 +1,187 @@
+#include "ConnectionFilter.h"
+#include "Logger.h"
+
+bool ConnectionFilter::onInput(Buffer *in, Buffer *out)
+{
+    out->append(in->peek(), in->readableBytes());
+    in->retrieveAll();
+    return true;
+}
+
+bool ConnectionFilter::onOutput(const char *data, size_t len, Buffer *out)
+{
+    out->append(data, len);
+    return true;
+}
+
+FilterChain::FilterChain(TcpConnection *conn, Buffer *applicationInput)
+    : conn_(conn)
+    , applicationInput_(applicationInput)
+    , pausedStages_(0)
+{
+}
+
+FilterChain::~FilterChain()
+{
+}
+
+bool FilterChain::add(const std::shared_ptr<ConnectionFilter> &filter)
+{
+    std::unique_ptr<Stage> stage(new Stage);
+    stage->filter = filter;
+    stage->index = stages_.size();
+    stage->paused = false;
+    bool moved = false;
+    if(filter->filtersInput())
+    {
+        stage->input.reset(new Buffer);
+        if(applicationInput_->readableBytes() > 0)
+        {
+            // 对端在协商消息之后发来的数据可能一起读了进来，应用处理完协商消息后剩下的要先经过这一级
+            stage->input->append(applicationInput_->peek(), applicationInput_->readableBytes());
+            applicationInput_->retrieveAll();
+            moved = true;
+        }
+        inputStages_.push_back(stage.get());
+    }
+    if(filter->filtersOutput())
+    {
+        stage->output.reset(new Buffer);
+        outputStages_.insert(outputStages_.begin(), stage.get());
+    }
+    stages_.push_back(std::move(stage));
+    filter->attached(this);
+    return moved;
+}
+
+bool FilterChain::processInput()
+{
+    for(size_t i = 0; i < inputStages_.size(); ++i)
+    {
+        Stage *stage = inputStages_[i];
+        if(stage->paused)
+        {
+            break;      // 后面的数据留在它的缓冲区里，恢复时再处理
+        }
+        Buffer *out = i + 1 < inputStages_.size() ? inputStages_[i + 1]->input.get() : applicationInput_;
+        if(stage->input->readableBytes() > 0 && !stage->filter->onInput(stage->input.get(), out))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t FilterChain::bufferedInputBytes() const
+{
+    size_t total = 0;
+    for(Stage *stage : inputStages_)
+    {
+        total += stage->input->readableBytes();
+    }
+    return total;
+}
+
+bool FilterChain::processOutput(const char *data, size_t len)
+{
+    return processOutputFrom(0, data, len);
+}
+
+bool FilterChain::processOutputFrom(size_t from, const char *data, size_t len)
+{
+    // 上一级的输出是这一级的输入，这一级处理完才能清空上一级的缓冲区
+    Buffer *prev = nullptr;
+    for(size_t i = from; i < outputStages_.size(); ++i)
+    {
+        Buffer *out = outputStages_[i]->output.get();
+        bool ok = outputStages_[i]->filter->onOutput(data, len, out);
+        if(prev != nullptr)
+        {
+            prev->retrieveAll();
+        }
+        if(!ok)
+        {
+            out->retrieveAll();
+            return false;
+        }
+        prev = out;
+        data = out->peek();
+        len = out->readableBytes();
+    }
+    if(len > 0)
+    {
+        writeCallback_(data, len);
+    }
+    if(prev != nullptr)
+    {
+        prev->retrieveAll();
+    }
+    return true;
+}
+
+void FilterChain::outputDrained()
+{
+    for(auto &stage : stages_)
+    {
+        stage->filter->onOutputDrained();
+    }
+}
+
+FilterChain::Stage* FilterChain::findStage(ConnectionFilter *filter)
+{
+    for(auto &stage : stages_)
+    {
+        if(stage->filter.get() == filter)
+        {
+            return stage.get();
+        }
+    }
+    LOG_ERROR("FilterChain::findStage filter %p is not installed \n", filter);
+    return nullptr;
+}
+
+void FilterChain::pauseInput(ConnectionFilter *filter)
+{
+    Stage *stage = findStage(filter);
+    if(stage != nullptr && !stage->paused)
+    {
+        stage->paused = true;
+        if(++pausedStages_ == 1)
+        {
+            readingCallback_();
+        }
+    }
+}
+
+void FilterChain::resumeInput(ConnectionFilter *filter)
+{
+    Stage *stage = findStage(filter);
+    if(stage != nullptr && stage->paused)
+    {
+        stage->paused = false;
+        if(--pausedStages_ == 0)
+        {
+            readingCallback_();
+        }
+        resumeCallback_();
+    }
+}
+
+void FilterChain::output(ConnectionFilter *filter, const char *data, size_t len)
+{
+    Stage *stage = findStage(filter);
+    if(stage == nullptr)
+    {
+        return;
+    }
+    // outputStages_从应用一侧排到socket一侧，跳过这一级和它上面的
+    size_t from = 0;
+    while(from < outputStages_.size() && outputStages_[from]->index >= stage->index)
+    {
+        ++from;
+    }
+    if(!processOutputFrom(from, data, len))
+    {
+        errorCallback_();
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Buffer.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class FilterChain;
+class TcpConnection;
+
+// 连接上的一级字节流处理（压缩、计量、限速……），装在socket（开启TLS时是解密之后）和应用之间，
+// 只在连接所属的loop线程中调用
+// 一条连接上的filter按安装顺序从socket一侧排到应用一侧：收到的数据依次经过各级到达inputBuffer_，
+// send的数据反方向依次经过各级再写给socket
+class ConnectionFilter : noncopyable
+{
+public:
+    virtual ~ConnectionFilter() {}
+
+    // 这一级是否处理某个方向的数据，安装时读取一次
+    // 返回false的方向直通：数据不经过这一级的缓冲区，不拷贝，也不调用onInput/onOutput
+    virtual bool filtersInput() const { return true; }
+    virtual bool filtersOutput() const { return true; }
+
+    // 入站：in里是下一级交上来还没处理的数据，取走处理了的部分，结果追加到out，不完整的留在in里
+    // 返回false表示数据有错，连接会被关闭
+    virtual bool onInput(Buffer *in, Buffer *out);
+    // 出站：把data处理后追加到out，返回false时连接会被关闭
+    virtual bool onOutput(const char *data, size_t len, Buffer *out);
+
+    // 安装到连接上时调用，chain用于反压和主动发送，和连接的生命周期一样长
+    virtual void attached(FilterChain* /*chain*/) {}
+    // socket上积压的待发送数据全部写出，自己扣着数据的filter可以在这里接着发
+    virtual void onOutputDrained() {}
+};
+
+// 一条连接上的filter，由TcpConnection持有，只在loop线程中访问
+// 每个处理入站数据的filter有一个输入缓冲区：socket读到的数据进入第一个的缓冲区，
+// 最后一个的输出就是连接的inputBuffer_；没有处理入站数据的filter时socket直接读进inputBuffer_
+// 反压：filter暂停入站时它之后的数据留在它的缓冲区里，连接停止读socket，恢复后从它这一级接着处理
+class FilterChain : noncopyable
+{
+public:
+    using WriteCallback = std::function<void (const char*, size_t)>;
+    using EventCallback = std::function<void ()>;
+
+    FilterChain(TcpConnection *conn, Buffer *applicationInput);
+    ~FilterChain();
+
+    // filter追加到应用一侧；applicationInput中还没处理的数据当作它下层交上来的数据，返回是否有这样的数据
+    bool add(const std::shared_ptr<ConnectionFilter> &filter);
+
+    TcpConnection* connection() const { return conn_; }
+    bool filtersInput() const { return !inputStages_.empty(); }
+    bool filtersOutput() const { return !outputStages_.empty(); }
+
+    // socket（或TLS解密）的数据应该放进哪个缓冲区
+    Buffer* inputBuffer() { return inputStages_.empty() ? applicationInput_ : inputStages_.front()->input.get(); }
+    // 入站数据依次交给各级，遇到暂停的一级就停下；返回false表示有filter报错
+    bool processInput();
+    // 还留在各级缓冲区里的入站数据
+    size_t bufferedInputBytes() const;
+
+    // 出站数据依次交给各级，最后交给写回调；返回false表示有filter报错
+    bool processOutput(const char *data, size_t len);
+    void outputDrained();
+
+    // 以下由filter调用
+    // 暂停/恢复这一级的入站处理，有任何一级暂停时连接不读socket
+    void pauseInput(ConnectionFilter *filter);
+    void resumeInput(ConnectionFilter *filter);
+    bool inputPaused() const { return pausedStages_ > 0; }
+    // filter主动发出数据（比如之前扣下的），从它的下一级开始处理
+    void output(ConnectionFilter *filter, const char *data, size_t len);
+
+    // 处理后的出站数据交给连接写出（TLS或socket）
+    void setWriteCallback(const WriteCallback &cb) { writeCallback_ = cb; }
+    // 暂停状态变化，连接据此更新读事件
+    void setReadingCallback(const EventCallback &cb) { readingCallback_ = cb; }
+    // 有filter恢复入站处理，连接应该在本轮回调结束后重新处理入站数据
+    void setResumeCallback(const EventCallback &cb) { resumeCallback_ = cb; }
+    // filter主动发出的数据处理出错，连接应该关闭
+    void setErrorCallback(const EventCallback &cb) { errorCallback_ = cb; }
+
+private:
+    struct Stage
+    {
+        std::shared_ptr<ConnectionFilter> filter;
+        std::unique_ptr<Buffer> input;      // 只有处理入站数据的filter有
+        std::unique_ptr<Buffer> output;     // 只有处理出站数据的filter有，处理完一次就清空
+        size_t index;                       // 在stages_中的位置
+        bool paused;
+    };
+
+    Stage* findStage(ConnectionFilter *filter);
+    // 从outputStages_[from]开始处理出站数据
+    bool processOutputFrom(size_t from, const char *data, size_t len);
+
+    TcpConnection *conn_;
+    Buffer *applicationInput_;
+    std::vector<std::unique_ptr<Stage>> stages_;
+    std::vector<Stage*> inputStages_;       // 从socket一侧到应用一侧
+    std::vector<Stage*> outputStages_;      // 从应用一侧到socket一侧
+    int pausedStages_;
+
+    WriteCallback writeCallback_;
+    EventCallback readingCallback_;
+    EventCallback resumeCallback_;
+    EventCallback errorCallback_;
+};
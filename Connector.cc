@@ -0,0 +1,224 @@
+#include "Connector.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+
+static int createNonblocking(sa_family_t family)
+{
+    int protocol = family == AF_UNIX ? 0 : IPPROTO_TCP;
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
+    if(sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d connect socket create err: %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+static int getSocketError(int sockfd)
+{
+    int optval;
+    socklen_t optlen = sizeof optval;
+    if(::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        return errno;
+    }
+    return optval;
+}
+
+// 本机连接本机时，端口可能自己连上自己，unix域socket不会
+static bool isSelfConnect(int sockfd)
+{
+    sockaddr_storage local, peer;
+    socklen_t len = sizeof local;
+    ::memset(&local, 0, sizeof local);
+    ::memset(&peer, 0, sizeof peer);
+    ::getsockname(sockfd, (sockaddr*)&local, &len);
+    len = sizeof peer;
+    ::getpeername(sockfd, (sockaddr*)&peer, &len);
+    if(local.ss_family == AF_INET6)
+    {
+        const sockaddr_in6 *l = (const sockaddr_in6*)&local;
+        const sockaddr_in6 *p = (const sockaddr_in6*)&peer;
+        return l->sin6_port == p->sin6_port && ::memcmp(&l->sin6_addr, &p->sin6_addr, sizeof l->sin6_addr) == 0;
+    }
+    if(local.ss_family == AF_INET)
+    {
+        const sockaddr_in *l = (const sockaddr_in*)&local;
+        const sockaddr_in *p = (const sockaddr_in*)&peer;
+        return l->sin_port == p->sin_port && l->sin_addr.s_addr == p->sin_addr.s_addr;
+    }
+    return false;
+}
+
+const int Connector::kMaxRetryDelayMs;
+const int Connector::kInitRetryDelayMs;
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , connect_(false)
+    , state_(kDisconnected)
+    , retryDelayMs_(kInitRetryDelayMs)
+{
+}
+
+Connector::~Connector()
+{
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop()
+{
+    if(connect_)
+    {
+        connect();
+    }
+}
+
+void Connector::restart()
+{
+    setState(kDisconnected);
+    retryDelayMs_ = kInitRetryDelayMs;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+void Connector::stopInLoop()
+{
+    loop_->cancel(retryTimer_);
+    if(state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        ::close(sockfd);
+    }
+}
+
+void Connector::connect()
+{
+    int sockfd = createNonblocking(serverAddr_.family());
+    int ret = ::connect(sockfd, serverAddr_.getSockAddr(), serverAddr_.getSockAddrLen());
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch(savedErrno)
+    {
+    case 0:
+    case EINPROGRESS:
+    case EINTR:
+    case EISCONN:
+        connecting(sockfd);
+        break;
+
+    case EAGAIN:
+    case EADDRINUSE:
+    case EADDRNOTAVAIL:
+    case ECONNREFUSED:
+    case ENETUNREACH:
+    case ENOENT:        // unix域socket的服务端还没有创建
+        retry(sockfd);
+        break;
+
+    default:
+        LOG_ERROR("Connector::connect to %s error %d \n", serverAddr_.toIpPort().c_str(), savedErrno);
+        ::close(sockfd);
+        break;
+    }
+}
+
+// 等待socket可写，可写时连接的结果才确定
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    channel_->tie(shared_from_this());
+    channel_->enableWritng();
+}
+
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 现在还在Channel::handleEvent中，不能直接析构channel
+    loop_->queueInLoop(std::bind(&Connector::resetChannel, shared_from_this()));
+    return sockfd;
+}
+
+void Connector::resetChannel()
+{
+    channel_.reset();
+}
+
+void Connector::handleWrite()
+{
+    if(state_ != kConnecting)
+    {
+        return;
+    }
+    int sockfd = removeAndResetChannel();
+    int err = getSocketError(sockfd);
+    if(err)
+    {
+        LOG_DEBUG("Connector::handleWrite SO_ERROR = %d \n", err);
+        retry(sockfd);
+    }
+    else if(isSelfConnect(sockfd))
+    {
+        LOG_ERROR("Connector::handleWrite self connect \n");
+        retry(sockfd);
+    }
+    else
+    {
+        setState(kConnected);
+        if(connect_ && newConnectionCallback_)
+        {
+            newConnectionCallback_(sockfd);
+        }
+        else
+        {
+            ::close(sockfd);
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    if(state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        LOG_DEBUG("Connector::handleError SO_ERROR = %d \n", getSocketError(sockfd));
+        retry(sockfd);
+    }
+}
+
+void Connector::retry(int sockfd)
+{
+    ::close(sockfd);
+    setState(kDisconnected);
+    if(connect_)
+    {
+        LOG_INFO("Connector::retry connecting to %s in %d ms \n",
+            serverAddr_.toIpPort().c_str(), retryDelayMs_);
+        retryTimer_ = loop_->runAfter(retryDelayMs_ / 1000.0,
+            std::bind(&Connector::startInLoop, shared_from_this()));
+        retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+
+class Channel;
+class EventLoop;
+
+// 主动发起连接，和Acceptor对应：非阻塞connect，socket可写时检查是否连接成功，
+// 失败后按指数退避重试，连接成功后把sockfd交给TcpClient
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+
+    void start();       // 可以跨线程调用
+    void restart();     // 只能在loop线程中调用
+    void stop();        // 可以跨线程调用
+
+    const InetAddress& serverAddress() const { return serverAddr_; }
+
+private:
+    enum States { kDisconnected, kConnecting, kConnected };
+    static const int kMaxRetryDelayMs = 30 * 1000;
+    static const int kInitRetryDelayMs = 500;
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_;
+    States state_;
+    std::unique_ptr<Channel> channel_;
+    NewConnectionCallback newConnectionCallback_;
+    int retryDelayMs_;
+    TimerId retryTimer_;
+};
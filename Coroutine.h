@@ -0,0 +1,337 @@
+#pragma once
+
+// C++20协程接口，只有头文件，使用的程序需要用-std=c++20编译，库本身仍然是C++11
+// 协程在连接所属的loop线程中运行，挂起时不占线程，由Channel回调（消息、写完成、连接断开）
+// 或者定时器恢复；等待对象放在协程帧里，每次co_await不需要额外分配内存
+//
+//   co::Task echo(TcpConnectionPtr conn)
+//   {
+//       co::Stream stream(conn);
+//       while(Buffer *buf = co_await stream.readable(1))
+//       {
+//           if(!co_await stream.write(buf->retrieveAllAsString())) break;
+//       }
+//   }
+//   server.setConnectionCallback([](const TcpConnectionPtr &conn){ if(conn->connected()) echo(conn); });
+//
+// 没有使用协程的连接仍然走原来的回调接口
+
+#if !defined(__cpp_impl_coroutine)
+#error "Coroutine.h requires C++20 coroutines, compile with -std=c++20"
+#else
+
+#include "TcpConnection.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+#include <coroutine>
+#include <exception>
+#include <algorithm>
+#include <memory>
+#include <string>
+
+namespace co
+{
+
+// 立即开始执行、结束后自动销毁的协程，调用方不等待它的结果
+class Task
+{
+public:
+    struct promise_type
+    {
+        Task get_return_object() noexcept { return Task(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept
+        {
+            LOG_ERROR("co::Task unhandled exception \n");
+            std::terminate();
+        }
+    };
+};
+
+namespace detail
+{
+
+// 连接和等待它的协程之间的状态，由连接的回调持有，对连接只持有弱引用，不会形成循环引用
+struct StreamState
+{
+    std::weak_ptr<TcpConnection> conn;
+    std::coroutine_handle<> reader;     // 等待输入的协程
+    std::coroutine_handle<> writer;     // 等待待发送数据（outputBuffer和排队的payload）发送完的协程
+    size_t need = 0;                    // reader至少需要的字节数
+    const char *delim = nullptr;        // 不为空时reader等待这个分隔符
+    size_t delimLen = 0;
+    size_t searched = 0;                // 已经查找过分隔符的字节数，新数据到来时不必从头找
+    bool closed = false;
+
+    // inputBuffer中分隔符结束的位置，没找到返回0
+    size_t findDelim(Buffer *buf)
+    {
+        size_t from = searched >= delimLen ? searched - delimLen + 1 : 0;
+        const char *begin = buf->peek();
+        const char *end = begin + buf->readableBytes();
+        const char *pos = std::search(begin + from, end, delim, delim + delimLen);
+        if(pos == end)
+        {
+            searched = buf->readableBytes();
+            return 0;
+        }
+        return pos - begin + delimLen;
+    }
+
+    bool readReady(Buffer *buf)
+    {
+        if(closed)
+        {
+            return true;
+        }
+        return delim ? findDelim(buf) > 0 : buf->readableBytes() >= need;
+    }
+
+    static void resume(std::coroutine_handle<> &handle)
+    {
+        std::coroutine_handle<> h = handle;
+        handle = nullptr;
+        h.resume();
+    }
+
+    void onMessage(Buffer *buf)
+    {
+        if(reader && readReady(buf))
+        {
+            resume(reader);
+        }
+    }
+
+    void onWriteComplete(const TcpConnectionPtr &c)
+    {
+        if(writer && c->pendingOutputBytes() == 0)
+        {
+            resume(writer);
+        }
+    }
+
+    void onClose()
+    {
+        closed = true;
+        if(reader)
+        {
+            resume(reader);
+        }
+        if(writer)
+        {
+            resume(writer);
+        }
+    }
+};
+
+} // namespace detail
+
+// 把一个已建立的连接交给协程读写，在连接所属的loop线程中构造
+// 会替换连接的消息回调、写完成回调和连接回调，不要在这个连接自己的消息回调里构造
+class Stream
+{
+public:
+    explicit Stream(const TcpConnectionPtr &conn)
+        : conn_(conn)
+        , state_(std::make_shared<detail::StreamState>())
+    {
+        std::shared_ptr<detail::StreamState> state = state_;
+        state->conn = conn;
+        state->closed = !conn->connected();
+        conn->setMessageCallback([state](const TcpConnectionPtr&, Buffer *buf, Timestamp){
+            state->onMessage(buf);
+        });
+        conn->setWriteCompleteCallback([state](const TcpConnectionPtr &c){
+            state->onWriteComplete(c);
+        });
+        // 通常在连接回调里构造Stream，这时不能替换正在执行的连接回调，放到loop里再做
+        conn->getLoop()->queueInLoop([state](){
+            TcpConnectionPtr c = state->conn.lock();
+            if(!c || c->disconnected())
+            {
+                state->onClose();
+                return;
+            }
+            c->setConnectionCallback([state](const TcpConnectionPtr &c){
+                if(!c->connected())
+                {
+                    state->onClose();
+                }
+            });
+        });
+    }
+
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+
+    const TcpConnectionPtr& connection() const { return conn_; }
+    // 对端关闭或者连接出错之后为false
+    bool connected() const { return !state_->closed; }
+
+    // co_await的结果是至少有n个字节可读的inputBuffer，可以直接在里面解析，不用拷贝；
+    // 连接在凑够n个字节之前断开时为nullptr
+    auto readable(size_t n)
+    {
+        struct Awaiter
+        {
+            Stream *stream;
+            size_t n;
+
+            bool await_ready()
+            {
+                stream->state_->need = n;
+                stream->state_->delim = nullptr;
+                return stream->state_->readReady(stream->conn_->inputBuffer());
+            }
+            void await_suspend(std::coroutine_handle<> h) { stream->state_->reader = h; }
+            Buffer* await_resume()
+            {
+                Buffer *buf = stream->conn_->inputBuffer();
+                return buf->readableBytes() >= n ? buf : nullptr;
+            }
+        };
+        return Awaiter{ this, n };
+    }
+
+    // 读出正好n个字节，连接断开时返回空字符串
+    auto read(size_t n)
+    {
+        struct Awaiter
+        {
+            Stream *stream;
+            size_t n;
+
+            bool await_ready()
+            {
+                stream->state_->need = n;
+                stream->state_->delim = nullptr;
+                return stream->state_->readReady(stream->conn_->inputBuffer());
+            }
+            void await_suspend(std::coroutine_handle<> h) { stream->state_->reader = h; }
+            std::string await_resume()
+            {
+                Buffer *buf = stream->conn_->inputBuffer();
+                return buf->readableBytes() >= n ? buf->retrieveAsString(n) : std::string();
+            }
+        };
+        return Awaiter{ this, n };
+    }
+
+    // 读到分隔符为止，结果包含分隔符，连接断开时返回空字符串
+    // delim在co_await返回之前必须有效
+    auto readUntil(const std::string &delim)
+    {
+        struct Awaiter
+        {
+            Stream *stream;
+            const std::string &delim;
+
+            bool await_ready()
+            {
+                detail::StreamState &state = *stream->state_;
+                state.delim = delim.data();
+                state.delimLen = delim.size();
+                state.searched = 0;
+                return state.readReady(stream->conn_->inputBuffer());
+            }
+            void await_suspend(std::coroutine_handle<> h) { stream->state_->reader = h; }
+            std::string await_resume()
+            {
+                detail::StreamState &state = *stream->state_;
+                size_t len = state.findDelim(stream->conn_->inputBuffer());
+                state.delim = nullptr;
+                return len > 0 ? stream->conn_->inputBuffer()->retrieveAsString(len) : std::string();
+            }
+        };
+        return Awaiter{ this, delim };
+    }
+
+    // 发送data，等待发送的数据（包括之前排队的payload）全部写到socket之后再继续；一次写完时不会挂起
+    // 连接已经断开时结果为false
+    auto write(const std::string &data)
+    {
+        struct Awaiter
+        {
+            Stream *stream;
+            const std::string &data;
+
+            bool await_ready()
+            {
+                if(stream->state_->closed)
+                {
+                    return true;
+                }
+                stream->conn_->send(data);
+                return stream->conn_->pendingOutputBytes() == 0;
+            }
+            void await_suspend(std::coroutine_handle<> h) { stream->state_->writer = h; }
+            bool await_resume() { return !stream->state_->closed; }
+        };
+        return Awaiter{ this, data };
+    }
+
+    void shutdown() { conn_->shutdown(); }
+
+private:
+    TcpConnectionPtr conn_;
+    std::shared_ptr<detail::StreamState> state_;
+};
+
+// 在loop中等待seconds秒
+inline auto sleep(EventLoop *loop, double seconds)
+{
+    struct Awaiter
+    {
+        EventLoop *loop;
+        double seconds;
+
+        bool await_ready() const noexcept { return seconds <= 0; }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            loop->runAfter(seconds, [h](){ h.resume(); });
+        }
+        void await_resume() const noexcept {}
+    };
+    return Awaiter{ loop, seconds };
+}
+
+// 用client发起连接，连接建立后在client的loop中继续，结果是建立的连接
+// 会替换client的连接回调；连接失败时Connector按退避时间一直重试，需要超时的话调用方自己stop
+inline auto connect(TcpClient &client)
+{
+    struct Awaiter
+    {
+        TcpClient &client;
+        TcpConnectionPtr conn;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            client.setConnectionCallback([this, h](const TcpConnectionPtr &c){
+                if(c->connected() && !conn)
+                {
+                    conn = c;
+                    // 正在执行连接回调，回到loop里再恢复，协程里可以放心地替换连接的回调
+                    c->getLoop()->queueInLoop([h](){ h.resume(); });
+                }
+            });
+            client.connect();
+        }
+        TcpConnectionPtr await_resume()
+        {
+            // 回调里引用了这个等待对象，协程继续之后它就失效了，之后重连的连接不能再用它
+            client.setConnectionCallback([](const TcpConnectionPtr&){});
+            return conn;
+        }
+    };
+    return Awaiter{ client, nullptr };
+}
+
+} // namespace co
+
+#endif
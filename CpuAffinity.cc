@@ -0,0 +1,185 @@
+#include "CpuAffinity.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <sched.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+
+namespace
+{
+    // 读取只有一行内容的sysfs/procfs文件
+    std::string readLine(const std::string &path)
+    {
+        std::ifstream in(path);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+    void normalize(CpuAffinity::CpuList *cpus)
+    {
+        std::sort(cpus->begin(), cpus->end());
+        cpus->erase(std::unique(cpus->begin(), cpus->end()), cpus->end());
+    }
+}
+
+namespace CpuAffinity
+{
+    CpuList parse(const std::string &list)
+    {
+        CpuList cpus;
+        std::stringstream ss(list);
+        std::string item;
+        while(std::getline(ss, item, ','))
+        {
+            item.erase(std::remove_if(item.begin(), item.end(), ::isspace), item.end());
+            if(item.empty())
+            {
+                continue;
+            }
+            char *end = nullptr;
+            long first = ::strtol(item.c_str(), &end, 10);
+            long last = first;
+            if(*end == '-')
+            {
+                last = ::strtol(end + 1, &end, 10);
+            }
+            if(*end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE)
+            {
+                return CpuList();
+            }
+            for(long cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+        }
+        normalize(&cpus);
+        return cpus;
+    }
+
+    std::string toString(const CpuList &cpus)
+    {
+        std::string result;
+        for(size_t i = 0; i < cpus.size(); )
+        {
+            size_t j = i;
+            while(j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            {
+                ++j;
+            }
+            if(!result.empty())
+            {
+                result += ',';
+            }
+            result += std::to_string(cpus[i]);
+            if(j > i)
+            {
+                result += '-' + std::to_string(cpus[j]);
+            }
+            i = j + 1;
+        }
+        return result;
+    }
+
+    bool bindCurrentThread(const CpuList &cpus)
+    {
+        if(cpus.empty())
+        {
+            return true;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(int cpu : cpus)
+        {
+            if(cpu >= 0 && cpu < CPU_SETSIZE)
+            {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if(::sched_setaffinity(0, sizeof set, &set) < 0)
+        {
+            LOG_ERROR("bind thread to cpus %s failed: %s \n", toString(cpus).c_str(), ::strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    CpuList currentThreadCpus()
+    {
+        CpuList cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(::sched_getaffinity(0, sizeof set, &set) == 0)
+        {
+            for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if(CPU_ISSET(cpu, &set))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        return cpus;
+    }
+
+    CpuList numaNodeCpus(int node)
+    {
+        return parse(readLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+    }
+
+    int numaNodeOfCpu(int cpu)
+    {
+        for(int node = 0; ; ++node)
+        {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if(!in)
+            {
+                return 0;
+            }
+            CpuList cpus = numaNodeCpus(node);
+            if(std::binary_search(cpus.begin(), cpus.end(), cpu))
+            {
+                return node;
+            }
+        }
+    }
+
+    CpuList irqCpus(const std::string &ifname)
+    {
+        CpuList cpus;
+        std::ifstream in("/proc/interrupts");
+        std::string line;
+        std::getline(in, line);     // 表头：CPU0 CPU1 ...
+        while(std::getline(in, line))
+        {
+            // 行的格式 " 45:  123  456  PCI-MSI 524288-edge  eth0-TxRx-0"，设备名在最后一列
+            std::istringstream fields(line);
+            std::string irq;
+            fields >> irq;
+            if(irq.empty() || irq.back() != ':')
+            {
+                continue;
+            }
+            std::string device;
+            std::string field;
+            while(fields >> field)
+            {
+                device = field;
+            }
+            if(device.find(ifname) == std::string::npos)
+            {
+                continue;
+            }
+            irq.pop_back();
+            CpuList affinity = parse(readLine("/proc/irq/" + irq + "/smp_affinity_list"));
+            cpus.insert(cpus.end(), affinity.begin(), affinity.end());
+        }
+        normalize(&cpus);
+        return cpus;
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// 线程的cpu绑定，以及从sysfs/procfs查询NUMA节点和网卡中断所在的cpu
+// cpu列表统一用内核的格式 "0-3,8,10-11"
+namespace CpuAffinity
+{
+    using CpuList = std::vector<int>;
+
+    // 格式错误时返回空列表
+    CpuList parse(const std::string &list);
+    std::string toString(const CpuList &cpus);
+
+    // 把调用线程绑定到cpus上，失败时打印日志并返回false，cpus为空时什么也不做
+    bool bindCurrentThread(const CpuList &cpus);
+    // 调用线程当前允许运行的cpu
+    CpuList currentThreadCpus();
+
+    // NUMA节点node上的cpu，读取 /sys/devices/system/node/node<N>/cpulist
+    CpuList numaNodeCpus(int node);
+    // cpu所在的NUMA节点，不是NUMA机器或者查不到时返回0
+    int numaNodeOfCpu(int cpu);
+
+    // 网卡ifname的中断所在的cpu：在/proc/interrupts中找出名字包含ifname的中断
+    // （多队列网卡的每个队列一个，如eth0-TxRx-0），合并它们的/proc/irq/<N>/smp_affinity_list
+    CpuList irqCpus(const std::string &ifname);
+}
@@ -1,4 +1,4 @@
-#pragma oncce
+#pragma once
 
 #include <unistd.h>
 #include <sys/syscall.h>
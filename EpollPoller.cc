@@ -28,7 +28,7 @@ EpollPoller::~EpollPoller(){
 // 对应epoll_wait
 Timestamp EpollPoller::poll(int timeoutMs, ChannelList *activeChannels){
     // 高并发情况下，LOG_INFO会大量调用，影响性能，用LOG_DEBUG更合理
-    LOG_INFO("Func=%s => fd total count:%lu\n", __FUNCTION__, channels_.size());
+    LOG_DEBUG("Func=%s => fd total count:%lu\n", __FUNCTION__, channels_.size());
 
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
     int saveErrno = errno;
@@ -37,7 +37,7 @@ Timestamp EpollPoller::poll(int timeoutMs, ChannelList *activeChannels){
     // LT 模式， 没上报的会一直上报
     if(numEvents > 0)
     {
-        LOG_INFO("%d events happened \n", numEvents);
+        LOG_DEBUG("%d events happened \n", numEvents);
         fillActiveChannels(numEvents, activeChannels);
         if(numEvents == events_.size())
         {
@@ -67,7 +67,7 @@ Timestamp EpollPoller::poll(int timeoutMs, ChannelList *activeChannels){
 // 最后调用到了Epoll的updateChannel 和 removeChannel
 void EpollPoller::updateChannel(Channel *channel){
     const int index = channel->index();     // 对应EpollPoller的三个状态
-    LOG_INFO("Func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, channel->fd(), channel->events(), index);
+    LOG_DEBUG("Func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, channel->fd(), channel->events(), index);
 
     if(index == kNew || index == kDeleted){
         if(index == kNew)
@@ -98,7 +98,7 @@ void EpollPoller::updateChannel(Channel *channel){
 void EpollPoller::removeChannel(Channel *channel){
     int fd = channel->fd();
     channels_.erase(fd);
-    LOG_INFO("Func=%s => fd=%d\n", __FUNCTION__, channel->fd());
+    LOG_DEBUG("Func=%s => fd=%d\n", __FUNCTION__, channel->fd());
 
     
     int index = channel->index();
@@ -2,6 +2,7 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
 
 #include <sys/eventfd.h>
 #include <unistd.h>
@@ -26,11 +27,19 @@ int createEventFd(){
 EventLoop::EventLoop()
     : looping_(false)
     , quit_(false)
-    , callingPendingFunctors_(false)
     , threadId_(CurrentThread::tid())
+    , pollReturnMonotonic_(0)
     , poller_(Poller::newDefaultPoller(this))
+    , timerQueue_(new TimerQueue(this))
     , wakeupFd_(createEventFd())
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , callingPendingFunctors_(false)
+    , stallThresholdMicros_(0)
+    , busySince_(0)
+    , currentFd_(-1)
+    , busyPollMicros_(0)
+    , spinning_(false)
+    , wakeupPending_(false)
 {
     LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
     // 判断线程是否已创建EventLoop
@@ -59,26 +68,103 @@ void EventLoop::loop(){
     quit_ = false;
     LOG_INFO("EventLoop %p start looping\n", this);
 
+    int64_t iterationEnd = Timestamp::monotonicMicros();
     while(!quit_){
         activeChannels_.clear();
+        busySince_.store(0, std::memory_order_relaxed);
         // 主要监听两类fd，client的fd和wakeupfd
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        if(busyPollMicros_ > 0){
+            pollReturnTime_ = busyPoll();
+        }else{
+            pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        }
+        pollReturnMonotonic_ = Timestamp::monotonicMicros();
+        busySince_.store(pollReturnMonotonic_, std::memory_order_relaxed);
 
-        for(Channel* channel : activeChannels_){
-            // poller监听哪些事件发生事件了，然后上报给Eventloop
-            // 通知Channel处理相应事件
-            channel->handleEvent(pollReturnTime_);
+        int64_t eventsDone = 0;
+        if(stallThresholdMicros_ > 0){
+            // 逐个handler计时，上一个handler的结束时间就是下一个的开始时间
+            int64_t start = pollReturnMonotonic_;
+            for(Channel* channel : activeChannels_){
+                currentFd_.store(channel->fd(), std::memory_order_relaxed);
+                channel->handleEvent(pollReturnTime_);
+                int64_t end = Timestamp::monotonicMicros();
+                if(end - start >= stallThresholdMicros_){
+                    // channel在pendingFunctors中才会被销毁，这里还是有效的
+                    reportStall(channel->describe(), end - start);
+                    end = Timestamp::monotonicMicros();
+                }
+                start = end;
+            }
+            eventsDone = start;
+        }else{
+            for(Channel* channel : activeChannels_){
+                // poller监听哪些事件发生事件了，然后上报给Eventloop
+                // 通知Channel处理相应事件
+                currentFd_.store(channel->fd(), std::memory_order_relaxed);
+                channel->handleEvent(pollReturnTime_);
+            }
+            eventsDone = Timestamp::monotonicMicros();
         }
+        currentFd_.store(-1, std::memory_order_relaxed);
+        metrics_.onPoll(static_cast<int>(activeChannels_.size()),
+            pollReturnMonotonic_ - iterationEnd, eventsDone - pollReturnMonotonic_);
+
         // 执行当前EventLoop事件循环需要处理的回调操作
         // mainLoop 实现注册一个回调cb（需要subloop来执行）
         // 通过wakeupfd唤醒subloop，然后subloop执行回调
-        doPendingFunctors();
+        size_t numFunctors = doPendingFunctors();
+        iterationEnd = Timestamp::monotonicMicros();
+        metrics_.onPendingFunctors(numFunctors, iterationEnd - eventsDone);
     }
 
+    busySince_.store(0, std::memory_order_relaxed);
     LOG_INFO("EventLoop %p stop looping. \n", this);
     looping_ = false;
 }
 
+// 自旋期间其他线程的wakeup只设置wakeupPending_，每次epoll_wait(0)之间检查它
+// 阻塞之前先清除spinning_再检查一次wakeupPending_，和wakeup()中先设置标志再读spinning_配对，
+// 两边都是顺序一致的原子操作，wakeup要么被这里看到，要么看到spinning_为false去写eventfd
+Timestamp EventLoop::busyPoll(){
+    int64_t deadline = Timestamp::monotonicMicros() + busyPollMicros_;
+    Timestamp now;
+    while(true){
+        now = poller_->poll(0, &activeChannels_);
+        if(!activeChannels_.empty() || quit_){
+            return now;
+        }
+        if(wakeupPending_.load(std::memory_order_relaxed) && wakeupPending_.exchange(false)){
+            return now;
+        }
+        if(Timestamp::monotonicMicros() >= deadline){
+            break;
+        }
+    }
+
+    // 预算用完，退回阻塞的epoll_wait，这期间的wakeup需要写eventfd
+    spinning_.store(false);
+    if(!wakeupPending_.exchange(false)){
+        now = poller_->poll(kPollTimeMs, &activeChannels_);
+    }
+    spinning_.store(true);
+    return now;
+}
+
+void EventLoop::setBusyPoll(int64_t spinMicros){
+    runInLoop(std::bind(&EventLoop::setBusyPollInLoop, this, spinMicros));
+}
+
+// 在loop线程中执行，此时loop不在阻塞的epoll_wait中
+void EventLoop::setBusyPollInLoop(int64_t spinMicros){
+    busyPollMicros_ = spinMicros;
+    spinning_.store(spinMicros > 0);
+    // 关闭时可能有只设置了标志的wakeup，补写eventfd，否则下一轮会阻塞到超时
+    if(spinMicros <= 0 && wakeupPending_.exchange(false)){
+        wakeup();
+    }
+}
+
 // 退出事件循环
 // 1. loop在自己的线程中调用quit，不会阻塞到poll中
 // 2. 在非loop线程中，调用loop的quit
@@ -129,6 +215,13 @@ void EventLoop::handleRead()
 // 唤醒loop所在线程
 // 向wakeupfd写一个数据, wakeupChannel就发生读事件， 当前loop线程就会被唤醒
 void EventLoop::wakeup(){
+    if(spinning_.load(std::memory_order_relaxed)){
+        // 忙轮询模式：loop没有阻塞时它自己会看到标志，不需要写eventfd
+        wakeupPending_.store(true);
+        if(spinning_.load()){
+            return;
+        }
+    }
     uint64_t one = 1;
     ssize_t n = write(wakeupFd_, &one, sizeof one);
     if(n != sizeof one){
@@ -136,6 +229,44 @@ void EventLoop::wakeup(){
     }
 }
 
+TimerId EventLoop::runAfter(double delay, Functor cb)
+{
+    int64_t when = Timer::now() + static_cast<int64_t>(delay * 1000 * 1000);
+    return timerQueue_->addTimer(std::move(cb), when, 0);
+}
+
+TimerId EventLoop::runEvery(double interval, Functor cb)
+{
+    int64_t intervalMicros = static_cast<int64_t>(interval * 1000 * 1000);
+    return timerQueue_->addTimer(std::move(cb), Timer::now() + intervalMicros, intervalMicros);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
+void EventLoop::setStallThreshold(int64_t thresholdMicros, StallCallback cb)
+{
+    runInLoop(std::bind(&EventLoop::setStallThresholdInLoop, this, thresholdMicros, std::move(cb)));
+}
+
+void EventLoop::setStallThresholdInLoop(int64_t thresholdMicros, const StallCallback &cb)
+{
+    stallThresholdMicros_ = thresholdMicros;
+    stallCallback_ = cb;
+}
+
+void EventLoop::reportStall(const std::string &where, int64_t micros)
+{
+    metrics_.onStall();
+    if(stallCallback_){
+        stallCallback_(where, micros);
+    }else{
+        LOG_ERROR("EventLoop %p stalled %ld us in %s \n", this, micros, where.c_str());
+    }
+}
+
 // EventLoop的方法，调用poller的方法
 void EventLoop::updateChannel(Channel *channel){
     poller_->updateChannel(channel);
@@ -149,7 +280,7 @@ bool EventLoop::hasChannel(Channel *channel){
     return poller_->hasChannel(channel);
 }
 
-void EventLoop::doPendingFunctors(){
+size_t EventLoop::doPendingFunctors(){
     std::vector<Functor> functors;
     callingPendingFunctors_ = true;
 
@@ -159,10 +290,24 @@ void EventLoop::doPendingFunctors(){
         functors.swap(pendingFunctors_);
     }
 
-    for(const Functor& functor : functors){
-        // 执行当前loop需要执行的回调操作
-        functor();
+    if(stallThresholdMicros_ > 0){
+        int64_t start = Timestamp::monotonicMicros();
+        for(const Functor& functor : functors){
+            functor();
+            int64_t end = Timestamp::monotonicMicros();
+            if(end - start >= stallThresholdMicros_){
+                reportStall("pending functor", end - start);
+                end = Timestamp::monotonicMicros();
+            }
+            start = end;
+        }
+    }else{
+        for(const Functor& functor : functors){
+            // 执行当前loop需要执行的回调操作
+            functor();
+        }
     }
 
     callingPendingFunctors_ = false;
+    return functors.size();
 }
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "TimerId.h"
+#include "LoopMetrics.h"
 
 #include <functional>
 #include <vector>
@@ -12,12 +14,15 @@
 
 class Channel;
 class Poller;
+class TimerQueue;
 
 // 事件循环类，主要包含两个大模块， Channel 和 Poller (epoll的抽象)
 class EventLoop : noncopyable
 {
 public:
     using Functor = std::function<void()>;
+    // where描述卡顿发生的位置，比如 "fd=12 name#3" 或 "pending functor"
+    using StallCallback = std::function<void(const std::string &where, int64_t micros)>;
 
     EventLoop();
     ~EventLoop();
@@ -26,7 +31,9 @@ public:
     void loop();
     void quit();
 
+    // 每轮poll返回时缓存一次当前时间，loop中的回调可以直接使用，不必再读时钟
     Timestamp pollReturnTime() const { return pollReturnTime_; }
+    int64_t pollReturnMonotonic() const { return pollReturnMonotonic_; }
 
     // 在当前loop中执行cb
     void runInLoop(Functor cb);
@@ -36,16 +43,47 @@ public:
     // 唤醒loop所在线程
     void wakeup();
 
+    // 定时器，可以跨线程调用，时间单位为秒
+    // delay秒之后执行cb
+    TimerId runAfter(double delay, Functor cb);
+    // 每隔interval秒执行一次cb
+    TimerId runEvery(double interval, Functor cb);
+    void cancel(TimerId timerId);
+
     // EventLoop的方法，调用poller的方法
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
 
+    // 运行指标，只能由loop线程更新，任意线程都可以调用snapshot()
+    LoopMetrics& metrics() { return metrics_; }
+    const LoopMetrics& metrics() const { return metrics_; }
+
+    // 单个channel的handleEvent或单个pendingFunctor执行超过thresholdMicros时报告，
+    // 默认用LOG_ERROR输出；0表示关闭，关闭时不对单个handler计时
+    void setStallThreshold(int64_t thresholdMicros, StallCallback cb = StallCallback());
+
+    // 忙轮询：每轮先用epoll_wait(0)自旋spinMicros，期间没有事件再退回阻塞的epoll_wait
+    // 自旋时其他线程的wakeup只设置标志，不写eventfd；0表示关闭，可以跨线程调用
+    // 自旋会占满一个cpu，应该和绑核一起使用，见EventLoopThreadPool::setThreadCpus
+    void setBusyPoll(int64_t spinMicros);
+    int64_t busyPollMicros() const { return busyPollMicros_; }
+
+    // 供LoopWatchdog在其他线程读取：loop离开epoll_wait的时刻(单调时钟us)，0表示在poll中，
+    // 以及正在处理的channel的fd，-1表示不在处理channel
+    int64_t busySince() const { return busySince_.load(std::memory_order_relaxed); }
+    int currentFd() const { return currentFd_.load(std::memory_order_relaxed); }
+    pid_t threadId() const { return threadId_; }
+
     // 判断Eventloop对象是否在自己的线程里面
     bool isInLoopTread() const { return threadId_ == CurrentThread::tid(); }
 private:
     void handleRead();  // wake up
-    void doPendingFunctors();   // 执行回调
+    size_t doPendingFunctors();   // 执行回调，返回执行的个数
+    void setStallThresholdInLoop(int64_t thresholdMicros, const StallCallback &cb);
+    void setBusyPollInLoop(int64_t spinMicros);
+    Timestamp busyPoll();   // 自旋等待事件，预算用完后阻塞
+    void reportStall(const std::string &where, int64_t micros);
     
     using ChannelList = std::vector<Channel*>;
 
@@ -55,7 +93,9 @@ private:
     const pid_t threadId_;      // 记录当前loop所在的线程id
     
     Timestamp pollReturnTime_;  // poller返回发生事件的channels的时间点
+    int64_t pollReturnMonotonic_;   // 同一时刻的单调时钟微秒数
     std::unique_ptr<Poller> poller_;    
+    std::unique_ptr<TimerQueue> timerQueue_;
 
     // 当mainloop获取一个新用户的channel，
     // 通过轮询算法选择一个subloop，通过该成员通知唤醒subloop处理事件
@@ -67,4 +107,17 @@ private:
     std::atomic_bool callingPendingFunctors_;   // 标识当前loop是否有需要执行的回调操作
     std::vector<Functor> pendingFunctors_;      // 存储loop需要执行的所有的回调操作
     std::mutex mutex_;  // 互斥锁，用来保护上面vector容器的线程安全操作
+
+    LoopMetrics metrics_;
+
+    int64_t stallThresholdMicros_;
+    StallCallback stallCallback_;
+    std::atomic<int64_t> busySince_;
+    std::atomic_int currentFd_;
+
+    int64_t busyPollMicros_;
+    // 为true时loop不会在没有检查wakeupPending_的情况下阻塞，wakeup不必写eventfd
+    // 忙轮询开启后只在阻塞的epoll_wait期间为false
+    std::atomic_bool spinning_;
+    std::atomic_bool wakeupPending_;
 };
@@ -7,6 +7,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <string>
+#include <vector>
 
 class EventLoop;
 
@@ -18,6 +19,10 @@ public:
         const std::string &name = std::string()); 
     ~EventLoopThread();
 
+    // 在startLoop之前设置，EventLoop在绑核之后才在新线程里构造，
+    // poller、wakeupfd等loop的状态都分配在这些cpu所在的NUMA节点上
+    void setCpuAffinity(const std::vector<int> &cpus) { thread_.setCpuAffinity(cpus); }
+
     EventLoop* startLoop();
 private:
     void threadFunc();
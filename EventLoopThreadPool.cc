@@ -1,5 +1,12 @@
 #include "EventLoopThreadPool.h"
 #include "EventLoopThread.h"
+#include "EventLoop.h"
+#include "CpuAffinity.h"
+
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg)
     : baseLoop_(baseLoop)
@@ -17,10 +24,17 @@ EventLoopThreadPool::~EventLoopThreadPool()
 void EventLoopThreadPool::start(const ThreadInitCallback &cb)
 {
     started_ = true;
+    if(!baseLoopCpus_.empty()){
+        std::vector<int> cpus = baseLoopCpus_;
+        baseLoop_->runInLoop([cpus](){ CpuAffinity::bindCurrentThread(cpus); });
+    }
     for(int i = 0; i < numThreads_; i++){
         char buf[name_.size() + 32];
         snprintf(buf, sizeof(buf), "%s%d", name_.c_str(), i);
         EventLoopThread *t = new EventLoopThread(cb, buf);
+        if(!cpusPerLoop_.empty()){
+            t->setCpuAffinity(cpusPerLoop_[i % cpusPerLoop_.size()]);
+        }
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         // 底层创建线程，绑定一个新的EventLoop，并放回该loop的地址
         loops_.push_back(t->startLoop());  
@@ -52,4 +66,53 @@ std::vector<EventLoop*> EventLoopThreadPool::getAllLoops()
     }else{
         return loops_;
     }
-}
\ No newline at end of file
+}
+
+LoopMetricsSnapshot EventLoopThreadPool::metricsSnapshot(std::vector<LoopMetricsSnapshot> *perLoop)
+{
+    LoopMetricsSnapshot total;
+    for(EventLoop *loop : getAllLoops()){
+        LoopMetricsSnapshot snap = loop->metrics().snapshot();
+        total.merge(snap);
+        if(perLoop){
+            perLoop->push_back(std::move(snap));
+        }
+    }
+    return total;
+}
+
+// func按投递顺序执行，超时之后才执行的func仍然会执行，访问的对象要能活到那个时候
+bool EventLoopThreadPool::runInLoopsAndWait(const std::vector<EventLoop*> &loops,
+    const std::function<void(EventLoop*)> &func,
+    int timeoutMs)
+{
+    struct Latch
+    {
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t count;
+    };
+    std::shared_ptr<Latch> latch = std::make_shared<Latch>();
+    latch->count = loops.size();
+
+    for(EventLoop *loop : loops)
+    {
+        loop->runInLoop([latch, loop, func](){
+            func(loop);
+            std::unique_lock<std::mutex> lock(latch->mutex);
+            if(--latch->count == 0)
+            {
+                latch->cond.notify_all();
+            }
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(latch->mutex);
+    if(timeoutMs < 0)
+    {
+        latch->cond.wait(lock, [&latch](){ return latch->count == 0; });
+        return true;
+    }
+    return latch->cond.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+        [&latch](){ return latch->count == 0; });
+}
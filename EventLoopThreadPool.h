@@ -1,6 +1,7 @@
 #pragma once
 
 #include "noncopyable.h"
+#include "LoopMetrics.h"
 
 #include <functional>
 #include <string>
@@ -20,6 +21,14 @@ public:
 
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
 
+    // 在start之前设置，第i个subloop绑定到cpusPerLoop[i % size]，
+    // 线程先绑核再构造EventLoop，loop的状态分配在对应的NUMA节点上
+    // cpu列表可以用CpuAffinity::parse、numaNodeCpus得到
+    void setThreadCpus(const std::vector<std::vector<int>> &cpusPerLoop) { cpusPerLoop_ = cpusPerLoop; }
+    // baseloop所在线程的cpu，start时在baseloop中绑定
+    // 通常设置成网卡中断所在的cpu（CpuAffinity::irqCpus），accept和软中断在同一个核上
+    void setBaseLoopCpus(const std::vector<int> &cpus) { baseLoopCpus_ = cpus; }
+
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
     // 如果工作在多线程中，baseloop会以轮询的方式分配channel给subloop
@@ -27,8 +36,17 @@ public:
 
     std::vector<EventLoop*> getAllLoops();
 
+    // 汇总所有loop的运行指标，perLoop不为空时同时返回每个loop各自的指标
+    LoopMetricsSnapshot metricsSnapshot(std::vector<LoopMetricsSnapshot> *perLoop = nullptr);
+
     bool started() const { return started_; }
 
+    // 在每个loop上执行func，等待所有loop都执行完或者超时，返回是否全部完成
+    // 当前线程是其中某个loop的线程时，这个loop上的func直接执行
+    static bool runInLoopsAndWait(const std::vector<EventLoop*> &loops,
+                                  const std::function<void(EventLoop*)> &func,
+                                  int timeoutMs = -1);
+
     const std::string& name() const { return name_; }
 private:
     EventLoop *baseLoop_;  // EventLoop loop;
@@ -38,4 +56,6 @@ private:
     int next_;
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     std::vector<EventLoop*> loops_;
+    std::vector<std::vector<int>> cpusPerLoop_;
+    std::vector<int> baseLoopCpus_;
 };
\ No newline at end of file
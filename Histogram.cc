@@ -0,0 +1,91 @@
+#include "Histogram.h"
+
+#include <algorithm>
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+int Histogram::bucketOf(uint64_t value)
+{
+    if(value < kLinearBuckets)
+    {
+        return static_cast<int>(value);
+    }
+    int msb = 63 - __builtin_clzll(value);      // >= 4
+    int sub = static_cast<int>((value >> (msb - 3)) & (kSubBuckets - 1));
+    return kLinearBuckets + (msb - 4) * kSubBuckets + sub;
+}
+
+uint64_t Histogram::bucketUpperBound(int bucket)
+{
+    if(bucket < kLinearBuckets)
+    {
+        return static_cast<uint64_t>(bucket);
+    }
+    int msb = (bucket - kLinearBuckets) / kSubBuckets + 4;
+    uint64_t sub = (bucket - kLinearBuckets) % kSubBuckets;
+    uint64_t lower = (1ULL << msb) | (sub << (msb - 3));
+    return lower + (1ULL << (msb - 3)) - 1;
+}
+
+Histogram::Snapshot Histogram::snapshot() const
+{
+    Snapshot snap;
+    for(int i = 0; i < kBuckets; ++i)
+    {
+        snap.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    snap.count = count_.load(std::memory_order_relaxed);
+    snap.sum = sum_.load(std::memory_order_relaxed);
+    snap.max = max_.load(std::memory_order_relaxed);
+    return snap;
+}
+
+void Histogram::reset()
+{
+    for(int i = 0; i < kBuckets; ++i)
+    {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+void Histogram::Snapshot::merge(const Snapshot &other)
+{
+    for(int i = 0; i < kBuckets; ++i)
+    {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+}
+
+uint64_t Histogram::Snapshot::percentile(double p) const
+{
+    // 各个桶是分别读取的，用桶的总数而不是count_，保证能落到某个桶里
+    uint64_t total = 0;
+    for(uint64_t n : buckets)
+    {
+        total += n;
+    }
+    if(total == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p * (total - 1)) + 1;
+    uint64_t seen = 0;
+    for(int i = 0; i < kBuckets; ++i)
+    {
+        seen += buckets[i];
+        if(seen >= rank)
+        {
+            return std::min(bucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+// 对数-线性分桶的直方图，相对误差不超过1/8
+// 0~15各占一个桶，之后每个2的幂区间再等分成8个桶
+//
+// 只允许一个线程写（所属loop线程），写操作没有锁也没有原子的读改写指令，
+// 其他线程随时可以调用snapshot()读取，读到的各个桶之间不保证是同一时刻的
+class Histogram : noncopyable
+{
+public:
+    static const int kLinearBuckets = 16;
+    static const int kSubBuckets = 8;
+    static const int kBuckets = kLinearBuckets + (64 - 4) * kSubBuckets;
+
+    // 某一时刻的拷贝，可以合并多个loop的数据，计算分位数
+    struct Snapshot
+    {
+        Snapshot() : buckets(kBuckets, 0), count(0), sum(0), max(0) {}
+
+        void merge(const Snapshot &other);
+        // p 取值 0~1，返回所在桶的上界
+        uint64_t percentile(double p) const;
+        double mean() const { return count ? static_cast<double>(sum) / count : 0; }
+
+        std::vector<uint64_t> buckets;
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+    };
+
+    Histogram();
+
+    void record(uint64_t value)
+    {
+        increment(buckets_[bucketOf(value)], 1);
+        increment(count_, 1);
+        increment(sum_, value);
+        if(value > max_.load(std::memory_order_relaxed))
+        {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    Snapshot snapshot() const;
+    void reset();
+
+    static int bucketOf(uint64_t value);
+    // 桶内最大的值
+    static uint64_t bucketUpperBound(int bucket);
+
+    // 单写者的计数器累加，relaxed的load+store，不会产生lock前缀的指令
+    static void increment(std::atomic<uint64_t> &counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> buckets_[kBuckets];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
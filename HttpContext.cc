@@ -0,0 +1,376 @@
+#include "HttpContext.h"
+#include "Buffer.h"
+
+#include <string.h>
+#include <algorithm>
+
+static const char kCRLF[] = "\r\n";
+static const char kHeaderEnd[] = "\r\n\r\n";
+static const size_t kMaxChunkLine = 1024;
+
+static const char* findCRLF(const char *begin, const char *end)
+{
+    const char *p = std::search(begin, end, kCRLF, kCRLF + 2);
+    return p == end ? nullptr : p;
+}
+
+static bool hasToken(const StringPiece &list, const StringPiece &token)
+{
+    size_t start = 0;
+    while(start <= list.size())
+    {
+        size_t comma = list.find(',', start);
+        size_t stop = comma == StringPiece::npos ? list.size() : comma;
+        if(list.substr(start, stop - start).trimmed().equalsIgnoreCase(token))
+        {
+            return true;
+        }
+        if(comma == StringPiece::npos)
+        {
+            break;
+        }
+        start = comma + 1;
+    }
+    return false;
+}
+
+HttpContext::HttpContext()
+    : state_(kHeaders)
+    , scanned_(0)
+    , pos_(0)
+    , contentLength_(0)
+    , hasContentLength_(false)
+    , chunkRemaining_(0)
+    , trailerStart_(0)
+    , maxHeaderBytes_(8 * 1024)
+    , maxBodyBytes_(1024 * 1024)
+    , errorStatus_(0)
+{
+}
+
+HttpContext::ParseResult HttpContext::fail(int status)
+{
+    errorStatus_ = status;
+    return kError;
+}
+
+HttpContext::ParseResult HttpContext::parse(Buffer *buf)
+{
+    if(state_ == kHeaders)
+    {
+        // 请求之间多余的空行直接跳过
+        while(buf->readableBytes() >= 2 && buf->peek()[0] == '\r' && buf->peek()[1] == '\n')
+        {
+            buf->retrieve(2);
+            scanned_ = 0;
+        }
+        const char *begin = buf->peek();
+        const char *end = begin + buf->readableBytes();
+        // 上次扫描的末尾可能是结束标志的前半部分，往回退3个字节
+        const char *from = begin + (scanned_ > 3 ? scanned_ - 3 : 0);
+        const char *headerEnd = std::search(from, end, kHeaderEnd, kHeaderEnd + 4);
+        if(headerEnd == end)
+        {
+            scanned_ = buf->readableBytes();
+            return scanned_ > maxHeaderBytes_ ? fail(431) : kNeedMore;
+        }
+        if(static_cast<size_t>(headerEnd - begin) > maxHeaderBytes_)
+        {
+            return fail(431);
+        }
+        request_.reset();
+        if(!parseHeaders(begin, headerEnd + 2))
+        {
+            return kError;
+        }
+        pos_ = headerEnd + 4 - begin;
+        if(request_.chunked_)
+        {
+            chunkedBody_.clear();
+            state_ = kChunkSize;
+        }
+        else if(contentLength_ > 0)
+        {
+            state_ = kBody;
+        }
+        else
+        {
+            state_ = kComplete;
+        }
+    }
+
+    if(state_ == kBody)
+    {
+        if(buf->readableBytes() < pos_ + contentLength_)
+        {
+            return kNeedMore;
+        }
+        request_.body_.set(buf->peek() + pos_, contentLength_);
+        pos_ += contentLength_;
+        state_ = kComplete;
+    }
+    else if(state_ >= kChunkSize && state_ <= kTrailers)
+    {
+        ParseResult result = parseChunked(buf);
+        if(result != kGotRequest)
+        {
+            return result;
+        }
+        request_.body_.set(chunkedBody_.data(), chunkedBody_.size());
+    }
+
+    request_.base_ = buf->peek();
+    return kGotRequest;
+}
+
+void HttpContext::consume(Buffer *buf)
+{
+    buf->retrieve(pos_);
+    state_ = kHeaders;
+    scanned_ = 0;
+    pos_ = 0;
+    contentLength_ = 0;
+    hasContentLength_ = false;
+    chunkRemaining_ = 0;
+    trailerStart_ = 0;
+}
+
+bool HttpContext::parseHeaders(const char *begin, const char *end)
+{
+    const char *lineEnd = findCRLF(begin, end);
+    if(!parseRequestLine(begin, lineEnd))
+    {
+        errorStatus_ = errorStatus_ ? errorStatus_ : 400;
+        return false;
+    }
+    request_.keepAlive_ = request_.version_ == HttpRequest::kHttp11;
+
+    const char *line = lineEnd + 2;
+    while(line < end)
+    {
+        lineEnd = findCRLF(line, end);
+        const char *colon = std::find(line, lineEnd, ':');
+        // 不支持已经废弃的多行头部，头部名字里也不能有空白，否则可能被用来走私请求
+        if(colon == lineEnd || colon == line || *line == ' ' || *line == '\t' || colon[-1] == ' ')
+        {
+            errorStatus_ = 400;
+            return false;
+        }
+        StringPiece name(line, colon - line);
+        StringPiece value = StringPiece(colon + 1, lineEnd - colon - 1).trimmed();
+        request_.headers_.push_back(std::make_pair(
+            HttpRequest::Range{static_cast<uint32_t>(name.data() - begin), static_cast<uint32_t>(name.size())},
+            HttpRequest::Range{static_cast<uint32_t>(value.data() - begin), static_cast<uint32_t>(value.size())}));
+        if(!processHeader(name, value))
+        {
+            return false;
+        }
+        line = lineEnd + 2;
+    }
+
+    // 同时有Content-Length和chunked时无法确定边界，拒绝
+    if(request_.chunked_ && hasContentLength_)
+    {
+        errorStatus_ = 400;
+        return false;
+    }
+    return true;
+}
+
+bool HttpContext::parseRequestLine(const char *begin, const char *end)
+{
+    const char *space = std::find(begin, end, ' ');
+    if(space == end)
+    {
+        return false;
+    }
+    StringPiece method(begin, space - begin);
+    request_.methodRange_ = HttpRequest::Range{0, static_cast<uint32_t>(method.size())};
+    if(method == "GET") request_.method_ = HttpRequest::kGet;
+    else if(method == "POST") request_.method_ = HttpRequest::kPost;
+    else if(method == "HEAD") request_.method_ = HttpRequest::kHead;
+    else if(method == "PUT") request_.method_ = HttpRequest::kPut;
+    else if(method == "DELETE") request_.method_ = HttpRequest::kDelete;
+    else if(method == "OPTIONS") request_.method_ = HttpRequest::kOptions;
+    else if(method == "PATCH") request_.method_ = HttpRequest::kPatch;
+    else
+    {
+        errorStatus_ = 501;
+        return false;
+    }
+
+    const char *target = space + 1;
+    space = std::find(target, end, ' ');
+    if(space == end || space == target)
+    {
+        return false;
+    }
+    const char *question = std::find(target, space, '?');
+    request_.pathRange_ = HttpRequest::Range{static_cast<uint32_t>(target - begin),
+                                             static_cast<uint32_t>(question - target)};
+    if(question != space)
+    {
+        request_.queryRange_ = HttpRequest::Range{static_cast<uint32_t>(question + 1 - begin),
+                                                  static_cast<uint32_t>(space - question - 1)};
+    }
+
+    StringPiece version(space + 1, end - space - 1);
+    if(version == "HTTP/1.1")
+    {
+        request_.version_ = HttpRequest::kHttp11;
+    }
+    else if(version == "HTTP/1.0")
+    {
+        request_.version_ = HttpRequest::kHttp10;
+    }
+    else
+    {
+        errorStatus_ = version.startsWith("HTTP/") ? 505 : 400;
+        return false;
+    }
+    return true;
+}
+
+bool HttpContext::processHeader(const StringPiece &name, const StringPiece &value)
+{
+    if(name.equalsIgnoreCase("Content-Length"))
+    {
+        size_t length = 0;
+        if(value.empty() || hasContentLength_)
+        {
+            errorStatus_ = 400;
+            return false;
+        }
+        for(char c : value)
+        {
+            if(c < '0' || c > '9')
+            {
+                errorStatus_ = 400;
+                return false;
+            }
+            length = length * 10 + (c - '0');
+            if(length > maxBodyBytes_)
+            {
+                errorStatus_ = 413;
+                return false;
+            }
+        }
+        contentLength_ = length;
+        hasContentLength_ = true;
+    }
+    else if(name.equalsIgnoreCase("Transfer-Encoding"))
+    {
+        // 只支持chunked，而且必须是最后一个编码
+        if(!value.equalsIgnoreCase("chunked"))
+        {
+            errorStatus_ = 501;
+            return false;
+        }
+        request_.chunked_ = true;
+    }
+    else if(name.equalsIgnoreCase("Connection"))
+    {
+        if(hasToken(value, "close"))
+        {
+            request_.keepAlive_ = false;
+        }
+        else if(hasToken(value, "keep-alive"))
+        {
+            request_.keepAlive_ = true;
+        }
+    }
+    return true;
+}
+
+// 分块数据解码到chunkedBody_，pos_记录解析到的位置，数据不够时下次从这里继续
+HttpContext::ParseResult HttpContext::parseChunked(Buffer *buf)
+{
+    const char *begin = buf->peek();
+    const char *end = begin + buf->readableBytes();
+    while(true)
+    {
+        const char *p = begin + pos_;
+        if(state_ == kChunkSize || state_ == kTrailers)
+        {
+            const char *lineEnd = findCRLF(p, end);
+            if(lineEnd == nullptr)
+            {
+                return static_cast<size_t>(end - p) > kMaxChunkLine ? fail(400) : kNeedMore;
+            }
+            pos_ = lineEnd + 2 - begin;
+            if(state_ == kTrailers)
+            {
+                // 结束之前trailer一直留在buf里，和头部一样限制总长度
+                if(pos_ - trailerStart_ > maxHeaderBytes_)
+                {
+                    return fail(400);
+                }
+                // 忽略trailer头部，空行表示请求结束
+                if(lineEnd == p)
+                {
+                    state_ = kComplete;
+                    return kGotRequest;
+                }
+                continue;
+            }
+            size_t size = 0;
+            const char *q = p;
+            for(; q < lineEnd && *q != ';'; ++q)
+            {
+                int digit;
+                if(*q >= '0' && *q <= '9') digit = *q - '0';
+                else if(*q >= 'a' && *q <= 'f') digit = *q - 'a' + 10;
+                else if(*q >= 'A' && *q <= 'F') digit = *q - 'A' + 10;
+                else return fail(400);
+                size = size * 16 + digit;
+                if(size > maxBodyBytes_)
+                {
+                    return fail(413);
+                }
+            }
+            if(q == p)
+            {
+                return fail(400);
+            }
+            if(chunkedBody_.size() + size > maxBodyBytes_)
+            {
+                return fail(413);
+            }
+            chunkRemaining_ = size;
+            state_ = size == 0 ? kTrailers : kChunkData;
+            trailerStart_ = pos_;
+        }
+        else if(state_ == kChunkData)
+        {
+            size_t n = std::min(chunkRemaining_, static_cast<size_t>(end - p));
+            if(n == 0)
+            {
+                return kNeedMore;
+            }
+            chunkedBody_.append(p, n);
+            pos_ += n;
+            chunkRemaining_ -= n;
+            if(chunkRemaining_ == 0)
+            {
+                state_ = kChunkDataEnd;
+            }
+        }
+        else if(state_ == kChunkDataEnd)
+        {
+            if(end - p < 2)
+            {
+                return kNeedMore;
+            }
+            if(p[0] != '\r' || p[1] != '\n')
+            {
+                return fail(400);
+            }
+            pos_ += 2;
+            state_ = kChunkSize;
+        }
+        else
+        {
+            return kGotRequest;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "HttpRequest.h"
+
+#include <string>
+
+class Buffer;
+
+// 增量的HTTP/1.1请求解析器，每个连接一个
+// 数据不完整时记住已经扫描过的位置，下次从断点继续，不会重复扫描头部
+// 一个请求完整之前不从Buffer中取走数据，解析出的字段是对Buffer的引用
+class HttpContext
+{
+public:
+    enum ParseResult
+    {
+        kNeedMore,      // 请求还不完整
+        kGotRequest,    // request()可用，处理完后调用consume
+        kError,         // 请求有错误，errorStatus()是应该回复的状态码，连接应当关闭
+    };
+
+    HttpContext();
+
+    // 默认头部最多8KB，请求体最多1MB
+    void setMaxHeaderBytes(size_t n) { maxHeaderBytes_ = n; }
+    void setMaxBodyBytes(size_t n) { maxBodyBytes_ = n; }
+
+    ParseResult parse(Buffer *buf);
+    const HttpRequest& request() const { return request_; }
+    // 从buf中取走刚才的请求，准备解析下一个（流水线上的请求已经在buf里了）
+    void consume(Buffer *buf);
+
+    int errorStatus() const { return errorStatus_; }
+
+private:
+    enum State
+    {
+        kHeaders,
+        kBody,          // 按Content-Length读取
+        kChunkSize,
+        kChunkData,
+        kChunkDataEnd,  // 每个分块数据后面的CRLF
+        kTrailers,
+        kComplete,
+    };
+
+    ParseResult fail(int status);
+    bool parseHeaders(const char *begin, const char *end);
+    bool parseRequestLine(const char *begin, const char *end);
+    bool processHeader(const StringPiece &name, const StringPiece &value);
+    ParseResult parseChunked(Buffer *buf);
+
+    HttpRequest request_;
+    State state_;
+    size_t scanned_;        // 已经找过头部结束标志的字节数
+    size_t pos_;            // 请求体解析到的位置，相对于请求起始
+    size_t contentLength_;
+    bool hasContentLength_;
+    size_t chunkRemaining_;
+    size_t trailerStart_;   // 最后一个分块之后trailer开始的位置
+    std::string chunkedBody_;
+    size_t maxHeaderBytes_;
+    size_t maxBodyBytes_;
+    int errorStatus_;
+};
@@ -0,0 +1,30 @@
+#include "HttpRequest.h"
+
+HttpRequest::HttpRequest()
+{
+    reset();
+}
+
+void HttpRequest::reset()
+{
+    base_ = nullptr;
+    method_ = kInvalid;
+    version_ = kUnknown;
+    methodRange_ = pathRange_ = queryRange_ = Range{0, 0};
+    headers_.clear();
+    body_.clear();
+    chunked_ = false;
+    keepAlive_ = false;
+}
+
+StringPiece HttpRequest::getHeader(const StringPiece &name) const
+{
+    for(const auto &header : headers_)
+    {
+        if(piece(header.first).equalsIgnoreCase(name))
+        {
+            return piece(header.second);
+        }
+    }
+    return StringPiece();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "StringPiece.h"
+
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+class HttpContext;
+
+// 解析出来的HTTP请求，字段都是指向连接inputBuffer_的StringPiece，不拷贝数据
+// 只在HttpServer的回调期间有效，需要保留时用asString()拷贝出来
+class HttpRequest
+{
+public:
+    enum Method
+    {
+        kInvalid, kGet, kPost, kHead, kPut, kDelete, kOptions, kPatch,
+    };
+    enum Version
+    {
+        kUnknown, kHttp10, kHttp11,
+    };
+
+    HttpRequest();
+
+    Method method() const { return method_; }
+    StringPiece methodString() const { return piece(methodRange_); }
+    Version version() const { return version_; }
+    // 请求目标中'?'之前的部分
+    StringPiece path() const { return piece(pathRange_); }
+    // '?'之后的部分，不包含'?'
+    StringPiece query() const { return piece(queryRange_); }
+
+    // 名字不区分大小写，没有这个头部时返回空
+    StringPiece getHeader(const StringPiece &name) const;
+    size_t headerCount() const { return headers_.size(); }
+    StringPiece headerName(size_t i) const { return piece(headers_[i].first); }
+    StringPiece headerValue(size_t i) const { return piece(headers_[i].second); }
+
+    // chunked编码的请求体已经解码成连续的数据
+    StringPiece body() const { return body_; }
+    bool chunked() const { return chunked_; }
+    // HTTP/1.1默认保持连接，除非Connection: close；HTTP/1.0需要Connection: keep-alive
+    bool keepAlive() const { return keepAlive_; }
+
+private:
+    friend class HttpContext;
+
+    // 字段相对于请求起始位置的偏移，解析过程中缓冲区可能扩容搬家，分发时再换算成指针
+    struct Range
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    void reset();
+    StringPiece piece(const Range &r) const { return StringPiece(base_ + r.offset, r.length); }
+
+    const char *base_;
+    Method method_;
+    Version version_;
+    Range methodRange_;
+    Range pathRange_;
+    Range queryRange_;
+    std::vector<std::pair<Range, Range>> headers_;  // clear不释放内存，连接上的后续请求复用
+    StringPiece body_;
+    bool chunked_;
+    bool keepAlive_;
+};
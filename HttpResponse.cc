@@ -0,0 +1,136 @@
+#include "HttpResponse.h"
+
+#include <stdio.h>
+
+static void appendString(Buffer *output, const StringPiece &s)
+{
+    output->append(s.data(), s.size());
+}
+
+// 十进制，不经过snprintf
+static void appendDecimal(Buffer *output, size_t value)
+{
+    char buf[24];
+    char *p = buf + sizeof buf;
+    do
+    {
+        *--p = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while(value != 0);
+    output->append(p, buf + sizeof buf - p);
+}
+
+HttpResponse::HttpResponse()
+    : statusCode_(200)
+    , closeConnection_(false)
+    , http10_(false)
+    , chunked_(false)
+{
+}
+
+void HttpResponse::reset(bool closeConnection, bool http10)
+{
+    statusCode_ = 200;
+    statusMessage_.clear();
+    closeConnection_ = closeConnection;
+    http10_ = http10;
+    chunked_ = false;
+    headers_.retrieveAll();
+    body_.retrieveAll();
+    if(upgradeHandler_)
+    {
+        upgradeHandler_ = UpgradeHandler();
+    }
+}
+
+void HttpResponse::addHeader(const StringPiece &name, const StringPiece &value)
+{
+    appendString(&headers_, name);
+    appendString(&headers_, ": ");
+    appendString(&headers_, value);
+    appendString(&headers_, "\r\n");
+}
+
+void HttpResponse::appendToBuffer(Buffer *output, bool headOnly) const
+{
+    appendString(output, http10_ ? "HTTP/1.0 " : "HTTP/1.1 ");
+    appendDecimal(output, statusCode_);
+    output->append(" ", 1);
+    appendString(output, statusMessage_.empty() ? StringPiece(defaultStatusMessage(statusCode_))
+                                                : StringPiece(statusMessage_));
+    appendString(output, "\r\n");
+
+    if(closeConnection_)
+    {
+        appendString(output, "Connection: close\r\n");
+    }
+    else if(http10_)
+    {
+        appendString(output, "Connection: Keep-Alive\r\n");
+    }
+
+    if(chunked_ && !http10_)
+    {
+        appendString(output, "Transfer-Encoding: chunked\r\n");
+    }
+    else if(!chunked_ && statusCode_ >= 200 && statusCode_ != 204)
+    {
+        appendString(output, "Content-Length: ");
+        appendDecimal(output, body_.readableBytes());
+        appendString(output, "\r\n");
+    }
+    output->append(headers_.peek(), headers_.readableBytes());
+    appendString(output, "\r\n");
+
+    if(headOnly || body_.readableBytes() == 0)
+    {
+        return;
+    }
+    if(chunked_ && !http10_)
+    {
+        appendChunk(output, StringPiece(body_.peek(), body_.readableBytes()));
+    }
+    else
+    {
+        output->append(body_.peek(), body_.readableBytes());
+    }
+}
+
+void HttpResponse::appendChunk(Buffer *output, const StringPiece &data)
+{
+    char size[24];
+    int n = ::snprintf(size, sizeof size, "%zx\r\n", data.size());
+    output->append(size, n);
+    appendString(output, data);
+    appendString(output, "\r\n");
+}
+
+const char* HttpResponse::defaultStatusMessage(int code)
+{
+    switch(code)
+    {
+    case 100: return "Continue";
+    case 101: return "Switching Protocols";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 413: return "Payload Too Large";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default: return "Unknown";
+    }
+}
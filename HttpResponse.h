@@ -0,0 +1,66 @@
+#pragma once
+
+#include "StringPiece.h"
+#include "Buffer.h"
+#include "Callbacks.h"
+
+#include <functional>
+#include <string>
+
+// HTTP响应，头部和响应体都先写进内部的Buffer，连接上的后续请求复用同一个对象，
+// 稳定之后不再分配内存；appendToBuffer把整个响应序列化到连接的发送缓冲区
+class HttpResponse
+{
+public:
+    using UpgradeHandler = std::function<void(const TcpConnectionPtr &conn, Buffer *buf)>;
+
+    HttpResponse();
+
+    // 开始一个新的响应，closeConnection为true时回复Connection: close，
+    // http10为true时对方是HTTP/1.0，保持连接需要显式回复Connection: Keep-Alive
+    void reset(bool closeConnection, bool http10 = false);
+
+    // 状态描述默认按状态码取标准的描述
+    void setStatusCode(int code) { statusCode_ = code; }
+    int statusCode() const { return statusCode_; }
+    void setStatusMessage(const StringPiece &message) { statusMessage_ = message.asString(); }
+
+    void setCloseConnection(bool on) { closeConnection_ = on; }
+    bool closeConnection() const { return closeConnection_; }
+
+    void setContentType(const StringPiece &contentType) { addHeader("Content-Type", contentType); }
+    // Content-Length、Connection和Transfer-Encoding由序列化时生成，不要自己添加
+    void addHeader(const StringPiece &name, const StringPiece &value);
+
+    void setBody(const StringPiece &body) { body_.retrieveAll(); appendBody(body); }
+    void appendBody(const StringPiece &data) { body_.append(data.data(), data.size()); }
+    size_t bodySize() const { return body_.readableBytes(); }
+
+    // 分块发送：回调返回时先发出状态行、头部和已有的响应体（作为第一块），
+    // 之后用HttpServer::sendChunk发送后续的分块，HttpServer::endChunked结束
+    // 对HTTP/1.0的请求不做分块编码，数据原样发送，结束时关闭连接
+    void setChunked(bool on) { chunked_ = on; }
+    bool chunked() const { return chunked_; }
+
+    // 协议升级（比如WebSocket）：回复101，发出后HttpServer不再处理这个连接，
+    // 接着在loop中调用handler，由它接管连接的消息回调和context，buf里是升级之后已经收到的数据
+    void setUpgrade(const UpgradeHandler &handler) { statusCode_ = 101; upgradeHandler_ = handler; }
+    const UpgradeHandler& upgradeHandler() const { return upgradeHandler_; }
+
+    // headOnly用于HEAD请求，只序列化状态行和头部
+    void appendToBuffer(Buffer *output, bool headOnly = false) const;
+
+    static const char* defaultStatusMessage(int code);
+    // 分块编码的一块：长度(16进制) CRLF 数据 CRLF，data为空时是结束块
+    static void appendChunk(Buffer *output, const StringPiece &data);
+
+private:
+    int statusCode_;
+    std::string statusMessage_;
+    bool closeConnection_;
+    bool http10_;
+    bool chunked_;
+    Buffer headers_;
+    Buffer body_;
+    UpgradeHandler upgradeHandler_;
+};
@@ -0,0 +1,197 @@
+#include "HttpServer.h"
+#include "HttpContext.h"
+#include "Logger.h"
+
+// 每个连接上的HTTP状态，挂在TcpConnection的context上
+struct HttpServer::Session
+{
+    explicit Session(HttpServer *server)
+        : server(server), streaming(false), chunkFraming(true), closing(false), upgraded(false) {}
+
+    HttpServer *server;
+    HttpContext context;
+    HttpResponse response;
+    Buffer output;          // 这一批请求的回复
+    bool streaming;         // 分块响应还没有结束
+    bool chunkFraming;      // 分块响应是否使用chunked编码（HTTP/1.0的请求不用）
+    bool closing;           // 回复完当前请求后关闭连接，之后的输入全部丢弃
+    bool upgraded;          // 已经升级成其他协议，连接交给了upgradeHandler
+};
+
+static void defaultHttpCallback(const TcpConnectionPtr&, const HttpRequest&, HttpResponse *response)
+{
+    response->setStatusCode(404);
+    response->setCloseConnection(true);
+}
+
+HttpServer::HttpServer(EventLoop *loop,
+    const InetAddress &listenAddr,
+    const std::string &nameArg,
+    TcpServer::Option option)
+    : server_(loop, listenAddr, nameArg, option)
+    , httpCallback_(defaultHttpCallback)
+    , maxHeaderBytes_(0)
+    , maxBodyBytes_(0)
+{
+    server_.setConnectionCallback(std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&HttpServer::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void HttpServer::start()
+{
+    LOG_INFO("HttpServer [%s] starts listening \n", server_.name().c_str());
+    server_.start();
+}
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        std::shared_ptr<Session> session = std::make_shared<Session>(this);
+        if(maxHeaderBytes_ > 0)
+        {
+            session->context.setMaxHeaderBytes(maxHeaderBytes_);
+        }
+        if(maxBodyBytes_ > 0)
+        {
+            session->context.setMaxBodyBytes(maxBodyBytes_);
+        }
+        conn->setContext(session);
+    }
+}
+
+void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    Session *session = static_cast<Session*>(conn->getContext().get());
+    if(session == nullptr)
+    {
+        buf->retrieveAll();
+        return;
+    }
+    if(!session->upgraded)
+    {
+        processRequests(conn, session, buf);
+    }
+}
+
+void HttpServer::processRequests(const TcpConnectionPtr &conn, Session *session, Buffer *buf)
+{
+    HttpResponse::UpgradeHandler upgradeHandler;
+    while(!session->streaming && !session->closing)
+    {
+        HttpContext::ParseResult result = session->context.parse(buf);
+        if(result == HttpContext::kNeedMore)
+        {
+            break;
+        }
+        HttpResponse &response = session->response;
+        if(result == HttpContext::kError)
+        {
+            response.reset(true);
+            response.setStatusCode(session->context.errorStatus());
+            response.appendToBuffer(&session->output);
+            session->closing = true;
+            break;
+        }
+
+        const HttpRequest &request = session->context.request();
+        bool http10 = request.version() == HttpRequest::kHttp10;
+        response.reset(!request.keepAlive(), http10);
+        httpCallback_(conn, request, &response);
+        if(response.chunked())
+        {
+            session->streaming = true;
+            // HTTP/1.0没有分块编码，只能靠关闭连接表示响应结束
+            session->chunkFraming = !http10;
+            if(http10)
+            {
+                response.setCloseConnection(true);
+            }
+        }
+        response.appendToBuffer(&session->output, request.method() == HttpRequest::kHead);
+        session->context.consume(buf);
+        session->closing = response.closeConnection();
+        if(response.upgradeHandler() && !session->closing)
+        {
+            upgradeHandler = response.upgradeHandler();
+            session->upgraded = true;
+            break;
+        }
+    }
+
+    if(session->closing)
+    {
+        buf->retrieveAll();
+    }
+    if(session->output.readableBytes() > 0)
+    {
+        conn->send(&session->output);
+    }
+    if(session->closing && !session->streaming)
+    {
+        conn->shutdown();
+    }
+    if(upgradeHandler)
+    {
+        // 现在还在连接的消息回调中，等它返回后再让handler替换回调
+        conn->getLoop()->queueInLoop([conn, upgradeHandler](){
+            upgradeHandler(conn, conn->inputBuffer());
+        });
+    }
+}
+
+void HttpServer::sendChunk(const TcpConnectionPtr &conn, const StringPiece &data)
+{
+    if(data.empty())
+    {
+        return;     // 空的分块表示结束，不能在这里发
+    }
+    EventLoop *loop = conn->getLoop();
+    if(loop->isInLoopTread())
+    {
+        sendChunkInLoop(conn, data, false);
+    }
+    else
+    {
+        std::string copy = data.asString();
+        loop->runInLoop([conn, copy](){ sendChunkInLoop(conn, copy, false); });
+    }
+}
+
+void HttpServer::endChunked(const TcpConnectionPtr &conn)
+{
+    conn->getLoop()->runInLoop([conn](){ sendChunkInLoop(conn, StringPiece(), true); });
+}
+
+void HttpServer::sendChunkInLoop(const TcpConnectionPtr &conn, const StringPiece &data, bool last)
+{
+    Session *session = static_cast<Session*>(conn->getContext().get());
+    if(session == nullptr || !session->streaming || !conn->connected())
+    {
+        return;
+    }
+    if(session->chunkFraming)
+    {
+        if(!data.empty())
+        {
+            HttpResponse::appendChunk(&session->output, data);
+        }
+        if(last)
+        {
+            HttpResponse::appendChunk(&session->output, StringPiece());
+        }
+    }
+    else
+    {
+        session->output.append(data.data(), data.size());
+    }
+    conn->send(&session->output);
+
+    if(last)
+    {
+        session->streaming = false;
+        // 继续处理分块响应期间流水线上积压的请求
+        session->server->processRequests(conn, session, conn->inputBuffer());
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "TcpServer.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+#include <functional>
+#include <string>
+
+// 基于TcpServer的HTTP/1.1服务器
+// 支持keep-alive和流水线：一次可读事件中解析出的所有请求，
+// 回复都序列化到同一个缓冲区，最后一次性写给socket
+// 请求和回调都在连接所属的loop线程中处理，回调里不要阻塞
+class HttpServer : noncopyable
+{
+public:
+    // request只在回调期间有效；回调返回后response被发送
+    // 分块响应需要保存conn，之后用sendChunk、endChunked继续发送
+    using HttpCallback = std::function<void(const TcpConnectionPtr &conn,
+                                            const HttpRequest &request,
+                                            HttpResponse *response)>;
+
+    HttpServer(EventLoop *loop,
+                const InetAddress &listenAddr,
+                const std::string &nameArg,
+                TcpServer::Option option = TcpServer::kNoReusePort);
+
+    EventLoop* getLoop() const { return server_.getLoop(); }
+    TcpServer* tcpServer() { return &server_; }
+
+    void setHttpCallback(const HttpCallback &cb) { httpCallback_ = cb; }
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    // 在start之前设置，见HttpContext
+    void setMaxHeaderBytes(size_t n) { maxHeaderBytes_ = n; }
+    void setMaxBodyBytes(size_t n) { maxBodyBytes_ = n; }
+
+    void start();
+
+    // 分块响应的后续数据，response->setChunked(true)之后使用，可以跨线程调用
+    // 分块响应结束之前，同一连接上流水线中的后续请求暂不处理
+    static void sendChunk(const TcpConnectionPtr &conn, const StringPiece &data);
+    static void endChunked(const TcpConnectionPtr &conn);
+
+private:
+    struct Session;
+
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    void processRequests(const TcpConnectionPtr &conn, Session *session, Buffer *buf);
+    static void sendChunkInLoop(const TcpConnectionPtr &conn, const StringPiece &data, bool last);
+
+    TcpServer server_;
+    HttpCallback httpCallback_;
+    size_t maxHeaderBytes_;
+    size_t maxBodyBytes_;
+};
@@ -1,45 +1,118 @@
 #include "InetAddress.h"
+#include "Logger.h"
 
 #include <strings.h>
 #include <string.h>
+#include <stddef.h>
+#include <algorithm>
 
 // 打包ip地址端口
 InetAddress::InetAddress(uint16_t port, std::string ip){
     bzero(&addr_, sizeof addr_);
-    addr_.sin_family = AF_INET;
-    addr_.sin_port = htons(port);  // host to net
-    addr_.sin_addr.s_addr = inet_addr(ip.c_str());
+    if(ip.find(':') != std::string::npos){
+        sockaddr_in6 *addr6 = reinterpret_cast<sockaddr_in6*>(&addr_);
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+        len_ = sizeof(sockaddr_in6);
+        if(::inet_pton(AF_INET6, ip.c_str(), &addr6->sin6_addr) != 1){
+            // 不能当成"::"用，否则会悄悄监听所有地址，和fromUnixPath一样返回无效地址
+            LOG_ERROR("InetAddress invalid IPv6 address: %.200s \n", ip.c_str());
+            bzero(&addr_, sizeof addr_);
+            len_ = 0;
+        }
+    }else{
+        sockaddr_in *addr4 = reinterpret_cast<sockaddr_in*>(&addr_);
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);  // host to net
+        addr4->sin_addr.s_addr = inet_addr(ip.c_str());
+        len_ = sizeof(sockaddr_in);
+    }
+}
+
+InetAddress::InetAddress(const sockaddr_in &addr){
+    setSockAddr(reinterpret_cast<const sockaddr*>(&addr), sizeof addr);
+}
+
+InetAddress::InetAddress(const sockaddr_in6 &addr){
+    setSockAddr(reinterpret_cast<const sockaddr*>(&addr), sizeof addr);
+}
+
+InetAddress::InetAddress(const sockaddr *addr, socklen_t len){
+    setSockAddr(addr, len);
+}
+
+InetAddress InetAddress::fromUnixPath(const std::string &path){
+    sockaddr_un addr;
+    bzero(&addr, sizeof addr);
+    // 文件路径要留一个字节给结尾的'\0'，abstract namespace的名字可以占满sun_path
+    bool abstract = !path.empty() && path[0] == '@';
+    size_t maxLen = abstract ? sizeof addr.sun_path : sizeof addr.sun_path - 1;
+    if(path.size() > maxLen){
+        // 截断之后是另一个地址，可能和别的程序冲突，不如直接失败
+        LOG_ERROR("InetAddress::fromUnixPath path too long (%zu > %zu): %.200s \n",
+            path.size(), maxLen, path.c_str());
+        InetAddress invalid;
+        invalid.setSockAddr(reinterpret_cast<const sockaddr*>(&addr), 0);
+        return invalid;
+    }
+    addr.sun_family = AF_UNIX;
+    size_t len = path.size();
+    ::memcpy(addr.sun_path, path.data(), len);
+    if(abstract){
+        addr.sun_path[0] = '\0';    // abstract namespace，长度里不包含结尾的'\0'
+    }else{
+        ++len;
+    }
+    return InetAddress(reinterpret_cast<const sockaddr*>(&addr),
+        static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + len));
+}
+
+void InetAddress::setSockAddr(const sockaddr *addr, socklen_t len){
+    bzero(&addr_, sizeof addr_);
+    len_ = std::min<socklen_t>(len, sizeof addr_);
+    ::memcpy(&addr_, addr, len_);
 }
 
 std::string InetAddress::toIp() const{
     // addr_里读出来，要做转换
     char buf[64] = {0};
-    ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
-
+    if(family() == AF_INET6){
+        ::inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(&addr_)->sin6_addr, buf, sizeof buf);
+    }else if(family() == AF_UNIX){
+        const sockaddr_un *addr = reinterpret_cast<const sockaddr_un*>(&addr_);
+        size_t len = len_ > offsetof(sockaddr_un, sun_path) ? len_ - offsetof(sockaddr_un, sun_path) : 0;
+        if(len == 0){
+            return std::string();   // 未命名的socket，比如客户端一端
+        }
+        if(addr->sun_path[0] == '\0'){
+            return "@" + std::string(addr->sun_path + 1, len - 1);
+        }
+        return std::string(addr->sun_path, ::strnlen(addr->sun_path, len));
+    }else{
+        ::inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&addr_)->sin_addr, buf, sizeof buf);
+    }
     return buf;
 }
 
 std::string InetAddress::toIpPort() const{
     // ip:port
-    char buf[64] = {0};
-    ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
-    size_t end = strlen(buf);
-    uint16_t port = ntohs(addr_.sin_port);
-    sprintf(buf + end, ":%u", port);
-
+    if(family() == AF_UNIX){
+        return "unix:" + toIp();
+    }
+    char buf[96] = {0};
+    if(family() == AF_INET6){
+        snprintf(buf, sizeof buf, "[%s]:%u", toIp().c_str(), toPort());
+    }else{
+        snprintf(buf, sizeof buf, "%s:%u", toIp().c_str(), toPort());
+    }
     return buf;
 }
 
 uint16_t InetAddress::toPort() const{
-    return ntohs(addr_.sin_port);
-}
-
-
-// 测试
-#include <iostream>
-int main(){
-    InetAddress addr(8080);
-    std::cout << addr.toIpPort() << std::endl;
-
+    if(family() == AF_INET6){
+        return ntohs(reinterpret_cast<const sockaddr_in6*>(&addr_)->sin6_port);
+    }else if(family() == AF_INET){
+        return ntohs(reinterpret_cast<const sockaddr_in*>(&addr_)->sin_port);
+    }
     return 0;
-}
\ No newline at end of file
+}
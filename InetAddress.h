@@ -2,23 +2,39 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <string>
 
-// 封装socket地址类型
+// 封装socket地址类型，用sockaddr_storage保存，可以是IPv4、IPv6或者unix域地址
 class InetAddress
 {
 public:
+    // ip中有':'时按IPv6解析，如 "::1"、"::"（监听所有地址，Acceptor关闭了IPV6_V6ONLY，也接受IPv4连接）
+    // IPv6地址格式错误时返回!isValid()的地址
     explicit InetAddress(uint16_t port = 0, std::string ip = "127.0.0.1");
-    explicit InetAddress(const sockaddr_in &addr)
-        : addr_(addr)
-    {}
+    explicit InetAddress(const sockaddr_in &addr);
+    explicit InetAddress(const sockaddr_in6 &addr);
+    InetAddress(const sockaddr *addr, socklen_t len);
 
+    // unix域socket地址，path以'@'开头时使用abstract namespace，不在文件系统中创建文件
+    // path超过sun_path的长度时不截断，返回!isValid()的地址
+    static InetAddress fromUnixPath(const std::string &path);
+
+    sa_family_t family() const { return addr_.ss_family; }
+    bool isValid() const { return family() != AF_UNSPEC; }
+    bool isUnix() const { return family() == AF_UNIX; }
+
+    // unix域地址的toIp()是路径，toPort()是0
     std::string toIp() const;
+    // IPv4 "1.2.3.4:80"，IPv6 "[::1]:80"，unix域 "unix:/path"
     std::string toIpPort() const;
     uint16_t toPort() const;
-    
-    const sockaddr_in* getSockAddr() const { return &addr_;}
-    void setSockAddr(const sockaddr_in &addr) { addr_ = addr; }
+
+    const sockaddr* getSockAddr() const { return reinterpret_cast<const sockaddr*>(&addr_); }
+    socklen_t getSockAddrLen() const { return len_; }
+    void setSockAddr(const sockaddr *addr, socklen_t len);
 private:
-    sockaddr_in addr_;
-};
\ No newline at end of file
+    sockaddr_storage addr_;
+    socklen_t len_;
+};
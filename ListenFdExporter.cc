@@ -0,0 +1,208 @@
+#include "ListenFdExporter.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+
+// 一次最多交接的listenfd个数
+static const int kMaxListenFds = 16;
+
+static int createUnixSocket(int flags)
+{
+    int sockfd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+    if(sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d unix socket create err: %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+static bool fillUnixAddr(const std::string &path, sockaddr_un *addr)
+{
+    bzero(addr, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    if(path.size() >= sizeof addr->sun_path)
+    {
+        LOG_ERROR("unix socket path too long: %s \n", path.c_str());
+        return false;
+    }
+    ::strncpy(addr->sun_path, path.c_str(), sizeof addr->sun_path - 1);
+    return true;
+}
+
+// 把fds放到SCM_RIGHTS控制消息里发出去，数据部分是fd的个数
+static bool sendFds(int sockfd, const std::vector<int> &fds)
+{
+    int count = static_cast<int>(fds.size());
+    iovec iov;
+    iov.iov_base = &count;
+    iov.iov_len = sizeof count;
+
+    char control[CMSG_SPACE(sizeof(int) * kMaxListenFds)];
+    bzero(control, sizeof control);
+    msghdr msg;
+    bzero(&msg, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    ::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * count);
+
+    return ::sendmsg(sockfd, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof count);
+}
+
+static bool recvFds(int sockfd, std::vector<int> *fds)
+{
+    int count = 0;
+    iovec iov;
+    iov.iov_base = &count;
+    iov.iov_len = sizeof count;
+
+    char control[CMSG_SPACE(sizeof(int) * kMaxListenFds)];
+    msghdr msg;
+    bzero(&msg, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    if(::recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC) != static_cast<ssize_t>(sizeof count))
+    {
+        return false;
+    }
+    for(cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int *data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            fds->assign(data, data + n);
+        }
+    }
+    return static_cast<int>(fds->size()) == count;
+}
+
+ListenFdExporter::ListenFdExporter(EventLoop *loop, const std::string &path, const std::vector<int> &listenFds)
+    : loop_(loop)
+    , path_(path)
+    , listenFds_(listenFds)
+    , socket_(createUnixSocket(SOCK_NONBLOCK))
+    , channel_(loop, socket_.fd())
+    , socketDev_(0)
+    , socketIno_(0)
+{
+    if(listenFds_.size() > kMaxListenFds)
+    {
+        LOG_FATAL("ListenFdExporter: too many listen fds: %lu \n", listenFds_.size());
+    }
+    channel_.setReadCallback(std::bind(&ListenFdExporter::handleRead, this));
+}
+
+ListenFdExporter::~ListenFdExporter()
+{
+    channel_.disableAll();
+    channel_.remove();
+    // 连锁重启时下一个进程可能已经在同一个path上重新导出了，只删自己创建的那个文件
+    struct stat st;
+    if(socketIno_ != 0 && ::lstat(path_.c_str(), &st) == 0
+        && st.st_dev == socketDev_ && st.st_ino == socketIno_)
+    {
+        ::unlink(path_.c_str());
+    }
+}
+
+void ListenFdExporter::start()
+{
+    sockaddr_un addr;
+    if(!fillUnixAddr(path_, &addr))
+    {
+        return;
+    }
+    ::unlink(path_.c_str());    // 上一个进程可能留下了同名文件
+    if(::bind(socket_.fd(), (sockaddr*)&addr, sizeof addr) < 0)
+    {
+        LOG_FATAL("ListenFdExporter bind %s fail: %d \n", path_.c_str(), errno);
+    }
+    // 拿到listenfd的进程可以让这个进程排空退出，只允许同一个用户连接
+    if(::chmod(path_.c_str(), 0600) < 0)
+    {
+        LOG_FATAL("ListenFdExporter chmod %s fail: %d \n", path_.c_str(), errno);
+    }
+    struct stat st;
+    if(::lstat(path_.c_str(), &st) == 0)
+    {
+        socketDev_ = st.st_dev;
+        socketIno_ = st.st_ino;
+    }
+    socket_.listen();
+    channel_.enableReading();
+    LOG_INFO("ListenFdExporter exporting %lu listen fds at %s \n", listenFds_.size(), path_.c_str());
+}
+
+// 有新进程来取listenfd
+void ListenFdExporter::handleRead()
+{
+    int connfd = ::accept4(socket_.fd(), nullptr, nullptr, SOCK_CLOEXEC);
+    if(connfd < 0)
+    {
+        LOG_ERROR("ListenFdExporter accept err: %d \n", errno);
+        return;
+    }
+
+    // 文件权限在bind和chmod之间有空隙，再按对端的uid检查一次
+    ucred cred;
+    bzero(&cred, sizeof cred);
+    socklen_t len = sizeof cred;
+    if(::getsockopt(connfd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 || cred.uid != ::geteuid())
+    {
+        LOG_ERROR("ListenFdExporter reject peer pid:%d uid:%d \n", static_cast<int>(cred.pid), static_cast<int>(cred.uid));
+        ::close(connfd);
+        return;
+    }
+
+    // 控制消息只有几十个字节，对端已经在等待接收，阻塞发送也不会卡住loop
+    bool ok = sendFds(connfd, listenFds_);
+    ::close(connfd);
+    if(!ok)
+    {
+        LOG_ERROR("ListenFdExporter send fds err: %d \n", errno);
+        return;
+    }
+
+    LOG_INFO("ListenFdExporter handed off %lu listen fds \n", listenFds_.size());
+    if(handoffCallback_)
+    {
+        handoffCallback_();
+    }
+}
+
+std::vector<int> ListenFdExporter::fetch(const std::string &path)
+{
+    std::vector<int> fds;
+    sockaddr_un addr;
+    if(!fillUnixAddr(path, &addr))
+    {
+        return fds;
+    }
+
+    int sockfd = createUnixSocket(0);
+    if(::connect(sockfd, (sockaddr*)&addr, sizeof addr) < 0 || !recvFds(sockfd, &fds))
+    {
+        LOG_ERROR("ListenFdExporter fetch listen fds from %s fail: %d \n", path.c_str(), errno);
+        fds.clear();
+    }
+    ::close(sockfd);
+    return fds;
+}
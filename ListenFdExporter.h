@@ -0,0 +1,47 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Socket.h"
+#include "Channel.h"
+
+#include <functional>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+class EventLoop;
+
+// 热重启时在进程之间交接listenfd
+// 旧进程在unix域socket上导出listenfd，新进程连上来后通过SCM_RIGHTS把fd发过去，
+// 新进程直接在继承来的listenfd上accept，两个进程共享同一个监听队列，升级期间不会拒绝连接
+// path的权限是0600，并且只接受和本进程同一个uid的对端
+class ListenFdExporter : noncopyable
+{
+public:
+    // 交接完成后的回调，在loop线程中执行，旧进程通常在这里开始排空
+    using HandoffCallback = std::function<void()>;
+
+    ListenFdExporter(EventLoop *loop, const std::string &path, const std::vector<int> &listenFds);
+    ~ListenFdExporter();
+
+    void setHandoffCallback(const HandoffCallback &cb) { handoffCallback_ = cb; }
+
+    // 在path上开始监听新进程的请求
+    void start();
+
+    // 新进程调用：连接旧进程导出的path，取回listenfd，失败时返回空
+    static std::vector<int> fetch(const std::string &path);
+
+private:
+    void handleRead();
+
+    EventLoop *loop_;
+    const std::string path_;
+    const std::vector<int> listenFds_;  // 不拥有，只负责发送
+    Socket socket_;
+    Channel channel_;
+    HandoffCallback handoffCallback_;
+    // start时创建的socket文件，析构时只删除仍然是它的path
+    dev_t socketDev_;
+    ino_t socketIno_;
+};
@@ -0,0 +1,106 @@
+#include "LoopMetrics.h"
+
+#include <stdio.h>
+
+LoopMetricsSnapshot::LoopMetricsSnapshot()
+    : loops(0)
+    , pollIterations(0)
+    , events(0)
+    , pollWaitMicros(0)
+    , handleEventMicros(0)
+    , pendingFunctorMicros(0)
+    , functorsRun(0)
+    , bytesRead(0)
+    , bytesWritten(0)
+    , connections(0)
+    , stalls(0)
+{
+}
+
+void LoopMetricsSnapshot::merge(const LoopMetricsSnapshot &other)
+{
+    loops += other.loops;
+    pollIterations += other.pollIterations;
+    events += other.events;
+    pollWaitMicros += other.pollWaitMicros;
+    handleEventMicros += other.handleEventMicros;
+    pendingFunctorMicros += other.pendingFunctorMicros;
+    functorsRun += other.functorsRun;
+    bytesRead += other.bytesRead;
+    bytesWritten += other.bytesWritten;
+    connections += other.connections;
+    stalls += other.stalls;
+    eventsPerPoll.merge(other.eventsPerPoll);
+    pendingFunctorsPerBatch.merge(other.pendingFunctorsPerBatch);
+    pollWaitLatency.merge(other.pollWaitLatency);
+    handleEventLatency.merge(other.handleEventLatency);
+    pendingFunctorLatency.merge(other.pendingFunctorLatency);
+}
+
+static std::string latencyJson(const Histogram::Snapshot &h)
+{
+    char buf[128] = {0};
+    snprintf(buf, sizeof buf, "{\"p50\":%lu,\"p99\":%lu,\"p999\":%lu,\"max\":%lu}",
+        h.percentile(0.50), h.percentile(0.99), h.percentile(0.999), h.max);
+    return buf;
+}
+
+std::string LoopMetricsSnapshot::toJson() const
+{
+    char buf[1024] = {0};
+    snprintf(buf, sizeof buf,
+        "{\"loops\":%d,\"poll_iterations\":%lu,\"events\":%lu,"
+        "\"poll_wait_us\":%lu,\"handle_event_us\":%lu,\"pending_functor_us\":%lu,"
+        "\"functors_run\":%lu,\"bytes_read\":%lu,\"bytes_written\":%lu,\"connections\":%ld,"
+        "\"stalls\":%lu,"
+        "\"events_per_poll\":{\"mean\":%.2f,\"p99\":%lu,\"max\":%lu},"
+        "\"pending_functors\":{\"mean\":%.2f,\"p99\":%lu,\"max\":%lu},",
+        loops, pollIterations, events,
+        pollWaitMicros, handleEventMicros, pendingFunctorMicros,
+        functorsRun, bytesRead, bytesWritten, connections,
+        stalls,
+        eventsPerPoll.mean(), eventsPerPoll.percentile(0.99), eventsPerPoll.max,
+        pendingFunctorsPerBatch.mean(), pendingFunctorsPerBatch.percentile(0.99),
+        pendingFunctorsPerBatch.max);
+    return std::string(buf)
+        + "\"poll_wait_latency_us\":" + latencyJson(pollWaitLatency)
+        + ",\"handle_event_latency_us\":" + latencyJson(handleEventLatency)
+        + ",\"pending_functor_latency_us\":" + latencyJson(pendingFunctorLatency)
+        + "}";
+}
+
+LoopMetrics::LoopMetrics()
+    : pollIterations_(0)
+    , events_(0)
+    , pollWaitMicros_(0)
+    , handleEventMicros_(0)
+    , pendingFunctorMicros_(0)
+    , functorsRun_(0)
+    , bytesRead_(0)
+    , bytesWritten_(0)
+    , connections_(0)
+    , stalls_(0)
+{
+}
+
+LoopMetricsSnapshot LoopMetrics::snapshot() const
+{
+    LoopMetricsSnapshot snap;
+    snap.loops = 1;
+    snap.pollIterations = pollIterations_.load(std::memory_order_relaxed);
+    snap.events = events_.load(std::memory_order_relaxed);
+    snap.pollWaitMicros = pollWaitMicros_.load(std::memory_order_relaxed);
+    snap.handleEventMicros = handleEventMicros_.load(std::memory_order_relaxed);
+    snap.pendingFunctorMicros = pendingFunctorMicros_.load(std::memory_order_relaxed);
+    snap.functorsRun = functorsRun_.load(std::memory_order_relaxed);
+    snap.bytesRead = bytesRead_.load(std::memory_order_relaxed);
+    snap.bytesWritten = bytesWritten_.load(std::memory_order_relaxed);
+    snap.connections = connections_.load(std::memory_order_relaxed);
+    snap.stalls = stalls_.load(std::memory_order_relaxed);
+    snap.eventsPerPoll = eventsPerPoll_.snapshot();
+    snap.pendingFunctorsPerBatch = pendingFunctorsPerBatch_.snapshot();
+    snap.pollWaitLatency = pollWaitLatency_.snapshot();
+    snap.handleEventLatency = handleEventLatency_.snapshot();
+    snap.pendingFunctorLatency = pendingFunctorLatency_.snapshot();
+    return snap;
+}
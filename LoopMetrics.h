@@ -0,0 +1,102 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Histogram.h"
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+// 某一时刻的loop运行指标，多个loop的快照可以合并
+struct LoopMetricsSnapshot
+{
+    LoopMetricsSnapshot();
+
+    void merge(const LoopMetricsSnapshot &other);
+    std::string toJson() const;
+
+    int loops;                      // 合并了几个loop
+    uint64_t pollIterations;
+    uint64_t events;                // poll返回的事件总数
+    uint64_t pollWaitMicros;        // 阻塞在poll中的时间
+    uint64_t handleEventMicros;     // 处理channel事件的时间
+    uint64_t pendingFunctorMicros;  // 执行doPendingFunctors的时间
+    uint64_t functorsRun;
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    int64_t connections;            // 当前连接数
+    uint64_t stalls;                // 超过卡顿阈值的handler/functor个数
+    Histogram::Snapshot eventsPerPoll;
+    Histogram::Snapshot pendingFunctorsPerBatch;    // 每次swap出的pendingFunctors_个数，即队列深度
+    // 每轮循环各阶段的耗时分布，单位us
+    Histogram::Snapshot pollWaitLatency;
+    Histogram::Snapshot handleEventLatency;
+    Histogram::Snapshot pendingFunctorLatency;
+};
+
+// 每个EventLoop一份，只由所属的loop线程更新（包括该loop上的TcpConnection），
+// 热路径上没有锁；按cache line对齐，不同loop的指标不会互相伪共享
+class alignas(64) LoopMetrics : noncopyable
+{
+public:
+    LoopMetrics();
+
+    void onPoll(int numEvents, int64_t waitMicros, int64_t handleMicros)
+    {
+        Histogram::increment(pollIterations_, 1);
+        Histogram::increment(events_, numEvents);
+        Histogram::increment(pollWaitMicros_, waitMicros);
+        Histogram::increment(handleEventMicros_, handleMicros);
+        eventsPerPoll_.record(numEvents);
+        pollWaitLatency_.record(waitMicros);
+        if(numEvents > 0)
+        {
+            handleEventLatency_.record(handleMicros);
+        }
+    }
+
+    void onPendingFunctors(size_t numFunctors, int64_t micros)
+    {
+        if(numFunctors > 0)
+        {
+            Histogram::increment(functorsRun_, numFunctors);
+            Histogram::increment(pendingFunctorMicros_, micros);
+            pendingFunctorsPerBatch_.record(numFunctors);
+            pendingFunctorLatency_.record(micros);
+        }
+    }
+
+    void onStall() { Histogram::increment(stalls_, 1); }
+
+    void addBytesRead(size_t n) { Histogram::increment(bytesRead_, n); }
+    void addBytesWritten(size_t n) { Histogram::increment(bytesWritten_, n); }
+
+    void connectionAdded()
+    {
+        connections_.store(connections_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    void connectionRemoved()
+    {
+        connections_.store(connections_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    }
+
+    // 可以在任意线程调用
+    LoopMetricsSnapshot snapshot() const;
+
+private:
+    std::atomic<uint64_t> pollIterations_;
+    std::atomic<uint64_t> events_;
+    std::atomic<uint64_t> pollWaitMicros_;
+    std::atomic<uint64_t> handleEventMicros_;
+    std::atomic<uint64_t> pendingFunctorMicros_;
+    std::atomic<uint64_t> functorsRun_;
+    std::atomic<uint64_t> bytesRead_;
+    std::atomic<uint64_t> bytesWritten_;
+    std::atomic<int64_t> connections_;
+    std::atomic<uint64_t> stalls_;
+    Histogram eventsPerPoll_;
+    Histogram pendingFunctorsPerBatch_;
+    Histogram pollWaitLatency_;
+    Histogram handleEventLatency_;
+    Histogram pendingFunctorLatency_;
+};
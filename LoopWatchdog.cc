@@ -0,0 +1,96 @@
+#include "LoopWatchdog.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+
+LoopWatchdog::LoopWatchdog(int stallMs, int checkIntervalMs)
+    : stallMicros_(static_cast<int64_t>(stallMs) * 1000)
+    , checkIntervalMs_(checkIntervalMs > 0 ? checkIntervalMs : std::max(stallMs / 2, 1))
+    , running_(false)
+{
+}
+
+LoopWatchdog::~LoopWatchdog()
+{
+    stop();
+}
+
+void LoopWatchdog::watch(EventLoop *loop)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    loops_.push_back(Watched{ loop, 0 });
+}
+
+void LoopWatchdog::unwatch(EventLoop *loop)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    loops_.erase(std::remove_if(loops_.begin(), loops_.end(),
+        [loop](const Watched &w){ return w.loop == loop; }), loops_.end());
+}
+
+void LoopWatchdog::start()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(running_)
+    {
+        return;
+    }
+    running_ = true;
+    thread_.reset(new Thread(std::bind(&LoopWatchdog::threadFunc, this), "LoopWatchdog"));
+    thread_->start();
+}
+
+void LoopWatchdog::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(!running_)
+        {
+            return;
+        }
+        running_ = false;
+    }
+    cond_.notify_all();
+    thread_->join();
+}
+
+void LoopWatchdog::threadFunc()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(running_)
+    {
+        cond_.wait_for(lock, std::chrono::milliseconds(checkIntervalMs_));
+        if(!running_)
+        {
+            break;
+        }
+        check();
+    }
+}
+
+// 持有mutex_时调用，保证检查期间被监视的loop不会被unwatch
+void LoopWatchdog::check()
+{
+    int64_t now = Timestamp::monotonicMicros();
+    for(Watched &w : loops_)
+    {
+        int64_t busySince = w.loop->busySince();
+        if(busySince == 0 || busySince == w.reportedBusySince || now - busySince < stallMicros_)
+        {
+            continue;
+        }
+        w.reportedBusySince = busySince;
+        int fd = w.loop->currentFd();
+        if(stallCallback_)
+        {
+            stallCallback_(w.loop, fd, now - busySince);
+        }
+        else
+        {
+            LOG_ERROR("LoopWatchdog: EventLoop %p (tid %d) has not returned to poll for %ld ms, fd=%d \n",
+                w.loop, w.loop->threadId(), (now - busySince) / 1000, fd);
+        }
+    }
+}
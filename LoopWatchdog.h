@@ -0,0 +1,55 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <functional>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+class EventLoop;
+
+// 看门狗线程：定期检查被监视的loop，离开epoll_wait超过stallMs还没有回去的就报告，
+// 同时报告它正在处理的channel的fd（-1表示卡在pendingFunctors里）
+// 同一次卡顿只报告一次；loop析构之前要先unwatch或者stop
+class LoopWatchdog : noncopyable
+{
+public:
+    using StallCallback = std::function<void(EventLoop *loop, int fd, int64_t micros)>;
+
+    // checkIntervalMs为0时取stallMs/2
+    explicit LoopWatchdog(int stallMs, int checkIntervalMs = 0);
+    ~LoopWatchdog();
+
+    // 默认用LOG_ERROR输出，在看门狗线程中调用
+    void setStallCallback(const StallCallback &cb) { stallCallback_ = cb; }
+
+    void watch(EventLoop *loop);
+    void unwatch(EventLoop *loop);
+
+    void start();
+    void stop();
+
+private:
+    struct Watched
+    {
+        EventLoop *loop;
+        int64_t reportedBusySince;  // 已经报告过的那次卡顿
+    };
+
+    void threadFunc();
+    void check();
+
+    const int64_t stallMicros_;
+    const int checkIntervalMs_;
+    StallCallback stallCallback_;
+
+    std::unique_ptr<Thread> thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool running_;
+    std::vector<Watched> loops_;
+};
@@ -0,0 +1,169 @@
+#include "RateLimiter.h"
+#include "Timestamp.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate_(rate)
+    , burst_(burst > 0 ? burst : rate)
+    , tokens_(burst_)
+    , lastMicros_(Timestamp::monotonicMicros())
+{
+}
+
+void TokenBucket::refill(int64_t nowMicros)
+{
+    if(nowMicros > lastMicros_)
+    {
+        tokens_ = std::min(burst_, tokens_ + (nowMicros - lastMicros_) * rate_ / 1e6);
+        lastMicros_ = nowMicros;
+    }
+}
+
+double TokenBucket::available(int64_t nowMicros)
+{
+    refill(nowMicros);
+    return tokens_;
+}
+
+void TokenBucket::consume(double n, int64_t nowMicros)
+{
+    refill(nowMicros);
+    tokens_ -= n;
+}
+
+int64_t TokenBucket::delayMicros(int64_t nowMicros, double need)
+{
+    refill(nowMicros);
+    need = std::min(need, burst_);
+    if(tokens_ >= need)
+    {
+        return 0;
+    }
+    return static_cast<int64_t>(::ceil((need - tokens_) * 1e6 / rate_));
+}
+
+std::shared_ptr<TokenBucket> RateLimit::makeBucket() const
+{
+    return enabled() ? std::make_shared<TokenBucket>(rate, burst) : std::shared_ptr<TokenBucket>();
+}
+
+ConnectionRateLimiter::ConnectionRateLimiter(const RateLimits &limits)
+{
+    addBucket(kReadBytes, limits.readBytes.makeBucket());
+    addBucket(kWriteBytes, limits.writeBytes.makeBucket());
+    addBucket(kMessages, limits.messages.makeBucket());
+}
+
+void ConnectionRateLimiter::addBucket(Kind kind, const std::shared_ptr<TokenBucket> &bucket)
+{
+    if(bucket)
+    {
+        buckets_[kind].push_back(bucket);
+    }
+}
+
+void ConnectionRateLimiter::consume(Kind kind, double n, int64_t nowMicros)
+{
+    for(auto &bucket : buckets_[kind])
+    {
+        bucket->consume(n, nowMicros);
+    }
+}
+
+int64_t ConnectionRateLimiter::delayMicros(Kind kind, int64_t nowMicros, double need)
+{
+    int64_t delay = 0;
+    for(auto &bucket : buckets_[kind])
+    {
+        delay = std::max(delay, bucket->delayMicros(nowMicros, need));
+    }
+    return delay;
+}
+
+size_t ConnectionRateLimiter::quota(Kind kind, int64_t nowMicros, double need)
+{
+    size_t quota = SIZE_MAX;
+    for(auto &bucket : buckets_[kind])
+    {
+        double tokens = bucket->available(nowMicros);
+        if(tokens < std::min(need, bucket->burst()))
+        {
+            return 0;
+        }
+        quota = std::min(quota, static_cast<size_t>(tokens));
+    }
+    return quota;
+}
+
+LoopRateLimiter::LoopRateLimiter(const RateLimits &perConnection, const RateLimits &perLoop, const RateLimits &perPeerIp)
+    : perConnection_(perConnection)
+    , perPeerIp_(perPeerIp)
+    , peersCleanThreshold_(1024)
+{
+    for(int kind = 0; kind < ConnectionRateLimiter::kNumKinds; ++kind)
+    {
+        loopBuckets_[kind] = limitOf(perLoop, kind).makeBucket();
+    }
+}
+
+const RateLimit& LoopRateLimiter::limitOf(const RateLimits &limits, int kind)
+{
+    switch(kind)
+    {
+    case ConnectionRateLimiter::kReadBytes:
+        return limits.readBytes;
+    case ConnectionRateLimiter::kWriteBytes:
+        return limits.writeBytes;
+    default:
+        return limits.messages;
+    }
+}
+
+std::unique_ptr<ConnectionRateLimiter> LoopRateLimiter::newConnection(const InetAddress &peerAddr)
+{
+    std::unique_ptr<ConnectionRateLimiter> limiter(new ConnectionRateLimiter(perConnection_));
+    PeerBuckets *peer = nullptr;
+    if(perPeerIp_.enabled())
+    {
+        peer = &peers_[peerAddr.toIp()];
+    }
+    for(int kind = 0; kind < ConnectionRateLimiter::kNumKinds; ++kind)
+    {
+        Kind k = static_cast<Kind>(kind);
+        limiter->addBucket(k, loopBuckets_[kind]);
+        if(peer != nullptr && limitOf(perPeerIp_, kind).enabled())
+        {
+            // 这个IP上还有连接时沿用它们的桶，否则重新开始计
+            std::shared_ptr<TokenBucket> bucket = peer->buckets[kind].lock();
+            if(!bucket)
+            {
+                bucket = limitOf(perPeerIp_, kind).makeBucket();
+                peer->buckets[kind] = bucket;
+            }
+            limiter->addBucket(k, bucket);
+        }
+    }
+    if(peers_.size() >= peersCleanThreshold_)
+    {
+        removeExpiredPeers();
+    }
+    return limiter;
+}
+
+// 对端很多时表会一直变大，超过阈值时清理一次，阈值随剩下的数量翻倍，均摊下来每个新连接O(1)
+void LoopRateLimiter::removeExpiredPeers()
+{
+    for(auto it = peers_.begin(); it != peers_.end(); )
+    {
+        bool expired = true;
+        for(auto &bucket : it->second.buckets)
+        {
+            expired = expired && bucket.expired();
+        }
+        it = expired ? peers_.erase(it) : std::next(it);
+    }
+    peersCleanThreshold_ = std::max<size_t>(1024, peers_.size() * 2);
+}
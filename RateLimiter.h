@@ -0,0 +1,108 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+// 令牌桶：每秒补充rate个令牌，最多攒burst个；读数据时令牌可以透支，还清之前不再放行
+// 不加锁，只在一个loop线程中使用
+class TokenBucket : noncopyable
+{
+public:
+    TokenBucket(double rate, double burst);
+
+    double rate() const { return rate_; }
+    double burst() const { return burst_; }
+
+    double available(int64_t nowMicros);
+    void consume(double n, int64_t nowMicros);
+    // 至少有need个令牌（不超过burst）还要等多少微秒，0表示现在就有
+    int64_t delayMicros(int64_t nowMicros, double need = 1);
+
+private:
+    void refill(int64_t nowMicros);
+
+    const double rate_;
+    const double burst_;
+    double tokens_;
+    int64_t lastMicros_;
+};
+
+// 一种流量的限制，rate为0表示不限，burst为0时取rate（攒一秒的量）
+struct RateLimit
+{
+    RateLimit(double r = 0, double b = 0) : rate(r), burst(b) {}
+
+    bool enabled() const { return rate > 0; }
+    std::shared_ptr<TokenBucket> makeBucket() const;
+
+    double rate;
+    double burst;
+};
+
+// 读、写字节数（socket上的字节，开启TLS时是密文）和消息数（交给messageCallback的次数）每秒的限制
+struct RateLimits
+{
+    bool enabled() const { return readBytes.enabled() || writeBytes.enabled() || messages.enabled(); }
+
+    RateLimit readBytes;
+    RateLimit writeBytes;
+    RateLimit messages;
+};
+
+// 一条连接受的全部限制：只属于它的令牌桶，以及和同一个loop、同一个对端IP的其他连接共享的
+// 读和消息数超限时连接停止读socket，写超限时数据留在outputBuffer_里，都在loop的定时器上恢复
+// 只在连接所属的loop线程中访问
+class ConnectionRateLimiter : noncopyable
+{
+public:
+    enum Kind { kReadBytes, kWriteBytes, kMessages, kNumKinds };
+
+    explicit ConnectionRateLimiter(const RateLimits &limits = RateLimits());
+
+    void addBucket(Kind kind, const std::shared_ptr<TokenBucket> &bucket);
+    bool limited(Kind kind) const { return !buckets_[kind].empty(); }
+
+    // 所有桶都扣掉n
+    void consume(Kind kind, double n, int64_t nowMicros);
+    // 所有桶都至少有need个令牌（不超过各自的burst）还要等多少微秒
+    int64_t delayMicros(Kind kind, int64_t nowMicros, double need = 1);
+    // 现在最多能用多少（各桶中最少的），有桶不足need个（不超过它的burst）时是0，没有限制时是SIZE_MAX
+    size_t quota(Kind kind, int64_t nowMicros, double need = 1);
+
+private:
+    std::vector<std::shared_ptr<TokenBucket>> buckets_[kNumKinds];
+};
+
+// 一个loop上的限速状态：整个loop共享一组令牌桶，每个对端IP共享一组，
+// 新连接再加上只属于自己的一组；只在这个loop线程中访问，不加锁
+// 对端IP的桶按loop分开，同一个IP分到不同loop上的连接各自受限
+class LoopRateLimiter : noncopyable
+{
+public:
+    LoopRateLimiter(const RateLimits &perConnection, const RateLimits &perLoop, const RateLimits &perPeerIp);
+
+    std::unique_ptr<ConnectionRateLimiter> newConnection(const InetAddress &peerAddr);
+
+private:
+    using Kind = ConnectionRateLimiter::Kind;
+    struct PeerBuckets
+    {
+        // 连接都关闭后过期
+        std::weak_ptr<TokenBucket> buckets[ConnectionRateLimiter::kNumKinds];
+    };
+
+    static const RateLimit& limitOf(const RateLimits &limits, int kind);
+    void removeExpiredPeers();
+
+    const RateLimits perConnection_;
+    const RateLimits perPeerIp_;
+    std::shared_ptr<TokenBucket> loopBuckets_[ConnectionRateLimiter::kNumKinds];
+    std::unordered_map<std::string, PeerBuckets> peers_;
+    size_t peersCleanThreshold_;
+};
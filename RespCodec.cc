@@ -0,0 +1,471 @@
+#include "RespCodec.h"
+#include "Buffer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const size_t kMaxLineLength = 64 * 1024;
+
+// 十进制，不经过snprintf
+static void appendDecimal(Buffer *output, int64_t value)
+{
+    char buf[24];
+    char *p = buf + sizeof buf;
+    uint64_t v = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    do
+    {
+        *--p = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while(v != 0);
+    if(value < 0)
+    {
+        *--p = '-';
+    }
+    output->append(p, buf + sizeof buf - p);
+}
+
+static bool parseInteger(const char *begin, const char *end, int64_t *value)
+{
+    bool negative = begin < end && *begin == '-';
+    if(negative)
+    {
+        ++begin;
+    }
+    if(begin == end || end - begin > 19)
+    {
+        return false;
+    }
+    uint64_t v = 0;
+    for(const char *p = begin; p < end; ++p)
+    {
+        if(*p < '0' || *p > '9')
+        {
+            return false;
+        }
+        v = v * 10 + static_cast<uint64_t>(*p - '0');
+    }
+    if(v > static_cast<uint64_t>(INT64_MAX))
+    {
+        return false;
+    }
+    *value = negative ? -static_cast<int64_t>(v) : static_cast<int64_t>(v);
+    return true;
+}
+
+const char* RespParser::findCRLF(const char *begin, const char *end)
+{
+    const char *p = begin;
+#if defined(__AVX2__)
+    const __m256i cr = _mm256_set1_epi8('\r');
+    for(; p + 32 <= end; p += 32)
+    {
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), cr)));
+        while(mask != 0)
+        {
+            const char *q = p + __builtin_ctz(mask);
+            if(q + 1 < end && q[1] == '\n')
+            {
+                return q;
+            }
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i cr = _mm_set1_epi8('\r');
+    for(; p + 16 <= end; p += 16)
+    {
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), cr)));
+        while(mask != 0)
+        {
+            const char *q = p + __builtin_ctz(mask);
+            if(q + 1 < end && q[1] == '\n')
+            {
+                return q;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for(; p + 1 < end; ++p)
+    {
+        if(p[0] == '\r' && p[1] == '\n')
+        {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+RespParser::RespParser()
+    : pos_(0)
+    , remaining_(0)
+    , needBytes_(0)
+    , maxBulkLength_(512 * 1024 * 1024)
+    , maxElements_(1024 * 1024)
+    , error_(nullptr)
+{
+}
+
+RespParser::ParseResult RespParser::fail(const char *reason)
+{
+    error_ = reason;
+    return kError;
+}
+
+RespParser::ParseResult RespParser::parse(const Buffer *buf)
+{
+    size_t readable = buf->readableBytes();
+    if(readable < needBytes_ || readable == 0)
+    {
+        return kNeedMore;
+    }
+    if(remaining_ == 0)
+    {
+        values_.clear();
+        offsets_.clear();
+        pos_ = 0;
+        remaining_ = 1;
+    }
+
+    const char *base = buf->peek();
+    const char *end = base + readable;
+    while(remaining_ > 0)
+    {
+        const char *p = base + pos_;
+        const char *cr = p < end ? findCRLF(p + 1, end) : nullptr;
+        if(cr == nullptr)
+        {
+            if(readable - pos_ > kMaxLineLength)
+            {
+                return fail("line too long");
+            }
+            needBytes_ = readable + 1;
+            return kNeedMore;
+        }
+
+        RespValue value;
+        value.type = static_cast<RespValue::Type>(*p);
+        value.integer = 0;
+        size_t offset = p + 1 - base;
+        size_t length = cr - p - 1;
+        size_t next = cr + 2 - base;
+        bool attribute = false;
+        switch(*p)
+        {
+        case RespValue::kSimpleString:
+        case RespValue::kError:
+        case RespValue::kDouble:
+        case RespValue::kBigNumber:
+            break;
+        case RespValue::kInteger:
+            if(!parseInteger(p + 1, cr, &value.integer))
+            {
+                return fail("invalid integer");
+            }
+            break;
+        case RespValue::kNull:
+            length = 0;
+            break;
+        case RespValue::kBoolean:
+            if(length != 1 || (p[1] != 't' && p[1] != 'f'))
+            {
+                return fail("invalid boolean");
+            }
+            value.integer = p[1] == 't';
+            break;
+        case RespValue::kBulkString:
+        case RespValue::kBulkError:
+        case RespValue::kVerbatim:
+        {
+            int64_t n;
+            if(!parseInteger(p + 1, cr, &n) || n < -1 || (n == -1 && *p != RespValue::kBulkString))
+            {
+                return fail("invalid bulk length");
+            }
+            if(n == -1)
+            {
+                // RESP2的null bulk string
+                value.type = RespValue::kNull;
+                length = 0;
+                break;
+            }
+            if(static_cast<size_t>(n) > maxBulkLength_)
+            {
+                return fail("bulk string too long");
+            }
+            if(next + n + 2 > readable)
+            {
+                // 数据到齐之前不再解析
+                needBytes_ = next + n + 2;
+                return kNeedMore;
+            }
+            if(base[next + n] != '\r' || base[next + n + 1] != '\n')
+            {
+                return fail("bulk string not terminated by CRLF");
+            }
+            offset = next;
+            length = static_cast<size_t>(n);
+            next += n + 2;
+            break;
+        }
+        case RespValue::kArray:
+        case RespValue::kSet:
+        case RespValue::kPush:
+        case RespValue::kMap:
+        case RespValue::kAttribute:
+        {
+            int64_t n;
+            if(!parseInteger(p + 1, cr, &n) || n < -1 || (n == -1 && *p != RespValue::kArray))
+            {
+                return fail("invalid aggregate length");
+            }
+            length = 0;
+            if(n == -1)
+            {
+                value.type = RespValue::kNull;
+                break;
+            }
+            size_t elements = static_cast<size_t>(n);
+            if(*p == RespValue::kMap || *p == RespValue::kAttribute)
+            {
+                elements *= 2;
+            }
+            if(elements > maxElements_ || values_.size() + elements > maxElements_)
+            {
+                return fail("too many elements");
+            }
+            value.integer = n;
+            remaining_ += elements;
+            attribute = *p == RespValue::kAttribute;
+            break;
+        }
+        default:
+            return fail("unknown type");
+        }
+
+        value.str.set(nullptr, length);
+        values_.push_back(value);
+        offsets_.push_back(offset);
+        pos_ = next;
+        // 属性修饰后面的那个值，不算一个独立的值
+        if(!attribute)
+        {
+            --remaining_;
+        }
+    }
+
+    for(size_t i = 0; i < values_.size(); ++i)
+    {
+        values_[i].str.set(base + offsets_[i], values_[i].str.size());
+    }
+    needBytes_ = 0;
+    return kGotValue;
+}
+
+RespParser::ParseResult RespParser::parseCommand(const Buffer *buf)
+{
+    if(remaining_ == 0 && buf->readableBytes() > 0 && *buf->peek() != RespValue::kArray)
+    {
+        return parseInline(buf);
+    }
+    ParseResult result = parse(buf);
+    if(result != kGotValue)
+    {
+        return result;
+    }
+    command_.args_.clear();
+    if(values_[0].type == RespValue::kNull)
+    {
+        return kGotValue;
+    }
+    if(values_.size() != static_cast<size_t>(values_[0].integer) + 1)
+    {
+        return fail("expected bulk strings in command");
+    }
+    for(size_t i = 1; i < values_.size(); ++i)
+    {
+        if(values_[i].type != RespValue::kBulkString)
+        {
+            return fail("expected bulk strings in command");
+        }
+        command_.args_.push_back(values_[i].str);
+    }
+    return kGotValue;
+}
+
+// telnet里直接敲的命令：一行，空白分隔，redis也接受只有\n的行尾
+RespParser::ParseResult RespParser::parseInline(const Buffer *buf)
+{
+    size_t readable = buf->readableBytes();
+    if(readable < needBytes_)
+    {
+        return kNeedMore;
+    }
+    const char *begin = buf->peek();
+    const char *lf = static_cast<const char*>(::memchr(begin, '\n', readable));
+    if(lf == nullptr)
+    {
+        if(readable > kMaxLineLength)
+        {
+            return fail("inline command too long");
+        }
+        needBytes_ = readable + 1;
+        return kNeedMore;
+    }
+    pos_ = lf + 1 - begin;
+    needBytes_ = 0;
+    const char *end = lf > begin && lf[-1] == '\r' ? lf - 1 : lf;
+    command_.args_.clear();
+    const char *p = begin;
+    while(p < end)
+    {
+        while(p < end && (*p == ' ' || *p == '\t'))
+        {
+            ++p;
+        }
+        const char *word = p;
+        while(p < end && *p != ' ' && *p != '\t')
+        {
+            ++p;
+        }
+        if(p > word)
+        {
+            command_.args_.push_back(StringPiece(word, p - word));
+        }
+    }
+    return kGotValue;
+}
+
+void RespParser::consume(Buffer *buf)
+{
+    buf->retrieve(pos_);
+    pos_ = 0;
+    remaining_ = 0;
+    needBytes_ = 0;
+}
+
+void RespWriter::appendLine(char type, const StringPiece &s)
+{
+    output_->ensureWritableBytes(s.size() + 3);
+    char *p = output_->beginWrite();
+    *p = type;
+    ::memcpy(p + 1, s.data(), s.size());
+    p[s.size() + 1] = '\r';
+    p[s.size() + 2] = '\n';
+    output_->hasWritten(s.size() + 3);
+}
+
+void RespWriter::appendPrefixedLength(char type, int64_t value)
+{
+    output_->append(&type, 1);
+    appendDecimal(output_, value);
+    output_->append("\r\n", 2);
+}
+
+void RespWriter::appendSimpleString(const StringPiece &s)
+{
+    appendLine(RespValue::kSimpleString, s);
+}
+
+void RespWriter::appendError(const StringPiece &message)
+{
+    appendLine(RespValue::kError, message);
+}
+
+void RespWriter::appendInteger(int64_t value)
+{
+    appendPrefixedLength(RespValue::kInteger, value);
+}
+
+void RespWriter::appendBulkString(const StringPiece &s)
+{
+    appendPrefixedLength(RespValue::kBulkString, static_cast<int64_t>(s.size()));
+    output_->append(s.data(), s.size());
+    output_->append("\r\n", 2);
+}
+
+void RespWriter::appendNull()
+{
+    if(protocol_ >= 3)
+    {
+        output_->append("_\r\n", 3);
+    }
+    else
+    {
+        output_->append("$-1\r\n", 5);
+    }
+}
+
+void RespWriter::appendBoolean(bool value)
+{
+    if(protocol_ >= 3)
+    {
+        output_->append(value ? "#t\r\n" : "#f\r\n", 4);
+    }
+    else
+    {
+        appendInteger(value ? 1 : 0);
+    }
+}
+
+void RespWriter::appendDouble(double value)
+{
+    char buf[32];
+    int n;
+    if(isinf(value))
+    {
+        n = ::snprintf(buf, sizeof buf, "%s", value > 0 ? "inf" : "-inf");
+    }
+    else if(isnan(value))
+    {
+        n = ::snprintf(buf, sizeof buf, "nan");
+    }
+    else
+    {
+        n = ::snprintf(buf, sizeof buf, "%.17g", value);
+    }
+    if(protocol_ >= 3)
+    {
+        appendLine(RespValue::kDouble, StringPiece(buf, n));
+    }
+    else
+    {
+        appendBulkString(StringPiece(buf, n));
+    }
+}
+
+void RespWriter::appendArrayHeader(size_t count)
+{
+    appendPrefixedLength(RespValue::kArray, static_cast<int64_t>(count));
+}
+
+void RespWriter::appendMapHeader(size_t count)
+{
+    if(protocol_ >= 3)
+    {
+        appendPrefixedLength(RespValue::kMap, static_cast<int64_t>(count));
+    }
+    else
+    {
+        appendPrefixedLength(RespValue::kArray, static_cast<int64_t>(count * 2));
+    }
+}
+
+void RespWriter::appendSetHeader(size_t count)
+{
+    appendPrefixedLength(protocol_ >= 3 ? RespValue::kSet : RespValue::kArray, static_cast<int64_t>(count));
+}
+
+void RespWriter::appendPushHeader(size_t count)
+{
+    appendPrefixedLength(protocol_ >= 3 ? RespValue::kPush : RespValue::kArray, static_cast<int64_t>(count));
+}
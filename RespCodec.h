@@ -0,0 +1,137 @@
+#pragma once
+
+#include "StringPiece.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class Buffer;
+
+// RESP的一个值，类型就是协议里的首字节
+// 解析结果按前序展开成一个数组：聚合类型（数组、map、集合……）后面紧跟着它的元素，
+// map和属性的元素数是count的两倍（键值交替）；属性出现在它修饰的值前面
+struct RespValue
+{
+    enum Type
+    {
+        kSimpleString = '+',
+        kError = '-',
+        kInteger = ':',
+        kBulkString = '$',
+        kArray = '*',
+        // RESP3
+        kNull = '_',
+        kBoolean = '#',
+        kDouble = ',',
+        kBigNumber = '(',
+        kBulkError = '!',
+        kVerbatim = '=',
+        kMap = '%',
+        kSet = '~',
+        kAttribute = '|',
+        kPush = '>',
+    };
+
+    Type type;
+    StringPiece str;        // 字符串类、double、大整数的原文
+    int64_t integer;        // kInteger、kBoolean(0/1)的值，聚合类型的元素个数
+};
+
+// 服务端收到的一条命令，参数指向连接的inputBuffer_，不拷贝
+class RespCommand
+{
+public:
+    size_t size() const { return args_.size(); }
+    const StringPiece& arg(size_t i) const { return args_[i]; }
+    const StringPiece& name() const { return args_[0]; }
+    const std::vector<StringPiece>& args() const { return args_; }
+    // 命令名不区分大小写
+    bool is(const char *name) const { return args_[0].equalsIgnoreCase(name); }
+
+private:
+    friend class RespParser;
+    std::vector<StringPiece> args_;
+};
+
+// 增量的RESP2/RESP3解析器，每个连接一个，直接在Buffer上解析，bulk string不拷贝
+// 一个值完整之前不从Buffer中取走数据，记住已经解析到的位置和还缺几个元素，下次从断点继续；
+// 缺一段大的bulk string时记住至少需要的字节数，数据不够之前的调用直接返回
+// 流式的bulk string和聚合类型（$?、*?）不支持，按协议错误处理
+class RespParser
+{
+public:
+    enum ParseResult
+    {
+        kNeedMore,
+        kGotValue,      // values()/command()可用，处理完后调用consume
+        kError,         // 协议错误，error()是原因，连接应当关闭
+    };
+
+    // 默认bulk string最大512MB，聚合类型最多1M个元素，一行（inline命令、简单字符串）最长64KB
+    RespParser();
+
+    void setMaxBulkLength(size_t n) { maxBulkLength_ = n; }
+    void setMaxElements(size_t n) { maxElements_ = n; }
+
+    // 解析任意一个值（客户端解析回复）
+    ParseResult parse(const Buffer *buf);
+    const std::vector<RespValue>& values() const { return values_; }
+
+    // 解析一条命令（服务端）：bulk string组成的数组，或者telnet式的inline命令
+    ParseResult parseCommand(const Buffer *buf);
+    const RespCommand& command() const { return command_; }
+
+    void consume(Buffer *buf);
+    const char* error() const { return error_; }
+
+    // 在[begin, end)中找"\r\n"，返回'\r'的位置，找不到返回nullptr；按SSE2/AVX2一次比较16/32字节
+    static const char* findCRLF(const char *begin, const char *end);
+
+private:
+    ParseResult parseInline(const Buffer *buf);
+    ParseResult fail(const char *reason);
+
+    std::vector<RespValue> values_;
+    std::vector<size_t> offsets_;   // 解析过程中values_[i].str相对于可读起点的偏移，Buffer可能搬移数据
+    RespCommand command_;
+    size_t pos_;            // 已经解析到的位置，相对于可读起点
+    size_t remaining_;      // 还需要解析的值的个数，0表示还没开始
+    size_t needBytes_;      // 可读数据至少要有这么多才继续解析
+    size_t maxBulkLength_;
+    size_t maxElements_;
+    const char *error_;
+};
+
+// 把回复序列化进Buffer，protocol是连接协商的RESP版本（HELLO），
+// RESP2里没有的类型按redis的惯例降级：null是$-1，map是键值交替的数组，double是bulk string
+class RespWriter
+{
+public:
+    explicit RespWriter(Buffer *output, int protocol = 2) : output_(output), protocol_(protocol) {}
+
+    Buffer* output() const { return output_; }
+    int protocol() const { return protocol_; }
+
+    void appendSimpleString(const StringPiece &s);
+    void appendOk() { appendSimpleString("OK"); }
+    // message通常以错误类型开头，比如"ERR unknown command"
+    void appendError(const StringPiece &message);
+    void appendInteger(int64_t value);
+    void appendBulkString(const StringPiece &s);
+    void appendNull();
+    void appendBoolean(bool value);
+    void appendDouble(double value);
+    // 聚合类型只写头部，之后依次写count个元素（map是count对键值）
+    void appendArrayHeader(size_t count);
+    void appendMapHeader(size_t count);
+    void appendSetHeader(size_t count);
+    void appendPushHeader(size_t count);
+
+private:
+    void appendLine(char type, const StringPiece &s);
+    void appendPrefixedLength(char type, int64_t value);
+
+    Buffer *output_;
+    int protocol_;
+};
@@ -0,0 +1,199 @@
+#include "RespServer.h"
+#include "Logger.h"
+
+#include <ctype.h>
+
+// 每个连接上的RESP状态，挂在TcpConnection的context上
+struct RespServer::Session
+{
+    Session() : protocol(2), closing(false) {}
+
+    RespParser parser;
+    Buffer output;          // 这一批命令的回复
+    int protocol;           // HELLO协商的协议版本
+    bool closing;           // QUIT或协议错误，回复完当前这一批后关闭连接
+};
+
+static void unknownCommand(const TcpConnectionPtr&, const RespCommand &command, RespWriter *reply)
+{
+    std::string message = "ERR unknown command '";
+    message.append(command.name().data(), command.name().size());
+    message += "'";
+    reply->appendError(message);
+}
+
+static void ping(const TcpConnectionPtr&, const RespCommand &command, RespWriter *reply)
+{
+    if(command.size() > 1)
+    {
+        reply->appendBulkString(command.arg(1));
+    }
+    else
+    {
+        reply->appendSimpleString("PONG");
+    }
+}
+
+static std::string upperName(const StringPiece &name)
+{
+    std::string s(name.data(), name.size());
+    for(char &c : s)
+    {
+        c = static_cast<char>(::toupper(static_cast<unsigned char>(c)));
+    }
+    return s;
+}
+
+RespServer::RespServer(EventLoop *loop,
+    const InetAddress &listenAddr,
+    const std::string &nameArg,
+    TcpServer::Option option)
+    : server_(loop, listenAddr, nameArg, option)
+    , defaultHandler_(unknownCommand)
+    , maxBulkLength_(0)
+{
+    server_.setConnectionCallback(std::bind(&RespServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&RespServer::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    registerCommand("PING", ping);
+}
+
+void RespServer::registerCommand(const std::string &name, const CommandHandler &handler)
+{
+    if(name.size() > kMaxCommandNameLength)
+    {
+        LOG_ERROR("RespServer::registerCommand command name too long \n");
+        return;
+    }
+    handlers_[upperName(name)] = handler;
+}
+
+void RespServer::start()
+{
+    LOG_INFO("RespServer [%s] starts listening, %zu commands \n", server_.name().c_str(), handlers_.size());
+    server_.start();
+}
+
+void RespServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        std::shared_ptr<Session> session = std::make_shared<Session>();
+        if(maxBulkLength_ > 0)
+        {
+            session->parser.setMaxBulkLength(maxBulkLength_);
+        }
+        conn->setContext(session);
+    }
+}
+
+void RespServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    Session *session = static_cast<Session*>(conn->getContext().get());
+    if(session == nullptr || session->closing)
+    {
+        buf->retrieveAll();
+        return;
+    }
+
+    while(!session->closing)
+    {
+        RespParser::ParseResult result = session->parser.parseCommand(buf);
+        if(result == RespParser::kNeedMore)
+        {
+            break;
+        }
+        if(result == RespParser::kError)
+        {
+            std::string message = "ERR Protocol error: ";
+            message += session->parser.error();
+            RespWriter(&session->output, session->protocol).appendError(message);
+            session->closing = true;
+            break;
+        }
+        const RespCommand &command = session->parser.command();
+        // 空数组和空行redis直接忽略
+        if(command.size() > 0)
+        {
+            dispatch(conn, session, command);
+        }
+        session->parser.consume(buf);
+    }
+
+    if(session->closing)
+    {
+        buf->retrieveAll();
+    }
+    if(session->output.readableBytes() > 0)
+    {
+        conn->send(&session->output);
+    }
+    if(session->closing)
+    {
+        conn->shutdown();
+    }
+}
+
+void RespServer::dispatch(const TcpConnectionPtr &conn, Session *session, const RespCommand &command)
+{
+    RespWriter reply(&session->output, session->protocol);
+    const StringPiece &name = command.name();
+    if(name.size() > kMaxCommandNameLength)
+    {
+        defaultHandler_(conn, command, &reply);
+        return;
+    }
+    // 命令名转成大写查表，名字很短，std::string不会分配内存
+    char upper[kMaxCommandNameLength];
+    for(size_t i = 0; i < name.size(); ++i)
+    {
+        upper[i] = static_cast<char>(::toupper(static_cast<unsigned char>(name[i])));
+    }
+    StringPiece key(upper, name.size());
+    if(key == "HELLO")
+    {
+        hello(session, command, &reply);
+        return;
+    }
+    if(key == "QUIT")
+    {
+        reply.appendOk();
+        session->closing = true;
+        return;
+    }
+    auto it = handlers_.find(std::string(upper, name.size()));
+    if(it != handlers_.end())
+    {
+        it->second(conn, command, &reply);
+    }
+    else
+    {
+        defaultHandler_(conn, command, &reply);
+    }
+}
+
+// HELLO [protover]，回复服务器信息，RESP3下是map
+void RespServer::hello(Session *session, const RespCommand &command, RespWriter *reply)
+{
+    if(command.size() > 1)
+    {
+        const StringPiece &version = command.arg(1);
+        if(version == "2" || version == "3")
+        {
+            session->protocol = version[0] - '0';
+        }
+        else
+        {
+            reply->appendError("NOPROTO unsupported protocol version");
+            return;
+        }
+    }
+    RespWriter writer(reply->output(), session->protocol);
+    writer.appendMapHeader(3);
+    writer.appendBulkString("server");
+    writer.appendBulkString("mymuduo");
+    writer.appendBulkString("proto");
+    writer.appendInteger(session->protocol);
+    writer.appendBulkString("mode");
+    writer.appendBulkString("standalone");
+}
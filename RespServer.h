@@ -0,0 +1,56 @@
+#pragma once
+
+#include "TcpServer.h"
+#include "RespCodec.h"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+// 基于TcpServer的RESP(redis协议)服务器，请求解析见RespParser
+// 每次可读事件把inputBuffer_中所有完整的命令依次处理，回复都序列化进同一个缓冲区，
+// 最后一次send发出，流水线深度再大也只有一次写
+// 命令在连接所属的loop线程中同步处理，每条命令恰好写一个回复
+// 内置HELLO（切换RESP2/RESP3）和QUIT，PING默认回复PONG，可以用registerCommand覆盖
+class RespServer : noncopyable
+{
+public:
+    // command的参数指向inputBuffer_，只在回调期间有效；reply按连接协商的协议版本序列化
+    using CommandHandler = std::function<void(const TcpConnectionPtr &conn,
+                                              const RespCommand &command,
+                                              RespWriter *reply)>;
+
+    RespServer(EventLoop *loop,
+               const InetAddress &listenAddr,
+               const std::string &nameArg,
+               TcpServer::Option option = TcpServer::kNoReusePort);
+
+    EventLoop* getLoop() const { return server_.getLoop(); }
+    TcpServer* tcpServer() { return &server_; }
+
+    // 以下在start之前调用，命令表之后只读
+    // 命令名不区分大小写
+    void registerCommand(const std::string &name, const CommandHandler &handler);
+    // 没有注册的命令，默认回复"-ERR unknown command"
+    void setDefaultHandler(const CommandHandler &handler) { defaultHandler_ = handler; }
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    // 见RespParser
+    void setMaxBulkLength(size_t n) { maxBulkLength_ = n; }
+
+    void start();
+
+    static const size_t kMaxCommandNameLength = 32;
+
+private:
+    struct Session;
+
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    void dispatch(const TcpConnectionPtr &conn, Session *session, const RespCommand &command);
+    void hello(Session *session, const RespCommand &command, RespWriter *reply);
+
+    TcpServer server_;
+    std::unordered_map<std::string, CommandHandler> handlers_;      // 键是大写的命令名
+    CommandHandler defaultHandler_;
+    size_t maxBulkLength_;
+};
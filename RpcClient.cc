@@ -0,0 +1,191 @@
+#include "RpcClient.h"
+#include "Logger.h"
+
+RpcClient::RpcClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg)
+    : loop_(loop)
+    , client_(loop, serverAddr, nameArg)
+    , defaultTimeout_(5.0)
+    , maxFrameSize_(RpcCodec::kDefaultMaxFrameSize)
+    , nextId_(1)
+    , flushQueued_(false)
+    , alive_(std::make_shared<bool>(true))
+{
+    client_.setConnectionCallback(std::bind(&RpcClient::onConnection, this, std::placeholders::_1));
+    client_.setMessageCallback(std::bind(&RpcClient::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+RpcClient::~RpcClient()
+{
+    if(connection_)
+    {
+        // TcpClient析构时连接异步关闭，之后的回调不能再指向this
+        connection_->setConnectionCallback([](const TcpConnectionPtr&){});
+        connection_->setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp){ buf->retrieveAll(); });
+    }
+    failAll(RpcStatus(RpcStatus::kDisconnected, "client destroyed"));
+}
+
+void RpcClient::call(const std::string &method, const StringPiece &request, const Callback &cb, double timeout)
+{
+    if(loop_->isInLoopTread())
+    {
+        size_t start = beginCall(method, cb, timeout);
+        output_.append(request.data(), request.size());
+        endCall(start);
+    }
+    else
+    {
+        // 投递期间RpcClient可能已经析构，和析构时还没完成的调用一样失败
+        std::weak_ptr<bool> alive(alive_);
+        std::string data(request.data(), request.size());
+        loop_->runInLoop([this, alive, method, data, cb, timeout](){
+            if(alive.lock())
+            {
+                callInLoop(method, data, cb, timeout);
+            }
+            else
+            {
+                cb(RpcStatus(RpcStatus::kDisconnected, "client destroyed"), StringPiece());
+            }
+        });
+    }
+}
+
+void RpcClient::callInLoop(const std::string &method, const std::string &request, const Callback &cb, double timeout)
+{
+    call(method, request, cb, timeout);
+}
+
+size_t RpcClient::beginCall(const std::string &method, const Callback &cb, double timeout)
+{
+    if(method.size() > 0xFFFF)
+    {
+        LOG_FATAL("RpcClient::call method name too long \n");
+    }
+    uint64_t id = nextId_++;
+    Call &c = calls_[id];
+    c.callback = cb;
+    if(timeout < 0)
+    {
+        timeout = defaultTimeout_;
+    }
+    if(timeout > 0)
+    {
+        c.timer = loop_->runAfter(timeout, std::bind(&RpcClient::onTimeout, this, id));
+    }
+    return RpcCodec::beginRequest(&output_, id, method);
+}
+
+void RpcClient::endCall(size_t start)
+{
+    RpcCodec::finish(&output_, start);
+    // 本轮事件处理中后面的调用继续追加，处理完之后一起发送
+    if(!flushQueued_ && connection_)
+    {
+        flushQueued_ = true;
+        std::weak_ptr<bool> alive(alive_);
+        loop_->queueInLoop([this, alive](){
+            if(alive.lock())
+            {
+                flush();
+            }
+        });
+    }
+}
+
+void RpcClient::flush()
+{
+    flushQueued_ = false;
+    if(connection_ && output_.readableBytes() > 0)
+    {
+        connection_->send(&output_);
+    }
+}
+
+void RpcClient::onTimeout(uint64_t id)
+{
+    auto it = calls_.find(id);
+    if(it == calls_.end())
+    {
+        return;
+    }
+    // 请求可能已经发出，之后到达的回复找不到对应的调用，直接丢弃
+    Callback cb;
+    cb.swap(it->second.callback);
+    calls_.erase(it);
+    cb(RpcStatus(RpcStatus::kTimeout, "deadline exceeded"), StringPiece());
+}
+
+void RpcClient::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        conn->setTcpNoDelay(true);
+        connection_ = conn;
+        // 连接之前缓存的调用
+        flush();
+    }
+    else
+    {
+        connection_.reset();
+        failAll(RpcStatus(RpcStatus::kDisconnected, "connection closed"));
+    }
+    if(connectionCallback_)
+    {
+        connectionCallback_(conn);
+    }
+}
+
+void RpcClient::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    RpcCodec::Frame frame;
+    RpcCodec::ParseResult result;
+    while((result = RpcCodec::parse(buf, &frame, maxFrameSize_)) == RpcCodec::kFrame)
+    {
+        if(frame.type != RpcCodec::kResponse)
+        {
+            result = RpcCodec::kError;
+            break;
+        }
+        auto it = calls_.find(frame.id);
+        if(it != calls_.end())
+        {
+            Callback cb;
+            cb.swap(it->second.callback);
+            loop_->cancel(it->second.timer);
+            calls_.erase(it);
+            if(frame.code == RpcStatus::kOk)
+            {
+                cb(RpcStatus(), frame.payload);
+            }
+            else
+            {
+                cb(RpcStatus(frame.code, std::string(frame.payload.data(), frame.payload.size())), StringPiece());
+            }
+        }
+        RpcCodec::consume(buf, frame);
+    }
+    if(result == RpcCodec::kError)
+    {
+        LOG_ERROR("RpcClient [%s] bad frame from %s \n", client_.name().c_str(), conn->name().c_str());
+        buf->retrieveAll();
+        conn->shutdown();
+    }
+}
+
+void RpcClient::failAll(const RpcStatus &status)
+{
+    output_.retrieveAll();
+    // 回调里可能发起新的调用，先把表换出来
+    std::unordered_map<uint64_t, Call> calls;
+    calls.swap(calls_);
+    for(auto &item : calls)
+    {
+        loop_->cancel(item.second.timer);
+    }
+    for(auto &item : calls)
+    {
+        item.second.callback(status, StringPiece());
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "TcpClient.h"
+#include "RpcCodec.h"
+#include "EventLoop.h"
+#include "TimerId.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// RPC客户端，一个RpcClient对应一条连接，连接上可以同时有任意多个未完成的调用
+// 固定在构造时传入的loop上：连接、回调、deadline定时器都在这个loop线程中，
+// 调用者最好就在这个loop线程里发起调用，这样既不加锁也不跨线程投递；其他线程发起的调用会转到loop线程
+// 同一轮事件处理中发起的调用写进同一个缓冲区，本轮结束时一次发送
+// 连接建立之前发起的调用先缓存，连上后发出；连接断开时未完成的调用以kDisconnected结束
+// 和TcpClient一样，要在loop线程中析构
+class RpcClient : noncopyable
+{
+public:
+    // response指向连接的inputBuffer_，只在回调期间有效；status不是kOk时response为空
+    using Callback = std::function<void(const RpcStatus &status, const StringPiece &response)>;
+
+    RpcClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg);
+    ~RpcClient();
+
+    void connect() { client_.connect(); }
+    void disconnect() { client_.disconnect(); }
+    void enableRetry() { client_.enableRetry(); }
+    EventLoop* getLoop() const { return loop_; }
+    // 连接建立和断开时调用，在loop线程中
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+
+    // 没有指定timeout的调用使用的deadline，单位秒，0表示不限时，默认5秒
+    void setDefaultTimeout(double seconds) { defaultTimeout_ = seconds; }
+    void setMaxFrameSize(size_t n) { maxFrameSize_ = n; }
+
+    // timeout小于0时使用默认值；cb在loop线程中恰好调用一次
+    void call(const std::string &method, const StringPiece &request, const Callback &cb, double timeout = -1);
+    // 类型化的调用，请求直接序列化进发送缓冲区
+    // client.call<PodSerializer, AddRequest, AddResponse>("add", request, cb)
+    template<typename Serializer, typename Req, typename Resp>
+    void call(const std::string &method, const Req &request,
+              const std::function<void(const RpcStatus&, const Resp&)> &cb, double timeout = -1);
+
+    // 还没有完成的调用数，只在loop线程中调用
+    size_t outstanding() const { return calls_.size(); }
+
+private:
+    struct Call
+    {
+        Callback callback;
+        TimerId timer;
+    };
+
+    // 登记调用、写好请求帧头，返回帧的起始位置；之后序列化请求，再调用endCall
+    size_t beginCall(const std::string &method, const Callback &cb, double timeout);
+    void endCall(size_t start);
+    void callInLoop(const std::string &method, const std::string &request, const Callback &cb, double timeout);
+    void flush();
+    void onTimeout(uint64_t id);
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    void failAll(const RpcStatus &status);
+
+    EventLoop *loop_;
+    TcpClient client_;
+    TcpConnectionPtr connection_;
+    ConnectionCallback connectionCallback_;
+    double defaultTimeout_;
+    size_t maxFrameSize_;
+
+    uint64_t nextId_;
+    std::unordered_map<uint64_t, Call> calls_;
+    Buffer output_;             // 还没有发出的请求
+    bool flushQueued_;
+    std::shared_ptr<bool> alive_;  // 排队中的flush和跨线程投递的调用在RpcClient析构之后不再执行
+};
+
+template<typename Serializer, typename Req, typename Resp>
+void RpcClient::call(const std::string &method, const Req &request,
+                     const std::function<void(const RpcStatus&, const Resp&)> &cb, double timeout)
+{
+    Callback wrapped = [cb](const RpcStatus &status, const StringPiece &data){
+        Resp response;
+        if(status.ok() && !Serializer::parse(data, &response))
+        {
+            cb(RpcStatus(RpcStatus::kBadResponse, "parse response fail"), Resp());
+            return;
+        }
+        cb(status, response);
+    };
+    if(loop_->isInLoopTread())
+    {
+        size_t start = beginCall(method, wrapped, timeout);
+        Serializer::serialize(request, &output_);
+        endCall(start);
+    }
+    else
+    {
+        Buffer data;
+        Serializer::serialize(request, &data);
+        call(method, StringPiece(data.peek(), data.readableBytes()), wrapped, timeout);
+    }
+}
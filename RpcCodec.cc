@@ -0,0 +1,121 @@
+#include "RpcCodec.h"
+
+#include <endian.h>
+
+uint64_t RpcCodec::readUint64(const char *p)
+{
+    uint64_t v;
+    ::memcpy(&v, p, sizeof v);
+    return be64toh(v);
+}
+
+uint32_t RpcCodec::readUint32(const char *p)
+{
+    uint32_t v;
+    ::memcpy(&v, p, sizeof v);
+    return be32toh(v);
+}
+
+uint16_t RpcCodec::readUint16(const char *p)
+{
+    uint16_t v;
+    ::memcpy(&v, p, sizeof v);
+    return be16toh(v);
+}
+
+void RpcCodec::appendUint64(Buffer *out, uint64_t v)
+{
+    v = htobe64(v);
+    out->append(reinterpret_cast<const char*>(&v), sizeof v);
+}
+
+void RpcCodec::appendUint32(Buffer *out, uint32_t v)
+{
+    v = htobe32(v);
+    out->append(reinterpret_cast<const char*>(&v), sizeof v);
+}
+
+void RpcCodec::appendUint16(Buffer *out, uint16_t v)
+{
+    v = htobe16(v);
+    out->append(reinterpret_cast<const char*>(&v), sizeof v);
+}
+
+RpcCodec::ParseResult RpcCodec::parse(const Buffer *buf, Frame *frame, size_t maxFrameSize)
+{
+    size_t readable = buf->readableBytes();
+    if(readable < 4)
+    {
+        return kNeedMore;
+    }
+    const char *p = buf->peek();
+    size_t length = readUint32(p);
+    if(length < kHeaderLen - 4 || length > maxFrameSize)
+    {
+        return kError;
+    }
+    if(readable < length + 4)
+    {
+        return kNeedMore;
+    }
+
+    uint8_t type = static_cast<uint8_t>(p[4]);
+    if(type != kRequest && type != kResponse)
+    {
+        return kError;
+    }
+    frame->type = static_cast<Type>(type);
+    frame->id = readUint64(p + 5);
+    frame->code = readUint16(p + 13);
+    frame->size = length + 4;
+
+    const char *body = p + kHeaderLen;
+    size_t bodyLen = length + 4 - kHeaderLen;
+    if(frame->type == kRequest)
+    {
+        size_t methodLen = static_cast<size_t>(frame->code);
+        if(methodLen > bodyLen)
+        {
+            return kError;
+        }
+        frame->method.set(body, methodLen);
+        frame->payload.set(body + methodLen, bodyLen - methodLen);
+        frame->code = 0;
+    }
+    else
+    {
+        frame->method.clear();
+        frame->payload.set(body, bodyLen);
+    }
+    return kFrame;
+}
+
+size_t RpcCodec::beginRequest(Buffer *out, uint64_t id, const StringPiece &method)
+{
+    size_t start = out->readableBytes();
+    appendUint32(out, 0);
+    char type = static_cast<char>(kRequest);
+    out->append(&type, 1);
+    appendUint64(out, id);
+    appendUint16(out, static_cast<uint16_t>(method.size()));
+    out->append(method.data(), method.size());
+    return start;
+}
+
+size_t RpcCodec::beginResponse(Buffer *out, uint64_t id, int code)
+{
+    size_t start = out->readableBytes();
+    appendUint32(out, 0);
+    char type = static_cast<char>(kResponse);
+    out->append(&type, 1);
+    appendUint64(out, id);
+    appendUint16(out, static_cast<uint16_t>(code));
+    return start;
+}
+
+void RpcCodec::finish(Buffer *out, size_t start)
+{
+    // 扩容或者整理空间时可读数据整体移动，相对于可读起点的偏移不变
+    uint32_t length = htobe32(static_cast<uint32_t>(out->readableBytes() - start - 4));
+    ::memcpy(out->beginRead() + start, &length, sizeof length);
+}
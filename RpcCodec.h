@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Buffer.h"
+#include "StringPiece.h"
+
+#include <string>
+#include <type_traits>
+#include <stdint.h>
+#include <string.h>
+
+// RPC调用的结果，kOk之外的code都带一段说明
+// 100以下是框架使用的错误，应用自定义的错误从kUserError开始
+class RpcStatus
+{
+public:
+    enum Code
+    {
+        kOk = 0,
+        kTimeout = 1,           // 超过deadline还没有收到回复
+        kDisconnected = 2,      // 连接断开时还没有收到回复
+        kNoMethod = 3,          // 服务端没有注册这个方法
+        kBadRequest = 4,        // 服务端解析请求失败
+        kBadResponse = 5,       // 客户端解析回复失败
+        kUserError = 100,
+    };
+
+    RpcStatus() : code_(kOk) {}
+    RpcStatus(int code, const std::string &message) : code_(code), message_(message) {}
+
+    bool ok() const { return code_ == kOk; }
+    int code() const { return code_; }
+    const std::string& message() const { return message_; }
+
+private:
+    int code_;
+    std::string message_;
+};
+
+// 长度前缀的RPC帧，整数都是网络字节序
+//   | length u32 | type u8 | id u64 | code u16 | method | payload |
+// length是它后面的字节数；请求的code是method的长度，回复没有method，code是RpcStatus::Code，
+// 出错时payload是错误说明
+// 一条连接上的请求用id区分，回复可以乱序，客户端按id找到对应的调用
+class RpcCodec
+{
+public:
+    enum Type
+    {
+        kRequest = 1,
+        kResponse = 2,
+    };
+
+    static const size_t kHeaderLen = 4 + 1 + 8 + 2;
+    static const size_t kDefaultMaxFrameSize = 64 * 1024 * 1024;
+
+    enum ParseResult
+    {
+        kNeedMore,
+        kFrame,         // 下面的字段可用，处理完后调用consume
+        kError,         // 帧格式错误或者超过maxFrameSize，连接应当关闭
+    };
+
+    // 解析出的一帧，method和payload指向buf中的数据，consume之前有效
+    struct Frame
+    {
+        Type type;
+        uint64_t id;
+        int code;
+        StringPiece method;
+        StringPiece payload;
+        size_t size;
+    };
+
+    static ParseResult parse(const Buffer *buf, Frame *frame, size_t maxFrameSize = kDefaultMaxFrameSize);
+    static void consume(Buffer *buf, const Frame &frame) { buf->retrieve(frame.size); }
+
+    // 在out后面写帧头，返回帧的起始位置；之后把payload直接序列化到out中，再调用finish补上长度
+    // 这样序列化的结果不需要先放进临时的string
+    static size_t beginRequest(Buffer *out, uint64_t id, const StringPiece &method);
+    static size_t beginResponse(Buffer *out, uint64_t id, int code);
+    static void finish(Buffer *out, size_t start);
+
+    static uint64_t readUint64(const char *p);
+    static uint32_t readUint32(const char *p);
+    static uint16_t readUint16(const char *p);
+    static void appendUint64(Buffer *out, uint64_t v);
+    static void appendUint32(Buffer *out, uint32_t v);
+    static void appendUint16(Buffer *out, uint16_t v);
+};
+
+// 可插拔的序列化：序列化器是一个提供下面两个静态函数模板（或重载）的类型
+//   static void serialize(const T &value, Buffer *out);     // 追加到out后面
+//   static bool parse(const StringPiece &data, T *value);    // 失败返回false
+// RpcServer/RpcClient的类型化接口用模板参数指定序列化器，比如包装protobuf的
+// SerializeToArray/ParseFromArray，框架本身只传递字节
+
+// 原样传递std::string，发送时也接受StringPiece
+struct StringSerializer
+{
+    static void serialize(const std::string &value, Buffer *out)
+    {
+        out->append(value.data(), value.size());
+    }
+    static void serialize(const StringPiece &value, Buffer *out)
+    {
+        out->append(value.data(), value.size());
+    }
+    static bool parse(const StringPiece &data, std::string *value)
+    {
+        value->assign(data.data(), data.size());
+        return true;
+    }
+};
+
+// 平凡可拷贝的结构体按内存布局直接拷贝，只适合两端是同一种机器和编译器的服务间调用
+struct PodSerializer
+{
+    template<typename T>
+    static void serialize(const T &value, Buffer *out)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "PodSerializer needs trivially copyable type");
+        out->append(reinterpret_cast<const char*>(&value), sizeof value);
+    }
+    template<typename T>
+    static bool parse(const StringPiece &data, T *value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "PodSerializer needs trivially copyable type");
+        if(data.size() != sizeof(T))
+        {
+            return false;
+        }
+        ::memcpy(value, data.data(), sizeof(T));
+        return true;
+    }
+};
@@ -0,0 +1,149 @@
+#include "RpcServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+// 每个连接上的状态，挂在TcpConnection的context上，只在loop线程中访问
+struct RpcServer::Session
+{
+    Session() : dispatching(false), flushQueued(false) {}
+
+    Buffer output;          // 还没有发出的回复
+    bool dispatching;       // 正在onMessage中处理请求，结束时统一发送
+    bool flushQueued;       // 已经安排了一次flushReplies
+};
+
+RpcServer::RpcServer(EventLoop *loop,
+    const InetAddress &listenAddr,
+    const std::string &nameArg,
+    TcpServer::Option option)
+    : server_(loop, listenAddr, nameArg, option)
+    , maxFrameSize_(RpcCodec::kDefaultMaxFrameSize)
+{
+    server_.setConnectionCallback(std::bind(&RpcServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&RpcServer::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void RpcServer::registerMethod(const std::string &name, const Method &method)
+{
+    if(name.size() > 0xFFFF)
+    {
+        LOG_ERROR("RpcServer::registerMethod method name too long \n");
+        return;
+    }
+    methods_[name] = method;
+}
+
+void RpcServer::start()
+{
+    LOG_INFO("RpcServer [%s] starts listening, %zu methods \n", server_.name().c_str(), methods_.size());
+    server_.start();
+}
+
+void RpcServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        // 回复很小，不能让Nagle等对端的ACK
+        conn->setTcpNoDelay(true);
+        conn->setContext(std::make_shared<Session>());
+    }
+}
+
+void RpcServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    Session *session = static_cast<Session*>(conn->getContext().get());
+    if(session == nullptr)
+    {
+        buf->retrieveAll();
+        return;
+    }
+
+    session->dispatching = true;
+    RpcCodec::Frame frame;
+    RpcCodec::ParseResult result;
+    while((result = RpcCodec::parse(buf, &frame, maxFrameSize_)) == RpcCodec::kFrame)
+    {
+        if(frame.type != RpcCodec::kRequest)
+        {
+            result = RpcCodec::kError;
+            break;
+        }
+        Responder responder(conn, frame.id);
+        auto it = methods_.find(std::string(frame.method.data(), frame.method.size()));
+        if(it == methods_.end())
+        {
+            responder.fail(RpcStatus::kNoMethod, "no such method");
+        }
+        else
+        {
+            it->second(frame.payload, responder);
+        }
+        RpcCodec::consume(buf, frame);
+    }
+    session->dispatching = false;
+
+    if(session->output.readableBytes() > 0)
+    {
+        conn->send(&session->output);
+    }
+    if(result == RpcCodec::kError)
+    {
+        LOG_ERROR("RpcServer [%s] bad frame from %s \n", server_.name().c_str(), conn->name().c_str());
+        buf->retrieveAll();
+        conn->shutdown();
+    }
+}
+
+Buffer* RpcServer::batchOutput(const TcpConnectionPtr &conn)
+{
+    if(!conn->getLoop()->isInLoopTread())
+    {
+        return nullptr;
+    }
+    Session *session = static_cast<Session*>(conn->getContext().get());
+    if(session == nullptr)
+    {
+        return nullptr;
+    }
+    // 定时器或者其他连接的回调里产生的回复，等这一轮事件处理完再一起发送
+    if(!session->dispatching && !session->flushQueued)
+    {
+        session->flushQueued = true;
+        conn->getLoop()->queueInLoop(std::bind(&RpcServer::flushReplies, conn));
+    }
+    return &session->output;
+}
+
+void RpcServer::flushReplies(const TcpConnectionPtr &conn)
+{
+    Session *session = static_cast<Session*>(conn->getContext().get());
+    session->flushQueued = false;
+    if(session->output.readableBytes() > 0)
+    {
+        conn->send(&session->output);
+    }
+}
+
+void RpcServer::Responder::reply(const StringPiece &response) const
+{
+    reply<StringSerializer>(response);
+}
+
+void RpcServer::Responder::fail(int code, const StringPiece &message) const
+{
+    auto encode = [&](Buffer *out){
+        size_t start = RpcCodec::beginResponse(out, id_, code);
+        out->append(message.data(), message.size());
+        RpcCodec::finish(out, start);
+    };
+    Buffer *batch = RpcServer::batchOutput(conn_);
+    if(batch != nullptr)
+    {
+        encode(batch);
+        return;
+    }
+    Buffer scratch;
+    encode(&scratch);
+    conn_->send(&scratch);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "TcpServer.h"
+#include "RpcCodec.h"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+// 基于TcpServer的RPC服务端，帧格式见RpcCodec
+// 一条连接上可以同时有多个请求，每个请求带自己的id；方法可以同步回复，也可以保存Responder之后
+// 在任意线程回复，所以回复的顺序和请求的顺序无关
+// 一次可读事件中解析出的所有请求，在loop线程中同步产生的回复都写进同一个缓冲区，最后一次性发送
+class RpcServer : noncopyable
+{
+public:
+    // 回复一个请求的句柄，可以拷贝，应当恰好回复一次；连接已经断开时回复被丢弃
+    class Responder
+    {
+    public:
+        Responder(const TcpConnectionPtr &conn, uint64_t id) : conn_(conn), id_(id) {}
+
+        void reply(const StringPiece &response) const;
+        // 用Serializer把response直接序列化进发送缓冲区
+        template<typename Serializer, typename T>
+        void reply(const T &response) const;
+        void fail(int code, const StringPiece &message) const;
+
+        const TcpConnectionPtr& connection() const { return conn_; }
+        uint64_t id() const { return id_; }
+
+    private:
+        TcpConnectionPtr conn_;
+        uint64_t id_;
+    };
+
+    // request指向连接的inputBuffer_，只在回调期间有效，异步处理时需要自己拷贝
+    using Method = std::function<void(const StringPiece &request, const Responder &responder)>;
+
+    RpcServer(EventLoop *loop,
+              const InetAddress &listenAddr,
+              const std::string &nameArg,
+              TcpServer::Option option = TcpServer::kNoReusePort);
+
+    EventLoop* getLoop() const { return server_.getLoop(); }
+    TcpServer* tcpServer() { return &server_; }
+
+    // 以下在start之前调用，方法表之后只读，各个loop不加锁查找
+    void registerMethod(const std::string &name, const Method &method);
+    // 类型化的同步方法：请求用Serializer解析，handler填好回复后立即发送
+    // server.registerMethod<AddRequest, AddResponse, PodSerializer>("add", handler)
+    template<typename Req, typename Resp, typename Serializer>
+    void registerMethod(const std::string &name, const std::function<void(const Req&, Resp*)> &handler);
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    // 默认64MB，超过的帧按协议错误关闭连接
+    void setMaxFrameSize(size_t n) { maxFrameSize_ = n; }
+
+    void start();
+
+private:
+    struct Session;
+
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // loop线程中返回连接的批量发送缓冲区，不在onMessage中时安排一次flush；其他线程返回nullptr
+    static Buffer* batchOutput(const TcpConnectionPtr &conn);
+    static void flushReplies(const TcpConnectionPtr &conn);
+
+    TcpServer server_;
+    std::unordered_map<std::string, Method> methods_;
+    size_t maxFrameSize_;
+};
+
+template<typename Serializer, typename T>
+void RpcServer::Responder::reply(const T &response) const
+{
+    auto encode = [&](Buffer *out){
+        size_t start = RpcCodec::beginResponse(out, id_, RpcStatus::kOk);
+        Serializer::serialize(response, out);
+        RpcCodec::finish(out, start);
+    };
+    Buffer *batch = RpcServer::batchOutput(conn_);
+    if(batch != nullptr)
+    {
+        encode(batch);
+        return;
+    }
+    Buffer scratch;
+    encode(&scratch);
+    conn_->send(&scratch);
+}
+
+template<typename Req, typename Resp, typename Serializer>
+void RpcServer::registerMethod(const std::string &name, const std::function<void(const Req&, Resp*)> &handler)
+{
+    registerMethod(name, [handler](const StringPiece &data, const Responder &responder){
+        Req request;
+        if(!Serializer::parse(data, &request))
+        {
+            responder.fail(RpcStatus::kBadRequest, "parse request fail");
+            return;
+        }
+        Resp response;
+        handler(request, &response);
+        responder.reply<Serializer>(response);
+    });
+}
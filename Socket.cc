@@ -3,6 +3,7 @@
 #include "InetAddress.h"
 
 #include <unistd.h>
+#include <errno.h>
 #include <sys/types.h>          
 #include <sys/socket.h>
 #include <strings.h>
@@ -16,7 +17,7 @@ Socket::~Socket()
 
 void Socket::bindAddress( const InetAddress &localaddr)
 {
-    if(0 != ::bind(sockfd_, (sockaddr*)localaddr.getSockAddr(), sizeof(sockaddr_in)))
+    if(0 != ::bind(sockfd_, localaddr.getSockAddr(), localaddr.getSockAddrLen()))
     {
         LOG_FATAL("bind sockfd:%d fail\n", sockfd_);
     }
@@ -32,14 +33,14 @@ void Socket::listen()
 
 int Socket::accept(InetAddress *peeraddr)
 {
-    sockaddr_in addr;
+    sockaddr_storage addr;
     socklen_t len = sizeof addr;
     bzero(&addr, sizeof addr);
     int connfd = ::accept4(sockfd_, (sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if(connfd >= 0)
     {
         // 有效
-        peeraddr->setSockAddr(addr);
+        peeraddr->setSockAddr((sockaddr*)&addr, len);
     }
     return connfd;
 }
@@ -69,8 +70,23 @@ void Socket::setReusePort(bool on)
     ::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof optval);
 }
 
+void Socket::setV6Only(bool on)
+{
+    int optval = on ? 1 : 0;
+    ::setsockopt(sockfd_, IPPROTO_IPV6, IPV6_V6ONLY, &optval, sizeof optval);
+}
+
 void Socket::setKeepAlive(bool on)
 {
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof optval);
-}
\ No newline at end of file
+}
+bool Socket::setBusyPoll(int usec)
+{
+    if(::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof usec) < 0)
+    {
+        LOG_ERROR("sockfd:%d setsockopt SO_BUSY_POLL %d err:%d \n", sockfd_, usec, errno);
+        return false;
+    }
+    return true;
+}
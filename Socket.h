@@ -24,6 +24,11 @@ public:
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    // IPV6_V6ONLY，关闭时监听"::"的IPv6 socket也接受IPv4连接（对端地址是::ffff:a.b.c.d）
+    void setV6Only(bool on);
+    // SO_BUSY_POLL，读这个socket时在驱动的接收队列上忙等usec微秒
+    // 超过sysctl net.core.busy_read时需要CAP_NET_ADMIN，失败返回false
+    bool setBusyPoll(int usec);
 private:
     const int sockfd_;
 };
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <string.h>
+#include <strings.h>
+#include <ostream>
+
+// 指向一段外部内存的只读字符串，不拥有数据，拷贝只复制指针和长度
+// 库按C++11编译，没有std::string_view，接口和它保持一致
+// 数据的生命周期由使用者保证，比如HttpRequest里的字段只在回调期间有效
+class StringPiece
+{
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    StringPiece() : ptr_(nullptr), length_(0) {}
+    StringPiece(const char *str) : ptr_(str), length_(::strlen(str)) {}
+    StringPiece(const char *ptr, size_t len) : ptr_(ptr), length_(len) {}
+    StringPiece(const std::string &str) : ptr_(str.data()), length_(str.size()) {}
+
+    const char* data() const { return ptr_; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    const char* begin() const { return ptr_; }
+    const char* end() const { return ptr_ + length_; }
+    char operator[](size_t i) const { return ptr_[i]; }
+
+    void clear() { ptr_ = nullptr; length_ = 0; }
+    void set(const char *ptr, size_t len) { ptr_ = ptr; length_ = len; }
+    void removePrefix(size_t n) { ptr_ += n; length_ -= n; }
+    void removeSuffix(size_t n) { length_ -= n; }
+
+    StringPiece substr(size_t pos, size_t n = npos) const
+    {
+        if(pos > length_)
+        {
+            pos = length_;
+        }
+        if(n > length_ - pos)
+        {
+            n = length_ - pos;
+        }
+        return StringPiece(ptr_ + pos, n);
+    }
+
+    size_t find(char c, size_t pos = 0) const
+    {
+        if(pos >= length_)
+        {
+            return npos;
+        }
+        const void *p = ::memchr(ptr_ + pos, c, length_ - pos);
+        return p == nullptr ? npos : static_cast<const char*>(p) - ptr_;
+    }
+
+    bool startsWith(const StringPiece &x) const
+    {
+        return length_ >= x.length_ && ::memcmp(ptr_, x.ptr_, x.length_) == 0;
+    }
+
+    // HTTP头部的名字和一些取值不区分大小写
+    bool equalsIgnoreCase(const StringPiece &x) const
+    {
+        return length_ == x.length_ && ::strncasecmp(ptr_, x.ptr_, length_) == 0;
+    }
+
+    // 去掉首尾的空格和tab
+    StringPiece trimmed() const
+    {
+        size_t b = 0;
+        size_t e = length_;
+        while(b < e && (ptr_[b] == ' ' || ptr_[b] == '\t'))
+        {
+            ++b;
+        }
+        while(e > b && (ptr_[e - 1] == ' ' || ptr_[e - 1] == '\t'))
+        {
+            --e;
+        }
+        return StringPiece(ptr_ + b, e - b);
+    }
+
+    int compare(const StringPiece &x) const
+    {
+        int r = ::memcmp(ptr_, x.ptr_, length_ < x.length_ ? length_ : x.length_);
+        if(r == 0)
+        {
+            if(length_ < x.length_) r = -1;
+            else if(length_ > x.length_) r = 1;
+        }
+        return r;
+    }
+
+    bool operator==(const StringPiece &x) const
+    {
+        return length_ == x.length_ && ::memcmp(ptr_, x.ptr_, length_) == 0;
+    }
+    bool operator!=(const StringPiece &x) const { return !(*this == x); }
+    bool operator<(const StringPiece &x) const { return compare(x) < 0; }
+
+    std::string asString() const { return std::string(ptr_, length_); }
+
+private:
+    const char *ptr_;
+    size_t length_;
+};
+
+inline std::ostream& operator<<(std::ostream &os, const StringPiece &piece)
+{
+    return os.write(piece.data(), piece.size());
+}
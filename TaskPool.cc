@@ -0,0 +1,159 @@
+#include "TaskPool.h"
+#include "Logger.h"
+
+// 当前worker线程所属的pool和编号，在worker里提交任务时直接放进自己的队列
+static __thread TaskPool *t_pool = nullptr;
+static __thread size_t t_workerIndex = 0;
+
+TaskPool::TaskPool(const std::string &name)
+    : name_(name)
+    , numThreads_(0)
+    , running_(false)
+    , nextWorker_(0)
+    , pending_(0)
+    , steals_(0)
+    , idle_(0)
+{
+}
+
+TaskPool::~TaskPool()
+{
+    stop();
+}
+
+void TaskPool::start()
+{
+    if(running_ || numThreads_ <= 0)
+    {
+        return;
+    }
+    running_ = true;
+    for(int i = 0; i < numThreads_; ++i)
+    {
+        workers_.emplace_back(new Worker);
+    }
+    for(int i = 0; i < numThreads_; ++i)
+    {
+        workers_[i]->thread.reset(new Thread(std::bind(&TaskPool::workerFunc, this, i), name_ + std::to_string(i)));
+        workers_[i]->thread->start();
+    }
+}
+
+void TaskPool::stop()
+{
+    if(!running_.exchange(false))
+    {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(idleMutex_);
+        idleCond_.notify_all();
+    }
+    for(auto &worker : workers_)
+    {
+        worker->thread->join();
+    }
+}
+
+void TaskPool::runInConnectionLoop(const TcpConnectionPtr &conn, Task cb)
+{
+    conn->getLoop()->queueInLoop([conn, cb]() {
+        if(!conn->getLoop()->isInLoopTread())
+        {
+            runInConnectionLoop(conn, cb);
+            return;
+        }
+        cb();
+    });
+}
+
+void TaskPool::run(Task task)
+{
+    if(!running_)
+    {
+        // 没有启动或者已经停止时直接在调用线程中执行
+        task();
+        return;
+    }
+    // 先计数再入队，worker取走任务时pending_不会减到负数
+    pending_.fetch_add(1);
+    size_t index = t_pool == this
+        ? t_workerIndex
+        : nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    {
+        std::unique_lock<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    // 先增加pending_再读idle_，和worker中先增加idle_再读pending_配对，不会漏掉唤醒
+    if(idle_.load() > 0)
+    {
+        std::unique_lock<std::mutex> lock(idleMutex_);
+        idleCond_.notify_one();
+    }
+}
+
+// 自己的队列从尾部取，最近提交的任务数据还在cache里
+bool TaskPool::popLocal(size_t index, Task *task)
+{
+    Worker &worker = *workers_[index];
+    std::unique_lock<std::mutex> lock(worker.mutex);
+    if(worker.tasks.empty())
+    {
+        return false;
+    }
+    *task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+// 从其他worker队列的头部偷，和队列主人在尾部的操作错开
+bool TaskPool::steal(size_t index, Task *task)
+{
+    for(size_t i = 1; i < workers_.size(); ++i)
+    {
+        Worker &victim = *workers_[(index + i) % workers_.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if(!lock.owns_lock() || victim.tasks.empty())
+        {
+            continue;
+        }
+        *task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        steals_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void TaskPool::workerFunc(size_t index)
+{
+    t_pool = this;
+    t_workerIndex = index;
+    Task task;
+    while(true)
+    {
+        if(popLocal(index, &task) || steal(index, &task))
+        {
+            pending_.fetch_sub(1);
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        // try_lock失败的队列，或者计数之后还没有入队的任务，pending_不为0时再试一轮
+        if(pending_.load() > 0)
+        {
+            continue;
+        }
+        // 停止时把已经提交的任务做完再退出
+        if(!running_)
+        {
+            break;
+        }
+        std::unique_lock<std::mutex> lock(idleMutex_);
+        idle_.fetch_add(1);
+        idleCond_.wait(lock, [this](){ return pending_.load() > 0 || !running_; });
+        idle_.fetch_sub(1);
+    }
+    LOG_DEBUG("TaskPool %s worker %lu exit, steals %lu \n", name_.c_str(), index, steals_.load());
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+#include "Callbacks.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <utility>
+#include <type_traits>
+
+// 计算线程池：把解析、压缩、加解密等耗CPU的工作从io loop中移出去
+// 每个worker一个双端队列，worker从自己队列的尾部取任务，空闲时从其他worker队列的头部偷任务
+// 外部线程提交的任务轮流放进各个worker的队列，worker里提交的任务放进自己的队列，没有全局的队列锁
+//
+// 典型用法，在MessageCallback里：
+//   pool.runForConnection(conn, [req](){ return handle(req); },
+//       [](const TcpConnectionPtr &conn, std::string reply){ conn->send(reply); });
+class TaskPool : noncopyable
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit TaskPool(const std::string &name = std::string("TaskPool"));
+    ~TaskPool();
+
+    // 在start之前设置
+    void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+    void start();
+    // 等已经提交的任务执行完后退出worker线程，析构时自动调用
+    // 调用之前要保证其他线程不再提交任务
+    void stop();
+
+    // 没有启动或者已经停止时直接在调用线程中执行task
+    void run(Task task);
+
+    // 在worker中执行task，然后回到loop线程中用task的返回值调用then，task必须有返回值
+    template <typename Func, typename Then>
+    void runInPool(EventLoop *loop, Func task, Then then)
+    {
+        using Result = typename std::decay<decltype(task())>::type;
+        run([loop, task, then]() mutable {
+            std::shared_ptr<Result> result = std::make_shared<Result>(task());
+            loop->queueInLoop([then, result]() mutable { then(std::move(*result)); });
+        });
+    }
+
+    // 同上，任务执行期间持有conn，then在conn当前所在的loop中执行
+    // 排队期间连接迁移了会转发到新的loop，then总是在conn所属的loop线程中执行
+    // then的参数是(const TcpConnectionPtr&, 返回值)，连接可能已经断开，需要时检查conn->connected()
+    // 同一个连接同时有多个任务时，then的执行顺序不保证和提交顺序一致
+    template <typename Func, typename Then>
+    void runForConnection(const TcpConnectionPtr &conn, Func task, Then then)
+    {
+        using Result = typename std::decay<decltype(task())>::type;
+        run([conn, task, then]() mutable {
+            std::shared_ptr<Result> result = std::make_shared<Result>(task());
+            runInConnectionLoop(conn, [conn, then, result]() mutable { then(conn, std::move(*result)); });
+        });
+    }
+
+    size_t pendingTasks() const { return pending_.load(std::memory_order_relaxed); }
+    uint64_t steals() const { return steals_.load(std::memory_order_relaxed); }
+    const std::string& name() const { return name_; }
+
+private:
+    // 每个worker的队列单独加锁，前后各填充一个cache line，避免相邻队列的锁互相干扰
+    // 不用alignas：C++11的new不保证超过16字节的对齐
+    struct Worker
+    {
+        char padBefore[64];
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::unique_ptr<Thread> thread;
+        char padAfter[64];
+    };
+
+    // 在conn的loop中执行cb，执行时发现连接已经迁走就再转发一次
+    static void runInConnectionLoop(const TcpConnectionPtr &conn, Task cb);
+
+    void workerFunc(size_t index);
+    bool popLocal(size_t index, Task *task);
+    bool steal(size_t index, Task *task);
+
+    std::string name_;
+    int numThreads_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic_bool running_;
+    std::atomic<size_t> nextWorker_;    // 外部提交时轮流选择的队列
+    std::atomic<size_t> pending_;       // 所有队列中的任务数
+    std::atomic<uint64_t> steals_;
+
+    // 只在没有任务可做时使用：worker在这里睡眠，提交任务时如果有睡眠的worker才去唤醒
+    std::mutex idleMutex_;
+    std::condition_variable idleCond_;
+    std::atomic_int idle_;
+};
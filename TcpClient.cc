@@ -0,0 +1,129 @@
+#include "TcpClient.h"
+#include "Connector.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <strings.h>
+#include <sys/socket.h>
+
+static EventLoop* CheckLoopNotNull(EventLoop *loop)
+{
+    if(loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d TcpClient loop is null! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+static InetAddress getLocalAddr(int sockfd)
+{
+    sockaddr_storage local;
+    ::bzero(&local, sizeof local);
+    socklen_t addrlen = sizeof local;
+    if(::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+    return InetAddress((sockaddr*)&local, addrlen);
+}
+
+// TcpClient已经析构之后，连接关闭时由它来销毁连接
+static void removeConnectionAfterClient(EventLoop *loop, const TcpConnectionPtr &conn)
+{
+    loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
+TcpClient::TcpClient(EventLoop *loop,
+    const InetAddress &serverAddr,
+    const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , connector_(new Connector(loop, serverAddr))
+    , name_(nameArg)
+    , connNamePrefix_(std::make_shared<const std::string>(nameArg + "-" + serverAddr.toIpPort()))
+    , retry_(false)
+    , connect_(false)
+    , nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(
+        std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+}
+
+TcpClient::~TcpClient()
+{
+    TcpConnectionPtr conn;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        conn = connection_;
+    }
+    if(conn)
+    {
+        // 连接可能比TcpClient活得久，关闭回调不能再指向this
+        conn->setCloseCallback(std::bind(removeConnectionAfterClient, loop_, std::placeholders::_1));
+        conn->forceClose();
+    }
+    else
+    {
+        connector_->stop();
+    }
+}
+
+void TcpClient::connect()
+{
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(connection_)
+    {
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    InetAddress peerAddr(connector_->serverAddress());
+    TcpConnectionPtr conn(new TcpConnection(loop_,
+                                            nextConnId_++,
+                                            connNamePrefix_,
+                                            sockfd,
+                                            getLocalAddr(sockfd),
+                                            peerAddr));
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(std::bind(&TcpClient::removeConnection, this, std::placeholders::_1));
+    if(tlsContext_)
+    {
+        conn->startTls(tlsContext_, tlsServerName_);
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if(retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::removeConnection [%s] - reconnecting to %s \n",
+            name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+        connector_->restart();
+    }
+}
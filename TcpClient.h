@@ -0,0 +1,74 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+#include "TcpConnection.h"
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+class Connector;
+class EventLoop;
+class TlsContext;
+
+// 客户端，和TcpServer对应，一个TcpClient同时最多只有一个连接
+// 连接和TcpClient都属于构造时传入的loop，TcpClient要在loop线程中析构
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop,
+            const InetAddress &serverAddr,
+            const std::string &nameArg);
+    ~TcpClient();
+
+    void connect();
+    // 关闭写端，等待对端关闭连接
+    void disconnect();
+    // 停止还没有完成的连接
+    void stop();
+
+    TcpConnectionPtr connection() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop* getLoop() const { return loop_; }
+    const std::string& name() const { return name_; }
+
+    // 连接断开后自动重连
+    void enableRetry() { retry_ = true; }
+    bool retry() const { return retry_; }
+
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    // 之后的连接都使用TLS，serverName用于SNI；多个TcpClient共享一个TlsContext时重连可以恢复会话
+    void setTlsContext(const std::shared_ptr<TlsContext> &context, const std::string &serverName = std::string())
+    { tlsContext_ = context; tlsServerName_ = serverName; }
+
+private:
+    void newConnection(int sockfd);
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    std::shared_ptr<Connector> connector_;
+    const std::string name_;
+    std::shared_ptr<const std::string> connNamePrefix_;
+
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    std::shared_ptr<TlsContext> tlsContext_;
+    std::string tlsServerName_;
+
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    uint64_t nextConnId_;       // 只在loop线程中访问
+
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_;
+};
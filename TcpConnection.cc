@@ -3,6 +3,10 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "TlsSession.h"
+#include "Compression.h"
+#include "ConnectionFilter.h"
+#include "RateLimiter.h"
 
 #include <functional>
 #include <errno.h>
@@ -10,7 +14,13 @@
 #include <sys/socket.h>
 #include <strings.h>
 #include <netinet/tcp.h>
+#include <sys/uio.h>
 #include <string>
+#include <algorithm>
+#include <stdint.h>
+
+// 写限速时攒够这么多额度（或者全部待发送的数据）再写，避免定时器每次只放出几个字节
+static const size_t kMinRateLimitedWrite = 16 * 1024;
 
 static EventLoop* CheckLoopNotNull(EventLoop* loop)
 {
@@ -22,54 +32,111 @@ static EventLoop* CheckLoopNotNull(EventLoop* loop)
 }
 
 TcpConnection::TcpConnection(EventLoop *loop,
-                        const std::string &nameArg,
+                        uint64_t id,
+                        const std::shared_ptr<const std::string> &namePrefix,
                         int sockfd,
                         const InetAddress &localAddr,
                         const InetAddress &peerAddr)
     : loop_(CheckLoopNotNull(loop))
-    , name_(nameArg)
+    , id_(id)
+    , namePrefix_(namePrefix)
     , state_(kConnecting)
     , reading_(true)
     , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
+    , channel_(createChannel(loop, sockfd))
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
     , highWaterMark_(64 * 1024 * 1024)      // 64 M
+    , queuedHead_(0)
+    , queuedPayloadBytes_(0)
+    , busyMicros_(0)
+    , flowHighWaterMark_(0)
+    , flowLowWaterMark_(0)
+    , inputLimit_(0)
+    , outputThrottled_(false)
+    , inputThrottled_(false)
+    , draining_(false)
+    , requestPending_(false)
+    , readRateThrottled_(false)
+    , writeRateThrottled_(false)
 {
-    // 下面给Channel设置相应的回调函数
-    // poller给channel通知感兴趣的事件发生了，channel会回调相应的操作函数
-    channel_->setReadCallback(
+    LOG_DEBUG("TcpConnection::ctor[#%lu] at fd=%d\n", id_, sockfd);
+    socket_->setKeepAlive(true);
+    
+}
+
+// 创建fd对应的channel，并设置相应的回调函数
+// poller给channel通知感兴趣的事件发生了，channel会回调相应的操作函数
+Channel* TcpConnection::createChannel(EventLoop *loop, int sockfd)
+{
+    Channel *channel = new Channel(loop, sockfd);
+    channel->setDescribeCallback([this](){ return name(); });
+    channel->setReadCallback(
         std::bind(&TcpConnection::handleRead, this, std::placeholders::_1)
     );
-    channel_->setWriteCallback(
+    channel->setWriteCallback(
         std::bind(&TcpConnection::handleWrite, this)
     );
-    channel_->setCloseCallback(
+    channel->setCloseCallback(
         std::bind(&TcpConnection::handleClose, this)
     );
-    channel_->setErrorCallback(
+    channel->setErrorCallback(
         std::bind(&TcpConnection::handleError, this)
     );
-
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
-    
+    return channel;
 }
 
 TcpConnection::~TcpConnection()
 {
-    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n",
-        name_.c_str(), channel_->fd(), (int)state_);
+    LOG_DEBUG("TcpConnection::dtor[#%lu] at fd=%d state=%d \n",
+        id_, channel_->fd(), (int)state_);
+}
+
+const std::string& TcpConnection::name() const
+{
+    std::call_once(nameOnce_, [this](){
+        char buf[32] = {0};
+        snprintf(buf, sizeof buf, "#%lu", id_);
+        name_ = *namePrefix_ + buf;
+    });
+    return name_;
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    // 开启TLS时socket上读到的是密文，有处理入站数据的filter时读进第一级的缓冲区，解密、经过各级之后才放进inputBuffer_
+    Buffer *readBuffer = tls_ ? tls_->cipherInput()
+                              : filters_ ? filters_->inputBuffer() : &inputBuffer_;
+    ssize_t n = readBuffer->readFd(channel_->fd(), &savedErrno);
     if (n > 0)
     {
+        getLoop()->metrics().addBytesRead(n);
+        if(rateLimiter_)
+        {
+            chargeRead(ConnectionRateLimiter::kReadBytes, n);
+        }
+        if(tls_ && !handleTlsInput())
+        {
+            return;     // 只有握手消息或者不完整的记录
+        }
+        if(filters_ && filters_->filtersInput() && !handleFilteredInput())
+        {
+            return;     // 各级都还没有产生新的数据，比如帧还不完整
+        }
+        requestPending_ = true;
         // 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
+        int64_t start = Timestamp::monotonicMicros();
         messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        busyMicros_ += Timestamp::monotonicMicros() - start;
+        if(rateLimiter_)
+        {
+            chargeRead(ConnectionRateLimiter::kMessages, 1);
+        }
+
+        // 应用没有及时处理的输入太多了，先不读了
+        checkInputLimit();
+        shutdownIfIdle();
     }
     else if (n == 0)
     {
@@ -87,25 +154,63 @@ void TcpConnection::handleWrite()
 {
     if (channel_->isWriting())
     {
+        size_t quota = writeQuota(pendingOutputBytes());
+        if(quota == 0)
+        {
+            throttleWrite();
+            return;
+        }
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+        // 有排队的共享数据时用writev一起写，写出的部分已经在writeQueuedOutput中移除
+        bool queued = !queuedPayloads_.empty();
+        ssize_t n = queued ? writeQueuedOutput(&savedErrno, quota)
+                           : outputBuffer_.writeFd(channel_->fd(), &savedErrno, quota);
         if(n > 0){
-            outputBuffer_.retrieve(n);
-            if(outputBuffer_.readableBytes() == 0)
+            getLoop()->metrics().addBytesWritten(n);
+            if(!queued)
+            {
+                outputBuffer_.retrieve(n);
+            }
+            if(rateLimiter_)
+            {
+                rateLimiter_->consume(ConnectionRateLimiter::kWriteBytes, n, Timestamp::monotonicMicros());
+                if(static_cast<size_t>(n) == quota && pendingOutputBytes() > 0)
+                {
+                    throttleWrite();
+                }
+            }
+            if(outputThrottled_ && pendingOutputBytes() < flowLowWaterMark_)
+            {
+                // 对端读走了足够多的数据，恢复读
+                outputThrottled_ = false;
+                if(inputThrottled_ && inputBuffer_.readableBytes() > 0)
+                {
+                    // 把积压的输入重新交给应用处理一次
+                    messageCallback_(shared_from_this(), &inputBuffer_, getLoop()->pollReturnTime());
+                }
+                checkInputLimit();
+                updateReading();
+            }
+            if(pendingOutputBytes() == 0)
             {
                 // 发送完成
-                channel_->disableReading();
+                channel_->disableWritng();
+                requestPending_ = false;
+                if(filters_)
+                {
+                    // 下层不再积压，扣着数据的filter可以接着发
+                    filters_->outputDrained();
+                }
                 if(writeCompleteCallback_)
                 {
                     // 唤醒loop_对应的thread线程，执行回调
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this())
-                    );
+                    queueInOwnLoop(std::bind(writeCompleteCallback_, shared_from_this()));
                 }
                 if(state_ == kDisconnecting)
                 {
                     shutdownInLoop();
                 }
+                shutdownIfIdle();
             }
         }
         else
@@ -122,9 +227,10 @@ void TcpConnection::handleWrite()
 // poller => channel::closeCallback => TcpConnection::handleclose
 void TcpConnection::handleClose()
 {
-    LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
+    LOG_DEBUG("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
     setState(kDisconnected);
     channel_->disableAll();
+    getLoop()->metrics().connectionRemoved();
 
     TcpConnectionPtr connPtr(shared_from_this());
     connectionCallback_(connPtr);   // 执行连接关闭的回调
@@ -144,7 +250,7 @@ void TcpConnection::handleError()
     {
         err = optval;
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name_.c_str(), err);
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name().c_str(), err);
 }
 
 
@@ -153,25 +259,127 @@ void TcpConnection::send(const std::string &buf)
 {
     if(state_ == kConnected)
     {
-        if(loop_->isInLoopTread())
+        EventLoop *loop = loop_;
+        if(loop->isInLoopTread())
         {
             sendInLoop(buf.c_str(), buf.size());
         }
         else
         {
-            loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop,
-                this,
-                buf.c_str(),
-                buf.size()
-            ));
+            // 跨线程发送必须拷贝一份数据，并持有连接的引用
+            void (TcpConnection::*fp)(const std::string&) = &TcpConnection::sendInLoop;
+            loop->runInLoop(std::bind(fp, shared_from_this(), buf));
+        }
+    }
+}
+
+void TcpConnection::send(Buffer *buf)
+{
+    if(state_ == kConnected)
+    {
+        EventLoop *loop = loop_;
+        if(loop->isInLoopTread())
+        {
+            sendInLoop(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
+        }
+        else
+        {
+            void (TcpConnection::*fp)(const std::string&) = &TcpConnection::sendInLoop;
+            loop->runInLoop(std::bind(fp, shared_from_this(), buf->retrieveAllAsString()));
+        }
+    }
+}
+
+void TcpConnection::send(const SharedPayload &payload)
+{
+    if(state_ == kConnected)
+    {
+        EventLoop *loop = loop_;
+        if(loop->isInLoopTread())
+        {
+            sendPayloadInLoop(payload);
+        }
+        else
+        {
+            // 只拷贝引用
+            loop->runInLoop(std::bind(&TcpConnection::sendPayloadInLoop, shared_from_this(), payload));
         }
     }
 }
 
+void TcpConnection::sendPayloadInLoop(const SharedPayload &payload)
+{
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        loop->runInLoop(std::bind(&TcpConnection::sendPayloadInLoop, shared_from_this(), payload));
+        return;
+    }
+    sendInLoop(payload->data(), payload->size(), &payload);
+}
+
+void TcpConnection::sendInLoop(const std::string &message)
+{
+    // 投递期间连接可能已经迁移到了其他loop，转发到当前所属的loop上执行
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        void (TcpConnection::*fp)(const std::string&) = &TcpConnection::sendInLoop;
+        loop->runInLoop(std::bind(fp, shared_from_this(), message));
+        return;
+    }
+    sendInLoop(message.data(), message.size());
+}
+
+void TcpConnection::sendInLoop(const void *data, size_t len)
+{
+    sendInLoop(data, len, nullptr);
+}
+
+void TcpConnection::sendInLoop(const void *data, size_t len, const SharedPayload *payload)
+{
+    if(filters_ && filters_->filtersOutput())
+    {
+        if(state_ == kDisconnected)
+        {
+            LOG_ERROR("disconnected, give up writing!");
+            return;
+        }
+        // 各级处理完通过写回调交给encryptInLoop
+        if(!filters_->processOutput(static_cast<const char*>(data), len))
+        {
+            LOG_ERROR("TcpConnection::sendInLoop [%s] filter failed \n", name().c_str());
+            forceCloseInLoop();
+        }
+        return;
+    }
+    encryptInLoop(data, len, payload);
+}
+
+void TcpConnection::encryptInLoop(const void *data, size_t len, const SharedPayload *payload)
+{
+    if(tls_ && !tls_->kernelTx())
+    {
+        if(state_ == kDisconnected)
+        {
+            LOG_ERROR("disconnected, give up writing!");
+            return;
+        }
+        if(!tls_->encrypt(data, len))
+        {
+            forceCloseInLoop();
+            return;
+        }
+        flushTlsOutput();
+        return;
+    }
+    writeInLoop(data, len, payload);
+}
+
 // 应用写得快，内核发送慢
 // 需要把带发送数据写入缓冲区，并设置水位回调
-void TcpConnection::sendInLoop(const void *data, size_t len)
+void TcpConnection::writeInLoop(const void *data, size_t len, const SharedPayload *payload)
 {
     ssize_t nwrote = 0;
     size_t remaining = len;
@@ -185,18 +393,36 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     }
     
     // 表示channel_第一次开始写数据，而且缓冲区没有待发送数据
-    if(!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    // 超过写限速时不写，数据放进缓冲区，等限速的定时器恢复写
+    size_t quota = !channel_->isWriting() && pendingOutputBytes() == 0 && !writeRateThrottled_ ? writeQuota(len) : 0;
+    if(quota > 0)
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        nwrote = ::write(channel_->fd(), data, std::min(len, quota));
         if(nwrote > 0)
         {
+            getLoop()->metrics().addBytesWritten(nwrote);
             remaining = len - nwrote;
-            if (remaining == 0 && writeCompleteCallback_)
+            if(rateLimiter_)
+            {
+                rateLimiter_->consume(ConnectionRateLimiter::kWriteBytes, nwrote, Timestamp::monotonicMicros());
+                if(static_cast<size_t>(nwrote) == quota && remaining > 0)
+                {
+                    throttleWrite();
+                }
+            }
+            if (remaining == 0)
             {
-                // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了
-                loop_->queueInLoop(std::bind(
-                    writeCompleteCallback_, shared_from_this()
-                ));
+                requestPending_ = false;
+                if(writeCompleteCallback_)
+                {
+                    // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了
+                    queueInOwnLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                }
+                if(draining_)
+                {
+                    // 可能还在用户的回调中，等回调返回后再检查是否空闲
+                    queueInOwnLoop(std::bind(&TcpConnection::shutdownIfIdle, shared_from_this()));
+                }
             }
         }
         else // nwrote < 0
@@ -220,53 +446,419 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     if(!faultError && remaining > 0)  
     {
         // 目前发送缓冲区剩余的带发送数据的长度
-        size_t oldLen = outputBuffer_.readableBytes();
+        size_t oldLen = pendingOutputBytes();
         if(oldLen + remaining >= highWaterMark_ 
             && oldLen < highWaterMark_
-            && highWaterMark_)
+            && highWaterMarkCallback_)
+        {
+            queueInOwnLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+        }
+        if(payload != nullptr)
         {
-            loop_->queueInLoop(std::bind(
-                highWaterMarkCallback_, shared_from_this(), oldLen + remaining
-            ));
+            queuedPayloads_.push_back(QueuedPayload{*payload, static_cast<size_t>(nwrote)});
+            queuedPayloadBytes_ += remaining;
         }
-        outputBuffer_.append((char*)data + nwrote, remaining);
-        if(!channel_->isWriting())
+        else if(queuedPayloads_.empty())
+        {
+            outputBuffer_.append((char*)data + nwrote, remaining);
+        }
+        else
+        {
+            // 要排在已经排队的共享数据后面，只能拷贝一份
+            queuedPayloads_.push_back(QueuedPayload{
+                std::make_shared<const std::string>((const char*)data + nwrote, remaining), 0});
+            queuedPayloadBytes_ += remaining;
+        }
+        if(!channel_->isWriting() && !writeRateThrottled_)
         {
             // 一定要注册channel的写事件，否则poller不会给channel通知epollout
             channel_->enableWritng();  
         }
+        checkOutputHighWaterMark();
+    }
+}
+
+// outputBuffer_和排队的共享数据用一次writev写出（最多maxBytes），返回写出的字节数并从队列中移除
+ssize_t TcpConnection::writeQueuedOutput(int *savedErrno, size_t maxBytes)
+{
+    static const int kMaxIov = 64;
+    struct iovec vec[kMaxIov];
+    int count = 0;
+    if(outputBuffer_.readableBytes() > 0)
+    {
+        vec[count].iov_base = const_cast<char*>(outputBuffer_.peek());
+        vec[count].iov_len = std::min(outputBuffer_.readableBytes(), maxBytes);
+        maxBytes -= vec[count].iov_len;
+        ++count;
+    }
+    for(auto it = queuedPayloads_.begin() + queuedHead_;
+        it != queuedPayloads_.end() && count < kMaxIov && maxBytes > 0; ++it)
+    {
+        vec[count].iov_base = const_cast<char*>(it->data->data() + it->offset);
+        vec[count].iov_len = std::min(it->data->size() - it->offset, maxBytes);
+        maxBytes -= vec[count].iov_len;
+        ++count;
+    }
+    ssize_t n = ::writev(channel_->fd(), vec, count);
+    if(n < 0)
+    {
+        *savedErrno = errno;
+        return n;
+    }
+
+    size_t left = n;
+    size_t fromBuffer = std::min(left, outputBuffer_.readableBytes());
+    outputBuffer_.retrieve(fromBuffer);
+    left -= fromBuffer;
+    while(left > 0)
+    {
+        QueuedPayload &front = queuedPayloads_[queuedHead_];
+        size_t size = front.data->size() - front.offset;
+        if(left < size)
+        {
+            front.offset += left;
+            queuedPayloadBytes_ -= left;
+            break;
+        }
+        left -= size;
+        queuedPayloadBytes_ -= size;
+        front.data.reset();
+        ++queuedHead_;
+    }
+    if(queuedHead_ == queuedPayloads_.size())
+    {
+        queuedPayloads_.clear();
+        queuedHead_ = 0;
+    }
+    else if(queuedHead_ > queuedPayloads_.size() / 2)
+    {
+        // 一直有新数据排队时，把写完的前半部分挪掉
+        queuedPayloads_.erase(queuedPayloads_.begin(), queuedPayloads_.begin() + queuedHead_);
+        queuedHead_ = 0;
+    }
+    return n;
+}
+
+// 对端读得慢，outputBuffer_积压到高水位，暂停读，不再产生新的回复
+void TcpConnection::checkOutputHighWaterMark()
+{
+    if(flowHighWaterMark_ > 0
+        && !outputThrottled_
+        && pendingOutputBytes() >= flowHighWaterMark_)
+    {
+        outputThrottled_ = true;
+        updateReading();
+    }
+}
+
+bool TcpConnection::readThrottled() const
+{
+    return outputThrottled_ || inputThrottled_ || readRateThrottled_ || (filters_ && filters_->inputPaused());
+}
+
+size_t TcpConnection::bufferedInputBytes() const
+{
+    return inputBuffer_.readableBytes() + (filters_ ? filters_->bufferedInputBytes() : 0);
+}
+
+// 每次交给应用之后，以及应用调用startRead时重新判断，应用取走了数据就恢复读
+void TcpConnection::checkInputLimit()
+{
+    bool throttled = inputLimit_ > 0 && bufferedInputBytes() >= inputLimit_;
+    if(throttled != inputThrottled_)
+    {
+        inputThrottled_ = throttled;
+        updateReading();
+    }
+}
+
+void TcpConnection::updateReading()
+{
+    if(state_ != kConnected && state_ != kDisconnecting)
+    {
+        return;     // channel已经从poller中移除了
+    }
+    bool wanted = reading_ && !readThrottled();
+    if(wanted && !channel_->isReading())
+    {
+        channel_->enableReading();
+    }
+    else if(!wanted && channel_->isReading())
+    {
+        channel_->disableReading();
+    }
+}
+
+void TcpConnection::setRateLimiter(std::unique_ptr<ConnectionRateLimiter> limiter)
+{
+    // 已经暂停的读写由还没到期的定时器按新的限制恢复
+    rateLimiter_ = std::move(limiter);
+}
+
+void TcpConnection::chargeRead(int kind, size_t n)
+{
+    ConnectionRateLimiter::Kind k = static_cast<ConnectionRateLimiter::Kind>(kind);
+    if(!rateLimiter_->limited(k))
+    {
+        return;
+    }
+    int64_t now = Timestamp::monotonicMicros();
+    rateLimiter_->consume(k, static_cast<double>(n), now);
+    if(!readRateThrottled_)
+    {
+        int64_t delay = rateLimiter_->delayMicros(k, now);
+        if(delay > 0)
+        {
+            // 透支了，还清之前不读；数据留在内核缓冲区里，对端的发送窗口会被填满
+            readRateThrottled_ = true;
+            updateReading();
+            runRateTimer(delay, &TcpConnection::readRateTimeout);
+        }
     }
 }
 
+void TcpConnection::readRateTimeout()
+{
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        // 连接已迁移，定时器还在旧loop上
+        loop->runInLoop(std::bind(&TcpConnection::readRateTimeout, shared_from_this()));
+        return;
+    }
+    if(!readRateThrottled_)
+    {
+        return;
+    }
+    if(rateLimiter_)
+    {
+        int64_t now = Timestamp::monotonicMicros();
+        int64_t delay = std::max(rateLimiter_->delayMicros(ConnectionRateLimiter::kReadBytes, now),
+                                 rateLimiter_->delayMicros(ConnectionRateLimiter::kMessages, now));
+        if(delay > 0)
+        {
+            // 共享的桶被同一个loop或IP上的其他连接用掉了
+            runRateTimer(delay, &TcpConnection::readRateTimeout);
+            return;
+        }
+    }
+    readRateThrottled_ = false;
+    updateReading();
+}
+
+double TcpConnection::writeChunk(size_t wanted)
+{
+    return static_cast<double>(std::max<size_t>(1, std::min(wanted, kMinRateLimitedWrite)));
+}
+
+size_t TcpConnection::writeQuota(size_t wanted)
+{
+    if(!rateLimiter_ || !rateLimiter_->limited(ConnectionRateLimiter::kWriteBytes))
+    {
+        return SIZE_MAX;
+    }
+    return rateLimiter_->quota(ConnectionRateLimiter::kWriteBytes, Timestamp::monotonicMicros(), writeChunk(wanted));
+}
+
+void TcpConnection::throttleWrite()
+{
+    if(channel_->isWriting())
+    {
+        channel_->disableWritng();
+    }
+    if(!writeRateThrottled_)
+    {
+        writeRateThrottled_ = true;
+        int64_t delay = rateLimiter_->delayMicros(ConnectionRateLimiter::kWriteBytes,
+            Timestamp::monotonicMicros(), writeChunk(pendingOutputBytes()));
+        runRateTimer(std::max<int64_t>(delay, 1), &TcpConnection::writeRateTimeout);
+    }
+}
+
+void TcpConnection::writeRateTimeout()
+{
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        loop->runInLoop(std::bind(&TcpConnection::writeRateTimeout, shared_from_this()));
+        return;
+    }
+    if(!writeRateThrottled_)
+    {
+        return;
+    }
+    if(rateLimiter_)
+    {
+        int64_t delay = rateLimiter_->delayMicros(ConnectionRateLimiter::kWriteBytes,
+            Timestamp::monotonicMicros(), writeChunk(pendingOutputBytes()));
+        if(delay > 0)
+        {
+            runRateTimer(delay, &TcpConnection::writeRateTimeout);
+            return;
+        }
+    }
+    writeRateThrottled_ = false;
+    if((state_ == kConnected || state_ == kDisconnecting)
+        && pendingOutputBytes() > 0 && !channel_->isWriting())
+    {
+        channel_->enableWritng();
+    }
+}
+
+void TcpConnection::runRateTimer(int64_t delayMicros, void (TcpConnection::*timeout)())
+{
+    // 定时器不延长连接的生命周期，连接关闭后到期什么也不做
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    getLoop()->runAfter(delayMicros / 1e6, [weakConn, timeout](){
+        TcpConnectionPtr conn = weakConn.lock();
+        if(conn)
+        {
+            ((*conn).*timeout)();
+        }
+    });
+}
+
+void TcpConnection::startRead()
+{
+    EventLoop *loop = loop_;
+    loop->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        loop->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+        return;
+    }
+    reading_ = true;
+    // 应用在回调之外处理完积压的输入后，靠这里解除inputLimit的暂停
+    checkInputLimit();
+    updateReading();
+}
+
+void TcpConnection::stopRead()
+{
+    EventLoop *loop = loop_;
+    loop->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        loop->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+        return;
+    }
+    reading_ = false;
+    updateReading();
+}
+
+void TcpConnection::setFlowControl(size_t highWaterMark, size_t lowWaterMark, size_t inputLimit)
+{
+    EventLoop *loop = loop_;
+    loop->runInLoop(std::bind(&TcpConnection::setFlowControlInLoop,
+        shared_from_this(), highWaterMark, lowWaterMark, inputLimit));
+}
+
+void TcpConnection::setFlowControlInLoop(size_t highWaterMark, size_t lowWaterMark, size_t inputLimit)
+{
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        loop->runInLoop(std::bind(&TcpConnection::setFlowControlInLoop,
+            shared_from_this(), highWaterMark, lowWaterMark, inputLimit));
+        return;
+    }
+    flowHighWaterMark_ = highWaterMark;
+    flowLowWaterMark_ = std::min(lowWaterMark, highWaterMark);
+    inputLimit_ = inputLimit;
+    outputThrottled_ = false;
+    inputThrottled_ = false;
+    checkOutputHighWaterMark();
+    updateReading();
+}
+
 // 关闭连接
 void TcpConnection::shutdown()
 {
     if(state_ == kConnected)
     {
         setState(kDisconnecting);
-        loop_->runInLoop(std::bind(
-            &TcpConnection::shutdownInLoop, this
+        EventLoop *loop = loop_;
+        loop->runInLoop(std::bind(
+            &TcpConnection::shutdownInLoop, shared_from_this()
         ));
     }
 }
 
 void TcpConnection::shutdownInLoop()
 {
-    if(!channel_->isWriting())    // 说明当前outputBuffer中的数据已经全发送完
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        // 连接已迁移，到新的loop上关闭写端
+        loop->runInLoop(std::bind(
+            &TcpConnection::shutdownInLoop, shared_from_this()
+        ));
+        return;
+    }
+    if(tls_ && !tls_->established())
     {
+        return;     // 握手完成、缓存的数据发出之后再关闭
+    }
+    // 说明当前outputBuffer中的数据已经全发送完；写限速时数据还在缓冲区里但没有注册写事件
+    if(!channel_->isWriting() && pendingOutputBytes() == 0)
+    {
+        if(tls_)
+        {
+            // 先发close_notify，写完之后handleWrite会再次调用这里
+            if(tls_->kernelTx())
+            {
+                tls_->sendKernelCloseNotify(channel_->fd());
+            }
+            else
+            {
+                tls_->shutdown();
+                flushTlsOutput();
+                if(pendingOutputBytes() > 0)
+                {
+                    return;
+                }
+            }
+        }
         socket_->shutdownWrite(); // 关闭写端
     }
 }
 
+void TcpConnection::setTcpNoDelay(bool on)
+{
+    socket_->setTcpNoDelay(on);
+}
+
+bool TcpConnection::setBusyPoll(int usec)
+{
+    return socket_->setBusyPoll(usec);
+}
+
 // 连接建立
 void TcpConnection::connectEstablished()
 {
     setState(kConnected);
+    getLoop()->metrics().connectionAdded();
     channel_->tie(shared_from_this());
     channel_->enableReading();  // 向poller注册channel的epollin事件
 
     // 新连接建立, 执行回调
     connectionCallback_(shared_from_this());
+
+    if(tls_ && state_ == kConnected)
+    {
+        // 客户端在这里发出ClientHello，服务端等待对方的ClientHello
+        handleTlsInput();
+    }
 }
 
 // 连接销毁
@@ -276,8 +868,295 @@ void TcpConnection::connectDestroyed()
     {
         setState(kDisconnected);
         channel_->disableAll();  // 把channel所有感兴趣的事件，从poller中del掉
+        getLoop()->metrics().connectionRemoved();
         
         connectionCallback_(shared_from_this());
     }
     channel_->remove();         // 把channel从poller中删除掉
+}
+
+void TcpConnection::startTls(const std::shared_ptr<TlsContext> &context, const std::string &serverName)
+{
+    // 客户端的会话按服务端地址和名字缓存，重连时尝试恢复
+    std::string sessionKey;
+    if(context->mode() == TlsContext::kClient)
+    {
+        sessionKey = peerAddr_.toIpPort() + "/" + serverName;
+    }
+    tls_.reset(new TlsSession(context, serverName, sessionKey));
+}
+
+bool TcpConnection::handleTlsInput()
+{
+    // 有处理入站数据的filter时解密到第一级的缓冲区
+    Buffer *plain = filters_ ? filters_->inputBuffer() : &inputBuffer_;
+    size_t before = plain->readableBytes();
+    bool wasEstablished = tls_->established();
+    bool ok = tls_->process(plain);
+    // 握手消息、alert都要写给对端
+    flushTlsOutput();
+    if(!ok)
+    {
+        handleClose();
+        return false;
+    }
+    if(!wasEstablished && tls_->established())
+    {
+        tlsHandshakeDone();
+    }
+    return plain->readableBytes() > before;
+}
+
+void TcpConnection::flushTlsOutput()
+{
+    Buffer *out = tls_->cipherOutput();
+    if(out->readableBytes() > 0)
+    {
+        if(tls_->kernelTx())
+        {
+            // kTLS下OpenSSL不应该再产生密文（比如对端请求更新密钥），无法保证记录序号，只能断开
+            LOG_ERROR("TcpConnection::flushTlsOutput [%s] unexpected tls record after kernel offload \n", name().c_str());
+            out->retrieveAll();
+            forceCloseInLoop();
+            return;
+        }
+        writeInLoop(out->peek(), out->readableBytes(), nullptr);
+        out->retrieveAll();
+    }
+}
+
+void TcpConnection::tlsHandshakeDone()
+{
+    // 握手消息都写给了socket才能把发送交给内核，否则内核会把还在outputBuffer_里的密文再加密一次
+    bool kernelTx = false;
+    if(tls_->context()->kernelTls() && pendingOutputBytes() == 0)
+    {
+        kernelTx = tls_->enableKernelTx(channel_->fd());
+    }
+    tls_->context()->onHandshakeDone(tls_->resumed(), kernelTx);
+    LOG_DEBUG("TcpConnection [%s] tls established %s %s resumed:%d ktls:%d \n", name().c_str(),
+        tls_->version(), tls_->cipherName(), (int)tls_->resumed(), (int)kernelTx);
+
+    Buffer *pending = tls_->pendingPlaintext();
+    if(pending->readableBytes() > 0)
+    {
+        // 缓存的是已经经过各级filter的数据
+        encryptInLoop(pending->peek(), pending->readableBytes(), nullptr);
+        pending->retrieveAll();
+    }
+    if(state_ == kDisconnecting)
+    {
+        shutdownInLoop();
+    }
+}
+
+void TcpConnection::addFilter(const std::shared_ptr<ConnectionFilter> &filter)
+{
+    if(!filters_)
+    {
+        filters_.reset(new FilterChain(this, &inputBuffer_));
+        filters_->setWriteCallback([this](const char *data, size_t len){
+            encryptInLoop(data, len, nullptr);
+        });
+        filters_->setReadingCallback(std::bind(&TcpConnection::updateReading, this));
+        filters_->setResumeCallback([this](){
+            // filter多半是在自己的回调里恢复的，等它返回后再处理
+            getLoop()->queueInLoop(std::bind(&TcpConnection::resumeFilteredInput, shared_from_this()));
+        });
+        filters_->setErrorCallback(std::bind(&TcpConnection::forceCloseInLoop, this));
+    }
+    if(filters_->add(filter))
+    {
+        // 现在多半还在messageCallback_中，等它返回后再交给应用
+        getLoop()->queueInLoop(std::bind(&TcpConnection::resumeFilteredInput, shared_from_this()));
+    }
+}
+
+void TcpConnection::startCompression(int level)
+{
+    compression_ = std::make_shared<Compression>(level);
+    addFilter(compression_);
+}
+
+bool TcpConnection::handleFilteredInput()
+{
+    size_t before = inputBuffer_.readableBytes();
+    if(!filters_->processInput())
+    {
+        LOG_ERROR("TcpConnection::handleFilteredInput [%s] filter rejected input \n", name().c_str());
+        handleClose();
+        return false;
+    }
+    return inputBuffer_.readableBytes() > before;
+}
+
+void TcpConnection::resumeFilteredInput()
+{
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        // 投递之后连接被迁走了，到新loop上再交给应用
+        loop->runInLoop(std::bind(&TcpConnection::resumeFilteredInput, shared_from_this()));
+        return;
+    }
+    if(state_ == kConnected && handleFilteredInput())
+    {
+        requestPending_ = true;
+        messageCallback_(shared_from_this(), &inputBuffer_, getLoop()->pollReturnTime());
+        checkInputLimit();
+    }
+}
+
+// 迁移连接
+void TcpConnection::migrateTo(EventLoop *newLoop, const MigrateCallback &cb)
+{
+    // 总是放到pendingFunctors里执行，保证此时没有处于channel的handleEvent中
+    EventLoop *loop = loop_;
+    loop->queueInLoop(std::bind(
+        &TcpConnection::migrateInLoop, shared_from_this(), newLoop, cb
+    ));
+}
+
+// 在旧loop线程中执行：把channel从旧的poller上摘掉，并为新loop创建channel
+void TcpConnection::migrateInLoop(EventLoop *newLoop, const MigrateCallback &cb)
+{
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        // 上一次迁移还没完成，到当前所属的loop上再处理
+        loop->runInLoop(std::bind(
+            &TcpConnection::migrateInLoop, shared_from_this(), newLoop, cb
+        ));
+        return;
+    }
+    if(newLoop == nullptr || newLoop == loop || state_ != kConnected)
+    {
+        if(cb)
+        {
+            cb(shared_from_this());
+        }
+        return;
+    }
+
+    LOG_INFO("TcpConnection::migrateInLoop [#%lu] fd=%d from loop %p to loop %p \n",
+        id_, channel_->fd(), loop, newLoop);
+
+    channel_->disableAll();
+    channel_->remove();
+    loop->metrics().connectionRemoved();
+    // 旧的channel在旧loop线程里析构，新的channel在切换loop_之前准备好
+    channel_.reset(createChannel(newLoop, socket_->fd()));
+    channel_->tie(shared_from_this());
+    loop_ = newLoop;
+
+    // LT模式，迁移期间到达的数据留在内核缓冲区里，在新loop上注册后会继续上报
+    newLoop->queueInLoop(std::bind(
+        &TcpConnection::attachInLoop, shared_from_this(), newLoop, cb
+    ));
+}
+
+void TcpConnection::queueInOwnLoop(std::function<void()> cb)
+{
+    TcpConnectionPtr self(shared_from_this());
+    getLoop()->queueInLoop([self, cb](){ self->runInOwnLoop(cb); });
+}
+
+void TcpConnection::runInOwnLoop(const std::function<void()> &cb)
+{
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        // 迁移时attachInLoop已经排在新loop的队列里，这个任务排在它后面
+        queueInOwnLoop(cb);
+        return;
+    }
+    cb();
+}
+
+// 在新loop线程中执行：向新的poller注册channel
+void TcpConnection::attachInLoop(EventLoop *loop, const MigrateCallback &cb)
+{
+    loop->metrics().connectionAdded();
+    if(loop_ != loop)
+    {
+        // 注册之前又被迁走了，channel和cb交给最后一次迁移处理；
+        // 上面的计数和迁走时在这个loop上减掉的抵消
+        return;
+    }
+    if(state_ == kConnected || state_ == kDisconnecting)
+    {
+        updateReading();
+        if(pendingOutputBytes() > 0 && !channel_->isWriting() && !writeRateThrottled_)
+        {
+            channel_->enableWritng();
+        }
+    }
+
+    if(cb)
+    {
+        cb(shared_from_this());
+    }
+}
+
+void TcpConnection::drain()
+{
+    EventLoop *loop = loop_;
+    loop->runInLoop(std::bind(
+        &TcpConnection::drainInLoop, shared_from_this()
+    ));
+}
+
+void TcpConnection::drainInLoop()
+{
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        loop->runInLoop(std::bind(
+            &TcpConnection::drainInLoop, shared_from_this()
+        ));
+        return;
+    }
+    draining_ = true;
+    shutdownIfIdle();
+}
+
+// 排空中的连接：没有未处理的输入、没有待发送的数据、也没有在等待回复的请求时，关闭写端
+// 对端读到EOF后关闭连接，走正常的handleClose流程
+void TcpConnection::shutdownIfIdle()
+{
+    if(draining_
+        && state_ == kConnected
+        && !requestPending_
+        && inputBuffer_.readableBytes() == 0
+        && pendingOutputBytes() == 0)
+    {
+        shutdown();
+    }
+}
+
+void TcpConnection::forceClose()
+{
+    if(state_ == kConnected || state_ == kDisconnecting)
+    {
+        EventLoop *loop = loop_;
+        loop->queueInLoop(std::bind(
+            &TcpConnection::forceCloseInLoop, shared_from_this()
+        ));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    EventLoop *loop = loop_;
+    if(!loop->isInLoopTread())
+    {
+        loop->runInLoop(std::bind(
+            &TcpConnection::forceCloseInLoop, shared_from_this()
+        ));
+        return;
+    }
+    if(state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose();
+    }
 }
\ No newline at end of file
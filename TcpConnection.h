@@ -6,32 +6,45 @@
 #include "Buffer.h"
 #include "Timestamp.h"
 
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 #include <atomic>
+#include <mutex>
 
 class Channel;
 class EventLoop;
 class Socket;
+class TlsContext;
+class TlsSession;
+class Compression;
+class ConnectionFilter;
+class FilterChain;
+class ConnectionRateLimiter;
 
 // TcpSever =》Acceptor =》有一个新用户连接，通过accept函数拿到connfd
 // =》TcpConnection 设置回调 =》 Channel => Poller => Channel的回调操作
 class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
 {
 public:
+    // 连接用64位的id标识，名字 namePrefix#id 只在第一次调用name()时才格式化
     TcpConnection(EventLoop *loop,
-                const std::string &nameArg,
+                uint64_t id,
+                const std::shared_ptr<const std::string> &namePrefix,
                 int sockfd,
                 const InetAddress &localAddr,
                 const InetAddress &peerAddr);
     ~TcpConnection();
 
     EventLoop *getLoop() const { return loop_; }
-    const std::string &name() const { return name_; }
+    uint64_t id() const { return id_; }
+    const std::string &name() const;
     const InetAddress& localAddress() const { return localAddr_; }
     const InetAddress& peerAddress() const { return  peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
+    bool disconnected() const { return state_ == kDisconnected; }
 
     void setConnectionCallback(const ConnectionCallback &cb)
     { connectionCallback_ = cb; }
@@ -50,13 +63,91 @@ public:
 
     // 发送数据
     void send(const std::string &buf);
+    // 发送buf中的全部可读数据并清空buf，在loop线程中调用时不拷贝，可以直接写socket
+    void send(Buffer *buf);
+    // 发送共享的数据，任何线程调用都不拷贝；写不完时把引用排进发送队列，用writev和outputBuffer_一起发出
+    void send(const SharedPayload &payload);
+    // 关闭Nagle算法，小包立即发出
+    void setTcpNoDelay(bool on);
+    // SO_BUSY_POLL，见Socket::setBusyPoll
+    bool setBusyPoll(int usec);
     // 关闭连接
     void shutdown();
+    // 强制关闭连接，不等待outputBuffer_发送完
+    void forceClose();
+
+    // 排空连接：已收到的请求处理完、回复发送完之后再关闭写端
+    // 收到数据之后到回复全部写出之前，认为连接上有正在处理的请求
+    // 只收不回的连接不会自己关闭，需要调用方超时后forceClose
+    void drain();
+    bool draining() const { return draining_; }
+
+    // 开始/停止从socket读数据
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
+
+    // 流量控制：outputBuffer_中待发送的数据达到highWaterMark时暂停读，
+    // 发送到lowWaterMark以下时恢复读，对端读得慢时每个连接的内存是有上限的
+    // inputLimit大于0时，inputBuffer_中未处理的数据达到inputLimit也暂停读，
+    // 每次messageCallback返回后重新检查，应用取走数据就恢复；在回调之外异步处理输入的应用，
+    // 取走数据后调用startRead()恢复读。inputLimit必须大于最大的一条消息，
+    // 否则一条消息还没收完就暂停了读，解析永远等不到剩下的数据
+    // highWaterMark为0表示关闭流量控制
+    void setFlowControl(size_t highWaterMark, size_t lowWaterMark, size_t inputLimit = 0);
+    // 当前是否因为流量控制（或者有filter暂停了入站处理、读超过了限速）暂停了读
+    bool readThrottled() const;
+
+    // 令牌桶限速，见RateLimiter.h，在loop线程中调用（TcpServer设置了限速时在连接建立前自动设置）
+    // 读字节数或消息数超限时停止读socket，写字节数超限时数据留在outputBuffer_里，
+    // 都在loop的定时器上恢复，不会忙等；limiter为空时取消限速
+    void setRateLimiter(std::unique_ptr<ConnectionRateLimiter> limiter);
+    ConnectionRateLimiter* rateLimiter() const { return rateLimiter_.get(); }
+    // 当前是否因为写超过了限速而暂停写
+    bool writeRateThrottled() const { return writeRateThrottled_; }
+
+    Buffer* inputBuffer() { return &inputBuffer_; }
+    Buffer* outputBuffer() { return &outputBuffer_; }
+    // 还没有写给socket的字节数：outputBuffer_加上排队的共享数据
+    size_t pendingOutputBytes() const { return outputBuffer_.readableBytes() + queuedPayloadBytes_; }
+
     // 连接建立
     void connectEstablished();
     // 连接销毁
     void connectDestroyed();
 
+    // 把连接迁移到另一个loop上：从旧loop的poller上摘除channel，在新loop上重新注册
+    // 缓冲区和回调都保留，cb在连接最终所属的loop线程中执行（迁移没有发生时就是原来的loop）
+    // 在新loop上注册之前又迁移了的话，这一次的cb不再调用，只调用最后一次的
+    void migrateTo(EventLoop *newLoop, const MigrateCallback &cb = MigrateCallback());
+
+    // 累计在消息回调中花费的时间(us)，用于衡量连接的繁忙程度
+    uint64_t busyMicros() const { return busyMicros_; }
+
+    // 开启TLS，在connectEstablished之前调用（TcpServer/TcpClient设置了TlsContext时创建连接后自动调用）
+    // 之后收发的都是明文，加解密在连接所属的loop线程中进行，握手完成前发送的数据先缓存；客户端的serverName用于SNI
+    void startTls(const std::shared_ptr<TlsContext> &context, const std::string &serverName = std::string());
+    // 没有开启TLS时为空，只在loop线程中访问
+    TlsSession* tlsSession() const { return tls_.get(); }
+
+    // 在socket（TLS之上）和应用之间安装一级filter，见ConnectionFilter.h，在loop线程中调用
+    // 新的filter排在已有filter的应用一侧，两端在应用协议约定的同一位置安装（比如协商消息之后）
+    // 调用时inputBuffer_中还没处理的数据被当作对端已经处理过的数据，经过它之后在本轮回调结束后重新交给应用
+    // 没有安装filter时收发都是直接读写socket，没有额外开销
+    void addFilter(const std::shared_ptr<ConnectionFilter> &filter);
+    // 没有安装过filter时为空，只在loop线程中访问
+    FilterChain* filterChain() const { return filters_.get(); }
+
+    // 开启透明压缩（zlib），即安装一级Compression filter
+    // 之后send的数据压缩成帧再发出（在TLS加密之前），收到的帧解压后才放进inputBuffer_
+    void startCompression(int level = -1);
+    // 没有开启压缩时为空，只在loop线程中访问
+    Compression* compression() const { return compression_.get(); }
+
+    // 上层协议（HTTP、WebSocket等）挂在连接上的状态，只在loop线程中访问
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void>& getContext() const { return context_; }
+
 private:
     enum StateE{ kDisconnected, kConnecting, kConnected, kDisconnecting };
     void setState(StateE state) { state_ = state; }
@@ -66,11 +157,66 @@ private:
     void handleClose();
     void handleError();
 
+    void sendInLoop(const std::string &message);
     void sendInLoop(const void *data, size_t len);
+    void sendPayloadInLoop(const SharedPayload &payload);
+    // 有处理出站数据的filter时先交给它们，payload会失去零拷贝
+    void sendInLoop(const void *data, size_t len, const SharedPayload *payload);
+    // 开启TLS时先加密，payload没有kTLS时会失去零拷贝
+    void encryptInLoop(const void *data, size_t len, const SharedPayload *payload);
+    // 写socket：payload不为空时data就是它的内容，写不完的部分按引用排队，否则拷贝
+    void writeInLoop(const void *data, size_t len, const SharedPayload *payload);
+    // 最多写出maxBytes
+    ssize_t writeQueuedOutput(int *savedErrno, size_t maxBytes);
     void shutdownInLoop();
+    void forceCloseInLoop();
+    void drainInLoop();
+    void shutdownIfIdle();
+    void startReadInLoop();
+    void stopReadInLoop();
+    void setFlowControlInLoop(size_t highWaterMark, size_t lowWaterMark, size_t inputLimit);
+    // 根据用户意愿和流量控制状态，更新channel的读事件
+    void updateReading();
+    void checkOutputHighWaterMark();
+    // 还没有被应用处理的输入：inputBuffer_加上各级filter缓冲区中的数据
+    size_t bufferedInputBytes() const;
+    void checkInputLimit();
+
+    // 限速：扣掉读到的字节数或者消息数，超限时停止读，定时器到期后恢复
+    void chargeRead(int kind, size_t n);
+    void readRateTimeout();
+    // 现在最多能写多少字节：没有限速时是SIZE_MAX，额度不够一次值得写的量（见writeChunk）时是0
+    size_t writeQuota(size_t wanted);
+    // 写限速时一次至少要攒够的额度：wanted和kMinRateLimitedWrite中小的那个
+    static double writeChunk(size_t wanted);
+    // 写超限：暂停写，定时器到期后恢复
+    void throttleWrite();
+    void writeRateTimeout();
+    void runRateTimer(int64_t delayMicros, void (TcpConnection::*timeout)());
+
+    // TLS：解密socket读到的密文，返回是否得到了新的明文；出错时关闭连接
+    bool handleTlsInput();
+    void flushTlsOutput();
+    void tlsHandshakeDone();
+    // filter：把各级缓冲区中的数据处理到inputBuffer_，返回是否得到了新的数据；出错时关闭连接
+    bool handleFilteredInput();
+    void resumeFilteredInput();
+
+    Channel* createChannel(EventLoop *loop, int sockfd);
+    void migrateInLoop(EventLoop *newLoop, const MigrateCallback &cb);
+    void attachInLoop(EventLoop *loop, const MigrateCallback &cb);
+    // 投递到连接所属的loop上，等当前的回调返回后执行；执行前连接被迁走时转到新loop，
+    // 用户回调和读写连接状态的任务不会在旧loop线程上和新loop同时运行
+    void queueInOwnLoop(std::function<void()> cb);
+    void runInOwnLoop(const std::function<void()> &cb);
     
-    EventLoop *loop_;  // 绝对不是mainloop，因为TcpConnection都是在subloop里管理的
-    const std::string name_;
+    // 绝对不是mainloop，因为TcpConnection都是在subloop里管理的
+    // 连接迁移时会被改写，其他线程可能同时读取，所以是原子的
+    std::atomic<EventLoop*> loop_;
+    const uint64_t id_;
+    const std::shared_ptr<const std::string> namePrefix_;
+    mutable std::once_flag nameOnce_;
+    mutable std::string name_;
     std::atomic_int state_;
     bool reading_;
 
@@ -90,4 +236,36 @@ private:
 
     Buffer inputBuffer_;
     Buffer outputBuffer_;
+    // outputBuffer_之后待发送的共享数据，队列不为空时后续的数据都要排在它后面
+    struct QueuedPayload
+    {
+        SharedPayload data;
+        size_t offset;          // 已经写出的字节
+    };
+    // 不用deque：deque构造时就要分配块，连接多时占内存；vector清空后容量保留，之后排队不再分配
+    std::vector<QueuedPayload> queuedPayloads_;
+    size_t queuedHead_;             // queuedPayloads_中第一个还没写完的
+    size_t queuedPayloadBytes_;
+
+    std::atomic<uint64_t> busyMicros_;
+
+    // 流量控制，只在loop线程中访问
+    size_t flowHighWaterMark_;
+    size_t flowLowWaterMark_;
+    size_t inputLimit_;
+    bool outputThrottled_;      // outputBuffer_超过高水位，暂停读
+    bool inputThrottled_;       // inputBuffer_超过上限，暂停读
+
+    std::atomic_bool draining_;
+    bool requestPending_;       // 收到了数据但回复还没有全部写出
+
+    std::shared_ptr<void> context_;
+    std::unique_ptr<TlsSession> tls_;
+    std::unique_ptr<FilterChain> filters_;
+    std::shared_ptr<Compression> compression_;
+
+    // 限速，只在loop线程中访问
+    std::unique_ptr<ConnectionRateLimiter> rateLimiter_;
+    bool readRateThrottled_;
+    bool writeRateThrottled_;
 };
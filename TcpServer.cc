@@ -4,6 +4,10 @@
 
 #include <strings.h>
 #include <functional>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
 
 static EventLoop* CheckLoopNotNull(EventLoop* loop)
 {
@@ -14,19 +18,60 @@ static EventLoop* CheckLoopNotNull(EventLoop* loop)
     return loop;
 }
     
+// 通过sockfd，获取其绑定的本机ip和端口信息
+static InetAddress getLocalAddr(int sockfd)
+{
+    sockaddr_storage local;
+    ::bzero(&local, sizeof local);
+    socklen_t addrlen = sizeof local;
+    if(::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+    return InetAddress((sockaddr*)&local, addrlen);
+}
+
 TcpServer::TcpServer(EventLoop *loop,
     const InetAddress &listenAddr,
     const std::string &nameArg,
     Option option)
-    : loop_(CheckLoopNotNull(loop))
-    , ipPort_(listenAddr.toIpPort())
+    : TcpServer(loop, listenAddr.toIpPort(), nameArg,
+        new Acceptor(CheckLoopNotNull(loop), listenAddr, option == kReusePort))
+{
+}
+
+TcpServer::TcpServer(EventLoop *loop,
+    int listenFd,
+    const std::string &nameArg)
+    : TcpServer(loop, getLocalAddr(listenFd).toIpPort(), nameArg,
+        new Acceptor(CheckLoopNotNull(loop), listenFd))
+{
+}
+
+TcpServer::TcpServer(EventLoop *loop,
+    const std::string &ipPort,
+    const std::string &nameArg,
+    Acceptor *acceptor)
+    : loop_(loop)
+    , ipPort_(ipPort)
     , name_(nameArg)
-    , acceptor_(new Acceptor(loop, listenAddr, option == kReusePort))
+    , acceptor_(acceptor)
     , threadPool_(new EventLoopThreadPool(loop, name_))
+    , connNamePrefix_(std::make_shared<const std::string>(nameArg + "-" + ipPort_))
     , connectionCallback_()
     , messageCallback_()
-    , nextConnId_(1)
+    , flowHighWaterMark_(0)
+    , flowLowWaterMark_(0)
+    , inputLimit_(0)
+    , socketBusyPollMicros_(0)
     , started_(0)
+    , nextConnId_(1)
+    , listenFdExported_(false)
+    , stopping_(false)
+    , drainRemaining_(0)
+    , rebalancerRunning_(false)
+    , rebalanceIntervalMs_(0)
+    , imbalanceRatio_(1.5)
 {
     // 当有新用户连接时，会执行Tcp::newConnection回调
     acceptor_->setNewConentionCallback(std::bind(&TcpServer::newConnection, this,
@@ -35,17 +80,29 @@ TcpServer::TcpServer(EventLoop *loop,
 
 TcpServer::~TcpServer()
 {
-    for(auto& item : connections_)
-    {
-        // shared_ptr智能指针对象，出右括号，可以自动释放new出来的TcpConnectionPtr对象资源
-        TcpConnectionPtr conn(item.second);     
-        item.second.reset();
+    stopRebalancer();
+    watchdog_.reset();      // subloop析构之前先停掉看门狗
+    loop_->cancel(drainTimer_);
 
-        // 销毁连接
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestroyed, conn)
-        );
+    if(connectionShards_.empty())
+    {
+        return;     // 没有start过
     }
+
+    // 每个subloop销毁自己连接表里的连接
+    EventLoopThreadPool::runInLoopsAndWait(threadPool_->getAllLoops(), [this](EventLoop *loop){
+        ConnectionMap connections;
+        connectionsOf(loop).swap(connections);
+        for(auto &item : connections)
+        {
+            // shared_ptr智能指针对象，出右括号，可以自动释放new出来的TcpConnectionPtr对象资源
+            TcpConnectionPtr conn(item.second);
+            item.second.reset();
+
+            // 销毁连接
+            conn->connectDestroyed();
+        }
+    });
 }
 
 // 设置底层subloop的个数
@@ -60,74 +117,514 @@ void TcpServer::start()
     if(started_++ == 0) // 防止一个TcpSever对象被start多次
     {
         threadPool_->start(threadInitCallback_);
+        // 每个loop一张连接表，start之后表的集合不再变化，各线程可以并发查找
+        for(EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            connectionShards_[ioLoop].reset(new ConnectionMap);
+            if(perConnectionLimits_.enabled() || perLoopLimits_.enabled() || perPeerIpLimits_.enabled())
+            {
+                rateLimiters_[ioLoop].reset(new LoopRateLimiter(perConnectionLimits_, perLoopLimits_, perPeerIpLimits_));
+            }
+        }
         loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
     }
 }
 
+TcpServer::ConnectionMap& TcpServer::connectionsOf(EventLoop *ioLoop)
+{
+    return *connectionShards_.find(ioLoop)->second;
+}
+
 // 有一个新的客户端的连接，会执行这个回调操作
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
     // 轮询算法，选择一个subloop，来管理channel
     EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
+    uint64_t connId = nextConnId_++;
 
-    LOG_INFO("TcpSever::newConnection [%s] - new connection [%s] from %s \n",
-        name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
-
-    // 通过sockfd，获取其绑定的本机ip和端口信息
-    sockaddr_in local;
-    ::bzero(&local, sizeof local);
-    socklen_t addrlen = sizeof local;
-    if(::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
-    {
-        LOG_ERROR("sockets::getLocalAddr");
-    }
+    LOG_INFO("TcpSever::newConnection [%s] - new connection [#%lu] from %s \n",
+        name_.c_str(), connId, peerAddr.toIpPort().c_str());
 
-    InetAddress localAddr(local);
+    InetAddress localAddr(getLocalAddr(sockfd));
 
     // 根据连接成功的sockfd，创建TcpConnection连接对象
     TcpConnectionPtr conn(new TcpConnection(
                             ioLoop,
-                            connName,
+                            connId,
+                            connNamePrefix_,
                             sockfd,
                             localAddr,
                             peerAddr));
 
-    connections_[connName] = conn;
     // 用户设置给TcpSever =》TcpConnection =》Channel =》Poller =》notify channel调用回调
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
+    if(flowHighWaterMark_ > 0 || inputLimit_ > 0)
+    {
+        conn->setFlowControl(flowHighWaterMark_, flowLowWaterMark_, inputLimit_);
+    }
+    if(socketBusyPollMicros_ > 0)
+    {
+        conn->setBusyPoll(socketBusyPollMicros_);
+    }
+    if(tlsContext_)
+    {
+        conn->startTls(tlsContext_);
+    }
     
     // 设置如何关闭的回调 ， conn => shutdown
     conn->setCloseCallback(std::bind(
         &TcpServer::removeConnection, this, std::placeholders::_1
     ));
 
-    // 直接调用TcpConnection::connectEstablished
+    // 连接登记到subloop自己的连接表中，然后调用TcpConnection::connectEstablished
     ioLoop->runInLoop(std::bind(
-        &TcpConnection::connectEstablished, conn
+        &TcpServer::connectEstablishedInLoop, this, conn
     ));
 } 
 
-void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+void TcpServer::connectEstablishedInLoop(const TcpConnectionPtr &conn)
 {
-    loop_->runInLoop(std::bind(
-        &TcpServer::removeConnectionInLoop, this, conn
-    ));
+    connectionsOf(conn->getLoop())[conn->id()] = conn;
+    setupRateLimiter(conn);
+    conn->connectEstablished();
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+void TcpServer::setupRateLimiter(const TcpConnectionPtr &conn)
 {
-    LOG_INFO("TcpSever::removeConnectionInLoop [%s] -connection %s \n",
-        name_.c_str(), conn->name().c_str());
-    
-    connections_.erase(conn->name());
+    auto it = rateLimiters_.find(conn->getLoop());
+    if(it != rateLimiters_.end())
+    {
+        conn->setRateLimiter(it->second->newConnection(conn->peerAddress()));
+    }
+}
+
+// 在连接所属的subloop中执行，连接的销毁不再经过baseloop
+void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+{
+    LOG_INFO("TcpSever::removeConnection [%s] -connection #%lu \n",
+        name_.c_str(), conn->id());
+
     EventLoop *ioLoop = conn->getLoop();
+    connectionsOf(ioLoop).erase(conn->id());
     ioLoop->queueInLoop(std::bind(
         &TcpConnection::connectDestroyed, conn
     ));
+
+    if(conn->draining())
+    {
+        connectionDrained();
+    }
+}
+
+void TcpServer::exportListenFd(const std::string &path, const std::function<void()> &cb)
+{
+    loop_->runInLoop(std::bind(
+        &TcpServer::exportListenFdInLoop, this, path, cb
+    ));
+}
+
+void TcpServer::exportListenFdInLoop(const std::string &path, const std::function<void()> &cb)
+{
+    if(listenFdExporter_ || acceptor_->listenFd() < 0)
+    {
+        return;
+    }
+    listenFdExporter_.reset(new ListenFdExporter(loop_, path,
+        std::vector<int>(1, acceptor_->listenFd())));
+    listenFdExporter_->setHandoffCallback([this, cb](){
+        listenFdExported_ = true;
+        if(cb)
+        {
+            cb();
+        }
+    });
+    listenFdExporter_->start();
+}
+
+void TcpServer::stop(int drainTimeoutMs, const DrainProgressCallback &cb)
+{
+    loop_->runInLoop(std::bind(
+        &TcpServer::stopInLoop, this, drainTimeoutMs, cb
+    ));
+}
+
+void TcpServer::stopInLoop(int drainTimeoutMs, const DrainProgressCallback &cb)
+{
+    if(started_ == 0 || stopping_.exchange(true))
+    {
+        return;
+    }
+
+    LOG_INFO("TcpServer::stop [%s] - drain timeout %d ms \n", name_.c_str(), drainTimeoutMs);
+    drainProgressCallback_ = cb;
+    // listenfd已经交给新进程时，backlog里的连接留给新进程accept
+    acceptor_->stop(!listenFdExported_);
+    if(listenFdExporter_)
+    {
+        // stop可能就是在交接完成的回调里调用的，延后到pendingFunctors里再析构
+        std::shared_ptr<ListenFdExporter> exporter(listenFdExporter_.release());
+        loop_->queueInLoop([exporter](){});
+    }
+
+    // 多算一个占位，防止各个loop还没统计完时计数就提前减到0
+    drainRemaining_ = 1;
+    EventLoopThreadPool::runInLoopsAndWait(threadPool_->getAllLoops(), [this](EventLoop *loop){
+        ConnectionMap &connections = connectionsOf(loop);
+        drainRemaining_ += connections.size();
+        std::vector<TcpConnectionPtr> conns;
+        for(auto &item : connections)
+        {
+            conns.push_back(item.second);
+        }
+        for(const TcpConnectionPtr &conn : conns)
+        {
+            conn->drain();
+        }
+    });
+
+    if(drainTimeoutMs > 0)
+    {
+        drainTimer_ = loop_->runAfter(drainTimeoutMs / 1000.0,
+            std::bind(&TcpServer::forceCloseConnections, this));
+    }
+    else
+    {
+        forceCloseConnections();
+    }
+    connectionDrained();    // 去掉占位
+}
+
+// 在连接所属的loop中执行，进度统一交给baseloop上报
+void TcpServer::connectionDrained()
+{
+    size_t remaining = --drainRemaining_;
+    loop_->queueInLoop(std::bind(
+        &TcpServer::reportDrainProgress, this, remaining
+    ));
+}
+
+void TcpServer::reportDrainProgress(size_t remaining)
+{
+    if(drainProgressCallback_)
+    {
+        drainProgressCallback_(remaining);
+    }
+    if(remaining == 0)
+    {
+        LOG_INFO("TcpServer::stop [%s] - all connections drained \n", name_.c_str());
+        loop_->cancel(drainTimer_);
+    }
+}
+
+// 排空超时，强制关闭所有剩下的连接
+void TcpServer::forceCloseConnections()
+{
+    for(EventLoop *ioLoop : threadPool_->getAllLoops())
+    {
+        ioLoop->runInLoop([this, ioLoop](){
+            std::vector<TcpConnectionPtr> conns;
+            for(auto &item : connectionsOf(ioLoop))
+            {
+                conns.push_back(item.second);
+            }
+            if(!conns.empty())
+            {
+                LOG_INFO("TcpServer::forceCloseConnections [%s] - %lu connections \n",
+                    name_.c_str(), conns.size());
+            }
+            for(const TcpConnectionPtr &conn : conns)
+            {
+                conn->forceClose();
+            }
+        });
+    }
+}
+
+bool TcpServer::broadcast(const SharedPayload &payload, const std::function<void()> &done)
+{
+    {
+        std::unique_lock<std::mutex> lock(rebalanceMutex_);
+        if(rebalancerRunning_)
+        {
+            LOG_ERROR("TcpServer::broadcast [%s] - rebalancer is running, pass the connections explicitly \n",
+                name_.c_str());
+            return false;
+        }
+    }
+    if(connectionShards_.empty())
+    {
+        if(done)
+        {
+            done();
+        }
+        return true;
+    }
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    std::shared_ptr<std::atomic<size_t>> remaining = std::make_shared<std::atomic<size_t>>(loops.size());
+    for(EventLoop *ioLoop : loops)
+    {
+        ConnectionMap *connections = &connectionsOf(ioLoop);
+        ioLoop->runInLoop([connections, payload, remaining, done](){
+            for(auto &item : *connections)
+            {
+                item.second->send(payload);
+            }
+            if(--*remaining == 0 && done)
+            {
+                done();
+            }
+        });
+    }
+    return true;
+}
+
+void TcpServer::broadcast(const SharedPayload &payload, const std::vector<TcpConnectionPtr> &conns,
+                          const std::function<void()> &done)
+{
+    // 按所属的loop分组；分组之后迁移走的连接由send转发到新的loop
+    std::unordered_map<EventLoop*, std::vector<TcpConnectionPtr>> groups;
+    for(const TcpConnectionPtr &conn : conns)
+    {
+        groups[conn->getLoop()].push_back(conn);
+    }
+    if(groups.empty())
+    {
+        if(done)
+        {
+            done();
+        }
+        return;
+    }
+    std::shared_ptr<std::atomic<size_t>> remaining = std::make_shared<std::atomic<size_t>>(groups.size());
+    for(auto &group : groups)
+    {
+        std::shared_ptr<std::vector<TcpConnectionPtr>> members =
+            std::make_shared<std::vector<TcpConnectionPtr>>(std::move(group.second));
+        group.first->runInLoop([members, payload, remaining, done](){
+            for(const TcpConnectionPtr &conn : *members)
+            {
+                conn->send(payload);
+            }
+            if(--*remaining == 0 && done)
+            {
+                done();
+            }
+        });
+    }
+}
+
+void TcpServer::migrateConnection(const TcpConnectionPtr &conn, EventLoop *ioLoop)
+{
+    conn->getLoop()->runInLoop(std::bind(
+        &TcpServer::migrateConnectionInLoop, this, conn, ioLoop
+    ));
+}
+
+// 在连接当前所属的loop中执行，把连接从这个loop的连接表中摘下来
+void TcpServer::migrateConnectionInLoop(const TcpConnectionPtr &conn, EventLoop *ioLoop)
+{
+    EventLoop *loop = conn->getLoop();
+    if(!loop->isInLoopTread())
+    {
+        // 连接在投递期间已经迁移走了
+        migrateConnection(conn, ioLoop);
+        return;
+    }
+    if(loop == ioLoop || !conn->connected())
+    {
+        return;
+    }
+    if(connectionsOf(loop).erase(conn->id()) == 0)
+    {
+        // 上一次迁移还没完成：还没登记到这个loop，或者已经摘下、channel还没挪走
+        // 放到队列后面，等排在前面的那一步做完再迁，否则连接会留在两个loop的连接表里
+        loop->queueInLoop(std::bind(
+            &TcpServer::migrateConnectionInLoop, this, conn, ioLoop
+        ));
+        return;
+    }
+    conn->migrateTo(ioLoop, std::bind(
+        &TcpServer::attachConnection, this, std::placeholders::_1
+    ));
+}
+
+// 在连接最终所属的loop中执行，登记到这个loop的连接表中
+void TcpServer::attachConnection(const TcpConnectionPtr &conn)
+{
+    if(!conn->disconnected())
+    {
+        connectionsOf(conn->getLoop())[conn->id()] = conn;
+        // 旧loop的共享令牌桶只能在旧loop线程中使用，换成新loop上的
+        setupRateLimiter(conn);
+        if(migrateCallback_)
+        {
+            migrateCallback_(conn);
+        }
+    }
+}
+
+void TcpServer::enableRebalancer(int intervalMs, double imbalanceRatio)
+{
+    std::unique_lock<std::mutex> lock(rebalanceMutex_);
+    if(rebalancerRunning_)
+    {
+        return;
+    }
+    rebalancerRunning_ = true;
+    rebalanceIntervalMs_ = intervalMs;
+    imbalanceRatio_ = imbalanceRatio;
+    rebalancer_.reset(new Thread(std::bind(&TcpServer::rebalancerFunc, this), name_ + "-rebalancer"));
+    rebalancer_->start();
+}
+
+void TcpServer::enableStallDetection(int thresholdMs, int watchdogMs)
+{
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    for(EventLoop *ioLoop : loops)
+    {
+        ioLoop->setStallThreshold(static_cast<int64_t>(thresholdMs) * 1000);
+    }
+    if(watchdogMs > 0 && !watchdog_)
+    {
+        watchdog_.reset(new LoopWatchdog(watchdogMs));
+        for(EventLoop *ioLoop : loops)
+        {
+            watchdog_->watch(ioLoop);
+        }
+        watchdog_->start();
+    }
+}
+
+void TcpServer::enableBusyPoll(int64_t spinMicros, int socketBusyPollMicros)
+{
+    socketBusyPollMicros_ = socketBusyPollMicros;
+    for(EventLoop *ioLoop : threadPool_->getAllLoops())
+    {
+        ioLoop->setBusyPoll(spinMicros);
+    }
+}
+
+void TcpServer::stopRebalancer()
+{
+    {
+        std::unique_lock<std::mutex> lock(rebalanceMutex_);
+        if(!rebalancerRunning_)
+        {
+            return;
+        }
+        rebalancerRunning_ = false;
+    }
+    rebalanceCond_.notify_all();
+    rebalancer_->join();
+}
+
+// 在单独的线程里运行，统计和迁移决策都在这个线程中完成，不占用baseloop
+void TcpServer::rebalancerFunc()
+{
+    std::unique_lock<std::mutex> lock(rebalanceMutex_);
+    while(rebalancerRunning_)
+    {
+        rebalanceCond_.wait_for(lock, std::chrono::milliseconds(rebalanceIntervalMs_));
+        if(!rebalancerRunning_)
+        {
+            break;
+        }
+        lock.unlock();
+        rebalance();
+        lock.lock();
+    }
+}
+
+void TcpServer::rebalance()
+{
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    if(loops.size() < 2)
+    {
+        return;
+    }
+
+    // 每个loop把自己连接表的快照交给负载均衡线程
+    // 等待超时后任务仍可能执行，所以快照放在共享的堆对象上
+    struct Snapshot
+    {
+        std::mutex mutex;
+        std::unordered_map<EventLoop*, std::vector<TcpConnectionPtr>> conns;
+    };
+    std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+    bool complete = EventLoopThreadPool::runInLoopsAndWait(loops, [this, snapshot](EventLoop *loop){
+        std::vector<TcpConnectionPtr> conns;
+        for(auto &item : connectionsOf(loop))
+        {
+            conns.push_back(item.second);
+        }
+        std::unique_lock<std::mutex> lock(snapshot->mutex);
+        snapshot->conns[loop].swap(conns);
+    }, rebalanceIntervalMs_);
+    if(!complete)
+    {
+        return;     // 有loop太忙没有及时响应，这一轮不做调整
+    }
+
+    // 统计这个周期内每个连接和每个loop的繁忙时间
+    std::unordered_map<EventLoop*, uint64_t> loopLoad;
+    std::unordered_map<EventLoop*, std::vector<std::pair<uint64_t, TcpConnectionPtr>>> loopConns;
+    std::unordered_map<uint64_t, uint64_t> currentBusy;
+    for(EventLoop *loop : loops)
+    {
+        loopLoad[loop] = 0;
+        for(const TcpConnectionPtr &conn : snapshot->conns[loop])
+        {
+            uint64_t busy = conn->busyMicros();
+            auto it = lastBusyMicros_.find(conn->id());
+            uint64_t delta = (it == lastBusyMicros_.end()) ? busy : busy - it->second;
+            currentBusy[conn->id()] = busy;
+
+            loopLoad[loop] += delta;
+            loopConns[loop].push_back(std::make_pair(delta, conn));
+        }
+    }
+    lastBusyMicros_.swap(currentBusy);
+    EventLoop *hottest = loops[0];
+    EventLoop *coldest = loops[0];
+    uint64_t total = 0;
+    for(EventLoop *loop : loops)
+    {
+        total += loopLoad[loop];
+        if(loopLoad[loop] > loopLoad[hottest]) hottest = loop;
+        if(loopLoad[loop] < loopLoad[coldest]) coldest = loop;
+    }
+    double average = static_cast<double>(total) / loops.size();
+    uint64_t hotLoad = loopLoad[hottest];
+    uint64_t coldLoad = loopLoad[coldest];
+    if(total == 0 || hotLoad <= average * imbalanceRatio_)
+    {
+        return;
+    }
+
+    // 从最繁忙的连接开始迁移，只迁移能缩小两个loop差距的连接
+    auto &candidates = loopConns[hottest];
+    std::sort(candidates.begin(), candidates.end(),
+        [](const std::pair<uint64_t, TcpConnectionPtr> &a, const std::pair<uint64_t, TcpConnectionPtr> &b)
+        { return a.first > b.first; });
+
+    for(auto &candidate : candidates)
+    {
+        uint64_t delta = candidate.first;
+        if(delta == 0 || hotLoad <= average * imbalanceRatio_)
+        {
+            break;
+        }
+        if(coldLoad + delta >= hotLoad)
+        {
+            continue;   // 迁移后目标loop反而成为最热的loop
+        }
+
+        LOG_INFO("TcpServer::rebalance [%s] - migrate #%lu (busy %lu us) from loop %p to loop %p \n",
+            name_.c_str(), candidate.second->id(), delta, hottest, coldest);
+        migrateConnection(candidate.second, coldest);
+        hotLoad -= delta;
+        coldLoad += delta;
+    }
 }
\ No newline at end of file
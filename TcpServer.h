@@ -9,17 +9,28 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "Thread.h"
+#include "ListenFdExporter.h"
+#include "LoopWatchdog.h"
+#include "CpuAffinity.h"
+#include "RateLimiter.h"
 
 #include <functional>
 #include <string>
 #include <memory>
 #include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+
+class TlsContext;
 
 // 对外的服务器编程使用的类
 class TcpServer : noncopyable
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
+    // 排空进度的回调，参数是还没有关闭的连接数，为0时排空结束，在baseloop中执行
+    using DrainProgressCallback = std::function<void(size_t remaining)>;
 
     enum Option
     {
@@ -31,39 +42,164 @@ public:
                 const InetAddress &listenAddr,
                 const std::string &nameArg,
                 Option option = kNoReusePort);
+    // 热重启的新进程：用从旧进程继承来的listenfd创建服务器，listenfd已经bind并listen过
+    TcpServer(EventLoop *loop,
+                int listenFd,
+                const std::string &nameArg);
     ~TcpServer();
 
+    EventLoop* getLoop() const { return loop_; }
+    const std::string& name() const { return name_; }
+
     void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
     void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
     void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    // 连接迁移到新的loop、登记到那个loop的连接表之后，在新loop线程中调用（conn->getLoop()已经是新loop），
+    // 按loop维护了连接状态的上层在这里把状态挪过去；迁移途中断开了的连接不调用
+    void setMigrateCallback(const MigrateCallback &cb) { migrateCallback_ = cb; }
+
+    // 设置后所有新连接都使用TLS，在start之前调用；同一个TlsContext（包括会话缓存）由所有loop共享
+    void setTlsContext(const std::shared_ptr<TlsContext> &context) { tlsContext_ = context; }
+
+    // 新连接默认的流量控制参数，见TcpConnection::setFlowControl
+    void setFlowControl(size_t highWaterMark, size_t lowWaterMark, size_t inputLimit = 0)
+    { flowHighWaterMark_ = highWaterMark; flowLowWaterMark_ = lowWaterMark; inputLimit_ = inputLimit; }
+
+    // 新连接的令牌桶限速，在start之前调用，见RateLimiter.h
+    // perConnection是每个连接自己的限制；perLoop由同一个subloop上的所有连接共享，
+    // 一个连接再快也只能占用它所在loop的这一份；perPeerIp由同一个loop上来自同一个IP的连接共享
+    void setRateLimits(const RateLimits &perConnection,
+                       const RateLimits &perLoop = RateLimits(),
+                       const RateLimits &perPeerIp = RateLimits())
+    { perConnectionLimits_ = perConnection; perLoopLimits_ = perLoop; perPeerIpLimits_ = perPeerIp; }
+
+    // 汇总所有subloop的运行指标，见EventLoopThreadPool::metricsSnapshot
+    LoopMetricsSnapshot metricsSnapshot(std::vector<LoopMetricsSnapshot> *perLoop = nullptr)
+    { return threadPool_->metricsSnapshot(perLoop); }
 
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
+
+    // 绑核，在start之前调用，见EventLoopThreadPool::setThreadCpus、setBaseLoopCpus
+    void setThreadCpus(const std::vector<std::vector<int>> &cpusPerLoop) { threadPool_->setThreadCpus(cpusPerLoop); }
+    void setBaseLoopCpus(const std::vector<int> &cpus) { threadPool_->setBaseLoopCpus(cpus); }
     
     // 开启服务器监听
     void start();
 
+    // 优雅停止：关闭listenfd不再接收新连接，每个连接处理完正在进行的请求、
+    // 发送完outputBuffer_后关闭，drainTimeoutMs之后强制关闭剩下的连接
+    // drainTimeoutMs为0时立即强制关闭所有连接
+    void stop(int drainTimeoutMs, const DrainProgressCallback &cb = DrainProgressCallback());
+
+    // 热重启的旧进程：在unix域socket path上导出listenfd，
+    // 新进程通过ListenFdExporter::fetch取走后，在baseloop中执行cb，通常在cb里调用stop排空
+    void exportListenFd(const std::string &path, const std::function<void()> &cb);
+
+    // 广播：把同一份payload发给所有连接（或者指定的conns），每个loop只投递一次任务，
+    // 各个连接只持有payload的引用，不拷贝；可以在任意线程调用，返回前不等待发送
+    // 发给所有连接时按各个loop执行任务那一刻的连接表，广播期间被迁移的连接可能收不到，
+    // 也可能在新旧两个loop上各收到一次；所以开启了负载均衡时这个重载拒绝广播，返回false，
+    // done不会被调用。开启了负载均衡或者调用过migrateConnection时传入conns，
+    // 每个连接正好发一次，迁移中的由send转发到新的loop
+    // done不为空时在最后一个loop投递完之后调用（在那个loop的线程中）
+    bool broadcast(const SharedPayload &payload, const std::function<void()> &done = std::function<void()>());
+    void broadcast(const SharedPayload &payload, const std::vector<TcpConnectionPtr> &conns,
+                   const std::function<void()> &done = std::function<void()>());
+
+    // 把一个连接迁移到指定的loop上
+    void migrateConnection(const TcpConnectionPtr &conn, EventLoop *ioLoop);
+
+    // 开启后台负载均衡：每隔intervalMs统计各个subloop在消息回调中花费的时间，
+    // 最繁忙的loop超过平均值的imbalanceRatio倍时，把它上面的连接迁移到最空闲的loop
+    // 需要在start之后调用
+    void enableRebalancer(int intervalMs, double imbalanceRatio = 1.5);
+
+    // 卡顿检测，在start()之后调用
+    // 每个loop中单个handler/functor超过thresholdMs时报告，同时更新metrics里的stalls
+    // watchdogMs大于0时再启动看门狗线程，报告超过watchdogMs还没有回到epoll_wait的loop
+    void enableStallDetection(int thresholdMs, int watchdogMs = 0);
+
+    // 忙轮询，在start()之后调用：每个subloop先自旋spinMicros再阻塞，见EventLoop::setBusyPoll
+    // socketBusyPollMicros大于0时对之后的新连接设置SO_BUSY_POLL
+    // 延迟更低但每个loop会占满一个cpu，应该配合setThreadCpus使用
+    void enableBusyPoll(int64_t spinMicros, int socketBusyPollMicros = 0);
+
 private:
+    // 每个loop一张连接表，用连接id索引，只在所属的loop线程中访问，不需要加锁
+    using ConnectionMap = std::unordered_map<uint64_t, TcpConnectionPtr>;
+
+    TcpServer(EventLoop *loop,
+                const std::string &ipPort,
+                const std::string &nameArg,
+                Acceptor *acceptor);
+
+    void exportListenFdInLoop(const std::string &path, const std::function<void()> &cb);
+
     void newConnection(int sockfd, const InetAddress &peerAddr);
+    void connectEstablishedInLoop(const TcpConnectionPtr &conn);
     void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    ConnectionMap& connectionsOf(EventLoop *ioLoop);
+    // 设置了限速时为连接创建限速器，在连接所属的loop中调用
+    void setupRateLimiter(const TcpConnectionPtr &conn);
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    void migrateConnectionInLoop(const TcpConnectionPtr &conn, EventLoop *ioLoop);
+    void attachConnection(const TcpConnectionPtr &conn);
+
+    void stopInLoop(int drainTimeoutMs, const DrainProgressCallback &cb);
+    void connectionDrained();
+    void reportDrainProgress(size_t remaining);
+    void forceCloseConnections();
+
+    void rebalancerFunc();
+    void rebalance();
+    void stopRebalancer();
 
     EventLoop *loop_;                                   // baseloop，用户定义的
     const std::string ipPort_;
     const std::string name_;
     std::unique_ptr<Acceptor> acceptor_;
     std::shared_ptr<EventLoopThreadPool> threadPool_;   // one loop per thread
+    std::shared_ptr<const std::string> connNamePrefix_; // 所有连接共享的名字前缀 name-ip:port
     
     ConnectionCallback connectionCallback_;             // 有新连接时的回调
     MessageCallback messageCallback_;                   // 有读写消息时的回调
     WriteCompleteCallback writeCompleteCallback_;       // 消息发送完成后的回调
+    MigrateCallback migrateCallback_;                   // 连接迁移到新loop之后的回调
+    size_t flowHighWaterMark_;
+    size_t flowLowWaterMark_;
+    size_t inputLimit_;
+    int socketBusyPollMicros_;
+    std::shared_ptr<TlsContext> tlsContext_;
+    RateLimits perConnectionLimits_;
+    RateLimits perLoopLimits_;
+    RateLimits perPeerIpLimits_;
     
     ThreadInitCallback threadInitCallback_;             // loop线程初始化的回调
     std::atomic_int started_;
 
-    int nextConnId_;
-    ConnectionMap connections_;                         // 保存所有的连接
+    uint64_t nextConnId_;                               // 只在baseloop中访问
+    std::unordered_map<EventLoop*, std::unique_ptr<ConnectionMap>> connectionShards_;
+    // 每个loop的限速状态，和连接表一样在start时建好，只在所属的loop线程中访问；没有设置限速时为空
+    std::unordered_map<EventLoop*, std::unique_ptr<LoopRateLimiter>> rateLimiters_;
+
+    std::unique_ptr<ListenFdExporter> listenFdExporter_;
+    bool listenFdExported_;                             // listenfd已经交给了新进程
+
+    std::atomic_bool stopping_;
+    std::atomic<size_t> drainRemaining_;                // 还没有关闭的排空中的连接数
+    DrainProgressCallback drainProgressCallback_;       // 只在baseloop中访问
+    TimerId drainTimer_;
+
+    // 负载均衡线程负责定时、统计和迁移决策，连接表的快照由各个loop自己提供
+    std::unique_ptr<LoopWatchdog> watchdog_;
+
+    std::unique_ptr<Thread> rebalancer_;
+    std::mutex rebalanceMutex_;
+    std::condition_variable rebalanceCond_;
+    bool rebalancerRunning_;
+    int rebalanceIntervalMs_;
+    double imbalanceRatio_;
+    std::unordered_map<uint64_t, uint64_t> lastBusyMicros_;  // 只在负载均衡线程中访问
 };
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include "Thread.h"
 #include "CurrentThread.h"
+#include "CpuAffinity.h"
 
 #include <semaphore.h>
+#include <pthread.h>
 
 std::atomic_int Thread::numCreated_(0);
 
@@ -30,6 +32,10 @@ void Thread::start(){
     thread_ = std::shared_ptr<std::thread> (new std::thread([&](){
         // 获取线程的tid
         tid_ = CurrentThread::tid();
+        // 内核里的线程名最长15个字符，top -H、perf、gdb中都能看到
+        ::pthread_setname_np(::pthread_self(), name_.substr(0, 15).c_str());
+        // 先绑核再执行线程函数，线程函数里分配的内存首次访问时就落在本地NUMA节点上
+        CpuAffinity::bindCurrentThread(cpus_);
         sem_post(&sem);
         // 开启一个新线程，专门执行该线程函数
         func_();
@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <string>
 #include <atomic>
+#include <vector>
 
 class Thread : noncopyable
 {
@@ -18,6 +19,9 @@ public:
     explicit Thread(ThreadFunc func, const std::string &name = std::string());
     ~Thread();
 
+    // 在start之前设置，新线程开始执行func之前把自己绑定到这些cpu上
+    void setCpuAffinity(const std::vector<int> &cpus) { cpus_ = cpus; }
+
     void start();
     void join();
 
@@ -35,5 +39,6 @@ private:
     pid_t tid_;
     ThreadFunc func_;
     std::string name_;
+    std::vector<int> cpus_;
     static std::atomic_int numCreated_;
 };
\ No newline at end of file
@@ -0,0 +1,22 @@
+#include "Timer.h"
+
+#include "Timestamp.h"
+
+std::atomic<int64_t> Timer::numCreated_(0);
+
+void Timer::restart(int64_t now)
+{
+    if(repeat_)
+    {
+        expiration_ = now + interval_;
+    }
+    else
+    {
+        expiration_ = 0;
+    }
+}
+
+int64_t Timer::now()
+{
+    return Timestamp::monotonicMicros();
+}
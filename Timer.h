@@ -0,0 +1,43 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <functional>
+#include <atomic>
+#include <stdint.h>
+
+// 定时器，时间用单调时钟的微秒数表示，不受系统时间调整的影响
+class Timer : noncopyable
+{
+public:
+    using TimerCallback = std::function<void()>;
+
+    Timer(TimerCallback cb, int64_t when, int64_t intervalMicros)
+        : callback_(std::move(cb))
+        , expiration_(when)
+        , interval_(intervalMicros)
+        , repeat_(intervalMicros > 0)
+        , sequence_(++numCreated_)
+    {}
+
+    void run() const { callback_(); }
+
+    int64_t expiration() const { return expiration_; }
+    bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
+
+    // 重复的定时器，以now为起点计算下一次超时时间
+    void restart(int64_t now);
+
+    // 当前单调时钟的微秒数
+    static int64_t now();
+
+private:
+    const TimerCallback callback_;
+    int64_t expiration_;
+    const int64_t interval_;
+    const bool repeat_;
+    const int64_t sequence_;    // 区分地址相同的新旧定时器
+
+    static std::atomic<int64_t> numCreated_;
+};
@@ -0,0 +1,180 @@
+#include "TimerQueue.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <strings.h>
+#include <errno.h>
+#include <iterator>
+
+static int createTimerfd()
+{
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(timerfd < 0)
+    {
+        LOG_FATAL("timerfd_create err: %d \n", errno);
+    }
+    return timerfd;
+}
+
+// 把timerfd设置为在when时刻超时
+static void resetTimerfd(int timerfd, int64_t when)
+{
+    int64_t micros = when - Timer::now();
+    if(micros < 100)
+    {
+        micros = 100;   // 已经超时的定时器，也要让timerfd尽快触发一次
+    }
+
+    itimerspec newValue;
+    itimerspec oldValue;
+    bzero(&newValue, sizeof newValue);
+    bzero(&oldValue, sizeof oldValue);
+    newValue.it_value.tv_sec = static_cast<time_t>(micros / (1000 * 1000));
+    newValue.it_value.tv_nsec = static_cast<long>((micros % (1000 * 1000)) * 1000);
+    if(::timerfd_settime(timerfd, 0, &newValue, &oldValue) < 0)
+    {
+        LOG_ERROR("timerfd_settime err: %d \n", errno);
+    }
+}
+
+static void readTimerfd(int timerfd)
+{
+    uint64_t howmany;
+    ssize_t n = ::read(timerfd, &howmany, sizeof howmany);
+    if(n != sizeof howmany)
+    {
+        LOG_ERROR("TimerQueue::handleRead() reads %ld bytes instead of 8 \n", n);
+    }
+}
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop)
+    , timerfd_(createTimerfd())
+    , timerfdChannel_(loop, timerfd_)
+    , callingExpiredTimers_(false)
+{
+    timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+    timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue()
+{
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+    for(const Entry &timer : timers_)
+    {
+        delete timer.second;
+    }
+}
+
+TimerId TimerQueue::addTimer(Timer::TimerCallback cb, int64_t when, int64_t intervalMicros)
+{
+    Timer *timer = new Timer(std::move(cb), when, intervalMicros);
+    loop_->runInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
+    return TimerId(timer, timer->sequence());
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
+}
+
+void TimerQueue::addTimerInLoop(Timer *timer)
+{
+    bool earliestChanged = insert(timer);
+    if(earliestChanged)
+    {
+        resetTimerfd(timerfd_, timer->expiration());
+    }
+}
+
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    ActiveTimer timer(timerId.timer_, timerId.sequence_);
+    auto it = activeTimers_.find(timer);
+    if(it != activeTimers_.end())
+    {
+        timers_.erase(Entry(it->first->expiration(), it->first));
+        delete it->first;
+        activeTimers_.erase(it);
+    }
+    else if(callingExpiredTimers_)
+    {
+        // 正在执行的定时器取消了自己，reset时不再重新加入
+        cancelingTimers_.insert(timer);
+    }
+}
+
+void TimerQueue::handleRead()
+{
+    int64_t now = Timer::now();
+    readTimerfd(timerfd_);
+
+    std::vector<Entry> expired = getExpired(now);
+
+    callingExpiredTimers_ = true;
+    cancelingTimers_.clear();
+    for(const Entry &it : expired)
+    {
+        it.second->run();
+    }
+    callingExpiredTimers_ = false;
+
+    reset(expired, now);
+}
+
+std::vector<TimerQueue::Entry> TimerQueue::getExpired(int64_t now)
+{
+    std::vector<Entry> expired;
+    // 超时时间不大于now的定时器都已经超时
+    Entry sentry(now, reinterpret_cast<Timer*>(UINTPTR_MAX));
+    auto end = timers_.lower_bound(sentry);
+    std::copy(timers_.begin(), end, std::back_inserter(expired));
+    timers_.erase(timers_.begin(), end);
+
+    for(const Entry &it : expired)
+    {
+        activeTimers_.erase(ActiveTimer(it.second, it.second->sequence()));
+    }
+    return expired;
+}
+
+void TimerQueue::reset(const std::vector<Entry> &expired, int64_t now)
+{
+    for(const Entry &it : expired)
+    {
+        ActiveTimer timer(it.second, it.second->sequence());
+        if(it.second->repeat()
+            && cancelingTimers_.find(timer) == cancelingTimers_.end())
+        {
+            it.second->restart(now);
+            insert(it.second);
+        }
+        else
+        {
+            delete it.second;
+        }
+    }
+
+    if(!timers_.empty())
+    {
+        resetTimerfd(timerfd_, timers_.begin()->second->expiration());
+    }
+}
+
+bool TimerQueue::insert(Timer *timer)
+{
+    bool earliestChanged = false;
+    int64_t when = timer->expiration();
+    auto it = timers_.begin();
+    if(it == timers_.end() || when < it->first)
+    {
+        earliestChanged = true;
+    }
+    timers_.insert(Entry(when, timer));
+    activeTimers_.insert(ActiveTimer(timer, timer->sequence()));
+    return earliestChanged;
+}
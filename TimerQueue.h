@@ -0,0 +1,51 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Channel.h"
+#include "Timer.h"
+#include "TimerId.h"
+
+#include <set>
+#include <vector>
+#include <utility>
+
+class EventLoop;
+
+// 定时器队列，底层用timerfd把定时事件接入poller，和其他fd的事件统一处理
+// 所有定时器按超时时间排序，timerfd总是设置为最早的那个超时时间
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 可以跨线程调用，when是单调时钟的微秒数，interval大于0表示重复的定时器
+    TimerId addTimer(Timer::TimerCallback cb, int64_t when, int64_t intervalMicros);
+    void cancel(TimerId timerId);
+
+private:
+    using Entry = std::pair<int64_t, Timer*>;
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer*, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    // timerfd可读时的回调
+    void handleRead();
+
+    // 取出所有超时的定时器
+    std::vector<Entry> getExpired(int64_t now);
+    void reset(const std::vector<Entry> &expired, int64_t now);
+    // 返回最早的超时时间是否改变
+    bool insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+    TimerList timers_;              // 按超时时间排序
+
+    ActiveTimerSet activeTimers_;   // 和timers_保存的是同一批定时器，按地址排序
+    bool callingExpiredTimers_;
+    ActiveTimerSet cancelingTimers_;    // 在自己的回调中被取消的定时器
+};
@@ -1,6 +1,12 @@
 #include "Timestamp.h"
 
 #include <time.h>
+#include <stdio.h>
+
+// 每个线程缓存上一次格式化的秒数和结果，同一秒内的日志不再调用localtime_r
+__thread time_t t_lastSecond = -1;
+// 按每个int字段最长11个字符留足空间，编译器能确认snprintf不会截断
+__thread char t_time[72];
 
 Timestamp::Timestamp() : microSecondsSinceEpoch_(0){}
 
@@ -9,28 +15,39 @@ Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
     {}
 
 Timestamp Timestamp::now(){
-    return Timestamp(time(nullptr));  // time_t
+    timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return Timestamp(static_cast<int64_t>(ts.tv_sec) * kMicroSecondsPerSecond + ts.tv_nsec / 1000);
 }
 
-std::string Timestamp::tostring() const {
-    char buf[128] = {0};
-    tm* tm_time = localtime(&microSecondsSinceEpoch_);
-    // 年从1900开始，月0~11要+1
-    snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d",
-        tm_time->tm_year + 1900,
-        tm_time->tm_mon + 1,
-        tm_time->tm_mday,
-        tm_time->tm_hour,
-        tm_time->tm_min,
-        tm_time->tm_sec
-    );
+int64_t Timestamp::monotonicMicros(){
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * kMicroSecondsPerSecond + ts.tv_nsec / 1000;
+}
 
+std::string Timestamp::tostring(bool showMicroseconds) const {
+    time_t seconds = secondsSinceEpoch();
+    if(seconds != t_lastSecond){
+        t_lastSecond = seconds;
+        tm tm_time;
+        ::localtime_r(&seconds, &tm_time);
+        // 年从1900开始，月0~11要+1
+        snprintf(t_time, sizeof t_time, "%4d/%02d/%02d %02d:%02d:%02d",
+            tm_time.tm_year + 1900,
+            tm_time.tm_mon + 1,
+            tm_time.tm_mday,
+            tm_time.tm_hour,
+            tm_time.tm_min,
+            tm_time.tm_sec
+        );
+    }
+
+    if(!showMicroseconds){
+        return t_time;
+    }
+    char buf[sizeof t_time + 16] = {0};
+    snprintf(buf, sizeof buf, "%s.%06d", t_time,
+        static_cast<int>(microSecondsSinceEpoch_ % kMicroSecondsPerSecond));
     return buf;
 }
-
-
-// 测试
-// int main(){
-//     std::cout << Timestamp::now().tostring() << std::endl;
-//     return 0;
-// }
\ No newline at end of file
@@ -2,7 +2,10 @@
 
 #include <iostream>
 #include <string>
+#include <stdint.h>
+#include <time.h>
 
+// 时间戳，保存的是从1970年开始的微秒数(CLOCK_REALTIME)
 class Timestamp
 {
 public:
@@ -10,7 +13,36 @@ public:
     // 防止隐式转换
     explicit Timestamp(int64_t microSecondsSinceEpoch);
     static Timestamp now();
-    std::string tostring() const;   // 只读
+
+    // 单调时钟的微秒数，不受系统时间调整的影响，用来计算耗时和定时器
+    static int64_t monotonicMicros();
+
+    // 格式 2024/05/15 12:00:00[.123456]
+    // 日期部分每个线程缓存一份，同一秒内只格式化微秒部分，线程安全
+    std::string tostring(bool showMicroseconds = false) const;   // 只读
+
+    int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+    time_t secondsSinceEpoch() const
+    { return static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond); }
+    bool valid() const { return microSecondsSinceEpoch_ > 0; }
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
 private:
     int64_t microSecondsSinceEpoch_;
 };
+
+inline bool operator<(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+// high - low 的微秒数
+inline int64_t timeDifference(Timestamp high, Timestamp low)
+{
+    return high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+}
@@ -0,0 +1,189 @@
+#include "TlsContext.h"
+#include "TlsSession.h"
+#include "Logger.h"
+
+#include <openssl/err.h>
+
+static void logSslErrors(const char *what)
+{
+    unsigned long err;
+    while((err = ERR_get_error()) != 0)
+    {
+        // 不能叫buf，LOG_ERROR宏里有一个同名的局部数组
+        char errbuf[256];
+        ERR_error_string_n(err, errbuf, sizeof errbuf);
+        LOG_ERROR("%s: %s \n", what, errbuf);
+    }
+}
+
+TlsContext::TlsContext(Mode mode)
+    : ctx_(SSL_CTX_new(mode == kServer ? TLS_server_method() : TLS_client_method()))
+    , mode_(mode)
+    , kernelTls_(false)
+    , handshakes_(0)
+    , resumedHandshakes_(0)
+    , kernelTlsConnections_(0)
+{
+    if(ctx_ == nullptr)
+    {
+        logSslErrors("SSL_CTX_new");
+        LOG_FATAL("TlsContext create SSL_CTX fail \n");
+    }
+    SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+    SSL_CTX_set_mode(ctx_, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    if(mode_ == kServer)
+    {
+        SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER);
+        static const unsigned char kSessionIdContext[] = "mymuduo";
+        SSL_CTX_set_session_id_context(ctx_, kSessionIdContext, sizeof kSessionIdContext - 1);
+    }
+    else
+    {
+        // 客户端的会话由新会话回调存进sessions_，不使用OpenSSL内部的客户端缓存
+        SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx_, &TlsContext::newSessionCallback);
+    }
+}
+
+TlsContext::~TlsContext()
+{
+    for(auto &item : sessions_)
+    {
+        SSL_SESSION_free(item.second);
+    }
+    SSL_CTX_free(ctx_);
+}
+
+bool TlsContext::loadCertificate(const std::string &certFile, const std::string &keyFile)
+{
+    if(SSL_CTX_use_certificate_chain_file(ctx_, certFile.c_str()) != 1
+        || SSL_CTX_use_PrivateKey_file(ctx_, keyFile.c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(ctx_) != 1)
+    {
+        logSslErrors("TlsContext::loadCertificate");
+        return false;
+    }
+    return true;
+}
+
+bool TlsContext::useCertificate(X509 *cert, EVP_PKEY *key)
+{
+    if(SSL_CTX_use_certificate(ctx_, cert) != 1
+        || SSL_CTX_use_PrivateKey(ctx_, key) != 1
+        || SSL_CTX_check_private_key(ctx_) != 1)
+    {
+        logSslErrors("TlsContext::useCertificate");
+        return false;
+    }
+    return true;
+}
+
+bool TlsContext::setVerifyPeer(bool on, const std::string &caFile)
+{
+    SSL_CTX_set_verify(ctx_, on ? SSL_VERIFY_PEER : SSL_VERIFY_NONE, nullptr);
+    if(!on)
+    {
+        return true;
+    }
+    int ret = caFile.empty() ? SSL_CTX_set_default_verify_paths(ctx_)
+                             : SSL_CTX_load_verify_locations(ctx_, caFile.c_str(), nullptr);
+    if(ret != 1)
+    {
+        logSslErrors("TlsContext::setVerifyPeer");
+        return false;
+    }
+    return true;
+}
+
+void TlsContext::setKernelTls(bool on)
+{
+    kernelTls_ = on;
+    SSL_CTX_set_keylog_callback(ctx_, on ? &TlsContext::keylogCallback : nullptr);
+}
+
+void TlsContext::setSessionCacheSize(long size)
+{
+    if(size > 0)
+    {
+        SSL_CTX_sess_set_cache_size(ctx_, size);
+    }
+    else
+    {
+        SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_OFF);
+    }
+}
+
+void TlsContext::setSessionTickets(int numTickets)
+{
+    SSL_CTX_set_num_tickets(ctx_, numTickets);
+    if(numTickets == 0)
+    {
+        SSL_CTX_set_options(ctx_, SSL_OP_NO_TICKET);
+    }
+    else
+    {
+        SSL_CTX_clear_options(ctx_, SSL_OP_NO_TICKET);
+    }
+}
+
+SSL_SESSION* TlsContext::findSession(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sessions_.find(key);
+    if(it == sessions_.end())
+    {
+        return nullptr;
+    }
+    SSL_SESSION_up_ref(it->second);
+    return it->second;
+}
+
+void TlsContext::saveSession(const std::string &key, SSL_SESSION *session)
+{
+    SSL_SESSION_up_ref(session);
+    SSL_SESSION *old = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SSL_SESSION *&slot = sessions_[key];
+        old = slot;
+        slot = session;
+    }
+    if(old != nullptr)
+    {
+        SSL_SESSION_free(old);
+    }
+}
+
+void TlsContext::onHandshakeDone(bool resumed, bool kernelTx)
+{
+    ++handshakes_;
+    if(resumed)
+    {
+        ++resumedHandshakes_;
+    }
+    if(kernelTx)
+    {
+        ++kernelTlsConnections_;
+    }
+}
+
+// 客户端收到新的会话（TLS1.3里是握手之后的NewSessionTicket）
+int TlsContext::newSessionCallback(SSL *ssl, SSL_SESSION *session)
+{
+    TlsSession *tls = static_cast<TlsSession*>(SSL_get_app_data(ssl));
+    if(tls != nullptr && !tls->sessionKey().empty())
+    {
+        tls->context()->saveSession(tls->sessionKey(), session);
+    }
+    return 0;   // 没有接管session的引用
+}
+
+// kTLS需要发送方向的流量密钥，OpenSSL只通过keylog回调交出来
+void TlsContext::keylogCallback(const SSL *ssl, const char *line)
+{
+    TlsSession *tls = static_cast<TlsSession*>(SSL_get_app_data(ssl));
+    if(tls != nullptr)
+    {
+        tls->onKeylogLine(line);
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <openssl/ssl.h>
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <stdint.h>
+
+// 一个SSL_CTX：证书、协议参数和会话缓存，所有loop上的连接共享同一个TlsContext
+// 服务端的会话缓存和ticket密钥在SSL_CTX里，任何loop上的连接都可以恢复其他loop建立的会话
+// 客户端按serverName缓存最近的会话，下次连接同一个服务端时带上它
+// 配置都在创建连接之前完成，之后只读
+class TlsContext : noncopyable
+{
+public:
+    enum Mode
+    {
+        kServer,
+        kClient,
+    };
+
+    explicit TlsContext(Mode mode);
+    ~TlsContext();
+
+    Mode mode() const { return mode_; }
+    SSL_CTX* nativeHandle() { return ctx_; }
+
+    // PEM格式的证书链和私钥
+    bool loadCertificate(const std::string &certFile, const std::string &keyFile);
+    // 直接使用内存中的证书和私钥（比如测试时临时生成的自签名证书），会增加它们的引用计数
+    bool useCertificate(X509 *cert, EVP_PKEY *key);
+    // 校验对端证书，caFile为空时使用系统默认的CA
+    bool setVerifyPeer(bool on, const std::string &caFile = std::string());
+    // 最低协议版本，默认TLS1.2
+    void setMinVersion(int version) { SSL_CTX_set_min_proto_version(ctx_, version); }
+
+    // 会话缓存的容量，0表示不缓存（客户端不再保存会话，也就不会恢复）
+    void setSessionCacheSize(long size);
+    // TLS1.3每次握手后发送的ticket数，TLS1.2是否使用ticket
+    void setSessionTickets(int numTickets);
+
+    // kTLS：握手完成后把发送方向的加密交给内核，之后明文直接写socket，sendfile也可以用
+    // 目前只支持TLS1.3的AES-GCM，内核不支持时退回到用户态加密
+    void setKernelTls(bool on);
+    bool kernelTls() const { return kernelTls_; }
+
+    // 客户端会话缓存，返回的会话引用计数已经加1，用完调用SSL_SESSION_free
+    SSL_SESSION* findSession(const std::string &key);
+    void saveSession(const std::string &key, SSL_SESSION *session);
+
+    // 统计，近似值
+    uint64_t handshakes() const { return handshakes_; }
+    uint64_t resumedHandshakes() const { return resumedHandshakes_; }
+    uint64_t kernelTlsConnections() const { return kernelTlsConnections_; }
+    void onHandshakeDone(bool resumed, bool kernelTx);
+
+private:
+    static int newSessionCallback(SSL *ssl, SSL_SESSION *session);
+    static void keylogCallback(const SSL *ssl, const char *line);
+
+    SSL_CTX *ctx_;
+    const Mode mode_;
+    bool kernelTls_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, SSL_SESSION*> sessions_;    // 只有客户端使用
+
+    std::atomic<uint64_t> handshakes_;
+    std::atomic<uint64_t> resumedHandshakes_;
+    std::atomic<uint64_t> kernelTlsConnections_;
+};
@@ -0,0 +1,413 @@
+#include "TlsSession.h"
+#include "Logger.h"
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+
+#include <algorithm>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+static const size_t kReadChunk = 16 * 1024;     // 一条TLS记录的最大明文长度
+
+// 直接读写Buffer的BIO：读时从Buffer取走数据，写时追加到Buffer
+static int bufferBioWrite(BIO *bio, const char *data, int len)
+{
+    static_cast<Buffer*>(BIO_get_data(bio))->append(data, len);
+    return len;
+}
+
+static int bufferBioRead(BIO *bio, char *data, int len)
+{
+    Buffer *buf = static_cast<Buffer*>(BIO_get_data(bio));
+    BIO_clear_retry_flags(bio);
+    if(buf->readableBytes() == 0)
+    {
+        BIO_set_retry_read(bio);
+        return -1;
+    }
+    size_t n = std::min(buf->readableBytes(), static_cast<size_t>(len));
+    ::memcpy(data, buf->peek(), n);
+    buf->retrieve(n);
+    return static_cast<int>(n);
+}
+
+static long bufferBioCtrl(BIO *bio, int cmd, long, void*)
+{
+    switch(cmd)
+    {
+    case BIO_CTRL_FLUSH:
+        return 1;
+    case BIO_CTRL_PENDING:
+        return static_cast<long>(static_cast<Buffer*>(BIO_get_data(bio))->readableBytes());
+    default:
+        return 0;
+    }
+}
+
+static int bufferBioCreate(BIO *bio)
+{
+    BIO_set_init(bio, 1);
+    return 1;
+}
+
+static BIO_METHOD* bufferBioMethod()
+{
+    static BIO_METHOD *method = [](){
+        BIO_METHOD *m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "mymuduo buffer");
+        BIO_meth_set_write(m, bufferBioWrite);
+        BIO_meth_set_read(m, bufferBioRead);
+        BIO_meth_set_ctrl(m, bufferBioCtrl);
+        BIO_meth_set_create(m, bufferBioCreate);
+        return m;
+    }();
+    return method;
+}
+
+static BIO* newBufferBio(Buffer *buf)
+{
+    BIO *bio = BIO_new(bufferBioMethod());
+    BIO_set_data(bio, buf);
+    return bio;
+}
+
+// 数一段密文里有几条TLS记录
+static uint64_t countRecords(const char *data, size_t len)
+{
+    uint64_t count = 0;
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+    while(len >= 5)
+    {
+        size_t recordLen = 5 + ((p[3] << 8) | p[4]);
+        if(recordLen > len)
+        {
+            break;
+        }
+        ++count;
+        p += recordLen;
+        len -= recordLen;
+    }
+    return count;
+}
+
+// RFC 8446 7.1 HKDF-Expand-Label(secret, label, "", length)
+static bool hkdfExpandLabel(const EVP_MD *md, const std::string &secret, const char *label,
+                            unsigned char *out, size_t length)
+{
+    std::string info;
+    std::string fullLabel = std::string("tls13 ") + label;
+    info.push_back(static_cast<char>(length >> 8));
+    info.push_back(static_cast<char>(length & 0xFF));
+    info.push_back(static_cast<char>(fullLabel.size()));
+    info += fullLabel;
+    info.push_back(0);
+
+    EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+    bool ok = pctx != nullptr
+        && EVP_PKEY_derive_init(pctx) > 0
+        && EVP_PKEY_CTX_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0
+        && EVP_PKEY_CTX_set_hkdf_md(pctx, md) > 0
+        && EVP_PKEY_CTX_set1_hkdf_key(pctx, reinterpret_cast<const unsigned char*>(secret.data()),
+                                      static_cast<int>(secret.size())) > 0
+        && EVP_PKEY_CTX_add1_hkdf_info(pctx, reinterpret_cast<const unsigned char*>(info.data()),
+                                       static_cast<int>(info.size())) > 0
+        && EVP_PKEY_derive(pctx, out, &length) > 0;
+    EVP_PKEY_CTX_free(pctx);
+    return ok;
+}
+
+TlsSession::TlsSession(const std::shared_ptr<TlsContext> &context,
+                       const std::string &serverName,
+                       const std::string &sessionKey)
+    : context_(context)
+    , sessionKey_(sessionKey)
+    , ssl_(SSL_new(context->nativeHandle()))
+    , established_(false)
+    , closeNotifySent_(false)
+    , kernelTx_(false)
+    , txSequence_(0)
+{
+    if(ssl_ == nullptr)
+    {
+        LOG_FATAL("TlsSession SSL_new fail \n");
+    }
+    SSL_set_app_data(ssl_, this);
+    SSL_set_bio(ssl_, newBufferBio(&cipherIn_), newBufferBio(&cipherOut_));
+    if(context_->mode() == TlsContext::kServer)
+    {
+        SSL_set_accept_state(ssl_);
+    }
+    else
+    {
+        SSL_set_connect_state(ssl_);
+        if(!serverName.empty())
+        {
+            SSL_set_tlsext_host_name(ssl_, serverName.c_str());
+        }
+        if(!sessionKey_.empty())
+        {
+            SSL_SESSION *session = context_->findSession(sessionKey_);
+            if(session != nullptr)
+            {
+                SSL_set_session(ssl_, session);
+                SSL_SESSION_free(session);
+            }
+        }
+    }
+}
+
+TlsSession::~TlsSession()
+{
+    OPENSSL_cleanse(&txSecret_[0], txSecret_.size());
+    SSL_free(ssl_);
+}
+
+void TlsSession::fail(const char *what, int ret)
+{
+    // errno要在调用OpenSSL之前取，SSL_get_error/ERR_get_error可能改掉它
+    int savedErrno = errno;
+    int err = SSL_get_error(ssl_, ret);
+    unsigned long code = ERR_get_error();
+    char errbuf[256] = "";
+    if(code != 0)
+    {
+        ERR_error_string_n(code, errbuf, sizeof errbuf);
+    }
+    ERR_clear_error();
+    LOG_ERROR("TlsSession %s fail, ssl error:%d errno:%d %s \n", what, err, savedErrno, errbuf);
+}
+
+bool TlsSession::process(Buffer *plain)
+{
+    if(!established_)
+    {
+        size_t before = cipherOut_.readableBytes();
+        int ret = SSL_do_handshake(ssl_);
+        if(ret != 1)
+        {
+            int err = SSL_get_error(ssl_, ret);
+            if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+            {
+                return true;
+            }
+            fail("handshake", ret);
+            return false;
+        }
+        established_ = true;
+        if(context_->mode() == TlsContext::kServer)
+        {
+            // 服务端最后一步收到客户端的Finished，这一步发出的只有用应用流量密钥加密的NewSessionTicket
+            txSequence_ = countRecords(cipherOut_.peek() + before, cipherOut_.readableBytes() - before);
+        }
+    }
+
+    while(true)
+    {
+        plain->ensureWritableBytes(kReadChunk);
+        int n = SSL_read(ssl_, plain->beginWrite(), static_cast<int>(plain->writableBytes()));
+        if(n > 0)
+        {
+            plain->hasWritten(n);
+            continue;
+        }
+        int err = SSL_get_error(ssl_, n);
+        if(err == SSL_ERROR_WANT_READ)
+        {
+            return true;
+        }
+        if(err == SSL_ERROR_ZERO_RETURN)
+        {
+            // 对端发来close_notify，后面通常紧跟着FIN，由socket的EOF走正常的关闭流程
+            return true;
+        }
+        fail("read", n);
+        return false;
+    }
+}
+
+bool TlsSession::encrypt(const void *data, size_t len)
+{
+    if(!established_)
+    {
+        pending_.append(static_cast<const char*>(data), len);
+        return true;
+    }
+    const char *p = static_cast<const char*>(data);
+    while(len > 0)
+    {
+        int chunk = static_cast<int>(std::min(len, static_cast<size_t>(INT_MAX)));
+        int n = SSL_write(ssl_, p, chunk);
+        if(n <= 0)
+        {
+            fail("write", n);
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+void TlsSession::shutdown()
+{
+    if(established_ && !closeNotifySent_)
+    {
+        closeNotifySent_ = true;
+        SSL_shutdown(ssl_);
+        ERR_clear_error();
+    }
+}
+
+bool TlsSession::resumed() const
+{
+    return SSL_session_reused(ssl_) == 1;
+}
+
+const char* TlsSession::version() const
+{
+    return SSL_get_version(ssl_);
+}
+
+const char* TlsSession::cipherName() const
+{
+    return SSL_get_cipher_name(ssl_);
+}
+
+void TlsSession::onKeylogLine(const char *line)
+{
+    // "SERVER_TRAFFIC_SECRET_0 <client_random> <secret>"，客户端发送用的是CLIENT_TRAFFIC_SECRET_0
+    const char *label = context_->mode() == TlsContext::kServer ? "SERVER_TRAFFIC_SECRET_0 " : "CLIENT_TRAFFIC_SECRET_0 ";
+    if(::strncmp(line, label, ::strlen(label)) != 0)
+    {
+        return;
+    }
+    const char *hex = ::strrchr(line, ' ');
+    if(hex == nullptr)
+    {
+        return;
+    }
+    ++hex;
+    txSecret_.clear();
+    for(size_t i = 0; hex[i] != '\0' && hex[i + 1] != '\0'; i += 2)
+    {
+        char byte[3] = { hex[i], hex[i + 1], '\0' };
+        txSecret_.push_back(static_cast<char>(::strtol(byte, nullptr, 16)));
+    }
+}
+
+bool TlsSession::enableKernelTx(int fd)
+{
+    if(!established_ || kernelTx_ || txSecret_.empty() || SSL_version(ssl_) != TLS1_3_VERSION)
+    {
+        return false;
+    }
+    const SSL_CIPHER *cipher = SSL_get_current_cipher(ssl_);
+    uint16_t id = static_cast<uint16_t>(SSL_CIPHER_get_id(cipher) & 0xFFFF);
+    const EVP_MD *md = SSL_CIPHER_get_handshake_digest(cipher);
+
+    unsigned char key[32];
+    unsigned char iv[12];
+    union
+    {
+        tls12_crypto_info_aes_gcm_128 aes128;
+        tls12_crypto_info_aes_gcm_256 aes256;
+    } info;
+    ::memset(&info, 0, sizeof info);
+    size_t infoLen = 0;
+    size_t keyLen = 0;
+    if(id == 0x1301)            // TLS_AES_128_GCM_SHA256
+    {
+        keyLen = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+        infoLen = sizeof info.aes128;
+    }
+    else if(id == 0x1302)       // TLS_AES_256_GCM_SHA384
+    {
+        keyLen = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+        infoLen = sizeof info.aes256;
+    }
+    else
+    {
+        return false;
+    }
+    if(!hkdfExpandLabel(md, txSecret_, "key", key, keyLen) || !hkdfExpandLabel(md, txSecret_, "iv", iv, sizeof iv))
+    {
+        return false;
+    }
+
+    // 内核的nonce是salt(4字节)+iv(8字节)，再和记录序号异或
+    unsigned char seq[8];
+    for(int i = 0; i < 8; ++i)
+    {
+        seq[i] = static_cast<unsigned char>(txSequence_ >> (56 - 8 * i));
+    }
+    if(keyLen == TLS_CIPHER_AES_GCM_128_KEY_SIZE)
+    {
+        info.aes128.info.version = TLS_1_3_VERSION;
+        info.aes128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+        ::memcpy(info.aes128.key, key, keyLen);
+        ::memcpy(info.aes128.salt, iv, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+        ::memcpy(info.aes128.iv, iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+        ::memcpy(info.aes128.rec_seq, seq, sizeof seq);
+    }
+    else
+    {
+        info.aes256.info.version = TLS_1_3_VERSION;
+        info.aes256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+        ::memcpy(info.aes256.key, key, keyLen);
+        ::memcpy(info.aes256.salt, iv, TLS_CIPHER_AES_GCM_256_SALT_SIZE);
+        ::memcpy(info.aes256.iv, iv + TLS_CIPHER_AES_GCM_256_SALT_SIZE, TLS_CIPHER_AES_GCM_256_IV_SIZE);
+        ::memcpy(info.aes256.rec_seq, seq, sizeof seq);
+    }
+
+    bool ok = ::setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof "tls") == 0
+        && ::setsockopt(fd, SOL_TLS, TLS_TX, &info, static_cast<socklen_t>(infoLen)) == 0;
+    if(!ok)
+    {
+        // 内核没有tls模块时是ENOENT，退回到用户态加密
+        LOG_DEBUG("TlsSession::enableKernelTx fd:%d errno:%d \n", fd, errno);
+    }
+    OPENSSL_cleanse(key, sizeof key);
+    OPENSSL_cleanse(iv, sizeof iv);
+    OPENSSL_cleanse(&info, sizeof info);
+    OPENSSL_cleanse(&txSecret_[0], txSecret_.size());
+    txSecret_.clear();
+    kernelTx_ = ok;
+    return ok;
+}
+
+bool TlsSession::sendKernelCloseNotify(int fd)
+{
+    if(!kernelTx_ || closeNotifySent_)
+    {
+        return false;
+    }
+    closeNotifySent_ = true;
+    unsigned char alert[2] = { 1, 0 };      // warning, close_notify
+    char control[CMSG_SPACE(sizeof(unsigned char))];
+    ::memset(control, 0, sizeof control);
+    iovec iov;
+    iov.iov_base = alert;
+    iov.iov_len = sizeof alert;
+    msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_TLS;
+    cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+    *CMSG_DATA(cmsg) = 21;                   // alert
+    return ::sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof alert;
+}
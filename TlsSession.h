@@ -0,0 +1,69 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Buffer.h"
+#include "TlsContext.h"
+
+#include <memory>
+#include <string>
+
+// 一个连接上的TLS状态，只在连接所属的loop线程中使用
+// SSL的两个BIO直接读写下面的两个Buffer：socket读到的密文追加到cipherInput，
+// SSL产生的密文（握手消息、加密后的数据、alert）追加到cipherOutput，由TcpConnection写给socket
+// 加解密都在这两个Buffer和连接的inputBuffer_之间进行，不经过额外的内存BIO拷贝
+class TlsSession : noncopyable
+{
+public:
+    // 客户端的serverName非空时用于SNI，sessionKey非空时从context的缓存中取会话尝试恢复
+    TlsSession(const std::shared_ptr<TlsContext> &context,
+               const std::string &serverName = std::string(),
+               const std::string &sessionKey = std::string());
+    ~TlsSession();
+
+    TlsContext* context() const { return context_.get(); }
+    const std::string& sessionKey() const { return sessionKey_; }
+
+    Buffer* cipherInput() { return &cipherIn_; }
+    Buffer* cipherOutput() { return &cipherOut_; }
+    // 握手完成之前发送的明文，握手完成后再加密发出
+    Buffer* pendingPlaintext() { return &pending_; }
+
+    // 推进握手，然后把cipherInput中能解密的记录解密后追加到plain
+    // 客户端第一次调用时生成ClientHello；返回false表示协议错误，连接应该关闭
+    bool process(Buffer *plain);
+    // 加密后追加到cipherOutput，握手还没完成时先放进pendingPlaintext
+    bool encrypt(const void *data, size_t len);
+    // 生成close_notify
+    void shutdown();
+
+    bool established() const { return established_; }
+    bool resumed() const;
+    // 协议版本和加密套件，比如"TLSv1.3"、"TLS_AES_128_GCM_SHA256"
+    const char* version() const;
+    const char* cipherName() const;
+
+    // 握手完成、握手消息都已经写给socket之后调用：把发送方向的加密交给内核
+    // 成功后发送的明文直接写socket，不再经过encrypt
+    bool enableKernelTx(int fd);
+    bool kernelTx() const { return kernelTx_; }
+    // kTLS下的close_notify要通过带记录类型的sendmsg发出
+    bool sendKernelCloseNotify(int fd);
+
+    // 由TlsContext的keylog回调调用
+    void onKeylogLine(const char *line);
+
+private:
+    void fail(const char *what, int ret);
+
+    std::shared_ptr<TlsContext> context_;
+    const std::string sessionKey_;
+    SSL *ssl_;
+    Buffer cipherIn_;
+    Buffer cipherOut_;
+    Buffer pending_;
+    bool established_;
+    bool closeNotifySent_;
+    bool kernelTx_;
+    std::string txSecret_;          // 发送方向的TLS1.3流量密钥，只在开启kTLS时记录
+    uint64_t txSequence_;           // 握手完成时已经用应用流量密钥发出的记录数（服务端的NewSessionTicket）
+};
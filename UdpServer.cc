@@ -0,0 +1,120 @@
+#include "UdpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <algorithm>
+
+const size_t kDefaultBatchSize = 64;
+const size_t kDefaultMaxDatagramSize = 2048;
+
+UdpServer::UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg)
+    : loop_(loop)
+    , listenAddr_(listenAddr)
+    , name_(nameArg)
+    , threadPool_(new EventLoopThreadPool(loop, nameArg))
+    , batchSize_(kDefaultBatchSize)
+    , maxDatagramSize_(kDefaultMaxDatagramSize)
+    , gro_(false)
+    , started_(false)
+{
+    if(loop_ == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d mainloop is null! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+}
+
+UdpServer::~UdpServer()
+{
+    if(!started_)
+    {
+        return;
+    }
+    // socket的channel只能在自己的loop中移除
+    runInSocketLoops([this](EventLoop*, size_t i){
+        sockets_[i].reset();
+    });
+}
+
+void UdpServer::start()
+{
+    if(started_)
+    {
+        return;
+    }
+    started_ = true;
+    threadPool_->start(threadInitCallback_);
+    loops_ = threadPool_->getAllLoops();
+    sockets_.resize(loops_.size());
+    runInSocketLoops([this](EventLoop *loop, size_t i){
+        UdpSocket *socket = new UdpSocket(loop, listenAddr_, true);
+        socket->setMessageCallback(messageCallback_);
+        socket->setBatchSize(batchSize_);
+        socket->setMaxDatagramSize(maxDatagramSize_);
+        if(gro_)
+        {
+            socket->enableGro(true);
+        }
+        socket->start();
+        sockets_[i].reset(socket);
+    });
+    LOG_INFO("UdpServer [%s] started on %s with %zu sockets \n",
+        name_.c_str(), listenAddr_.toIpPort().c_str(), sockets_.size());
+}
+
+void UdpServer::runInSocketLoops(const std::function<void(EventLoop*, size_t)> &func)
+{
+    EventLoopThreadPool::runInLoopsAndWait(loops_, [this, &func](EventLoop *loop){
+        size_t i = std::find(loops_.begin(), loops_.end(), loop) - loops_.begin();
+        func(loop, i);
+    });
+}
+
+uint64_t UdpServer::datagramsReceived() const
+{
+    uint64_t total = 0;
+    for(auto &socket : sockets_)
+    {
+        total += socket->datagramsReceived();
+    }
+    return total;
+}
+
+uint64_t UdpServer::recvCalls() const
+{
+    uint64_t total = 0;
+    for(auto &socket : sockets_)
+    {
+        total += socket->recvCalls();
+    }
+    return total;
+}
+
+uint64_t UdpServer::datagramsSent() const
+{
+    uint64_t total = 0;
+    for(auto &socket : sockets_)
+    {
+        total += socket->datagramsSent();
+    }
+    return total;
+}
+
+uint64_t UdpServer::sendDrops() const
+{
+    uint64_t total = 0;
+    for(auto &socket : sockets_)
+    {
+        total += socket->sendDrops();
+    }
+    return total;
+}
+
+uint64_t UdpServer::truncatedDrops() const
+{
+    uint64_t total = 0;
+    for(auto &socket : sockets_)
+    {
+        total += socket->truncatedDrops();
+    }
+    return total;
+}
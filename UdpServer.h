@@ -0,0 +1,67 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "UdpSocket.h"
+#include "EventLoopThreadPool.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EventLoop;
+
+// UDP服务器：每个subloop一个绑定在同一地址上的SO_REUSEPORT socket，
+// 由内核按四元组把数据报分到各个socket上，各个loop之间不共享任何状态
+// 消息回调在收到数据报的loop线程中执行，回复用回调参数里的UdpSocket发送
+class UdpServer : noncopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop*)>;
+    using MessageCallback = UdpSocket::MessageCallback;
+
+    UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg);
+    ~UdpServer();
+
+    void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+
+    // 以下在start之前设置，见UdpSocket
+    void setThreadNum(int numThreads) { threadPool_->setThreadNum(numThreads); }
+    void setThreadCpus(const std::vector<std::vector<int>> &cpusPerLoop) { threadPool_->setThreadCpus(cpusPerLoop); }
+    void setBatchSize(size_t batchSize) { batchSize_ = batchSize; }
+    void setMaxDatagramSize(size_t size) { maxDatagramSize_ = size; }
+    void enableGro(bool on) { gro_ = on; }
+
+    // 启动subloop，在每个loop中创建socket并开始读，返回时所有socket都已经绑定
+    void start();
+
+    const std::string& name() const { return name_; }
+    const InetAddress& listenAddress() const { return listenAddr_; }
+
+    // 所有socket的统计之和，各个socket的计数不是同一时刻读的，是近似值
+    uint64_t datagramsReceived() const;
+    uint64_t recvCalls() const;
+    uint64_t datagramsSent() const;
+    uint64_t sendDrops() const;
+    uint64_t truncatedDrops() const;
+
+private:
+    // 在每个socket所属的loop中执行func，等待全部执行完
+    void runInSocketLoops(const std::function<void(EventLoop*, size_t)> &func);
+
+    EventLoop *loop_;
+    const InetAddress listenAddr_;
+    const std::string name_;
+    std::unique_ptr<EventLoopThreadPool> threadPool_;
+    ThreadInitCallback threadInitCallback_;
+    MessageCallback messageCallback_;
+    size_t batchSize_;
+    size_t maxDatagramSize_;
+    bool gro_;
+    bool started_;
+
+    std::vector<EventLoop*> loops_;
+    std::vector<std::unique_ptr<UdpSocket>> sockets_;   // sockets_[i]属于loops_[i]
+};
@@ -0,0 +1,303 @@
+#include "UdpSocket.h"
+#include "EventLoop.h"
+#include "Channel.h"
+#include "Logger.h"
+#include "Histogram.h"
+
+#include <algorithm>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+const size_t kDefaultBatchSize = 64;
+const size_t kDefaultMaxDatagramSize = 2048;
+const size_t kGroBufferSize = 65536;
+
+static int createNonblockingUdp(sa_family_t family)
+{
+    int sockfd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d udp socket create err: %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+UdpSocket::UdpSocket(EventLoop *loop, const InetAddress &addr, bool reusePort)
+    : loop_(loop)
+    , fd_(createNonblockingUdp(addr.family()))
+    , localAddr_(addr)
+    , channel_(new Channel(loop, fd_))
+    , batchSize_(kDefaultBatchSize)
+    , maxDatagramSize_(kDefaultMaxDatagramSize)
+    , gro_(false)
+    , inBatch_(false)
+    , numQueued_(0)
+    , datagramsReceived_(0)
+    , recvCalls_(0)
+    , datagramsSent_(0)
+    , sendDrops_(0)
+    , truncatedDrops_(0)
+    , alive_(std::make_shared<bool>(true))
+{
+    int on = 1;
+    ::setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    if(reusePort)
+    {
+        ::setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on);
+    }
+    if(::bind(fd_, addr.getSockAddr(), addr.getSockAddrLen()) < 0)
+    {
+        LOG_FATAL("udp bind %s fail: %d \n", addr.toIpPort().c_str(), errno);
+    }
+    channel_->setReadCallback(std::bind(&UdpSocket::handleRead, this, std::placeholders::_1));
+    channel_->setDescribeCallback([this](){ return "udp " + localAddr_.toIpPort(); });
+}
+
+UdpSocket::~UdpSocket()
+{
+    if(!channel_->isNoneEvent())
+    {
+        stop();
+    }
+    ::close(fd_);
+}
+
+bool UdpSocket::enableGro(bool on)
+{
+    int optval = on ? 1 : 0;
+    if(::setsockopt(fd_, SOL_UDP, UDP_GRO, &optval, sizeof optval) < 0)
+    {
+        LOG_ERROR("udp fd:%d setsockopt UDP_GRO err:%d \n", fd_, errno);
+        return false;
+    }
+    gro_ = on;
+    return true;
+}
+
+void UdpSocket::start()
+{
+    size_t bufferSize = gro_ ? kGroBufferSize : maxDatagramSize_;
+    size_t controlSize = CMSG_SPACE(sizeof(int));
+    recvBuffer_.resize(batchSize_ * bufferSize);
+    recvControl_.resize(batchSize_ * controlSize);
+    recvMsgs_.resize(batchSize_);
+    recvIov_.resize(batchSize_);
+    recvAddrs_.resize(batchSize_);
+    for(size_t i = 0; i < batchSize_; ++i)
+    {
+        recvIov_[i].iov_base = &recvBuffer_[i * bufferSize];
+        recvIov_[i].iov_len = bufferSize;
+        ::memset(&recvMsgs_[i], 0, sizeof(mmsghdr));
+        recvMsgs_[i].msg_hdr.msg_iov = &recvIov_[i];
+        recvMsgs_[i].msg_hdr.msg_iovlen = 1;
+        recvMsgs_[i].msg_hdr.msg_name = &recvAddrs_[i];
+        if(gro_)
+        {
+            recvMsgs_[i].msg_hdr.msg_control = &recvControl_[i * controlSize];
+        }
+    }
+
+    sendBuffer_.resize(batchSize_ * maxDatagramSize_);
+    sendMsgs_.resize(batchSize_);
+    sendIov_.resize(batchSize_);
+    sendAddrs_.resize(batchSize_);
+    channel_->enableReading();
+}
+
+void UdpSocket::stop()
+{
+    flushSends();
+    channel_->disableAll();
+    channel_->remove();
+}
+
+// LT模式，每次可读只读一批，剩下的留给下一轮poll，不会饿死同一个loop上的其他channel
+void UdpSocket::handleRead(Timestamp receiveTime)
+{
+    size_t controlSize = CMSG_SPACE(sizeof(int));
+    for(size_t i = 0; i < batchSize_; ++i)
+    {
+        // recvmmsg会改写这两个长度，每次都要复位
+        recvMsgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        recvMsgs_[i].msg_hdr.msg_controllen = gro_ ? controlSize : 0;
+    }
+    int n = ::recvmmsg(fd_, recvMsgs_.data(), static_cast<unsigned int>(batchSize_), MSG_DONTWAIT, nullptr);
+    if(n < 0)
+    {
+        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            LOG_ERROR("UdpSocket::handleRead recvmmsg fd:%d err:%d \n", fd_, errno);
+        }
+        return;
+    }
+    Histogram::increment(recvCalls_, 1);
+
+    inBatch_ = true;
+    for(int i = 0; i < n; ++i)
+    {
+        msghdr &hdr = recvMsgs_[i].msg_hdr;
+        const char *data = static_cast<const char*>(recvIov_[i].iov_base);
+        size_t len = recvMsgs_[i].msg_len;
+        if(hdr.msg_flags & MSG_TRUNC)
+        {
+            // 比接收缓冲区大，只收到了前一部分，不交给回调
+            Histogram::increment(truncatedDrops_, 1);
+            continue;
+        }
+        InetAddress peer(static_cast<const sockaddr*>(hdr.msg_name), hdr.msg_namelen);
+
+        // GRO合并过的数据报带有原来每段的大小
+        size_t segment = len;
+        if(gro_)
+        {
+            for(cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+            {
+                if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+                {
+                    int gsoSize = 0;
+                    ::memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof gsoSize);
+                    if(gsoSize > 0)
+                    {
+                        segment = static_cast<size_t>(gsoSize);
+                    }
+                }
+            }
+        }
+        size_t offset = 0;
+        do
+        {
+            size_t size = std::min(segment, len - offset);
+            Histogram::increment(datagramsReceived_, 1);
+            if(messageCallback_)
+            {
+                messageCallback_(this, data + offset, size, peer, receiveTime);
+            }
+            offset += size;
+        } while(offset < len);
+    }
+    inBatch_ = false;
+    flushSends();
+}
+
+void UdpSocket::send(const InetAddress &peer, const char *data, size_t len)
+{
+    if(loop_->isInLoopTread())
+    {
+        sendInLoop(peer, data, len);
+    }
+    else
+    {
+        // 排队期间UdpSocket可能已经析构（析构在loop线程中），这时丢弃
+        std::weak_ptr<bool> alive(alive_);
+        std::string copy(data, len);
+        loop_->queueInLoop([this, alive, peer, copy](){
+            if(alive.lock())
+            {
+                sendInLoop(peer, copy.data(), copy.size());
+            }
+        });
+    }
+}
+
+void UdpSocket::sendInLoop(const InetAddress &peer, const char *data, size_t len)
+{
+    if(len > maxDatagramSize_ || sendMsgs_.empty())
+    {
+        // 放不进发送队列，直接发
+        flushSends();
+        if(::sendto(fd_, data, len, MSG_DONTWAIT, peer.getSockAddr(), peer.getSockAddrLen()) < 0)
+        {
+            Histogram::increment(sendDrops_, 1);
+        }
+        else
+        {
+            Histogram::increment(datagramsSent_, 1);
+        }
+        return;
+    }
+
+    size_t i = numQueued_++;
+    char *slot = &sendBuffer_[i * maxDatagramSize_];
+    ::memcpy(slot, data, len);
+    ::memcpy(&sendAddrs_[i], peer.getSockAddr(), peer.getSockAddrLen());
+    sendIov_[i].iov_base = slot;
+    sendIov_[i].iov_len = len;
+    ::memset(&sendMsgs_[i], 0, sizeof(mmsghdr));
+    sendMsgs_[i].msg_hdr.msg_name = &sendAddrs_[i];
+    sendMsgs_[i].msg_hdr.msg_namelen = peer.getSockAddrLen();
+    sendMsgs_[i].msg_hdr.msg_iov = &sendIov_[i];
+    sendMsgs_[i].msg_hdr.msg_iovlen = 1;
+
+    // 不在一批回调中时立即发出，否则等这一批结束
+    if(!inBatch_ || numQueued_ == sendMsgs_.size())
+    {
+        flushSends();
+    }
+}
+
+// UDP没有重传，发送缓冲区满的时候直接丢弃，计入sendDrops
+void UdpSocket::flushSends()
+{
+    size_t sent = 0;
+    while(sent < numQueued_)
+    {
+        int n = ::sendmmsg(fd_, &sendMsgs_[sent], static_cast<unsigned int>(numQueued_ - sent), MSG_DONTWAIT);
+        if(n > 0)
+        {
+            sent += n;
+            Histogram::increment(datagramsSent_, n);
+        }
+        else if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            Histogram::increment(sendDrops_, numQueued_ - sent);
+            break;
+        }
+        else
+        {
+            // 第一个数据报出错（比如ICMP不可达），跳过它继续发后面的
+            ++sent;
+            Histogram::increment(sendDrops_, 1);
+        }
+    }
+    numQueued_ = 0;
+}
+
+bool UdpSocket::sendSegments(const InetAddress &peer, const char *data, size_t len, uint16_t segmentSize)
+{
+    iovec iov;
+    iov.iov_base = const_cast<char*>(data);
+    iov.iov_len = len;
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    ::memset(control, 0, sizeof control);
+
+    msghdr hdr;
+    ::memset(&hdr, 0, sizeof hdr);
+    hdr.msg_name = const_cast<sockaddr*>(peer.getSockAddr());
+    hdr.msg_namelen = peer.getSockAddrLen();
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof control;
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    ::memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof segmentSize);
+
+    flushSends();
+    if(::sendmsg(fd_, &hdr, MSG_DONTWAIT) < 0)
+    {
+        LOG_ERROR("UdpSocket::sendSegments fd:%d err:%d \n", fd_, errno);
+        Histogram::increment(sendDrops_, 1);
+        return false;
+    }
+    Histogram::increment(datagramsSent_, (len + segmentSize - 1) / segmentSize);
+    return true;
+}
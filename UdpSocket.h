@@ -0,0 +1,101 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Timestamp.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <sys/socket.h>
+
+class EventLoop;
+class Channel;
+
+// loop上的一个UDP socket：每次可读时用recvmmsg一次读入最多batchSize个数据报，
+// 接收和发送用的缓冲区、mmsghdr等在start时一次分配好，之后反复使用
+// 消息回调里调用send时先放进发送队列，这一批回调结束后用一次sendmmsg发出
+// 除了send以外都只能在loop线程中调用
+class UdpSocket : noncopyable
+{
+public:
+    // data只在回调期间有效
+    using MessageCallback = std::function<void(UdpSocket *socket, const char *data, size_t len,
+                                               const InetAddress &peer, Timestamp receiveTime)>;
+
+    // 创建并绑定到addr；reusePort为true时设置SO_REUSEPORT，多个socket可以绑定同一个地址，由内核分流
+    UdpSocket(EventLoop *loop, const InetAddress &addr, bool reusePort = true);
+    ~UdpSocket();
+
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+
+    // 以下在start之前设置
+    void setBatchSize(size_t batchSize) { batchSize_ = batchSize; }
+    void setMaxDatagramSize(size_t size) { maxDatagramSize_ = size; }
+    // UDP_GRO：内核把同一个流的多个数据报合并成一个大的交上来，回调时再按原来的大小拆开
+    // 开启后每个接收缓冲区是64KB，内核不支持时返回false
+    bool enableGro(bool on);
+
+    // 分配缓冲区并开始读
+    void start();
+    void stop();
+
+    // 发送一个数据报，可以跨线程调用（会拷贝数据）
+    void send(const InetAddress &peer, const char *data, size_t len);
+    void send(const InetAddress &peer, const std::string &data) { send(peer, data.data(), data.size()); }
+    // UDP_SEGMENT(GSO)：data按segmentSize切成多个数据报发给同一个peer，只经过一次协议栈
+    bool sendSegments(const InetAddress &peer, const char *data, size_t len, uint16_t segmentSize);
+
+    int fd() const { return fd_; }
+    EventLoop* getLoop() const { return loop_; }
+    const InetAddress& localAddress() const { return localAddr_; }
+
+    // 只由loop线程写，可以在任意线程读
+    uint64_t datagramsReceived() const { return datagramsReceived_.load(std::memory_order_relaxed); }
+    uint64_t recvCalls() const { return recvCalls_.load(std::memory_order_relaxed); }
+    uint64_t datagramsSent() const { return datagramsSent_.load(std::memory_order_relaxed); }
+    uint64_t sendDrops() const { return sendDrops_.load(std::memory_order_relaxed); }
+    // 比接收缓冲区大、被截断而丢弃的数据报
+    uint64_t truncatedDrops() const { return truncatedDrops_.load(std::memory_order_relaxed); }
+
+private:
+    void handleRead(Timestamp receiveTime);
+    void sendInLoop(const InetAddress &peer, const char *data, size_t len);
+    void flushSends();
+
+    EventLoop *loop_;
+    const int fd_;
+    InetAddress localAddr_;
+    std::unique_ptr<Channel> channel_;
+    MessageCallback messageCallback_;
+
+    size_t batchSize_;
+    size_t maxDatagramSize_;
+    bool gro_;
+    bool inBatch_;      // 正在执行这一批的消息回调，send先入队
+
+    // 接收池
+    std::vector<char> recvBuffer_;
+    std::vector<char> recvControl_;
+    std::vector<mmsghdr> recvMsgs_;
+    std::vector<iovec> recvIov_;
+    std::vector<sockaddr_storage> recvAddrs_;
+
+    // 发送队列
+    std::vector<char> sendBuffer_;
+    std::vector<mmsghdr> sendMsgs_;
+    std::vector<iovec> sendIov_;
+    std::vector<sockaddr_storage> sendAddrs_;
+    size_t numQueued_;
+
+    std::atomic<uint64_t> datagramsReceived_;
+    std::atomic<uint64_t> recvCalls_;
+    std::atomic<uint64_t> datagramsSent_;
+    std::atomic<uint64_t> sendDrops_;
+    std::atomic<uint64_t> truncatedDrops_;
+
+    std::shared_ptr<bool> alive_;  // 跨线程投递的send在UdpSocket析构之后不再执行
+};
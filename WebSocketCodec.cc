@@ -0,0 +1,280 @@
+#include "WebSocketCodec.h"
+#include "Buffer.h"
+
+#include <openssl/sha.h>
+
+#include <string.h>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const char kWebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+WebSocketCodec::WebSocketCodec(size_t maxMessageSize)
+    : maxMessageSize_(maxMessageSize)
+    , consumed_(0)
+    , messageStart_(0)
+    , messageLength_(0)
+    , fragmented_(false)
+    , messageOpcode_(kText)
+    , frameEnd_(0)
+    , opcode_(kText)
+    , errorCode_(0)
+{
+}
+
+// 帧格式：FIN|RSV|opcode, MASK|len(7), [len 16/64], [mask key 4], payload
+// 分片消息的数据依次往前搬到第一片数据开始的位置，拼成连续的一段，
+// 中间的帧头和控制帧被覆盖，整个消息结束之前不从buf中取走数据
+WebSocketCodec::ParseResult WebSocketCodec::parse(Buffer *buf)
+{
+    while(true)
+    {
+        size_t available = buf->readableBytes() - consumed_;
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(buf->peek()) + consumed_;
+        if(available < 2)
+        {
+            return kNeedMore;
+        }
+        bool fin = (p[0] & 0x80) != 0;
+        Opcode opcode = static_cast<Opcode>(p[0] & 0x0F);
+        bool masked = (p[1] & 0x80) != 0;
+        uint64_t length = p[1] & 0x7F;
+        size_t headerSize = 2;
+        if((p[0] & 0x70) != 0 || !masked)
+        {
+            // 没有协商扩展，RSV必须为0；客户端的帧必须带掩码
+            return fail(kProtocolError);
+        }
+        if(length == 126)
+        {
+            if(available < 4)
+            {
+                return kNeedMore;
+            }
+            length = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+            headerSize = 4;
+        }
+        else if(length == 127)
+        {
+            if(available < 10)
+            {
+                return kNeedMore;
+            }
+            length = 0;
+            for(int i = 2; i < 10; ++i)
+            {
+                length = (length << 8) | p[i];
+            }
+            headerSize = 10;
+        }
+        bool control = (opcode & 0x08) != 0;
+        if(control && (length > 125 || !fin))
+        {
+            return fail(kProtocolError);
+        }
+        if(!control && (length > maxMessageSize_ || messageLength_ + length > maxMessageSize_))
+        {
+            return fail(kMessageTooBig);
+        }
+        if(available < headerSize + 4 + length)
+        {
+            return kNeedMore;
+        }
+
+        unsigned char key[4];
+        ::memcpy(key, p + headerSize, 4);
+        size_t payloadOffset = consumed_ + headerSize + 4;
+        char *payload = buf->beginRead() + payloadOffset;
+        applyMask(payload, length, key);
+        size_t frameEnd = payloadOffset + length;
+
+        if(control)
+        {
+            opcode_ = opcode;
+            payload_.set(payload, length);
+            frameEnd_ = frameEnd;
+            return kControl;
+        }
+
+        if(opcode == kContinuation)
+        {
+            if(!fragmented_)
+            {
+                return fail(kProtocolError);
+            }
+        }
+        else if(opcode == kText || opcode == kBinary)
+        {
+            if(fragmented_)
+            {
+                return fail(kProtocolError);
+            }
+            messageOpcode_ = opcode;
+            // 第一片不需要搬动，从它的数据开始拼接
+            messageLength_ = 0;
+            fragmented_ = true;
+            messageStart_ = payloadOffset;
+        }
+        else
+        {
+            return fail(kProtocolError);
+        }
+
+        char *dest = buf->beginRead() + messageStart_ + messageLength_;
+        if(dest != payload)
+        {
+            ::memmove(dest, payload, length);
+        }
+        messageLength_ += length;
+        consumed_ = frameEnd;
+        if(fin)
+        {
+            fragmented_ = false;
+            opcode_ = messageOpcode_;
+            payload_.set(buf->beginRead() + messageStart_, messageLength_);
+            frameEnd_ = frameEnd;
+            return kMessage;
+        }
+    }
+}
+
+void WebSocketCodec::consume(Buffer *buf)
+{
+    if(opcode_ & 0x08)
+    {
+        if(!fragmented_)
+        {
+            buf->retrieve(frameEnd_);
+            consumed_ = 0;
+        }
+        else
+        {
+            // 分片消息中间的控制帧，等整个消息结束时一起取走
+            consumed_ = frameEnd_;
+        }
+    }
+    else
+    {
+        buf->retrieve(frameEnd_);
+        consumed_ = 0;
+        messageLength_ = 0;
+    }
+    payload_.clear();
+}
+
+void WebSocketCodec::encode(Buffer *output, Opcode opcode, const StringPiece &payload, bool fin)
+{
+    unsigned char header[10];
+    size_t headerSize = 2;
+    header[0] = static_cast<unsigned char>((fin ? 0x80 : 0x00) | opcode);
+    size_t length = payload.size();
+    if(length < 126)
+    {
+        header[1] = static_cast<unsigned char>(length);
+    }
+    else if(length <= 0xFFFF)
+    {
+        header[1] = 126;
+        header[2] = static_cast<unsigned char>(length >> 8);
+        header[3] = static_cast<unsigned char>(length);
+        headerSize = 4;
+    }
+    else
+    {
+        header[1] = 127;
+        for(int i = 0; i < 8; ++i)
+        {
+            header[2 + i] = static_cast<unsigned char>(static_cast<uint64_t>(length) >> (56 - 8 * i));
+        }
+        headerSize = 10;
+    }
+    output->append(reinterpret_cast<const char*>(header), headerSize);
+    output->append(payload.data(), payload.size());
+}
+
+std::string WebSocketCodec::encode(Opcode opcode, const StringPiece &payload, bool fin)
+{
+    Buffer output(payload.size() + 10);
+    encode(&output, opcode, payload, fin);
+    return output.retrieveAllAsString();
+}
+
+std::string WebSocketCodec::encodeClose(int code, const StringPiece &reason)
+{
+    std::string payload;
+    payload.push_back(static_cast<char>((code >> 8) & 0xFF));
+    payload.push_back(static_cast<char>(code & 0xFF));
+    payload.append(reason.data(), std::min<size_t>(reason.size(), 123));
+    return encode(kClose, payload);
+}
+
+void WebSocketCodec::applyMask(char *data, size_t len, const unsigned char key[4], size_t offset)
+{
+    // 把key旋转到从data[0]开始对齐
+    unsigned char k[4];
+    for(int i = 0; i < 4; ++i)
+    {
+        k[i] = key[(i + offset) % 4];
+    }
+    uint32_t key32;
+    ::memcpy(&key32, k, 4);
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i mask256 = _mm256_set1_epi32(static_cast<int>(key32));
+    for(; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_xor_si256(v, mask256));
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i mask128 = _mm_set1_epi32(static_cast<int>(key32));
+    for(; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(v, mask128));
+    }
+#endif
+    uint64_t key64 = (static_cast<uint64_t>(key32) << 32) | key32;
+    for(; i + 8 <= len; i += 8)
+    {
+        uint64_t v;
+        ::memcpy(&v, data + i, 8);
+        v ^= key64;
+        ::memcpy(data + i, &v, 8);
+    }
+    for(; i < len; ++i)
+    {
+        data[i] ^= k[i % 4];
+    }
+}
+
+static std::string base64(const unsigned char *data, size_t len)
+{
+    static const char kTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for(size_t i = 0; i < len; i += 3)
+    {
+        uint32_t n = static_cast<uint32_t>(data[i]) << 16;
+        if(i + 1 < len) n |= static_cast<uint32_t>(data[i + 1]) << 8;
+        if(i + 2 < len) n |= data[i + 2];
+        out.push_back(kTable[(n >> 18) & 0x3F]);
+        out.push_back(kTable[(n >> 12) & 0x3F]);
+        out.push_back(i + 1 < len ? kTable[(n >> 6) & 0x3F] : '=');
+        out.push_back(i + 2 < len ? kTable[n & 0x3F] : '=');
+    }
+    return out;
+}
+
+std::string WebSocketCodec::acceptKey(const StringPiece &key)
+{
+    std::string input = key.asString() + kWebSocketGuid;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    ::SHA1(reinterpret_cast<const unsigned char*>(input.data()), input.size(), digest);
+    return base64(digest, sizeof digest);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "StringPiece.h"
+
+#include <string>
+#include <stdint.h>
+
+class Buffer;
+
+// WebSocket(RFC 6455)的帧编解码，每个连接一个解析器
+// 客户端发来的帧原地去掩码，分片的消息在inputBuffer_里原地拼接成连续的一段，
+// 交给上层的消息是指向inputBuffer_的StringPiece，不拷贝
+class WebSocketCodec
+{
+public:
+    enum Opcode
+    {
+        kContinuation = 0x0,
+        kText = 0x1,
+        kBinary = 0x2,
+        kClose = 0x8,
+        kPing = 0x9,
+        kPong = 0xA,
+    };
+
+    // 关闭帧的状态码
+    enum CloseCode
+    {
+        kNormalClosure = 1000,
+        kGoingAway = 1001,
+        kProtocolError = 1002,
+        kMessageTooBig = 1009,
+    };
+
+    enum ParseResult
+    {
+        kNeedMore,
+        kMessage,       // 完整的数据消息，opcode()是kText或kBinary
+        kControl,       // 控制帧（close/ping/pong），可能夹在分片消息中间
+        kError,         // 协议错误，应当用errorCode()关闭连接
+    };
+
+    explicit WebSocketCodec(size_t maxMessageSize = 1024 * 1024);
+
+    void setMaxMessageSize(size_t n) { maxMessageSize_ = n; }
+
+    // 返回kMessage或kControl时，opcode()和payload()可用，处理完后调用consume
+    ParseResult parse(Buffer *buf);
+    void consume(Buffer *buf);
+
+    Opcode opcode() const { return opcode_; }
+    StringPiece payload() const { return payload_; }
+    int errorCode() const { return errorCode_; }
+
+    // 服务端发出的帧不加掩码
+    static void encode(Buffer *output, Opcode opcode, const StringPiece &payload, bool fin = true);
+    static std::string encode(Opcode opcode, const StringPiece &payload, bool fin = true);
+    static std::string encodeClose(int code, const StringPiece &reason);
+
+    // data[i] ^= key[(i + offset) % 4]，按机器支持的最宽的向量处理
+    static void applyMask(char *data, size_t len, const unsigned char key[4], size_t offset = 0);
+
+    // 握手：Sec-WebSocket-Accept = base64(sha1(key + GUID))
+    static std::string acceptKey(const StringPiece &key);
+
+private:
+    ParseResult fail(int code) { errorCode_ = code; return kError; }
+
+    size_t maxMessageSize_;
+    // 相对于buf->peek()的偏移
+    size_t consumed_;       // 已经解析过的原始字节，消息结束时一起取走
+    size_t messageStart_;   // 消息第一片数据的位置
+    size_t messageLength_;  // 已经拼接到消息起始位置的分片数据长度
+    bool fragmented_;       // 正在接收分片消息
+    Opcode messageOpcode_;
+    size_t frameEnd_;       // 控制帧结束的位置，consume时跳过它
+
+    Opcode opcode_;
+    StringPiece payload_;
+    int errorCode_;
+};
@@ -0,0 +1,400 @@
+#include "WebSocketServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+// 关闭帧发出后等待对方回复的时间
+static const double kCloseTimeoutSeconds = 5.0;
+
+// 每个WebSocket连接的状态，升级之后挂在TcpConnection的context上
+struct WebSocketServer::Session
+{
+    Session(WebSocketServer *server, EventLoop *loop, size_t maxMessageSize)
+        : server(server), loop(loop), codec(maxMessageSize), active(true), pingSent(false), closeSent(false) {}
+
+    WebSocketServer *server;
+    EventLoop *loop;        // 表项在哪个loop的连接表里，迁移之后由新loop更新
+    WebSocketCodec codec;
+    Buffer output;          // 这一次可读事件中产生的控制帧回复
+    bool active;            // 上次心跳检查之后收到过数据
+    bool pingSent;
+    bool closeSent;
+};
+
+WebSocketServer::WebSocketServer(EventLoop *loop,
+    const InetAddress &listenAddr,
+    const std::string &nameArg,
+    TcpServer::Option option)
+    : httpServer_(loop, listenAddr, nameArg, option)
+    , maxMessageSize_(1024 * 1024)
+    , pingInterval_(0)
+    , numConnections_(0)
+{
+    httpServer_.setHttpCallback(std::bind(&WebSocketServer::onRequest, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    httpServer_.tcpServer()->setThreadInitCallback(std::bind(&WebSocketServer::onThreadInit, this,
+        std::placeholders::_1));
+    httpServer_.tcpServer()->setMigrateCallback(std::bind(&WebSocketServer::onMigrated, this,
+        std::placeholders::_1));
+}
+
+WebSocketServer::~WebSocketServer()
+{
+    std::vector<EventLoop*> loops;
+    for(auto &item : shards_)
+    {
+        loops.push_back(item.first);
+    }
+    // 连接随TcpServer一起销毁，先把它们和本对象断开
+    EventLoopThreadPool::runInLoopsAndWait(loops, [this](EventLoop *loop){
+        Shard &shard = shardOf(loop);
+        loop->cancel(shard.heartbeatTimer);
+        for(auto &item : shard.connections)
+        {
+            const TcpConnectionPtr &conn = item.second;
+            conn->setConnectionCallback([](const TcpConnectionPtr&){});
+            conn->setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp){ buf->retrieveAll(); });
+            conn->setContext(std::shared_ptr<void>());
+        }
+        shard.connections.clear();
+    });
+}
+
+void WebSocketServer::start()
+{
+    httpServer_.start();
+}
+
+void WebSocketServer::onThreadInit(EventLoop *loop)
+{
+    {
+        std::lock_guard<std::mutex> lock(shardsMutex_);
+        shards_[loop].reset(new Shard);
+    }
+    if(pingInterval_ > 0)
+    {
+        shardOf(loop).heartbeatTimer = loop->runEvery(pingInterval_,
+            std::bind(&WebSocketServer::checkHeartbeats, this, loop));
+    }
+    if(threadInitCallback_)
+    {
+        threadInitCallback_(loop);
+    }
+}
+
+WebSocketServer::Shard& WebSocketServer::shardOf(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(shardsMutex_);
+    return *shards_.find(loop)->second;
+}
+
+void WebSocketServer::onRequest(const TcpConnectionPtr &conn, const HttpRequest &request, HttpResponse *response)
+{
+    StringPiece upgrade = request.getHeader("Upgrade");
+    if(!upgrade.equalsIgnoreCase("websocket"))
+    {
+        if(httpCallback_)
+        {
+            httpCallback_(conn, request, response);
+        }
+        else
+        {
+            response->setStatusCode(404);
+        }
+        return;
+    }
+
+    StringPiece key = request.getHeader("Sec-WebSocket-Key");
+    if(request.method() != HttpRequest::kGet || request.version() != HttpRequest::kHttp11 || key.empty())
+    {
+        response->setStatusCode(400);
+        response->setCloseConnection(true);
+        return;
+    }
+    if(request.getHeader("Sec-WebSocket-Version") != "13")
+    {
+        response->setStatusCode(426);
+        response->setStatusMessage("Upgrade Required");
+        response->addHeader("Sec-WebSocket-Version", "13");
+        return;
+    }
+    if(acceptCallback_ && !acceptCallback_(request))
+    {
+        response->setStatusCode(403);
+        response->setCloseConnection(true);
+        return;
+    }
+
+    response->setUpgrade(std::bind(&WebSocketServer::onUpgraded, this,
+        std::placeholders::_1, std::placeholders::_2));
+    response->addHeader("Upgrade", "websocket");
+    response->addHeader("Connection", "Upgrade");
+    response->addHeader("Sec-WebSocket-Accept", WebSocketCodec::acceptKey(key));
+}
+
+void WebSocketServer::onUpgraded(const TcpConnectionPtr &conn, Buffer *buf)
+{
+    if(!conn->connected())
+    {
+        return;
+    }
+    conn->setContext(std::make_shared<Session>(this, conn->getLoop(), maxMessageSize_));
+    conn->setConnectionCallback(std::bind(&WebSocketServer::onConnection, this, std::placeholders::_1));
+    conn->setMessageCallback(std::bind(&WebSocketServer::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    shardOf(conn->getLoop()).connections[conn->id()] = conn;
+    ++numConnections_;
+
+    LOG_DEBUG("WebSocketServer - %s upgraded \n", conn->name().c_str());
+    if(connectionCallback_)
+    {
+        connectionCallback_(conn);
+    }
+    if(buf->readableBytes() > 0)
+    {
+        onMessage(conn, buf, conn->getLoop()->pollReturnTime());
+    }
+}
+
+// 升级之后只会收到断开的通知
+void WebSocketServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        return;
+    }
+    Session *session = static_cast<Session*>(conn->getContext().get());
+    if(session != nullptr)
+    {
+        removeFromShard(conn, session);
+    }
+    if(connectionCallback_)
+    {
+        connectionCallback_(conn);
+    }
+}
+
+void WebSocketServer::removeFromShard(const TcpConnectionPtr &conn, Session *session)
+{
+    EventLoop *loop = session->loop;
+    uint64_t id = conn->id();
+    // 迁移途中断开的连接还登记在旧loop的表里
+    loop->runInLoop([this, loop, id](){
+        if(shardOf(loop).connections.erase(id) > 0)
+        {
+            --numConnections_;
+        }
+    });
+}
+
+// 在新loop线程中调用：登记到新loop的表里，再到旧loop上删掉旧的表项
+// 删掉之前旧loop的心跳和广播遇到它会跳过，见checkHeartbeats
+void WebSocketServer::onMigrated(const TcpConnectionPtr &conn)
+{
+    Session *session = static_cast<Session*>(conn->getContext().get());
+    EventLoop *loop = conn->getLoop();
+    if(session == nullptr || session->loop == loop)
+    {
+        return;     // 还没升级的HTTP连接
+    }
+    EventLoop *oldLoop = session->loop;
+    session->loop = loop;
+    shardOf(loop).connections[conn->id()] = conn;
+    uint64_t id = conn->id();
+    oldLoop->runInLoop([this, oldLoop, id](){
+        shardOf(oldLoop).connections.erase(id);
+    });
+}
+
+void WebSocketServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    Session *session = static_cast<Session*>(conn->getContext().get());
+    if(session == nullptr)
+    {
+        buf->retrieveAll();
+        return;
+    }
+    session->active = true;
+    session->pingSent = false;
+
+    bool closing = false;
+    while(!closing)
+    {
+        WebSocketCodec::ParseResult result = session->codec.parse(buf);
+        if(result == WebSocketCodec::kNeedMore)
+        {
+            break;
+        }
+        if(result == WebSocketCodec::kError)
+        {
+            if(!session->closeSent)
+            {
+                std::string frame = WebSocketCodec::encodeClose(session->codec.errorCode(), StringPiece());
+                session->output.append(frame.data(), frame.size());
+                session->closeSent = true;
+            }
+            closing = true;
+            break;
+        }
+
+        WebSocketCodec::Opcode opcode = session->codec.opcode();
+        StringPiece payload = session->codec.payload();
+        if(result == WebSocketCodec::kMessage)
+        {
+            // 发出关闭帧之后收到的数据消息丢弃
+            if(!session->closeSent && messageCallback_)
+            {
+                messageCallback_(conn, opcode, payload);
+            }
+        }
+        else if(opcode == WebSocketCodec::kPing)
+        {
+            if(!session->closeSent)
+            {
+                WebSocketCodec::encode(&session->output, WebSocketCodec::kPong, payload);
+            }
+        }
+        else if(opcode == WebSocketCodec::kClose)
+        {
+            // 对方先发起关闭时原样回复状态码；我们先发起时这就是回复
+            if(!session->closeSent)
+            {
+                WebSocketCodec::encode(&session->output, WebSocketCodec::kClose, payload.substr(0, 2));
+                session->closeSent = true;
+            }
+            closing = true;
+        }
+        session->codec.consume(buf);
+    }
+
+    if(session->output.readableBytes() > 0)
+    {
+        conn->send(&session->output);
+    }
+    if(closing)
+    {
+        buf->retrieveAll();
+        // 服务端先关闭TCP连接
+        conn->shutdown();
+    }
+}
+
+void WebSocketServer::send(const TcpConnectionPtr &conn, WebSocketCodec::Opcode opcode, const StringPiece &payload)
+{
+    EventLoop *loop = conn->getLoop();
+    if(loop->isInLoopTread())
+    {
+        Session *session = static_cast<Session*>(conn->getContext().get());
+        if(session == nullptr || session->closeSent)
+        {
+            return;
+        }
+        WebSocketCodec::encode(&session->output, opcode, payload);
+        conn->send(&session->output);
+    }
+    else
+    {
+        std::string copy = payload.asString();
+        loop->runInLoop([conn, opcode, copy](){ send(conn, opcode, copy); });
+    }
+}
+
+void WebSocketServer::close(const TcpConnectionPtr &conn, int code, const StringPiece &reason)
+{
+    std::string copy = reason.asString();
+    conn->getLoop()->runInLoop([conn, code, copy](){ closeInLoop(conn, code, copy); });
+}
+
+void WebSocketServer::closeInLoop(const TcpConnectionPtr &conn, int code, const std::string &reason)
+{
+    Session *session = static_cast<Session*>(conn->getContext().get());
+    if(session == nullptr || session->closeSent || !conn->connected())
+    {
+        return;
+    }
+    session->closeSent = true;
+    conn->send(WebSocketCodec::encodeClose(code, reason));
+    std::weak_ptr<TcpConnection> weakConn(conn);
+    conn->getLoop()->runAfter(kCloseTimeoutSeconds, [weakConn](){
+        TcpConnectionPtr conn = weakConn.lock();
+        if(conn)
+        {
+            conn->forceClose();
+        }
+    });
+}
+
+void WebSocketServer::broadcast(const Frame &frame, const std::function<void()> &done)
+{
+    std::vector<EventLoop*> loops;
+    {
+        std::lock_guard<std::mutex> lock(shardsMutex_);
+        for(auto &item : shards_)
+        {
+            loops.push_back(item.first);
+        }
+    }
+    std::shared_ptr<std::atomic<size_t>> remaining = std::make_shared<std::atomic<size_t>>(loops.size());
+    for(EventLoop *loop : loops)
+    {
+        Shard *shard = &shardOf(loop);
+        loop->runInLoop([loop, shard, frame, remaining, done](){
+            for(auto &item : shard->connections)
+            {
+                // 已经迁走、还没从这张表里删掉的连接由新loop的表负责
+                if(item.second->getLoop() != loop)
+                {
+                    continue;
+                }
+                Session *session = static_cast<Session*>(item.second->getContext().get());
+                if(session != nullptr && !session->closeSent)
+                {
+                    item.second->send(frame);
+                }
+            }
+            if(--*remaining == 0 && done)
+            {
+                done();
+            }
+        });
+    }
+}
+
+// 心跳检查：一个周期内没有收到数据就发ping，再一个周期还没有收到就关闭
+void WebSocketServer::checkHeartbeats(EventLoop *loop)
+{
+    static const std::string kPingFrame = WebSocketCodec::encode(WebSocketCodec::kPing, StringPiece());
+    std::vector<TcpConnectionPtr> expired;
+    for(auto &item : shardOf(loop).connections)
+    {
+        const TcpConnectionPtr &conn = item.second;
+        // 连接已经迁到别的loop上，Session归那个loop的线程访问，这里的表项很快会被删掉
+        // loop_只在连接原来所属的loop线程中改，所以这里读到等于loop时连接确实还属于本线程
+        if(conn->getLoop() != loop)
+        {
+            continue;
+        }
+        Session *session = static_cast<Session*>(conn->getContext().get());
+        if(session == nullptr)
+        {
+            continue;
+        }
+        if(session->active)
+        {
+            session->active = false;
+        }
+        else if(!session->pingSent)
+        {
+            session->pingSent = true;
+            conn->send(kPingFrame);
+        }
+        else
+        {
+            expired.push_back(conn);
+        }
+    }
+    for(const TcpConnectionPtr &conn : expired)
+    {
+        LOG_INFO("WebSocketServer - %s heartbeat timeout \n", conn->name().c_str());
+        conn->forceClose();
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "HttpServer.h"
+#include "WebSocketCodec.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// WebSocket服务器：在HttpServer上处理升级握手，之后用WebSocketCodec收发帧
+// 每个loop维护自己的WebSocket连接表，心跳检测和广播都按loop分片进行，
+// 连接表只在所属的loop线程中访问；TcpServer迁移连接后表项跟着挪到新loop的表里
+class WebSocketServer : noncopyable
+{
+public:
+    // 握手完成（conn->connected()为true）和连接关闭时调用
+    using ConnectionCallback = std::function<void(const TcpConnectionPtr&)>;
+    // message指向连接的inputBuffer_，只在回调期间有效
+    using MessageCallback = std::function<void(const TcpConnectionPtr&,
+                                               WebSocketCodec::Opcode opcode,
+                                               const StringPiece &message)>;
+    // 决定是否接受某个路径上的升级请求，默认都接受
+    using AcceptCallback = std::function<bool(const HttpRequest&)>;
+    // 预先编码好的帧，广播时所有连接共享同一份
+    using Frame = SharedPayload;
+
+    WebSocketServer(EventLoop *loop,
+                    const InetAddress &listenAddr,
+                    const std::string &nameArg,
+                    TcpServer::Option option = TcpServer::kNoReusePort);
+    ~WebSocketServer();
+
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setAcceptCallback(const AcceptCallback &cb) { acceptCallback_ = cb; }
+    // 非升级的普通HTTP请求，默认回复404
+    void setHttpCallback(const HttpServer::HttpCallback &cb) { httpCallback_ = cb; }
+
+    // 以下在start之前设置
+    void setThreadNum(int numThreads) { httpServer_.setThreadNum(numThreads); }
+    void setThreadInitCallback(const TcpServer::ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    void setMaxMessageSize(size_t n) { maxMessageSize_ = n; }
+    // 每隔interval秒检查一次：期间没有收到过数据的连接发一个ping，
+    // 上一次的ping之后还是什么都没收到的连接关闭；0表示不做心跳检测
+    void setPingInterval(double seconds) { pingInterval_ = seconds; }
+
+    void start();
+
+    TcpServer* tcpServer() { return httpServer_.tcpServer(); }
+
+    // 以下可以在任意线程调用
+    static void send(const TcpConnectionPtr &conn, WebSocketCodec::Opcode opcode, const StringPiece &payload);
+    static void sendText(const TcpConnectionPtr &conn, const StringPiece &text) { send(conn, WebSocketCodec::kText, text); }
+    static void sendBinary(const TcpConnectionPtr &conn, const StringPiece &data) { send(conn, WebSocketCodec::kBinary, data); }
+    // 发送关闭帧，对方回复关闭帧或者超时后关闭连接
+    static void close(const TcpConnectionPtr &conn, int code = WebSocketCodec::kNormalClosure,
+                      const StringPiece &reason = StringPiece());
+
+    static Frame makeFrame(WebSocketCodec::Opcode opcode, const StringPiece &payload)
+    { return std::make_shared<const std::string>(WebSocketCodec::encode(opcode, payload)); }
+    // 把一个编码好的帧发给所有WebSocket连接，每个loop投递一次任务，帧不重新编码也不拷贝
+    // 返回前不等待发送完成，done不为空时在最后一个loop发送完之后调用（在那个loop的线程中）
+    void broadcast(const Frame &frame, const std::function<void()> &done = std::function<void()>());
+
+    // 所有loop上的WebSocket连接数，近似值
+    size_t numConnections() const { return numConnections_; }
+
+private:
+    struct Session;
+    // 每个loop一张连接表
+    struct Shard
+    {
+        std::unordered_map<uint64_t, TcpConnectionPtr> connections;
+        TimerId heartbeatTimer;
+    };
+
+    void onRequest(const TcpConnectionPtr &conn, const HttpRequest &request, HttpResponse *response);
+    void onUpgraded(const TcpConnectionPtr &conn, Buffer *buf);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMigrated(const TcpConnectionPtr &conn);
+    // 在连接当前所属的loop线程中调用，表项在别的loop上时投递过去删
+    void removeFromShard(const TcpConnectionPtr &conn, Session *session);
+    void onThreadInit(EventLoop *loop);
+    void checkHeartbeats(EventLoop *loop);
+    Shard& shardOf(EventLoop *loop);
+
+    static void closeInLoop(const TcpConnectionPtr &conn, int code, const std::string &reason);
+
+    HttpServer httpServer_;
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    AcceptCallback acceptCallback_;
+    HttpServer::HttpCallback httpCallback_;
+    TcpServer::ThreadInitCallback threadInitCallback_;
+    size_t maxMessageSize_;
+    double pingInterval_;
+
+    std::mutex shardsMutex_;        // 只保护start期间的插入，之后连接表的集合不再变化
+    std::unordered_map<EventLoop*, std::unique_ptr<Shard>> shards_;
+    std::atomic<size_t> numConnections_;
+};
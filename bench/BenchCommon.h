@@ -0,0 +1,160 @@
+#pragma once
+
+// bench程序共用的工具：参数解析、结果的JSON输出、日志静默、延迟直方图
+
+#include "Histogram.h"
+
+#include <string>
+#include <map>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// 命令行参数 --key=value
+class BenchArgs
+{
+public:
+    BenchArgs(int argc, char *argv[])
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            const char *arg = argv[i];
+            if(::strncmp(arg, "--", 2) != 0)
+            {
+                continue;
+            }
+            const char *eq = ::strchr(arg, '=');
+            if(eq)
+            {
+                values_[std::string(arg + 2, eq)] = eq + 1;
+            }
+            else
+            {
+                values_[arg + 2] = "1";
+            }
+        }
+    }
+
+    int getInt(const std::string &key, int def) const
+    {
+        auto it = values_.find(key);
+        return it == values_.end() ? def : ::atoi(it->second.c_str());
+    }
+
+    double getDouble(const std::string &key, double def) const
+    {
+        auto it = values_.find(key);
+        return it == values_.end() ? def : ::atof(it->second.c_str());
+    }
+
+    std::string getString(const std::string &key, const std::string &def) const
+    {
+        auto it = values_.find(key);
+        return it == values_.end() ? def : it->second;
+    }
+
+    bool has(const std::string &key) const { return values_.count(key) > 0; }
+
+private:
+    std::map<std::string, std::string> values_;
+};
+
+// 库的日志直接写stdout，和结果混在一起不方便解析
+// 没有--verbose时把stdout重定向到/dev/null，结果写到原来的stdout上
+class BenchOutput
+{
+public:
+    explicit BenchOutput(const BenchArgs &args)
+        : resultFd_(::dup(STDOUT_FILENO))
+    {
+        if(!args.has("verbose"))
+        {
+            int devnull = ::open("/dev/null", O_WRONLY);
+            ::fflush(stdout);
+            ::dup2(devnull, STDOUT_FILENO);
+            ::close(devnull);
+        }
+    }
+
+    ~BenchOutput()
+    {
+        ::close(resultFd_);
+    }
+
+    // 一行一个JSON对象
+    void emit(const std::string &json)
+    {
+        std::string line = json + "\n";
+        ssize_t n = ::write(resultFd_, line.data(), line.size());
+        (void)n;
+    }
+
+private:
+    int resultFd_;
+};
+
+// 依次追加字段，生成一个平铺的JSON对象
+class JsonObject
+{
+public:
+    JsonObject& add(const std::string &key, const std::string &value)
+    {
+        fields_.push_back("\"" + key + "\":\"" + value + "\"");
+        return *this;
+    }
+
+    JsonObject& add(const std::string &key, double value)
+    {
+        char buf[64];
+        ::snprintf(buf, sizeof buf, "%.2f", value);
+        fields_.push_back("\"" + key + "\":" + buf);
+        return *this;
+    }
+
+    JsonObject& add(const std::string &key, int64_t value)
+    {
+        fields_.push_back("\"" + key + "\":" + std::to_string(value));
+        return *this;
+    }
+
+    JsonObject& add(const std::string &key, int value) { return add(key, static_cast<int64_t>(value)); }
+    JsonObject& add(const std::string &key, uint64_t value) { return add(key, static_cast<int64_t>(value)); }
+
+    // 嵌入一个已经是JSON的值
+    JsonObject& addRaw(const std::string &key, const std::string &json)
+    {
+        fields_.push_back("\"" + key + "\":" + json);
+        return *this;
+    }
+
+    // 延迟分布，单位us
+    JsonObject& addLatency(const std::string &prefix, const Histogram::Snapshot &h)
+    {
+        add(prefix + "_mean_us", h.mean());
+        add(prefix + "_p50_us", h.percentile(0.50));
+        add(prefix + "_p99_us", h.percentile(0.99));
+        add(prefix + "_p999_us", h.percentile(0.999));
+        add(prefix + "_max_us", h.max);
+        return *this;
+    }
+
+    std::string str() const
+    {
+        std::string s = "{";
+        for(size_t i = 0; i < fields_.size(); ++i)
+        {
+            if(i > 0)
+            {
+                s += ",";
+            }
+            s += fields_[i];
+        }
+        return s + "}";
+    }
+
+private:
+    std::vector<std::string> fields_;
+};
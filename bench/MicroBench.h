@@ -0,0 +1,135 @@
+#pragma once
+
+// 自包含的微基准框架：预热、自动确定每轮迭代次数、多轮重复，
+// 输出每次操作耗时的均值、标准差和95%置信区间，便于对比修改前后的结果
+//
+// 每个基准是一个函数 int64_t f(uint64_t iterations, std::mt19937 &rng)，
+// 执行iterations次操作，返回这些操作花费的纳秒数，准备工作可以不计入
+// 随机数发生器每轮都用同一个种子重新初始化，每轮的输入完全相同
+
+#include "BenchCommon.h"
+
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+class MicroBench
+{
+public:
+    using Func = std::function<int64_t (uint64_t iterations, std::mt19937 &rng)>;
+
+    void add(const std::string &name, Func func)
+    {
+        benches_.push_back(Bench{ name, std::move(func) });
+    }
+
+    // 参数：--filter=子串 --repetitions=10 --warmup=2 --min_time_ms=100 --seed=42
+    void run(const BenchArgs &args, BenchOutput &output)
+    {
+        std::string filter = args.getString("filter", "");
+        int repetitions = std::max(args.getInt("repetitions", 10), 2);
+        int warmup = args.getInt("warmup", 2);
+        int64_t minTimeNs = static_cast<int64_t>(args.getInt("min_time_ms", 100)) * 1000 * 1000;
+        unsigned seed = static_cast<unsigned>(args.getInt("seed", 42));
+
+        for(Bench &bench : benches_)
+        {
+            if(!filter.empty() && bench.name.find(filter) == std::string::npos)
+            {
+                continue;
+            }
+
+            // 预热的同时确定迭代次数，使每轮至少运行minTimeNs
+            uint64_t iterations = 1;
+            for(int i = 0; ; ++i)
+            {
+                std::mt19937 rng(seed);
+                int64_t ns = std::max<int64_t>(bench.func(iterations, rng), 1);
+                if(ns >= minTimeNs && i >= warmup)
+                {
+                    break;
+                }
+                if(ns < minTimeNs)
+                {
+                    double scale = std::min(10.0, 1.2 * minTimeNs / ns);
+                    iterations = static_cast<uint64_t>(std::ceil(iterations * std::max(scale, 1.5)));
+                }
+            }
+
+            std::vector<double> nsPerOp;
+            for(int i = 0; i < repetitions; ++i)
+            {
+                std::mt19937 rng(seed);
+                int64_t ns = bench.func(iterations, rng);
+                nsPerOp.push_back(static_cast<double>(ns) / iterations);
+            }
+
+            double mean = 0;
+            for(double v : nsPerOp)
+            {
+                mean += v;
+            }
+            mean /= nsPerOp.size();
+            double var = 0;
+            for(double v : nsPerOp)
+            {
+                var += (v - mean) * (v - mean);
+            }
+            double stddev = std::sqrt(var / (nsPerOp.size() - 1));
+            double ci95 = tValue95(static_cast<int>(nsPerOp.size()) - 1) * stddev / std::sqrt(nsPerOp.size());
+            std::sort(nsPerOp.begin(), nsPerOp.end());
+
+            output.emit(JsonObject()
+                .add("bench", bench.name)
+                .add("iterations", iterations)
+                .add("repetitions", repetitions)
+                .add("seed", static_cast<int>(seed))
+                .add("ns_per_op", mean)
+                .add("stddev_ns", stddev)
+                .add("ci95_ns", ci95)
+                .add("min_ns", nsPerOp.front())
+                .add("median_ns", nsPerOp[nsPerOp.size() / 2])
+                .str());
+        }
+    }
+
+    static int64_t nowNanos()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    // 双侧95%的t分布临界值
+    static double tValue95(int df)
+    {
+        static const double table[] = {
+            0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+            2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+            2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+        };
+        if(df <= 0)
+        {
+            return 0;
+        }
+        return df <= 30 ? table[df] : 1.960;
+    }
+
+    struct Bench
+    {
+        std::string name;
+        Func func;
+    };
+    std::vector<Bench> benches_;
+};
+
+// 防止编译器把基准里没有使用的计算结果优化掉
+template <typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
@@ -0,0 +1,349 @@
+// 广播扇出：connections个本地TCP客户端连上服务端后，每一轮把一条size字节的消息发给所有连接，
+// 测量从发起广播到最后一个客户端收完这条消息的时间(time-to-last-byte)，以及这期间的内存分配次数
+//   --mode=shared  TcpServer::broadcast，每个loop投递一次任务，所有连接共享同一份payload
+//   --mode=copy    在驱动线程里逐个调用conn->send(std::string)，每个连接拷贝一份数据、投递一次任务
+// 连接数超过一个目标地址可用的本地端口时，客户端轮流连接127.0.0.1、127.0.0.2……
+//
+// bench_broadcast --mode=shared --connections=200000 --loops=8 --size=1024 --rounds=20
+//                 --client_threads=2 --port=9907 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <new>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+static const size_t kConnectionsPerAddress = 25000;
+
+// 统计整个进程的operator new次数
+static std::atomic<uint64_t> gAllocations(0);
+
+void* operator new(size_t size)
+{
+    ++gAllocations;
+    void *p = ::malloc(size == 0 ? 1 : size);
+    if(p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    ::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    ::free(p);
+}
+
+class FanoutClient;
+
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, FanoutClient *owner);
+
+    void start() { client_.connect(); }
+    void stop() { client_.disconnect(); }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+
+    TcpClient client_;
+    FanoutClient *owner_;
+    size_t received_;       // 这一条消息已经收到的字节数
+};
+
+class FanoutClient : noncopyable
+{
+public:
+    FanoutClient(EventLoop *loop, uint16_t port, size_t messageSize, const BenchArgs &args)
+        : threadPool_(loop, "fanout-client")
+        , numConnections_(args.getInt("connections", 200000))
+        , messageSize_(messageSize)
+        , numConnected_(0)
+        , numDisconnected_(0)
+        , numReceived_(0)
+        , roundStart_(0)
+        , allConnected_(false)
+    {
+        threadPool_.setThreadNum(args.getInt("client_threads", 2));
+        threadPool_.start();
+        for(int i = 0; i < numConnections_; ++i)
+        {
+            std::string ip = "127.0.0." + std::to_string(1 + i / kConnectionsPerAddress);
+            sessions_.emplace_back(new Session(threadPool_.getNextLoop(), InetAddress(port, ip),
+                "fanout-" + std::to_string(i), this));
+        }
+    }
+
+    void start()
+    {
+        for(auto &session : sessions_)
+        {
+            session->start();
+        }
+    }
+
+    void stop()
+    {
+        for(auto &session : sessions_)
+        {
+            session->stop();
+        }
+    }
+
+    int numConnections() const { return numConnections_; }
+    size_t messageSize() const { return messageSize_; }
+
+    void onConnected()
+    {
+        if(++numConnected_ == numConnections_)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            allConnected_ = true;
+            cond_.notify_all();
+        }
+    }
+
+    void onDisconnect() { ++numDisconnected_; }
+    int numDisconnected() const { return numDisconnected_; }
+    int connected() const { return numConnected_; }
+
+    // 每个连接收完一条消息调用一次，最后一个连接收完时记下这一轮的耗时和分配次数
+    void onMessageComplete()
+    {
+        if(++numReceived_ == numConnections_)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            lastByteMicros_.push_back(Timestamp::monotonicMicros() - roundStart_);
+            allocations_.push_back(gAllocations.load() - roundAllocations_.load());
+            cond_.notify_all();
+        }
+    }
+
+    void waitConnected(double timeoutSeconds)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait_for(lock, std::chrono::milliseconds(static_cast<int64_t>(timeoutSeconds * 1000)),
+            [this](){ return allConnected_; });
+    }
+
+    void beginRound()
+    {
+        numReceived_ = 0;
+        roundAllocations_ = gAllocations.load();
+        roundStart_ = Timestamp::monotonicMicros();
+    }
+
+    bool waitRound(size_t round, double timeoutSeconds)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cond_.wait_for(lock, std::chrono::milliseconds(static_cast<int64_t>(timeoutSeconds * 1000)),
+            [this, round](){ return lastByteMicros_.size() > round; });
+    }
+
+    const std::vector<int64_t>& lastByteMicros() const { return lastByteMicros_; }
+    const std::vector<int64_t>& allocations() const { return allocations_; }
+
+private:
+    EventLoopThreadPool threadPool_;
+    int numConnections_;
+    size_t messageSize_;
+    std::atomic_int numConnected_;
+    std::atomic_int numDisconnected_;
+    std::atomic_int numReceived_;
+    std::atomic<int64_t> roundStart_;
+    std::atomic<uint64_t> roundAllocations_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool allConnected_;
+    std::vector<int64_t> lastByteMicros_;
+    std::vector<int64_t> allocations_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+};
+
+Session::Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, FanoutClient *owner)
+    : client_(loop, serverAddr, name)
+    , owner_(owner)
+    , received_(0)
+{
+    client_.setConnectionCallback(std::bind(&Session::onConnection, this, std::placeholders::_1));
+    client_.setMessageCallback(std::bind(&Session::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void Session::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        owner_->onConnected();
+    }
+    else
+    {
+        owner_->onDisconnect();
+    }
+}
+
+void Session::onMessage(const TcpConnectionPtr&, Buffer *buf, Timestamp)
+{
+    received_ += buf->readableBytes();
+    buf->retrieveAll();
+    while(received_ >= owner_->messageSize())
+    {
+        received_ -= owner_->messageSize();
+        owner_->onMessageComplete();
+    }
+}
+
+static void raiseFdLimit()
+{
+    rlimit limit;
+    if(::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static double percentile(std::vector<int64_t> values, double p)
+{
+    if(values.empty())
+    {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t i = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    return static_cast<double>(values[i]);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    raiseFdLimit();
+    std::string mode = args.getString("mode", "shared");
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9907));
+    int rounds = args.getInt("rounds", 20);
+    size_t size = static_cast<size_t>(args.getInt("size", 1024));
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port, "0.0.0.0"), "fanout-server");
+    std::mutex connsMutex;
+    std::vector<TcpConnectionPtr> conns;
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn){
+        if(conn->connected())
+        {
+            std::lock_guard<std::mutex> lock(connsMutex);
+            conns.push_back(conn);
+        }
+    });
+    server.setThreadNum(args.getInt("loops", 8));
+    server.start();
+    FanoutClient client(&loop, port, size, args);
+
+    // 连接、广播和收尾在单独的线程中按顺序进行，主线程运行baseloop
+    double connectSeconds = 0;
+    std::vector<int64_t> postMicros;
+    int completed = 0;
+    Thread driver([&](){
+        int64_t connectStart = Timestamp::monotonicMicros();
+        client.start();
+        client.waitConnected(args.getDouble("connect_timeout", 120));
+        // 客户端连上时服务端可能还没有accept完，等服务端的连接表也齐了再开始
+        for(int i = 0; i < 600; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(connsMutex);
+                if(conns.size() >= static_cast<size_t>(client.numConnections()))
+                {
+                    break;
+                }
+            }
+            ::usleep(50 * 1000);
+        }
+        connectSeconds = (Timestamp::monotonicMicros() - connectStart) / 1e6;
+
+        SharedPayload payload = std::make_shared<const std::string>(size, 'b');
+        if(client.connected() == client.numConnections())
+        {
+            for(int round = 0; round < rounds; ++round)
+            {
+                client.beginRound();
+                int64_t start = Timestamp::monotonicMicros();
+                if(mode == "copy")
+                {
+                    std::lock_guard<std::mutex> lock(connsMutex);
+                    for(const TcpConnectionPtr &conn : conns)
+                    {
+                        conn->send(*payload);
+                    }
+                }
+                else
+                {
+                    server.broadcast(payload);
+                }
+                postMicros.push_back(Timestamp::monotonicMicros() - start);
+                if(!client.waitRound(round, 30))
+                {
+                    break;
+                }
+                ++completed;
+            }
+        }
+
+        client.stop();
+        for(int i = 0; i < 200 && client.numDisconnected() < client.connected(); ++i)
+        {
+            ::usleep(50 * 1000);
+        }
+        {
+            std::lock_guard<std::mutex> lock(connsMutex);
+            conns.clear();
+        }
+        loop.quit();
+    }, "fanout-driver");
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    const std::vector<int64_t> &lastByte = client.lastByteMicros();
+    double meanLastByte = 0;
+    for(int64_t us : lastByte)
+    {
+        meanLastByte += us;
+    }
+    meanLastByte = lastByte.empty() ? 0 : meanLastByte / lastByte.size();
+    double allocsPerConn = percentile(client.allocations(), 0.5) / std::max(1, client.numConnections());
+    output.emit(JsonObject()
+        .add("bench", "broadcast")
+        .add("mode", mode)
+        .add("connections", client.numConnections())
+        .add("connected", client.connected())
+        .add("connect_seconds", connectSeconds)
+        .add("size", static_cast<int64_t>(size))
+        .add("rounds", completed)
+        .add("loops", args.getInt("loops", 8))
+        .add("client_threads", args.getInt("client_threads", 2))
+        .add("broadcast_call_p50_us", percentile(postMicros, 0.5))
+        .add("last_byte_mean_us", meanLastByte)
+        .add("last_byte_p50_us", percentile(lastByte, 0.5))
+        .add("last_byte_max_us", percentile(lastByte, 1.0))
+        .add("allocs_per_round_p50", percentile(client.allocations(), 0.5))
+        .add("allocs_per_conn", allocsPerConn)
+        .add("msgs_per_sec", meanLastByte > 0 ? client.numConnections() / (meanLastByte / 1e6) : 0.0)
+        .str());
+    return 0;
+}
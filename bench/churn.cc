@@ -0,0 +1,183 @@
+// 短连接测试：客户端不停地建立连接，服务端accept之后立刻关闭，
+// 统计每秒完成的连接数、连接建立的延迟，以及baseloop(accept所在线程)在每个连接上花费的CPU时间
+// 由服务端先关闭，TIME_WAIT留在服务端，客户端的临时端口不会被耗尽
+//
+// bench_churn --concurrency=64 --server_threads=2 --client_threads=2 --seconds=10
+//             --port=9902 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <time.h>
+
+static int64_t threadCpuMicros()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 + ts.tv_nsec / 1000;
+}
+
+// 并发的每一路都是一个slot，一个连接结束后在同一个loop上开始下一个
+class ChurnClient : noncopyable
+{
+public:
+    ChurnClient(EventLoop *loop, const InetAddress &serverAddr, const BenchArgs &args)
+        : loop_(loop)
+        , serverAddr_(serverAddr)
+        , threadPool_(loop, "churn-client")
+        , running_(true)
+        , numSlots_(args.getInt("concurrency", 64))
+        , numFinished_(0)
+        , completed_(0)
+    {
+        threadPool_.setThreadNum(args.getInt("client_threads", 2));
+        threadPool_.start();
+        for(EventLoop *ioLoop : threadPool_.getAllLoops())
+        {
+            latency_[ioLoop].reset(new Histogram);
+        }
+        for(int i = 0; i < numSlots_; ++i)
+        {
+            slots_.emplace_back(new Slot(threadPool_.getNextLoop()));
+        }
+    }
+
+    void start()
+    {
+        for(auto &slot : slots_)
+        {
+            Slot *s = slot.get();
+            s->loop->runInLoop([this, s](){ startSlot(s); });
+        }
+    }
+
+    // 可以在任意线程调用，正在进行的连接完成之后各个slot自己停下来
+    void stop() { running_ = false; }
+
+    uint64_t completed() const { return completed_; }
+
+    Histogram::Snapshot connectLatency() const
+    {
+        Histogram::Snapshot total;
+        for(auto &item : latency_)
+        {
+            total.merge(item.second->snapshot());
+        }
+        return total;
+    }
+
+private:
+    struct Slot
+    {
+        explicit Slot(EventLoop *l) : loop(l), connectStart(0) {}
+
+        EventLoop *loop;
+        std::unique_ptr<TcpClient> client;
+        int64_t connectStart;
+    };
+
+    void startSlot(Slot *slot)
+    {
+        slot->client.reset();
+        if(!running_)
+        {
+            if(++numFinished_ == numSlots_)
+            {
+                loop_->queueInLoop(std::bind(&EventLoop::quit, loop_));
+            }
+            return;
+        }
+        slot->client.reset(new TcpClient(slot->loop, serverAddr_, "churn"));
+        slot->client->setConnectionCallback([this, slot](const TcpConnectionPtr &conn){
+            onConnection(slot, conn);
+        });
+        slot->connectStart = Timestamp::monotonicMicros();
+        slot->client->connect();
+    }
+
+    void onConnection(Slot *slot, const TcpConnectionPtr &conn)
+    {
+        if(conn->connected())
+        {
+            latency_[slot->loop]->record(Timestamp::monotonicMicros() - slot->connectStart);
+        }
+        else
+        {
+            ++completed_;
+            // 还在TcpClient的回调里，等回调返回之后再销毁它
+            slot->loop->queueInLoop([this, slot](){ startSlot(slot); });
+        }
+    }
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    EventLoopThreadPool threadPool_;
+    std::atomic_bool running_;
+    int numSlots_;
+    std::atomic_int numFinished_;
+    std::atomic<uint64_t> completed_;
+    // 每个loop一个直方图，只由该loop线程写入；start之后不再修改这张表
+    std::unordered_map<EventLoop*, std::unique_ptr<Histogram>> latency_;
+    std::vector<std::unique_ptr<Slot>> slots_;
+};
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9902));
+    double seconds = args.getDouble("seconds", 10);
+
+    EventLoop loop;
+    InetAddress serverAddr(port);
+    TcpServer server(&loop, serverAddr, "churn-server");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn){
+        if(conn->connected())
+        {
+            conn->shutdown();
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp){
+        buf->retrieveAll();
+    });
+    server.setThreadNum(args.getInt("server_threads", 2));
+    server.start();
+
+    ChurnClient client(&loop, serverAddr, args);
+    int64_t cpuBegin = threadCpuMicros();
+    int64_t wallBegin = Timestamp::monotonicMicros();
+    int64_t cpuEnd = 0;
+    int64_t wallEnd = 0;
+    loop.runAfter(seconds, [&](){
+        cpuEnd = threadCpuMicros();
+        wallEnd = Timestamp::monotonicMicros();
+        client.stop();
+    });
+    client.start();
+    loop.loop();
+
+    double elapsed = (wallEnd - wallBegin) / 1e6;
+    uint64_t completed = client.completed();
+    double baseCpu = static_cast<double>(cpuEnd - cpuBegin);
+    output.emit(JsonObject()
+        .add("bench", "churn")
+        .add("concurrency", args.getInt("concurrency", 64))
+        .add("server_threads", args.getInt("server_threads", 2))
+        .add("client_threads", args.getInt("client_threads", 2))
+        .add("seconds", elapsed)
+        .add("connections", completed)
+        .add("connections_per_sec", completed / elapsed)
+        .add("base_loop_us_per_conn", completed ? baseCpu / completed : 0.0)
+        .addLatency("connect", client.connectLatency())
+        .addRaw("server_loops", server.metricsSnapshot().toJson())
+        .str());
+    return 0;
+}
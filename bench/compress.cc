@@ -0,0 +1,242 @@
+// 透明压缩：connections个客户端持续向服务端发送可压缩的数据（仿访问日志的文本行），
+// 上一块写完再发下一块；服务端只计数（--verify=1时逐字节和原文比对）
+// 客户端连上后先发一行"COMPRESS"再开启压缩，服务端读到这一行后开启，
+// 和协商消息一起读进来的压缩数据由startCompression转交给解压
+// 统计：应用层每秒收到的原文字节、socket上实际传输的字节（服务端loop读到的字节）、压缩比，
+// 以及整个进程（压缩和解压都在这个进程里）每处理1GB原文消耗的CPU秒数
+//
+// bench_compress --compress=1 --level=1 --connections=4 --block=65536 --seconds=5
+//                --server_threads=1 --client_threads=1 --port=9911 [--verify=0] [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <random>
+#include <vector>
+#include <sys/resource.h>
+
+static const char kNegotiation[] = "COMPRESS\n";
+
+// 1MB左右的文本，内容像访问日志：结构重复、数字随机
+static std::string makeCorpus(size_t size)
+{
+    static const char *kPaths[] = { "/api/v1/items", "/api/v1/users", "/static/app.js", "/api/v2/search", "/healthz" };
+    static const char *kLevels[] = { "INFO ", "INFO ", "INFO ", "WARN ", "ERROR" };
+    std::minstd_rand rng(42);
+    std::string corpus;
+    char line[256];
+    while(corpus.size() < size)
+    {
+        int n = ::snprintf(line, sizeof line,
+            "2026-10-19T%02u:%02u:%02u.%03uZ %s request_id=%08x method=GET path=%s/%u status=%u latency_us=%u bytes=%u\n",
+            static_cast<unsigned>(rng() % 24), static_cast<unsigned>(rng() % 60), static_cast<unsigned>(rng() % 60),
+            static_cast<unsigned>(rng() % 1000), kLevels[rng() % 5], static_cast<unsigned>(rng()),
+            kPaths[rng() % 5], static_cast<unsigned>(rng() % 100000), rng() % 10 == 0 ? 404u : 200u,
+            static_cast<unsigned>(rng() % 50000), static_cast<unsigned>(rng() % 20000));
+        corpus.append(line, n);
+    }
+    corpus.resize(size);
+    return corpus;
+}
+
+static double cpuSeconds()
+{
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// 服务端每个连接上的状态
+struct SinkSession
+{
+    SinkSession() : negotiated(false), offset(0) {}
+    bool negotiated;
+    size_t offset;          // 校验时在corpus中的位置
+};
+
+class Sender : noncopyable
+{
+public:
+    Sender(EventLoop *loop, const InetAddress &serverAddr, const std::string &name,
+           const std::string *corpus, size_t block, bool compress, int level, std::atomic_bool *sending)
+        : client_(loop, serverAddr, name)
+        , corpus_(corpus)
+        , block_(block)
+        , offset_(0)
+        , sending_(sending)
+    {
+        client_.setConnectionCallback([this, compress, level](const TcpConnectionPtr &conn){
+            if(!conn->connected())
+            {
+                return;
+            }
+            if(compress)
+            {
+                conn->send(std::string(kNegotiation));
+                conn->startCompression(level);
+            }
+            sendBlock(conn);
+        });
+        client_.setWriteCompleteCallback([this](const TcpConnectionPtr &conn){
+            if(*sending_ && conn->connected())
+            {
+                sendBlock(conn);
+            }
+        });
+        client_.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp){
+            buf->retrieveAll();
+        });
+    }
+
+    void start() { client_.connect(); }
+    void stop() { client_.disconnect(); }
+
+private:
+    // 按顺序循环发送corpus，服务端校验时可以算出每个字节应该是什么
+    void sendBlock(const TcpConnectionPtr &conn)
+    {
+        size_t n = std::min(block_, corpus_->size() - offset_);
+        conn->send(std::string(corpus_->data() + offset_, n));
+        offset_ = (offset_ + n) % corpus_->size();
+    }
+
+    TcpClient client_;
+    const std::string *corpus_;
+    size_t block_;
+    size_t offset_;
+    std::atomic_bool *sending_;
+};
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9911));
+    double seconds = args.getDouble("seconds", 5);
+    bool compress = args.getInt("compress", 1) != 0;
+    int level = args.getInt("level", 1);
+    bool verify = args.getInt("verify", 0) != 0;
+    int numConnections = args.getInt("connections", 4);
+    size_t block = static_cast<size_t>(args.getInt("block", 65536));
+    std::string corpus = makeCorpus(1024 * 1024);
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port, "127.0.0.1"), "compress-server");
+    server.setThreadNum(args.getInt("server_threads", 1));
+    std::atomic<uint64_t> received(0);
+    std::atomic<uint64_t> mismatches(0);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn){
+        if(conn->connected())
+        {
+            conn->setContext(std::make_shared<SinkSession>());
+        }
+    });
+    server.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        SinkSession *session = static_cast<SinkSession*>(conn->getContext().get());
+        if(compress && !session->negotiated)
+        {
+            if(buf->readableBytes() < sizeof kNegotiation - 1)
+            {
+                return;
+            }
+            buf->retrieve(sizeof kNegotiation - 1);
+            session->negotiated = true;
+            conn->startCompression(level);
+            return;
+        }
+        size_t n = buf->readableBytes();
+        if(verify)
+        {
+            const char *p = buf->peek();
+            size_t left = n;
+            while(left > 0)
+            {
+                size_t chunk = std::min(left, corpus.size() - session->offset);
+                if(::memcmp(p, corpus.data() + session->offset, chunk) != 0)
+                {
+                    ++mismatches;
+                }
+                session->offset = (session->offset + chunk) % corpus.size();
+                p += chunk;
+                left -= chunk;
+            }
+        }
+        received += n;
+        buf->retrieveAll();
+    });
+    server.start();
+
+    EventLoopThreadPool clientPool(&loop, "compress-client");
+    clientPool.setThreadNum(args.getInt("client_threads", 1));
+    clientPool.start();
+    std::atomic_bool sending(true);
+    std::vector<std::unique_ptr<Sender>> senders;
+    for(int i = 0; i < numConnections; ++i)
+    {
+        senders.emplace_back(new Sender(clientPool.getNextLoop(), InetAddress(port, "127.0.0.1"),
+            "compress-" + std::to_string(i), &corpus, block, compress, level, &sending));
+    }
+
+    uint64_t rawBytes = 0;
+    uint64_t wireBytes = 0;
+    double elapsed = 0;
+    double cpu = 0;
+    Thread driver([&](){
+        for(auto &sender : senders)
+        {
+            sender->start();
+        }
+        // 预热一秒再计时
+        ::usleep(1000 * 1000);
+        uint64_t rawBegin = received;
+        uint64_t wireBegin = server.metricsSnapshot().bytesRead;
+        double cpuBegin = cpuSeconds();
+        int64_t start = Timestamp::monotonicMicros();
+        ::usleep(static_cast<useconds_t>(seconds * 1e6));
+        rawBytes = received - rawBegin;
+        wireBytes = server.metricsSnapshot().bytesRead - wireBegin;
+        cpu = cpuSeconds() - cpuBegin;
+        elapsed = (Timestamp::monotonicMicros() - start) / 1e6;
+
+        sending = false;
+        for(auto &sender : senders)
+        {
+            sender->stop();
+        }
+        ::usleep(500 * 1000);
+        loop.quit();
+    }, "compress-driver");
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    double rawGiB = rawBytes / (1024.0 * 1024.0 * 1024.0);
+    JsonObject json;
+    json.add("bench", "compress")
+        .add("compress", compress)
+        .add("level", level)
+        .add("connections", numConnections)
+        .add("block", static_cast<int64_t>(block))
+        .add("server_threads", args.getInt("server_threads", 1))
+        .add("client_threads", args.getInt("client_threads", 1))
+        .add("seconds", elapsed)
+        .add("raw_bytes", rawBytes)
+        .add("wire_bytes", wireBytes)
+        .add("ratio", wireBytes > 0 ? static_cast<double>(rawBytes) / wireBytes : 0.0)
+        .add("raw_mib_per_sec", elapsed > 0 ? rawBytes / elapsed / (1024.0 * 1024.0) : 0.0)
+        .add("wire_mib_per_sec", elapsed > 0 ? wireBytes / elapsed / (1024.0 * 1024.0) : 0.0)
+        .add("cpu_seconds", cpu)
+        .add("cpu_seconds_per_gib", rawGiB > 0 ? cpu / rawGiB : 0.0);
+    if(verify)
+    {
+        json.add("mismatches", static_cast<uint64_t>(mismatches));
+    }
+    output.emit(json.str());
+    return 0;
+}
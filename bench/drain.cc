@@ -0,0 +1,154 @@
+// 滚动重启：客户端持续发送请求，服务端每个请求异步处理一段时间才回复，
+// 运行中途停止服务器，统计发出了请求却没有拿到完整回复的请求数
+// --drain_ms=0是立即关闭，大于0时排空关闭(stop(drain_ms))，两种各跑一次对比
+// 客户端是每个连接一个线程的阻塞socket，不经过本库的loop
+//
+// bench_drain --drain_ms=2000 --server_threads=4 --connections=32 --process_ms=20
+//             --think_us=2000 --seconds=1 --port=9912 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "EventLoop.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static const size_t kMessageSize = 64;
+
+struct Result
+{
+    Result() : completed(0), failed(0), closedIdle(0) {}
+
+    std::atomic<uint64_t> completed;
+    std::atomic<uint64_t> failed;       // 发出了请求但没有拿到完整回复
+    std::atomic<uint64_t> closedIdle;   // 空闲时被服务端关闭，客户端可以安全重连
+};
+
+static void client(uint16_t port, int thinkMicros, Result *result)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        ::perror("connect");
+        ::exit(1);
+    }
+
+    char buf[kMessageSize];
+    while(true)
+    {
+        // 发请求之前先看一下服务端是不是已经关闭了连接
+        pollfd pfd = { fd, POLLIN, 0 };
+        if(::poll(&pfd, 1, 0) > 0 && ::recv(fd, buf, sizeof buf, MSG_PEEK | MSG_DONTWAIT) <= 0)
+        {
+            ++result->closedIdle;
+            break;
+        }
+
+        ::memset(buf, 'r', sizeof buf);
+        if(::send(fd, buf, sizeof buf, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof buf))
+        {
+            ++result->failed;
+            break;
+        }
+        size_t got = 0;
+        while(got < sizeof buf)
+        {
+            ssize_t n = ::recv(fd, buf + got, sizeof buf - got, 0);
+            if(n <= 0)
+            {
+                break;
+            }
+            got += n;
+        }
+        if(got < sizeof buf)
+        {
+            ++result->failed;
+            break;
+        }
+        ++result->completed;
+        ::usleep(thinkMicros);
+    }
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9912));
+    int drainMs = args.getInt("drain_ms", 2000);
+    int numConnections = args.getInt("connections", 32);
+    int thinkMicros = args.getInt("think_us", 2000);
+    double processSeconds = args.getInt("process_ms", 20) / 1000.0;
+    double seconds = args.getDouble("seconds", 1);
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "drain-server");
+    server.setConnectionCallback([](const TcpConnectionPtr&){});
+    server.setMessageCallback([processSeconds](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        while(buf->readableBytes() >= kMessageSize)
+        {
+            std::string request = buf->retrieveAsString(kMessageSize);
+            // 模拟异步的请求处理，处理完再回复
+            conn->getLoop()->runAfter(processSeconds, [conn, request](){
+                conn->send(request);
+            });
+        }
+    });
+    server.setThreadNum(args.getInt("server_threads", 4));
+    server.start();
+
+    Result result;
+    int64_t stopBegin = 0;
+    int64_t stopEnd = 0;
+    std::thread driver([&](){
+        std::vector<std::thread> clients;
+        for(int i = 0; i < numConnections; ++i)
+        {
+            clients.emplace_back(client, port, thinkMicros, &result);
+        }
+        ::usleep(static_cast<useconds_t>(seconds * 1e6));
+
+        stopBegin = Timestamp::monotonicMicros();
+        server.stop(drainMs, [&loop, &stopEnd](size_t remaining){
+            if(remaining == 0)
+            {
+                stopEnd = Timestamp::monotonicMicros();
+                loop.quit();
+            }
+        });
+        for(std::thread &t : clients)
+        {
+            t.join();
+        }
+    });
+
+    loop.loop();
+    driver.join();
+
+    output.emit(JsonObject()
+        .add("bench", "drain")
+        .add("drain_ms", drainMs)
+        .add("connections", numConnections)
+        .add("completed", static_cast<uint64_t>(result.completed))
+        .add("failed", static_cast<uint64_t>(result.failed))
+        .add("closed_idle", static_cast<uint64_t>(result.closedIdle))
+        .add("stop_ms", (stopEnd - stopBegin) / 1000.0)
+        .str());
+    return 0;
+}
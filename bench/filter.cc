@@ -0,0 +1,165 @@
+// filter的开销：connections个连接上客户端和服务端互相回显message_size大小的消息（同pingpong），
+// 两端在连接建立时各装上stages级filter，统计每秒回显的消息数
+//   --filters=none          不装filter，即原来的直接读写socket
+//   --filters=passthrough   装上收发两个方向都直通的filter，数据不经过它们
+//   --filters=copy          装上收发两个方向都把数据原样拷到下一级的filter
+// 比较none和passthrough看空的filter链有没有开销，copy是每一级多一次拷贝的代价
+//
+// bench_filter --filters=none|passthrough|copy --stages=4 --message_size=64 --connections=16
+//              --seconds=5 --server_threads=1 --client_threads=1 --port=9912 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "ConnectionFilter.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// 两个方向都直通
+class PassThroughFilter : public ConnectionFilter
+{
+public:
+    bool filtersInput() const override { return false; }
+    bool filtersOutput() const override { return false; }
+};
+
+// 默认的onInput/onOutput：原样拷给下一级
+class CopyFilter : public ConnectionFilter
+{
+};
+
+static void installFilters(const TcpConnectionPtr &conn, const std::string &mode, int stages)
+{
+    for(int i = 0; mode != "none" && i < stages; ++i)
+    {
+        if(mode == "copy")
+        {
+            conn->addFilter(std::make_shared<CopyFilter>());
+        }
+        else
+        {
+            conn->addFilter(std::make_shared<PassThroughFilter>());
+        }
+    }
+}
+
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name,
+            const std::string &mode, int stages, const std::string &message)
+        : client_(loop, serverAddr, name)
+        , messagesRead_(0)
+    {
+        client_.setConnectionCallback([mode, stages, message](const TcpConnectionPtr &conn){
+            if(conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+                installFilters(conn, mode, stages);
+                conn->send(message);
+            }
+        });
+        client_.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+            ++messagesRead_;
+            conn->send(buf);
+        });
+    }
+
+    void start() { client_.connect(); }
+    void stop() { client_.disconnect(); }
+    uint64_t messagesRead() const { return messagesRead_; }
+
+private:
+    TcpClient client_;
+    std::atomic<uint64_t> messagesRead_;
+};
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9912));
+    double seconds = args.getDouble("seconds", 5);
+    std::string mode = args.getString("filters", "none");
+    int stages = args.getInt("stages", 4);
+    int numConnections = args.getInt("connections", 16);
+    std::string message(static_cast<size_t>(args.getInt("message_size", 64)), 'f');
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port, "127.0.0.1"), "filter-server");
+    server.setThreadNum(args.getInt("server_threads", 1));
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn){
+        if(conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            installFilters(conn, mode, stages);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        conn->send(buf);
+    });
+    server.start();
+
+    EventLoopThreadPool clientPool(&loop, "filter-client");
+    clientPool.setThreadNum(args.getInt("client_threads", 1));
+    clientPool.start();
+    std::vector<std::unique_ptr<Session>> sessions;
+    for(int i = 0; i < numConnections; ++i)
+    {
+        sessions.emplace_back(new Session(clientPool.getNextLoop(), InetAddress(port, "127.0.0.1"),
+            "filter-" + std::to_string(i), mode, stages, message));
+    }
+
+    auto totalMessages = [&](){
+        uint64_t total = 0;
+        for(auto &session : sessions)
+        {
+            total += session->messagesRead();
+        }
+        return total;
+    };
+    uint64_t messages = 0;
+    double elapsed = 0;
+    Thread driver([&](){
+        for(auto &session : sessions)
+        {
+            session->start();
+        }
+        // 预热半秒再计时
+        ::usleep(500 * 1000);
+        uint64_t begin = totalMessages();
+        int64_t start = Timestamp::monotonicMicros();
+        ::usleep(static_cast<useconds_t>(seconds * 1e6));
+        messages = totalMessages() - begin;
+        elapsed = (Timestamp::monotonicMicros() - start) / 1e6;
+        for(auto &session : sessions)
+        {
+            session->stop();
+        }
+        ::usleep(200 * 1000);
+        loop.quit();
+    }, "filter-driver");
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    JsonObject json;
+    json.add("bench", "filter")
+        .add("filters", mode)
+        .add("stages", mode == "none" ? 0 : stages)
+        .add("message_size", static_cast<int64_t>(message.size()))
+        .add("connections", numConnections)
+        .add("server_threads", args.getInt("server_threads", 1))
+        .add("client_threads", args.getInt("client_threads", 1))
+        .add("seconds", elapsed)
+        .add("messages", messages)
+        .add("messages_per_sec", elapsed > 0 ? messages / elapsed : 0.0)
+        .add("mib_per_sec", elapsed > 0 ? messages * message.size() / elapsed / (1024.0 * 1024.0) : 0.0);
+    output.emit(json.str());
+    return 0;
+}
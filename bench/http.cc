@@ -0,0 +1,259 @@
+// HTTP吞吐：HttpServer回复一个固定的小响应，客户端类似wrk，
+// 每个连接保持pipeline个请求在途，收到一个响应就补发一个请求
+//
+// bench_http --connections=64 --pipeline=1 --server_threads=2 --client_threads=2
+//            --body_size=13 --warmup=1 --seconds=10 --port=9905 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "HttpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+static const char kRequest[] = "GET /hello HTTP/1.1\r\nHost: localhost\r\nUser-Agent: bench_http\r\n\r\n";
+
+class HttpLoadClient;
+
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, HttpLoadClient *owner);
+
+    void start() { client_.connect(); }
+    void stop() { client_.disconnect(); }
+
+    uint64_t responses() const { return responses_; }
+    uint64_t errors() const { return errors_; }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+
+    TcpClient client_;
+    HttpLoadClient *owner_;
+    uint64_t responses_;
+    uint64_t errors_;
+};
+
+class HttpLoadClient : noncopyable
+{
+public:
+    HttpLoadClient(EventLoop *loop, const InetAddress &serverAddr, const BenchArgs &args)
+        : loop_(loop)
+        , threadPool_(loop, "http-client")
+        , numConnections_(args.getInt("connections", 64))
+        , pipeline_(std::max(1, args.getInt("pipeline", 1)))
+        , warmupSeconds_(args.getDouble("warmup", 1))
+        , seconds_(args.getDouble("seconds", 10))
+        , numConnected_(0)
+        , numDisconnected_(0)
+        , recordFrom_(INT64_MAX)
+        , recordUntil_(INT64_MAX)
+    {
+        threadPool_.setThreadNum(args.getInt("client_threads", 2));
+        threadPool_.start();
+        for(int i = 0; i < numConnections_; ++i)
+        {
+            sessions_.emplace_back(new Session(threadPool_.getNextLoop(), serverAddr,
+                "http-" + std::to_string(i), this));
+        }
+    }
+
+    void start()
+    {
+        for(auto &session : sessions_)
+        {
+            session->start();
+        }
+    }
+
+    int pipeline() const { return pipeline_; }
+    bool recording(int64_t now) const { return now >= recordFrom_ && now < recordUntil_; }
+
+    void onConnect()
+    {
+        if(++numConnected_ == numConnections_)
+        {
+            loop_->runInLoop(std::bind(&HttpLoadClient::allConnected, this));
+        }
+    }
+
+    void onDisconnect()
+    {
+        if(++numDisconnected_ == numConnections_)
+        {
+            loop_->queueInLoop(std::bind(&EventLoop::quit, loop_));
+        }
+    }
+
+    uint64_t responses() const
+    {
+        uint64_t total = 0;
+        for(auto &session : sessions_)
+        {
+            total += session->responses();
+        }
+        return total;
+    }
+
+    uint64_t errors() const
+    {
+        uint64_t total = 0;
+        for(auto &session : sessions_)
+        {
+            total += session->errors();
+        }
+        return total;
+    }
+
+    double seconds() const { return seconds_; }
+
+private:
+    void allConnected()
+    {
+        int64_t now = Timestamp::monotonicMicros();
+        recordFrom_ = now + static_cast<int64_t>(warmupSeconds_ * 1e6);
+        recordUntil_ = recordFrom_ + static_cast<int64_t>(seconds_ * 1e6);
+        loop_->runAfter(warmupSeconds_ + seconds_, std::bind(&HttpLoadClient::stop, this));
+    }
+
+    void stop()
+    {
+        for(auto &session : sessions_)
+        {
+            session->stop();
+        }
+    }
+
+    EventLoop *loop_;
+    EventLoopThreadPool threadPool_;
+    int numConnections_;
+    int pipeline_;
+    double warmupSeconds_;
+    double seconds_;
+    std::atomic_int numConnected_;
+    std::atomic_int numDisconnected_;
+    std::atomic<int64_t> recordFrom_;
+    std::atomic<int64_t> recordUntil_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+};
+
+Session::Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, HttpLoadClient *owner)
+    : client_(loop, serverAddr, name)
+    , owner_(owner)
+    , responses_(0)
+    , errors_(0)
+{
+    client_.setConnectionCallback(std::bind(&Session::onConnection, this, std::placeholders::_1));
+    client_.setMessageCallback(std::bind(&Session::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void Session::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        conn->setTcpNoDelay(true);
+        owner_->onConnect();
+        Buffer requests;
+        for(int i = 0; i < owner_->pipeline(); ++i)
+        {
+            requests.append(kRequest, sizeof kRequest - 1);
+        }
+        conn->send(&requests);
+    }
+    else
+    {
+        owner_->onDisconnect();
+    }
+}
+
+// 只解析状态码和Content-Length，足够把流水线上的响应一个个切开
+void Session::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    static const char kHeaderEnd[] = "\r\n\r\n";
+    static const char kContentLength[] = "Content-Length: ";
+    Buffer requests;
+    while(true)
+    {
+        const char *begin = buf->peek();
+        const char *end = begin + buf->readableBytes();
+        const char *headerEnd = std::search(begin, end, kHeaderEnd, kHeaderEnd + 4);
+        if(headerEnd == end)
+        {
+            break;
+        }
+        const char *field = std::search(begin, headerEnd, kContentLength, kContentLength + sizeof kContentLength - 1);
+        size_t bodySize = field == headerEnd ? 0 : ::strtoul(field + sizeof kContentLength - 1, nullptr, 10);
+        size_t total = headerEnd + 4 - begin + bodySize;
+        if(buf->readableBytes() < total)
+        {
+            break;
+        }
+        bool ok = buf->readableBytes() > 12 && ::memcmp(begin + 9, "200", 3) == 0;
+        buf->retrieve(total);
+        if(owner_->recording(Timestamp::monotonicMicros()))
+        {
+            ++(ok ? responses_ : errors_);
+        }
+        requests.append(kRequest, sizeof kRequest - 1);
+    }
+    if(requests.readableBytes() > 0)
+    {
+        conn->send(&requests);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9905));
+    std::string body(static_cast<size_t>(args.getInt("body_size", 13)), 'x');
+    if(body.size() == 13)
+    {
+        body = "Hello, World!";
+    }
+
+    EventLoop loop;
+    InetAddress serverAddr(port);
+    HttpServer server(&loop, serverAddr, "http-server");
+    server.setHttpCallback([&body](const TcpConnectionPtr&, const HttpRequest &request, HttpResponse *response){
+        if(request.path() == "/hello")
+        {
+            response->setContentType("text/plain");
+            response->setBody(body);
+        }
+        else
+        {
+            response->setStatusCode(404);
+        }
+    });
+    server.setThreadNum(args.getInt("server_threads", 2));
+    server.start();
+
+    HttpLoadClient client(&loop, serverAddr, args);
+    client.start();
+    loop.loop();
+
+    output.emit(JsonObject()
+        .add("bench", "http")
+        .add("connections", args.getInt("connections", 64))
+        .add("pipeline", client.pipeline())
+        .add("server_threads", args.getInt("server_threads", 2))
+        .add("client_threads", args.getInt("client_threads", 2))
+        .add("body_size", static_cast<int64_t>(body.size()))
+        .add("seconds", client.seconds())
+        .add("responses", client.responses())
+        .add("errors", client.errors())
+        .add("requests_per_sec", client.responses() / client.seconds())
+        .addRaw("server_loops", server.tcpServer()->metricsSnapshot().toJson())
+        .str());
+    return 0;
+}
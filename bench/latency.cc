@@ -0,0 +1,293 @@
+// 请求/响应延迟测试：每个连接发送一个message_size大小的请求，收到完整回复后再发下一个，
+// 统计往返延迟的p50/p99/p999，预热阶段的样本不计入
+// 加--pin时每个loop绑定到一个cpu上，依次是baseloop、服务端subloop、客户端subloop，
+// 也可以用--base_cpus/--server_cpus/--client_cpus分别指定，和不绑核的结果对比rtt_jitter_us
+// --busy_poll_us让服务端和客户端的subloop先自旋再阻塞（EventLoop::setBusyPoll），
+// --socket_busy_poll_us再给每个连接设置SO_BUSY_POLL，和默认的阻塞模式对比rtt的p50/p99
+//
+// bench_latency --message_size=64 --connections=16 --server_threads=2 --client_threads=1
+//               --warmup=1 --seconds=10 --port=9901 [--pin] [--server_cpus=2-3]
+//               [--client_cpus=4] [--base_cpus=0] [--busy_poll_us=50]
+//               [--socket_busy_poll_us=50] [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "CpuAffinity.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// --key指定的cpu列表；没有指定但开了--pin时，从允许运行的cpu中第first个开始依次取count个
+static CpuAffinity::CpuList cpusFor(const BenchArgs &args, const std::string &key, int first, int count)
+{
+    if(args.has(key))
+    {
+        return CpuAffinity::parse(args.getString(key, ""));
+    }
+    CpuAffinity::CpuList cpus;
+    CpuAffinity::CpuList allowed = CpuAffinity::currentThreadCpus();
+    if(args.getInt("pin", 0) && !allowed.empty())
+    {
+        for(int i = 0; i < count; ++i)
+        {
+            cpus.push_back(allowed[(first + i) % allowed.size()]);
+        }
+    }
+    return cpus;
+}
+
+// 每个loop独占列表中的一个cpu
+static std::vector<std::vector<int>> onePerLoop(const CpuAffinity::CpuList &cpus)
+{
+    std::vector<std::vector<int>> result;
+    for(int cpu : cpus)
+    {
+        result.push_back(std::vector<int>(1, cpu));
+    }
+    return result;
+}
+
+class LatencyClient;
+
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, LatencyClient *owner);
+
+    void start() { client_.connect(); }
+    void stop() { client_.disconnect(); }
+
+    // 只有所属的loop线程会写
+    const Histogram& latency() const { return latency_; }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+    void sendRequest(const TcpConnectionPtr &conn);
+
+    TcpClient client_;
+    LatencyClient *owner_;
+    int64_t sentMicros_;
+    Histogram latency_;
+};
+
+class LatencyClient : noncopyable
+{
+public:
+    LatencyClient(EventLoop *loop, const InetAddress &serverAddr, const BenchArgs &args)
+        : loop_(loop)
+        , threadPool_(loop, "latency-client")
+        , request_(args.getInt("message_size", 64), 'l')
+        , numConnections_(args.getInt("connections", 16))
+        , warmupSeconds_(args.getDouble("warmup", 1))
+        , seconds_(args.getDouble("seconds", 10))
+        , socketBusyPollMicros_(args.getInt("socket_busy_poll_us", 0))
+        , numConnected_(0)
+        , numDisconnected_(0)
+        , recordFrom_(INT64_MAX)
+        , recordUntil_(INT64_MAX)
+    {
+        int numThreads = args.getInt("client_threads", 1);
+        cpus_ = cpusFor(args, "client_cpus", 1 + args.getInt("server_threads", 2), numThreads);
+        threadPool_.setThreadNum(numThreads);
+        threadPool_.setThreadCpus(onePerLoop(cpus_));
+        threadPool_.start();
+        int64_t busyPollMicros = args.getInt("busy_poll_us", 0);
+        if(busyPollMicros > 0)
+        {
+            for(EventLoop *ioLoop : threadPool_.getAllLoops())
+            {
+                ioLoop->setBusyPoll(busyPollMicros);
+            }
+        }
+        for(int i = 0; i < numConnections_; ++i)
+        {
+            sessions_.emplace_back(new Session(threadPool_.getNextLoop(), serverAddr,
+                "latency-" + std::to_string(i), this));
+        }
+    }
+
+    void start()
+    {
+        for(auto &session : sessions_)
+        {
+            session->start();
+        }
+    }
+
+    const std::string& request() const { return request_; }
+
+    bool recording(int64_t now) const { return now >= recordFrom_ && now < recordUntil_; }
+
+    void onConnect()
+    {
+        if(++numConnected_ == numConnections_)
+        {
+            loop_->runInLoop(std::bind(&LatencyClient::allConnected, this));
+        }
+    }
+
+    void onDisconnect()
+    {
+        if(++numDisconnected_ == numConnections_)
+        {
+            loop_->queueInLoop(std::bind(&EventLoop::quit, loop_));
+        }
+    }
+
+    Histogram::Snapshot latency() const
+    {
+        Histogram::Snapshot total;
+        for(auto &session : sessions_)
+        {
+            total.merge(session->latency().snapshot());
+        }
+        return total;
+    }
+
+    double seconds() const { return seconds_; }
+    const CpuAffinity::CpuList& cpus() const { return cpus_; }
+    int socketBusyPollMicros() const { return socketBusyPollMicros_; }
+
+private:
+    void allConnected()
+    {
+        int64_t now = Timestamp::monotonicMicros();
+        recordFrom_ = now + static_cast<int64_t>(warmupSeconds_ * 1e6);
+        recordUntil_ = recordFrom_ + static_cast<int64_t>(seconds_ * 1e6);
+        loop_->runAfter(warmupSeconds_ + seconds_, std::bind(&LatencyClient::stop, this));
+    }
+
+    void stop()
+    {
+        for(auto &session : sessions_)
+        {
+            session->stop();
+        }
+    }
+
+    EventLoop *loop_;
+    EventLoopThreadPool threadPool_;
+    std::string request_;
+    int numConnections_;
+    double warmupSeconds_;
+    double seconds_;
+    int socketBusyPollMicros_;
+    std::atomic_int numConnected_;
+    std::atomic_int numDisconnected_;
+    std::atomic<int64_t> recordFrom_;
+    std::atomic<int64_t> recordUntil_;
+    CpuAffinity::CpuList cpus_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+};
+
+Session::Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, LatencyClient *owner)
+    : client_(loop, serverAddr, name)
+    , owner_(owner)
+    , sentMicros_(0)
+{
+    client_.setConnectionCallback(std::bind(&Session::onConnection, this, std::placeholders::_1));
+    client_.setMessageCallback(std::bind(&Session::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void Session::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        conn->setTcpNoDelay(true);
+        if(owner_->socketBusyPollMicros() > 0)
+        {
+            conn->setBusyPoll(owner_->socketBusyPollMicros());
+        }
+        owner_->onConnect();
+        sendRequest(conn);
+    }
+    else
+    {
+        owner_->onDisconnect();
+    }
+}
+
+void Session::sendRequest(const TcpConnectionPtr &conn)
+{
+    sentMicros_ = Timestamp::monotonicMicros();
+    conn->send(owner_->request());
+}
+
+void Session::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    size_t size = owner_->request().size();
+    while(buf->readableBytes() >= size)
+    {
+        buf->retrieve(size);
+        int64_t now = Timestamp::monotonicMicros();
+        if(owner_->recording(now))
+        {
+            latency_.record(now - sentMicros_);
+        }
+        sendRequest(conn);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9901));
+    int serverThreads = args.getInt("server_threads", 2);
+    CpuAffinity::CpuList baseCpus = cpusFor(args, "base_cpus", 0, 1);
+    CpuAffinity::CpuList serverCpus = cpusFor(args, "server_cpus", 1, serverThreads);
+
+    // 在构造baseloop之前绑定主线程
+    CpuAffinity::bindCurrentThread(baseCpus);
+    EventLoop loop;
+    InetAddress serverAddr(port);
+    TcpServer server(&loop, serverAddr, "latency-server");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn){
+        if(conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.setThreadNum(serverThreads);
+    server.setThreadCpus(onePerLoop(serverCpus));
+    server.start();
+    if(args.getInt("busy_poll_us", 0) > 0)
+    {
+        server.enableBusyPoll(args.getInt("busy_poll_us", 0), args.getInt("socket_busy_poll_us", 0));
+    }
+
+    LatencyClient client(&loop, serverAddr, args);
+    client.start();
+    loop.loop();
+
+    Histogram::Snapshot latency = client.latency();
+    output.emit(JsonObject()
+        .add("bench", "latency")
+        .add("message_size", args.getInt("message_size", 64))
+        .add("connections", args.getInt("connections", 16))
+        .add("server_threads", serverThreads)
+        .add("client_threads", args.getInt("client_threads", 1))
+        .add("base_cpus", CpuAffinity::toString(baseCpus))
+        .add("server_cpus", CpuAffinity::toString(serverCpus))
+        .add("client_cpus", CpuAffinity::toString(client.cpus()))
+        .add("busy_poll_us", args.getInt("busy_poll_us", 0))
+        .add("socket_busy_poll_us", args.getInt("socket_busy_poll_us", 0))
+        .add("seconds", client.seconds())
+        .add("requests", latency.count)
+        .add("requests_per_sec", latency.count / client.seconds())
+        .addLatency("rtt", latency)
+        .add("rtt_jitter_us", static_cast<int64_t>(latency.percentile(0.99) - latency.percentile(0.50)))
+        .addRaw("server_loops", server.metricsSnapshot().toJson())
+        .str());
+    return 0;
+}
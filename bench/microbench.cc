@@ -0,0 +1,319 @@
+// 热点基础组件的微基准：Buffer、readFd、Channel::handleEvent、
+// 带N个活跃fd的一轮事件循环、跨线程queueInLoop、accept+newConnection
+// 每个基准输出一行JSON，ns_per_op的ci95_ns不重叠时可以认为有差异
+//
+// bench_micro [--filter=buffer] [--repetitions=10] [--warmup=2] [--min_time_ms=100]
+//             [--seed=42] [--verbose]
+
+#include "BenchCommon.h"
+#include "MicroBench.h"
+
+#include "Buffer.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "TcpServer.h"
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
+
+static int64_t benchBufferAppendRetrieve(uint64_t iterations, std::mt19937&)
+{
+    Buffer buf;
+    char data[64] = {0};
+    int64_t start = MicroBench::nowNanos();
+    for(uint64_t i = 0; i < iterations; ++i)
+    {
+        buf.append(data, sizeof data);
+        buf.retrieve(sizeof data);
+    }
+    int64_t ns = MicroBench::nowNanos() - start;
+    doNotOptimize(buf);
+    return ns;
+}
+
+// 随机大小的写入和部分读取，覆盖makeSpace的扩容和内部搬移
+static int64_t benchBufferRandomPattern(uint64_t iterations, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<size_t> appendSize(1, 4096);
+    std::vector<size_t> sizes(iterations);
+    std::vector<double> fractions(iterations);
+    std::uniform_real_distribution<double> fraction(0.0, 1.0);
+    for(uint64_t i = 0; i < iterations; ++i)
+    {
+        sizes[i] = appendSize(rng);
+        fractions[i] = fraction(rng);
+    }
+    std::vector<char> data(4096, 'b');
+
+    Buffer buf;
+    int64_t start = MicroBench::nowNanos();
+    for(uint64_t i = 0; i < iterations; ++i)
+    {
+        buf.append(data.data(), sizes[i]);
+        buf.retrieve(static_cast<size_t>(buf.readableBytes() * fractions[i]));
+    }
+    int64_t ns = MicroBench::nowNanos() - start;
+    doNotOptimize(buf);
+    return ns;
+}
+
+// 读走大部分后再写入，可写空间不够但总空间足够，触发数据前移
+static int64_t benchBufferMakeSpaceCompact(uint64_t iterations, std::mt19937&)
+{
+    char data[1000] = {0};
+    Buffer buf;
+    buf.append(data, sizeof data);
+    int64_t start = MicroBench::nowNanos();
+    for(uint64_t i = 0; i < iterations; ++i)
+    {
+        buf.retrieve(900);
+        buf.append(data, 900);
+    }
+    int64_t ns = MicroBench::nowNanos() - start;
+    doNotOptimize(buf);
+    return ns;
+}
+
+// 每次写入chunk字节后用readFd读出，只统计readFd的时间
+static int64_t benchReadFd(uint64_t iterations, size_t chunk)
+{
+    int fds[2];
+    ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    std::vector<char> data(chunk, 'r');
+    Buffer buf;
+    int savedErrno = 0;
+    int64_t ns = 0;
+    for(uint64_t i = 0; i < iterations; ++i)
+    {
+        size_t written = 0;
+        while(written < chunk)
+        {
+            written += ::write(fds[1], data.data() + written, chunk - written);
+        }
+        size_t got = 0;
+        int64_t start = MicroBench::nowNanos();
+        while(got < chunk)
+        {
+            got += buf.readFd(fds[0], &savedErrno);
+        }
+        ns += MicroBench::nowNanos() - start;
+        buf.retrieveAll();
+    }
+    ::close(fds[0]);
+    ::close(fds[1]);
+    return ns;
+}
+
+static int64_t benchChannelHandleEvent(uint64_t iterations, bool tied)
+{
+    EventLoop loop;
+    Channel channel(&loop, -1);
+    uint64_t count = 0;
+    channel.setReadCallback([&count](Timestamp){ ++count; });
+    std::shared_ptr<int> owner = std::make_shared<int>(0);
+    if(tied)
+    {
+        channel.tie(owner);
+    }
+    channel.set_revents(EPOLLIN);
+    Timestamp now = Timestamp::now();
+    int64_t start = MicroBench::nowNanos();
+    for(uint64_t i = 0; i < iterations; ++i)
+    {
+        channel.handleEvent(now);
+    }
+    int64_t ns = MicroBench::nowNanos() - start;
+    doNotOptimize(count);
+    return ns;
+}
+
+// numFds个eventfd一直可读（LT模式，回调里不读），每轮poll都返回全部numFds个事件
+// 统计一轮循环的时间：epoll_wait、分发、指标统计和doPendingFunctors
+static int64_t benchLoopIteration(uint64_t iterations, int numFds)
+{
+    EventLoop loop;
+    std::vector<int> fds;
+    std::vector<std::unique_ptr<Channel>> channels;
+    uint64_t rounds = 0;
+    for(int i = 0; i < numFds; ++i)
+    {
+        int fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+        fds.push_back(fd);
+        channels.emplace_back(new Channel(&loop, fd));
+        if(i == 0)
+        {
+            channels.back()->setReadCallback([&](Timestamp){
+                if(++rounds == iterations)
+                {
+                    loop.quit();
+                }
+            });
+        }
+        else
+        {
+            channels.back()->setReadCallback([](Timestamp){});
+        }
+        channels.back()->enableReading();
+    }
+
+    int64_t start = MicroBench::nowNanos();
+    loop.loop();
+    int64_t ns = MicroBench::nowNanos() - start;
+
+    for(auto &channel : channels)
+    {
+        channel->disableAll();
+        channel->remove();
+    }
+    for(int fd : fds)
+    {
+        ::close(fd);
+    }
+    return ns;
+}
+
+// 生产者线程连续投递iterations个空任务，统计全部被loop执行完的时间
+static int64_t benchQueueInLoopCrossThread(uint64_t iterations, std::mt19937&)
+{
+    EventLoopThread thread;
+    EventLoop *loop = thread.startLoop();
+    std::promise<int64_t> done;
+    uint64_t executed = 0;
+
+    int64_t start = MicroBench::nowNanos();
+    for(uint64_t i = 0; i < iterations; ++i)
+    {
+        loop->queueInLoop([&executed](){ ++executed; });
+    }
+    loop->queueInLoop([&done](){ done.set_value(MicroBench::nowNanos()); });
+    int64_t ns = done.get_future().get() - start;
+    doNotOptimize(executed);
+    return ns;
+}
+
+// 在pendingFunctors中投递任务（回调里继续发请求的常见情况）：
+// 加锁入队，并且因为callingPendingFunctors_每次都要写一次wakeupfd
+static int64_t benchQueueInLoopSameThread(uint64_t iterations, std::mt19937&)
+{
+    EventLoop loop;
+    uint64_t executed = 0;
+    int64_t start = 0;
+    int64_t end = 0;
+    loop.queueInLoop([&](){
+        start = MicroBench::nowNanos();
+        for(uint64_t i = 0; i < iterations; ++i)
+        {
+            loop.queueInLoop([&executed](){ ++executed; });
+        }
+        loop.queueInLoop([&](){
+            end = MicroBench::nowNanos();
+            loop.quit();
+        });
+    });
+    loop.wakeup();  // 不唤醒的话第一次poll要等到超时
+    loop.loop();
+    doNotOptimize(executed);
+    return end - start;
+}
+
+static int64_t threadCpuNanos()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+// baseloop上accept和TcpServer::newConnection的CPU时间，连接在subloop上建立和关闭
+// 客户端用SO_LINGER(0)关闭，不留TIME_WAIT，多轮重复不会耗尽端口
+static int64_t benchNewConnection(uint64_t iterations, std::mt19937&)
+{
+    const uint16_t port = 9910;
+    EventLoopThread baseThread;
+    EventLoop *baseLoop = baseThread.startLoop();
+    std::unique_ptr<TcpServer> server;
+    std::atomic<uint64_t> accepted(0);
+
+    std::promise<void> ready;
+    baseLoop->runInLoop([&](){
+        server.reset(new TcpServer(baseLoop, InetAddress(port), "micro-server"));
+        server->setConnectionCallback([&accepted](const TcpConnectionPtr &conn){
+            if(conn->connected())
+            {
+                ++accepted;
+            }
+        });
+        server->setThreadNum(1);
+        server->start();
+        ready.set_value();
+    });
+    ready.get_future().get();
+
+    auto cpuOfBaseLoop = [baseLoop](){
+        std::promise<int64_t> cpu;
+        baseLoop->runInLoop([&cpu](){ cpu.set_value(threadCpuNanos()); });
+        return cpu.get_future().get();
+    };
+
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    linger lin = { 1, 0 };
+
+    int64_t cpuBegin = cpuOfBaseLoop();
+    for(uint64_t i = 0; i < iterations; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        ::connect(fd, (sockaddr*)&addr, sizeof addr);
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof lin);
+        // 等服务端处理完这个连接再关闭，保证每次都走完整的accept路径
+        while(accepted < i + 1)
+        {
+            std::this_thread::yield();
+        }
+        ::close(fd);
+    }
+    int64_t ns = cpuOfBaseLoop() - cpuBegin;
+
+    std::promise<void> destroyed;
+    baseLoop->runInLoop([&](){
+        server.reset();
+        destroyed.set_value();
+    });
+    destroyed.get_future().get();
+    return ns;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+
+    MicroBench micro;
+    micro.add("buffer_append_retrieve_64", benchBufferAppendRetrieve);
+    micro.add("buffer_random_pattern", benchBufferRandomPattern);
+    micro.add("buffer_make_space_compact", benchBufferMakeSpaceCompact);
+    micro.add("buffer_read_fd_1k", [](uint64_t n, std::mt19937&){ return benchReadFd(n, 1024); });
+    micro.add("buffer_read_fd_64k", [](uint64_t n, std::mt19937&){ return benchReadFd(n, 64 * 1024); });
+    micro.add("channel_handle_event", [](uint64_t n, std::mt19937&){ return benchChannelHandleEvent(n, false); });
+    micro.add("channel_handle_event_tied", [](uint64_t n, std::mt19937&){ return benchChannelHandleEvent(n, true); });
+    micro.add("loop_iteration_1_active", [](uint64_t n, std::mt19937&){ return benchLoopIteration(n, 1); });
+    micro.add("loop_iteration_16_active", [](uint64_t n, std::mt19937&){ return benchLoopIteration(n, 16); });
+    micro.add("loop_iteration_256_active", [](uint64_t n, std::mt19937&){ return benchLoopIteration(n, 256); });
+    micro.add("queue_in_loop_cross_thread", benchQueueInLoopCrossThread);
+    micro.add("queue_in_loop_same_thread", benchQueueInLoopSameThread);
+    micro.add("tcp_server_new_connection", benchNewConnection);
+    micro.run(args, output);
+    return 0;
+}
@@ -0,0 +1,293 @@
+// 计算密集的请求处理：每个请求在服务端消耗work_us微秒的CPU，
+// 对比在io loop中直接处理和交给TaskPool处理时的吞吐量和往返延迟
+// 每个连接同时只有一个请求，收到回复后再发下一个
+//
+// bench_offload --offload=1 --workers=4 --work_us=50 --connections=32 --server_threads=2
+//               --client_threads=2 --warmup=1 --seconds=10 --port=9903 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+const size_t kRequestSize = 64;
+
+static uint64_t g_iterationsPerMicro = 1;
+static volatile uint64_t g_sink;
+
+// 对请求反复做FNV-1a，模拟解析、压缩这类纯CPU的工作
+static uint64_t burn(const std::string &request, uint64_t iterations)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for(uint64_t i = 0; i < iterations; ++i)
+    {
+        for(unsigned char c : request)
+        {
+            hash = (hash ^ c) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+static void calibrate()
+{
+    std::string request(kRequestSize, 'o');
+    uint64_t iterations = 1000;
+    while(true)
+    {
+        int64_t start = Timestamp::monotonicMicros();
+        g_sink = burn(request, iterations);
+        int64_t elapsed = Timestamp::monotonicMicros() - start;
+        if(elapsed >= 20000)
+        {
+            g_iterationsPerMicro = std::max<uint64_t>(1, iterations / elapsed);
+            return;
+        }
+        iterations *= 2;
+    }
+}
+
+static std::string handle(const std::string &request, int workMicros)
+{
+    uint64_t hash = burn(request, g_iterationsPerMicro * workMicros);
+    std::string reply(kRequestSize, '\0');
+    ::memcpy(&reply[0], &hash, sizeof hash);
+    return reply;
+}
+
+class OffloadClient;
+
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, OffloadClient *owner);
+
+    void start() { client_.connect(); }
+    void stop() { client_.disconnect(); }
+
+    const Histogram& latency() const { return latency_; }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+    void sendRequest(const TcpConnectionPtr &conn);
+
+    TcpClient client_;
+    OffloadClient *owner_;
+    int64_t sentMicros_;
+    Histogram latency_;
+};
+
+class OffloadClient : noncopyable
+{
+public:
+    OffloadClient(EventLoop *loop, const InetAddress &serverAddr, const BenchArgs &args)
+        : loop_(loop)
+        , threadPool_(loop, "offload-client")
+        , request_(kRequestSize, 'o')
+        , numConnections_(args.getInt("connections", 32))
+        , warmupSeconds_(args.getDouble("warmup", 1))
+        , seconds_(args.getDouble("seconds", 10))
+        , numConnected_(0)
+        , numDisconnected_(0)
+        , recordFrom_(INT64_MAX)
+        , recordUntil_(INT64_MAX)
+    {
+        threadPool_.setThreadNum(args.getInt("client_threads", 2));
+        threadPool_.start();
+        for(int i = 0; i < numConnections_; ++i)
+        {
+            sessions_.emplace_back(new Session(threadPool_.getNextLoop(), serverAddr,
+                "offload-" + std::to_string(i), this));
+        }
+    }
+
+    void start()
+    {
+        for(auto &session : sessions_)
+        {
+            session->start();
+        }
+    }
+
+    const std::string& request() const { return request_; }
+
+    bool recording(int64_t now) const { return now >= recordFrom_ && now < recordUntil_; }
+
+    void onConnect()
+    {
+        if(++numConnected_ == numConnections_)
+        {
+            loop_->runInLoop(std::bind(&OffloadClient::allConnected, this));
+        }
+    }
+
+    void onDisconnect()
+    {
+        if(++numDisconnected_ == numConnections_)
+        {
+            loop_->queueInLoop(std::bind(&EventLoop::quit, loop_));
+        }
+    }
+
+    Histogram::Snapshot latency() const
+    {
+        Histogram::Snapshot total;
+        for(auto &session : sessions_)
+        {
+            total.merge(session->latency().snapshot());
+        }
+        return total;
+    }
+
+    double seconds() const { return seconds_; }
+
+private:
+    void allConnected()
+    {
+        int64_t now = Timestamp::monotonicMicros();
+        recordFrom_ = now + static_cast<int64_t>(warmupSeconds_ * 1e6);
+        recordUntil_ = recordFrom_ + static_cast<int64_t>(seconds_ * 1e6);
+        loop_->runAfter(warmupSeconds_ + seconds_, std::bind(&OffloadClient::stop, this));
+    }
+
+    void stop()
+    {
+        for(auto &session : sessions_)
+        {
+            session->stop();
+        }
+    }
+
+    EventLoop *loop_;
+    EventLoopThreadPool threadPool_;
+    std::string request_;
+    int numConnections_;
+    double warmupSeconds_;
+    double seconds_;
+    std::atomic_int numConnected_;
+    std::atomic_int numDisconnected_;
+    std::atomic<int64_t> recordFrom_;
+    std::atomic<int64_t> recordUntil_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+};
+
+Session::Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, OffloadClient *owner)
+    : client_(loop, serverAddr, name)
+    , owner_(owner)
+    , sentMicros_(0)
+{
+    client_.setConnectionCallback(std::bind(&Session::onConnection, this, std::placeholders::_1));
+    client_.setMessageCallback(std::bind(&Session::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void Session::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        conn->setTcpNoDelay(true);
+        owner_->onConnect();
+        sendRequest(conn);
+    }
+    else
+    {
+        owner_->onDisconnect();
+    }
+}
+
+void Session::sendRequest(const TcpConnectionPtr &conn)
+{
+    sentMicros_ = Timestamp::monotonicMicros();
+    conn->send(owner_->request());
+}
+
+void Session::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    while(buf->readableBytes() >= kRequestSize)
+    {
+        buf->retrieve(kRequestSize);
+        int64_t now = Timestamp::monotonicMicros();
+        if(owner_->recording(now))
+        {
+            latency_.record(now - sentMicros_);
+        }
+        sendRequest(conn);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9903));
+    bool offload = args.getInt("offload", 1) != 0;
+    int workMicros = args.getInt("work_us", 50);
+    calibrate();
+
+    TaskPool pool("offload-worker");
+    pool.setThreadNum(args.getInt("workers", 4));
+    if(offload)
+    {
+        pool.start();
+    }
+
+    EventLoop loop;
+    InetAddress serverAddr(port);
+    TcpServer server(&loop, serverAddr, "offload-server");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn){
+        if(conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+        }
+    });
+    server.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        while(buf->readableBytes() >= kRequestSize)
+        {
+            std::string request = buf->retrieveAsString(kRequestSize);
+            if(offload)
+            {
+                pool.runForConnection(conn,
+                    [request, workMicros](){ return handle(request, workMicros); },
+                    [](const TcpConnectionPtr &conn, const std::string &reply){ conn->send(reply); });
+            }
+            else
+            {
+                conn->send(handle(request, workMicros));
+            }
+        }
+    });
+    server.setThreadNum(args.getInt("server_threads", 2));
+    server.start();
+
+    OffloadClient client(&loop, serverAddr, args);
+    client.start();
+    loop.loop();
+    pool.stop();
+
+    Histogram::Snapshot latency = client.latency();
+    output.emit(JsonObject()
+        .add("bench", "offload")
+        .add("offload", offload ? 1 : 0)
+        .add("workers", offload ? args.getInt("workers", 4) : 0)
+        .add("work_us", workMicros)
+        .add("connections", args.getInt("connections", 32))
+        .add("server_threads", args.getInt("server_threads", 2))
+        .add("client_threads", args.getInt("client_threads", 2))
+        .add("seconds", client.seconds())
+        .add("requests", latency.count)
+        .add("requests_per_sec", latency.count / client.seconds())
+        .addLatency("rtt", latency)
+        .add("steals", pool.steals())
+        .addRaw("server_loops", server.metricsSnapshot().toJson())
+        .str());
+    return 0;
+}
@@ -0,0 +1,262 @@
+// 吞吐量测试：每个连接建立后发送一个message_size大小的消息，
+// 服务端和客户端都原样回显，统计单位时间内客户端收到的字节数和消息数
+// --server=coroutine时服务端用Coroutine.h的协程实现回显（需要C++20编译），和默认的回调版本对比
+// --family选择回环地址的类型：tcp(127.0.0.1)、tcp6(::1)或unix（--unix_path，默认abstract namespace）
+//
+// bench_pingpong --message_size=4096 --connections=64 --server_threads=2
+//                --client_threads=2 --seconds=10 --port=9900 [--server=callback|coroutine]
+//                [--family=tcp|tcp6|unix] [--unix_path=@mymuduo-pingpong] [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#ifdef __cpp_impl_coroutine
+#include "Coroutine.h"
+
+// 协程版本的回显，和回调版本一样收到多少回多少
+static co::Task echo(TcpConnectionPtr conn)
+{
+    co::Stream stream(conn);
+    while(Buffer *buf = co_await stream.readable(1))
+    {
+        if(!co_await stream.write(buf->retrieveAllAsString()))
+        {
+            break;
+        }
+    }
+}
+#endif
+
+class PingpongClient;
+
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, PingpongClient *owner);
+
+    void start() { client_.connect(); }
+    void stop() { client_.disconnect(); }
+
+    uint64_t bytesRead() const { return bytesRead_; }
+    uint64_t messagesRead() const { return messagesRead_; }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        ++messagesRead_;
+        bytesRead_ += buf->readableBytes();
+        conn->send(buf->retrieveAllAsString());
+    }
+
+    TcpClient client_;
+    PingpongClient *owner_;
+    uint64_t bytesRead_;
+    uint64_t messagesRead_;
+};
+
+class PingpongClient : noncopyable
+{
+public:
+    PingpongClient(EventLoop *loop, const InetAddress &serverAddr, const BenchArgs &args)
+        : loop_(loop)
+        , threadPool_(loop, "pingpong-client")
+        , message_(args.getInt("message_size", 4096), 'p')
+        , numConnections_(args.getInt("connections", 64))
+        , numConnected_(0)
+        , numDisconnected_(0)
+        , startMicros_(0)
+        , stopMicros_(0)
+    {
+        threadPool_.setThreadNum(args.getInt("client_threads", 2));
+        threadPool_.start();
+        for(int i = 0; i < numConnections_; ++i)
+        {
+            sessions_.emplace_back(new Session(threadPool_.getNextLoop(), serverAddr,
+                "pingpong-" + std::to_string(i), this));
+        }
+    }
+
+    void start()
+    {
+        for(auto &session : sessions_)
+        {
+            session->start();
+        }
+    }
+
+    const std::string& message() const { return message_; }
+
+    // 在各个客户端loop线程中调用
+    void onConnect()
+    {
+        if(++numConnected_ == numConnections_)
+        {
+            startMicros_ = Timestamp::monotonicMicros();
+            loop_->runInLoop(std::bind(&PingpongClient::allConnected, this));
+        }
+    }
+
+    void onDisconnect()
+    {
+        if(++numDisconnected_ == numConnections_)
+        {
+            loop_->queueInLoop(std::bind(&EventLoop::quit, loop_));
+        }
+    }
+
+    void setDuration(double seconds) { seconds_ = seconds; }
+
+    uint64_t totalBytesRead() const
+    {
+        uint64_t total = 0;
+        for(auto &session : sessions_)
+        {
+            total += session->bytesRead();
+        }
+        return total;
+    }
+
+    uint64_t totalMessagesRead() const
+    {
+        uint64_t total = 0;
+        for(auto &session : sessions_)
+        {
+            total += session->messagesRead();
+        }
+        return total;
+    }
+
+    double elapsedSeconds() const { return (stopMicros_ - startMicros_) / 1e6; }
+
+private:
+    void allConnected()
+    {
+        loop_->runAfter(seconds_, std::bind(&PingpongClient::stop, this));
+    }
+
+    void stop()
+    {
+        stopMicros_ = Timestamp::monotonicMicros();
+        for(auto &session : sessions_)
+        {
+            session->stop();
+        }
+    }
+
+    EventLoop *loop_;
+    EventLoopThreadPool threadPool_;
+    std::string message_;
+    int numConnections_;
+    std::atomic_int numConnected_;
+    std::atomic_int numDisconnected_;
+    double seconds_;
+    int64_t startMicros_;
+    int64_t stopMicros_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+};
+
+Session::Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, PingpongClient *owner)
+    : client_(loop, serverAddr, name)
+    , owner_(owner)
+    , bytesRead_(0)
+    , messagesRead_(0)
+{
+    client_.setConnectionCallback(std::bind(&Session::onConnection, this, std::placeholders::_1));
+    client_.setMessageCallback(std::bind(&Session::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void Session::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        conn->setTcpNoDelay(true);
+        conn->send(owner_->message());
+        owner_->onConnect();
+    }
+    else
+    {
+        owner_->onDisconnect();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9900));
+    double seconds = args.getDouble("seconds", 10);
+    std::string serverMode = args.getString("server", "callback");
+#ifndef __cpp_impl_coroutine
+    if(serverMode == "coroutine")
+    {
+        ::fprintf(stderr, "bench_pingpong was built without C++20 coroutine support\n");
+        return 1;
+    }
+#endif
+
+    std::string family = args.getString("family", "tcp");
+    InetAddress serverAddr(port);
+    if(family == "tcp6")
+    {
+        serverAddr = InetAddress(port, "::1");
+    }
+    else if(family == "unix")
+    {
+        serverAddr = InetAddress::fromUnixPath(args.getString("unix_path", "@mymuduo-pingpong"));
+    }
+
+    EventLoop loop;
+    TcpServer server(&loop, serverAddr, "pingpong-server");
+    server.setConnectionCallback([serverMode](const TcpConnectionPtr &conn){
+        if(conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+#ifdef __cpp_impl_coroutine
+            if(serverMode == "coroutine")
+            {
+                echo(conn);
+            }
+#endif
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.setThreadNum(args.getInt("server_threads", 2));
+    server.start();
+
+    PingpongClient client(&loop, serverAddr, args);
+    client.setDuration(seconds);
+    client.start();
+    loop.loop();
+
+    double elapsed = client.elapsedSeconds();
+    uint64_t bytes = client.totalBytesRead();
+    uint64_t messages = client.totalMessagesRead();
+    output.emit(JsonObject()
+        .add("bench", "pingpong")
+        .add("server", serverMode)
+        .add("family", family)
+        .add("message_size", args.getInt("message_size", 4096))
+        .add("connections", args.getInt("connections", 64))
+        .add("server_threads", args.getInt("server_threads", 2))
+        .add("client_threads", args.getInt("client_threads", 2))
+        .add("seconds", elapsed)
+        .add("bytes", bytes)
+        .add("messages", messages)
+        .add("mib_per_sec", bytes / elapsed / (1024 * 1024))
+        .add("messages_per_sec", messages / elapsed)
+        .addRaw("server_loops", server.metricsSnapshot().toJson())
+        .str());
+    return 0;
+}
@@ -0,0 +1,246 @@
+// 限速下的公平性：服务端只有一个subloop，一个激进的客户端连接不停地发送block大小的数据块（上一块写完就发下一块），
+// 同时normal个普通连接每隔interval_ms各发一个message_size大小的请求，服务端全部原样回显
+// 统计普通连接请求的往返延迟，以及激进连接每秒被回显的字节数
+// --limit=1时服务端给每个连接限读带宽（--read_limit字节每秒，--read_burst）和消息数（--message_limit，0为不限），
+// 激进连接读超限后停止读，普通连接的请求不再排在它的大块数据后面
+//
+// bench_ratelimit --limit=0|1 --read_limit=1048576 --read_burst=262144 --message_limit=0
+//                 --normal=1000 --interval_ms=100 --message_size=64 --block=65536
+//                 --seconds=5 --port=9913 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "RateLimiter.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// 普通连接：同一时刻最多一个请求在路上
+class NormalSession : noncopyable
+{
+public:
+    NormalSession(EventLoop *loop, const InetAddress &serverAddr, const std::string &name,
+                  const std::string &message, Histogram *latency, std::atomic_bool *measuring,
+                  std::atomic<int> *numConnected)
+        : client_(loop, serverAddr, name)
+        , message_(message)
+        , latency_(latency)
+        , measuring_(measuring)
+        , sentMicros_(0)
+        , outstanding_(false)
+        , completed_(0)
+    {
+        client_.setConnectionCallback([this, numConnected](const TcpConnectionPtr &conn){
+            if(conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+                conn_ = conn;
+                ++*numConnected;
+            }
+            else
+            {
+                conn_.reset();
+            }
+        });
+        client_.setMessageCallback([this](const TcpConnectionPtr&, Buffer *buf, Timestamp){
+            if(outstanding_ && buf->readableBytes() >= message_.size())
+            {
+                buf->retrieve(message_.size());
+                outstanding_ = false;
+                if(*measuring_)
+                {
+                    latency_->record(static_cast<uint64_t>(Timestamp::monotonicMicros() - sentMicros_));
+                    ++completed_;
+                }
+            }
+        });
+    }
+
+    void connect() { client_.connect(); }
+    void disconnect() { client_.disconnect(); }
+    uint64_t completed() const { return completed_; }
+
+    // 在所属loop线程中调用
+    void sendRequest()
+    {
+        if(conn_ && !outstanding_)
+        {
+            outstanding_ = true;
+            sentMicros_ = Timestamp::monotonicMicros();
+            conn_->send(message_);
+        }
+    }
+
+private:
+    TcpClient client_;
+    TcpConnectionPtr conn_;
+    const std::string &message_;
+    Histogram *latency_;
+    std::atomic_bool *measuring_;
+    int64_t sentMicros_;
+    bool outstanding_;
+    std::atomic<uint64_t> completed_;
+};
+
+// 激进连接：发送窗口一空就再写一块
+class AggressiveSession : noncopyable
+{
+public:
+    AggressiveSession(EventLoop *loop, const InetAddress &serverAddr, size_t block, std::atomic<int> *numConnected)
+        : client_(loop, serverAddr, "aggressive")
+        , block_(block, 'x')
+        , echoed_(0)
+    {
+        client_.setConnectionCallback([this, numConnected](const TcpConnectionPtr &conn){
+            if(conn->connected())
+            {
+                ++*numConnected;
+                conn->send(block_);
+            }
+        });
+        client_.setWriteCompleteCallback([this](const TcpConnectionPtr &conn){
+            if(conn->connected())
+            {
+                conn->send(block_);
+            }
+        });
+        client_.setMessageCallback([this](const TcpConnectionPtr&, Buffer *buf, Timestamp){
+            echoed_ += buf->readableBytes();
+            buf->retrieveAll();
+        });
+    }
+
+    void connect() { client_.connect(); }
+    void disconnect() { client_.disconnect(); }
+    uint64_t echoed() const { return echoed_; }
+
+private:
+    TcpClient client_;
+    std::string block_;
+    std::atomic<uint64_t> echoed_;
+};
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9913));
+    double seconds = args.getDouble("seconds", 5);
+    bool limit = args.getInt("limit", 1) != 0;
+    double readLimit = args.getDouble("read_limit", 1024 * 1024);
+    double readBurst = args.getDouble("read_burst", 256 * 1024);
+    double messageLimit = args.getDouble("message_limit", 0);
+    int numNormal = args.getInt("normal", 1000);
+    int intervalMs = std::max(1, args.getInt("interval_ms", 100));
+    std::string message(static_cast<size_t>(args.getInt("message_size", 64)), 'n');
+    size_t block = static_cast<size_t>(args.getInt("block", 65536));
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port, "127.0.0.1"), "ratelimit-server");
+    server.setThreadNum(1);
+    if(limit)
+    {
+        RateLimits perConnection;
+        perConnection.readBytes = RateLimit(readLimit, readBurst);
+        perConnection.messages = RateLimit(messageLimit);
+        server.setRateLimits(perConnection);
+    }
+    server.setConnectionCallback([](const TcpConnectionPtr &conn){
+        if(conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        conn->send(buf);
+    });
+    server.start();
+
+    // 激进连接和普通连接各用一个客户端loop
+    EventLoopThreadPool clientPool(&loop, "ratelimit-client");
+    clientPool.setThreadNum(2);
+    clientPool.start();
+    std::vector<EventLoop*> clientLoops = clientPool.getAllLoops();
+    EventLoop *normalLoop = clientLoops[1];
+    InetAddress serverAddr(port, "127.0.0.1");
+    std::atomic<int> numConnected(0);
+    std::atomic_bool measuring(false);
+    Histogram latency;
+    AggressiveSession aggressive(clientLoops[0], serverAddr, block, &numConnected);
+    std::vector<std::unique_ptr<NormalSession>> sessions;
+    for(int i = 0; i < numNormal; ++i)
+    {
+        sessions.emplace_back(new NormalSession(normalLoop, serverAddr, "normal-" + std::to_string(i),
+            message, &latency, &measuring, &numConnected));
+    }
+
+    uint64_t completed = 0;
+    uint64_t echoed = 0;
+    double elapsed = 0;
+    Thread driver([&](){
+        for(auto &session : sessions)
+        {
+            session->connect();
+        }
+        while(numConnected < numNormal)
+        {
+            ::usleep(10 * 1000);
+        }
+        // 每毫秒让1/interval_ms的普通连接发一个请求，每个连接每interval_ms发一次
+        std::shared_ptr<int> tick = std::make_shared<int>(0);
+        normalLoop->runEvery(0.001, [&sessions, tick, intervalMs](){
+            int slot = (*tick)++ % intervalMs;
+            for(size_t i = slot; i < sessions.size(); i += intervalMs)
+            {
+                sessions[i]->sendRequest();
+            }
+        });
+        aggressive.connect();
+        // 预热一秒再计时
+        ::usleep(1000 * 1000);
+        uint64_t echoedBegin = aggressive.echoed();
+        measuring = true;
+        int64_t start = Timestamp::monotonicMicros();
+        ::usleep(static_cast<useconds_t>(seconds * 1e6));
+        measuring = false;
+        elapsed = (Timestamp::monotonicMicros() - start) / 1e6;
+        echoed = aggressive.echoed() - echoedBegin;
+        for(auto &session : sessions)
+        {
+            completed += session->completed();
+        }
+
+        aggressive.disconnect();
+        for(auto &session : sessions)
+        {
+            session->disconnect();
+        }
+        ::usleep(500 * 1000);
+        loop.quit();
+    }, "ratelimit-driver");
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    double expected = numNormal * elapsed * 1000.0 / intervalMs;
+    JsonObject json;
+    json.add("bench", "ratelimit")
+        .add("limit", limit)
+        .add("read_limit", limit ? readLimit : 0.0)
+        .add("message_limit", limit ? messageLimit : 0.0)
+        .add("normal", numNormal)
+        .add("interval_ms", intervalMs)
+        .add("block", static_cast<int64_t>(block))
+        .add("seconds", elapsed)
+        .add("normal_requests", completed)
+        .add("normal_completion", expected > 0 ? completed / expected : 0.0)
+        .addLatency("normal_latency", latency.snapshot())
+        .add("aggressive_mib_per_sec", elapsed > 0 ? echoed / elapsed / (1024.0 * 1024.0) : 0.0);
+    output.emit(json.str());
+    return 0;
+}
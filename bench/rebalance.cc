@@ -0,0 +1,197 @@
+// 连接迁移：故意把所有繁忙连接分到同一个subloop上，比较开启负载均衡前后普通连接请求的尾延迟
+// 连接按轮询分配到subloop，第i个连接落在i % server_threads号loop上，
+// 所以i % server_threads == 0的连接作为繁忙连接，每毫秒连续发送一批请求
+// 繁忙连接全部挤在一个loop上时会让它过载，均摊到所有loop之后则不会
+// 客户端是每个连接一个线程的阻塞socket，不经过本库的loop
+//
+// bench_rebalance --server_threads=4 --connections=32 --work_us=20 --burst=16 --seconds=5
+//                 --interval_ms=200 --threshold=1.2 --port=9911 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "EventLoop.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+static const size_t kMessageSize = 64;
+
+enum Phase { kWarmup = -1, kSkewed = 0, kRebalanced = 1, kNumPhases = 2 };
+
+static int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        ::perror("connect");
+        ::exit(1);
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    return fd;
+}
+
+static bool roundTrip(int fd)
+{
+    char buf[kMessageSize];
+    ::memset(buf, 'x', sizeof buf);
+    if(::write(fd, buf, sizeof buf) != static_cast<ssize_t>(sizeof buf))
+    {
+        return false;
+    }
+    size_t got = 0;
+    while(got < sizeof buf)
+    {
+        ssize_t n = ::read(fd, buf + got, sizeof buf - got);
+        if(n <= 0)
+        {
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+// 一个客户端连接，每个阶段一个直方图，只由这个连接的线程写入
+struct Client
+{
+    Client(int f, bool b) : fd(f), busy(b) {}
+
+    int fd;
+    bool busy;
+    Histogram latency[kNumPhases];
+};
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9911));
+    int numThreads = args.getInt("server_threads", 4);
+    int numConnections = args.getInt("connections", 32);
+    int workMicros = args.getInt("work_us", 20);
+    int burst = args.getInt("burst", 16);
+    double seconds = args.getDouble("seconds", 5);
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "rebalance-server");
+    server.setConnectionCallback([](const TcpConnectionPtr&){});
+    server.setMessageCallback([workMicros](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        while(buf->readableBytes() >= kMessageSize)
+        {
+            std::string msg = buf->retrieveAsString(kMessageSize);
+            // 模拟业务的计算开销
+            int64_t deadline = Timestamp::monotonicMicros() + workMicros;
+            while(Timestamp::monotonicMicros() < deadline) {}
+            conn->send(msg);
+        }
+    });
+    server.setThreadNum(numThreads);
+    server.start();
+
+    std::atomic_bool stop(false);
+    std::atomic_int phase(kWarmup);
+    std::vector<std::unique_ptr<Client>> clients;
+    std::thread driver([&](){
+        std::vector<std::thread> threads;
+        for(int i = 0; i < numConnections; ++i)
+        {
+            int fd = connectTo(port);
+            roundTrip(fd);  // 等连接在服务端建好再建下一个，保证分配顺序
+            clients.emplace_back(new Client(fd, i % numThreads == 0));
+            Client *c = clients.back().get();
+            threads.emplace_back([c, burst, &stop, &phase](){
+                while(!stop)
+                {
+                    if(c->busy)
+                    {
+                        for(int k = 0; k < burst; ++k)
+                        {
+                            if(!roundTrip(c->fd))
+                            {
+                                return;
+                            }
+                        }
+                        ::usleep(1000);
+                        continue;
+                    }
+                    int64_t begin = Timestamp::monotonicMicros();
+                    if(!roundTrip(c->fd))
+                    {
+                        return;
+                    }
+                    int p = phase;
+                    if(p != kWarmup)
+                    {
+                        c->latency[p].record(Timestamp::monotonicMicros() - begin);
+                    }
+                    ::usleep(5000);
+                }
+            });
+        }
+
+        phase = kSkewed;
+        ::usleep(static_cast<useconds_t>(seconds * 1e6));
+
+        // 开启负载均衡，等迁移完成之后再统计
+        phase = kWarmup;
+        server.enableRebalancer(args.getInt("interval_ms", 200), args.getDouble("threshold", 1.2));
+        ::sleep(2);
+        phase = kRebalanced;
+        ::usleep(static_cast<useconds_t>(seconds * 1e6));
+
+        stop = true;
+        for(std::thread &t : threads)
+        {
+            t.join();
+        }
+        for(auto &c : clients)
+        {
+            ::close(c->fd);
+        }
+        loop.queueInLoop(std::bind(&EventLoop::quit, &loop));
+    });
+
+    loop.loop();
+    driver.join();
+
+    Histogram::Snapshot latency[kNumPhases];
+    for(auto &c : clients)
+    {
+        for(int p = 0; p < kNumPhases; ++p)
+        {
+            latency[p].merge(c->latency[p].snapshot());
+        }
+    }
+    output.emit(JsonObject()
+        .add("bench", "rebalance")
+        .add("server_threads", numThreads)
+        .add("connections", numConnections)
+        .add("work_us", workMicros)
+        .add("burst", burst)
+        .add("seconds", seconds)
+        .add("skewed_requests", latency[kSkewed].count)
+        .addLatency("skewed", latency[kSkewed])
+        .add("rebalanced_requests", latency[kRebalanced].count)
+        .addLatency("rebalanced", latency[kRebalanced])
+        .addRaw("server_loops", server.metricsSnapshot().toJson())
+        .str());
+    return 0;
+}
@@ -0,0 +1,361 @@
+// RESP：仿redis-benchmark，clients个连接，每个连接一次发出pipeline条命令（一次write），
+// 收齐全部回复后再发下一批；统计每秒命令数，以及每条命令从整批发出到收到它的回复的延迟
+// 服务端是RespServer上的一个内存KV（SET/GET），客户端用RespParser解析回复
+// --pipeline可以是逗号分隔的列表，每个取值输出一行JSON
+//
+// bench_resp --command=set|get|ping --pipeline=1,4,16,64,128 --clients=50 --size=3
+//            --keyspace=100000 --seconds=3 --server_threads=1 --client_threads=1 --port=9910 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "RespServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "Logger.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+// 服务端的数据，多个loop共享，用一把锁
+class KvStore : noncopyable
+{
+public:
+    void set(const StringPiece &key, const StringPiece &value)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        map_[std::string(key.data(), key.size())].assign(value.data(), value.size());
+    }
+
+    // 找到时把值直接写进回复
+    void get(const StringPiece &key, RespWriter *reply)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = map_.find(std::string(key.data(), key.size()));
+        if(it == map_.end())
+        {
+            reply->appendNull();
+        }
+        else
+        {
+            reply->appendBulkString(it->second);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::string> map_;
+};
+
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name,
+            const std::string &command, const std::string &value, int keyspace, std::atomic<int> *numConnected)
+        : client_(loop, serverAddr, name)
+        , command_(command)
+        , value_(value)
+        , keyspace_(keyspace)
+        , rng_(std::hash<std::string>()(name))
+        , numConnected_(numConnected)
+        , pipeline_(1)
+        , received_(0)
+        , batchStart_(0)
+        , running_(false)
+        , measuring_(false)
+        , busy_(false)
+        , completed_(0)
+        , errors_(0)
+        , latency_(new Histogram)
+    {
+        client_.setConnectionCallback([this](const TcpConnectionPtr &conn){
+            if(conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+                conn_ = conn;
+                ++*numConnected_;
+            }
+            else
+            {
+                conn_.reset();
+            }
+        });
+        client_.setMessageCallback(std::bind(&Session::onMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    }
+
+    void connect() { client_.connect(); }
+    void disconnect() { client_.disconnect(); }
+
+    // 以下在所属loop线程中调用
+    void startPhase(int pipeline)
+    {
+        pipeline_ = pipeline;
+        latency_.reset(new Histogram);
+        completed_ = 0;
+        errors_ = 0;
+        running_ = true;
+        sendBatch();
+    }
+
+    void setMeasuring(bool on) { measuring_ = on; }
+    void stop() { running_ = false; }
+    bool busy() const { return busy_; }
+    uint64_t completed() const { return completed_; }
+    uint64_t errors() const { return errors_; }
+    Histogram::Snapshot latency() const { return latency_->snapshot(); }
+
+private:
+    void appendBulk(const StringPiece &s)
+    {
+        char header[32];
+        int n = ::snprintf(header, sizeof header, "$%zu\r\n", s.size());
+        batch_.append(header, n);
+        batch_.append(s.data(), s.size());
+        batch_.append("\r\n", 2);
+    }
+
+    void sendBatch()
+    {
+        if(!conn_ || !running_)
+        {
+            busy_ = false;
+            return;
+        }
+        busy_ = true;
+        for(int i = 0; i < pipeline_; ++i)
+        {
+            char key[32];
+            int n = ::snprintf(key, sizeof key, "key:%012d", static_cast<int>(rng_() % keyspace_));
+            if(command_ == "set")
+            {
+                batch_.append("*3\r\n", 4);
+                appendBulk("SET");
+                appendBulk(StringPiece(key, n));
+                appendBulk(value_);
+            }
+            else if(command_ == "get")
+            {
+                batch_.append("*2\r\n", 4);
+                appendBulk("GET");
+                appendBulk(StringPiece(key, n));
+            }
+            else
+            {
+                batch_.append("*1\r\n", 4);
+                appendBulk("PING");
+            }
+        }
+        received_ = 0;
+        batchStart_ = Timestamp::monotonicMicros();
+        conn_->send(&batch_);
+    }
+
+    void onMessage(const TcpConnectionPtr&, Buffer *buf, Timestamp)
+    {
+        int64_t now = Timestamp::monotonicMicros();
+        RespParser::ParseResult result;
+        while((result = parser_.parse(buf)) == RespParser::kGotValue)
+        {
+            RespValue::Type type = parser_.values()[0].type;
+            parser_.consume(buf);
+            if(measuring_)
+            {
+                if(type == RespValue::kError)
+                {
+                    ++errors_;
+                }
+                latency_->record(static_cast<uint64_t>(now - batchStart_));
+                ++completed_;
+            }
+            if(++received_ == pipeline_)
+            {
+                sendBatch();
+            }
+        }
+        if(result == RespParser::kError)
+        {
+            LOG_ERROR("bad reply: %s \n", parser_.error());
+            buf->retrieveAll();
+        }
+    }
+
+    TcpClient client_;
+    TcpConnectionPtr conn_;
+    std::string command_;
+    std::string value_;
+    int keyspace_;
+    std::minstd_rand rng_;
+    std::atomic<int> *numConnected_;
+    RespParser parser_;
+    Buffer batch_;
+    int pipeline_;
+    int received_;
+    int64_t batchStart_;
+    bool running_;
+    std::atomic_bool measuring_;
+    std::atomic_bool busy_;
+    std::atomic<uint64_t> completed_;
+    std::atomic<uint64_t> errors_;
+    std::unique_ptr<Histogram> latency_;
+};
+
+static std::vector<int> parseList(const std::string &s)
+{
+    std::vector<int> values;
+    size_t pos = 0;
+    while(pos <= s.size())
+    {
+        size_t comma = s.find(',', pos);
+        if(comma == std::string::npos)
+        {
+            comma = s.size();
+        }
+        if(comma > pos)
+        {
+            values.push_back(std::stoi(s.substr(pos, comma - pos)));
+        }
+        pos = comma + 1;
+    }
+    return values;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9910));
+    double seconds = args.getDouble("seconds", 3);
+    std::string command = args.getString("command", "set");
+    int numClients = args.getInt("clients", 50);
+    int keyspace = args.getInt("keyspace", 100000);
+    std::string value(static_cast<size_t>(args.getInt("size", 3)), 'x');
+    std::vector<int> pipelines = parseList(args.getString("pipeline", "1,4,16,64,128"));
+
+    EventLoop loop;
+    KvStore store;
+    RespServer server(&loop, InetAddress(port, "127.0.0.1"), "resp-server");
+    server.setThreadNum(args.getInt("server_threads", 1));
+    server.registerCommand("SET", [&](const TcpConnectionPtr&, const RespCommand &cmd, RespWriter *reply){
+        if(cmd.size() != 3)
+        {
+            reply->appendError("ERR wrong number of arguments for 'set' command");
+            return;
+        }
+        store.set(cmd.arg(1), cmd.arg(2));
+        reply->appendOk();
+    });
+    server.registerCommand("GET", [&](const TcpConnectionPtr&, const RespCommand &cmd, RespWriter *reply){
+        if(cmd.size() != 2)
+        {
+            reply->appendError("ERR wrong number of arguments for 'get' command");
+            return;
+        }
+        store.get(cmd.arg(1), reply);
+    });
+    server.start();
+
+    EventLoopThreadPool clientPool(&loop, "resp-client");
+    clientPool.setThreadNum(args.getInt("client_threads", 1));
+    clientPool.start();
+    InetAddress serverAddr(port, "127.0.0.1");
+    std::atomic<int> numConnected(0);
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::vector<EventLoop*> sessionLoops;
+    for(int i = 0; i < numClients; ++i)
+    {
+        EventLoop *ioLoop = clientPool.getNextLoop();
+        sessions.emplace_back(new Session(ioLoop, serverAddr, "resp-" + std::to_string(i),
+            command, value, keyspace, &numConnected));
+        sessionLoops.push_back(ioLoop);
+    }
+
+    std::vector<std::string> results;
+    Thread driver([&](){
+        for(auto &session : sessions)
+        {
+            session->connect();
+        }
+        while(numConnected < numClients)
+        {
+            ::usleep(10 * 1000);
+        }
+        for(int pipeline : pipelines)
+        {
+            for(int i = 0; i < numClients; ++i)
+            {
+                Session *session = sessions[i].get();
+                sessionLoops[i]->runInLoop([session, pipeline](){ session->startPhase(pipeline); });
+            }
+            // 预热半秒再计时
+            ::usleep(500 * 1000);
+            for(auto &session : sessions)
+            {
+                session->setMeasuring(true);
+            }
+            int64_t start = Timestamp::monotonicMicros();
+            ::usleep(static_cast<useconds_t>(seconds * 1e6));
+            for(auto &session : sessions)
+            {
+                session->setMeasuring(false);
+            }
+            double elapsed = (Timestamp::monotonicMicros() - start) / 1e6;
+            for(int i = 0; i < numClients; ++i)
+            {
+                Session *session = sessions[i].get();
+                sessionLoops[i]->runInLoop([session](){ session->stop(); });
+            }
+            // 等每个连接上的最后一批回复收齐
+            for(auto &session : sessions)
+            {
+                while(session->busy())
+                {
+                    ::usleep(1000);
+                }
+            }
+
+            uint64_t completed = 0;
+            uint64_t errors = 0;
+            Histogram::Snapshot latency;
+            for(auto &session : sessions)
+            {
+                completed += session->completed();
+                errors += session->errors();
+                latency.merge(session->latency());
+            }
+            JsonObject json;
+            json.add("bench", "resp")
+                .add("command", command)
+                .add("pipeline", pipeline)
+                .add("clients", numClients)
+                .add("size", static_cast<int64_t>(value.size()))
+                .add("server_threads", args.getInt("server_threads", 1))
+                .add("client_threads", args.getInt("client_threads", 1))
+                .add("seconds", elapsed)
+                .add("requests", completed)
+                .add("errors", errors)
+                .add("requests_per_sec", elapsed > 0 ? completed / elapsed : 0.0)
+                .addLatency("latency", latency);
+            results.push_back(json.str());
+        }
+        for(auto &session : sessions)
+        {
+            session->disconnect();
+        }
+        ::usleep(200 * 1000);
+        loop.quit();
+    }, "resp-driver");
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    for(const std::string &line : results)
+    {
+        output.emit(line);
+    }
+    return 0;
+}
@@ -0,0 +1,215 @@
+// RPC：一个RpcClient通过一条连接调用服务端的echo方法，请求和回复都是size字节
+// 闭环：始终保持outstanding个未完成的调用，一个完成就立刻发起下一个，统计每秒调用数和调用延迟
+// --outstanding可以是逗号分隔的列表，每个取值输出一行JSON
+// --serializer=raw直接传StringPiece，pod用PodSerializer传一个定长结构体（size固定为64）
+//
+// bench_rpc --outstanding=1,16,256 --size=64 --seconds=3 --server_threads=1 --port=9909
+//           [--serializer=raw] [--timeout=5] [--verbose]
+
+#include "BenchCommon.h"
+
+#include "RpcServer.h"
+#include "RpcClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+struct EchoMessage
+{
+    char data[64];
+};
+
+// 一种outstanding取值的测量
+class CallRunner : noncopyable
+{
+public:
+    CallRunner(RpcClient *client, const std::string &payload, bool pod, double timeout)
+        : client_(client)
+        , payload_(payload)
+        , pod_(pod)
+        , timeout_(timeout)
+        , running_(true)
+        , measuring_(false)
+        , completed_(0)
+        , failed_(0)
+        , inflight_(0)
+    {
+        ::memset(&message_, 'r', sizeof message_);
+    }
+
+    // 在client的loop线程中调用
+    void start(int outstanding)
+    {
+        for(int i = 0; i < outstanding; ++i)
+        {
+            issue();
+        }
+    }
+
+    void setMeasuring(bool on) { measuring_ = on; }
+    void stop() { running_ = false; }
+    int inflight() const { return inflight_; }
+    uint64_t completed() const { return completed_; }
+    uint64_t failed() const { return failed_; }
+    Histogram::Snapshot latency() const { return latency_.snapshot(); }
+
+private:
+    void issue()
+    {
+        ++inflight_;
+        int64_t start = Timestamp::monotonicMicros();
+        if(pod_)
+        {
+            client_->call<PodSerializer, EchoMessage, EchoMessage>("echo", message_,
+                [this, start](const RpcStatus &status, const EchoMessage&){ done(status, start); }, timeout_);
+        }
+        else
+        {
+            client_->call("echo", payload_,
+                [this, start](const RpcStatus &status, const StringPiece&){ done(status, start); }, timeout_);
+        }
+    }
+
+    void done(const RpcStatus &status, int64_t start)
+    {
+        --inflight_;
+        if(measuring_)
+        {
+            if(status.ok())
+            {
+                latency_.record(static_cast<uint64_t>(Timestamp::monotonicMicros() - start));
+                ++completed_;
+            }
+            else
+            {
+                ++failed_;
+            }
+        }
+        if(running_)
+        {
+            issue();
+        }
+    }
+
+    RpcClient *client_;
+    std::string payload_;
+    EchoMessage message_;
+    bool pod_;
+    double timeout_;
+    std::atomic_bool running_;
+    std::atomic_bool measuring_;
+    std::atomic<uint64_t> completed_;
+    std::atomic<uint64_t> failed_;
+    std::atomic<int> inflight_;
+    Histogram latency_;
+};
+
+static std::vector<int> parseList(const std::string &s)
+{
+    std::vector<int> values;
+    size_t pos = 0;
+    while(pos <= s.size())
+    {
+        size_t comma = s.find(',', pos);
+        if(comma == std::string::npos)
+        {
+            comma = s.size();
+        }
+        if(comma > pos)
+        {
+            values.push_back(std::stoi(s.substr(pos, comma - pos)));
+        }
+        pos = comma + 1;
+    }
+    return values;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9909));
+    double seconds = args.getDouble("seconds", 3);
+    double timeout = args.getDouble("timeout", 5);
+    std::string serializer = args.getString("serializer", "raw");
+    bool pod = serializer == "pod";
+    size_t size = pod ? sizeof(EchoMessage) : static_cast<size_t>(args.getInt("size", 64));
+    std::vector<int> outstandings = parseList(args.getString("outstanding", "1,16,256"));
+
+    EventLoop loop;
+    RpcServer server(&loop, InetAddress(port, "127.0.0.1"), "rpc-server");
+    server.setThreadNum(args.getInt("server_threads", 1));
+    server.registerMethod("echo", [](const StringPiece &request, const RpcServer::Responder &responder){
+        responder.reply(request);
+    });
+    server.start();
+
+    EventLoopThreadPool clientPool(&loop, "rpc-client");
+    clientPool.setThreadNum(1);
+    clientPool.start();
+    EventLoop *clientLoop = clientPool.getNextLoop();
+    std::unique_ptr<RpcClient> client;
+    std::atomic_bool connected(false);
+    EventLoopThreadPool::runInLoopsAndWait({clientLoop}, [&](EventLoop*){
+        client.reset(new RpcClient(clientLoop, InetAddress(port, "127.0.0.1"), "rpc-client"));
+        client->setConnectionCallback([&](const TcpConnectionPtr &conn){ connected = conn->connected(); });
+        client->connect();
+    });
+
+    std::string payload(size, 'r');
+    std::vector<std::string> results;
+    Thread driver([&](){
+        while(!connected)
+        {
+            ::usleep(10 * 1000);
+        }
+        for(int outstanding : outstandings)
+        {
+            CallRunner runner(client.get(), payload, pod, timeout);
+            clientLoop->runInLoop([&](){ runner.start(outstanding); });
+            // 预热半秒再计时
+            ::usleep(500 * 1000);
+            runner.setMeasuring(true);
+            int64_t start = Timestamp::monotonicMicros();
+            ::usleep(static_cast<useconds_t>(seconds * 1e6));
+            runner.setMeasuring(false);
+            double elapsed = (Timestamp::monotonicMicros() - start) / 1e6;
+            uint64_t completed = runner.completed();
+            runner.stop();
+            while(runner.inflight() > 0)
+            {
+                ::usleep(1000);
+            }
+
+            JsonObject json;
+            json.add("bench", "rpc")
+                .add("serializer", serializer)
+                .add("size", static_cast<int64_t>(size))
+                .add("outstanding", outstanding)
+                .add("server_threads", args.getInt("server_threads", 1))
+                .add("seconds", elapsed)
+                .add("calls", completed)
+                .add("failed", runner.failed())
+                .add("calls_per_sec", elapsed > 0 ? completed / elapsed : 0.0)
+                .addLatency("latency", runner.latency());
+            results.push_back(json.str());
+        }
+        EventLoopThreadPool::runInLoopsAndWait({clientLoop}, [&](EventLoop*){
+            client.reset();
+        });
+        ::usleep(100 * 1000);
+        loop.quit();
+    }, "rpc-driver");
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    for(const std::string &line : results)
+    {
+        output.emit(line);
+    }
+    return 0;
+}
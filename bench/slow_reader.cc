@@ -0,0 +1,149 @@
+// 慢读者：客户端尽可能快地发送，但读得很慢，echo服务器的回复会在outputBuffer_中积压
+// 比较开启和关闭流量控制时进程的内存峰值(VmHWM)，两种各跑一次，每次一个进程互不影响
+// 客户端是阻塞socket上的一个写线程和一个读线程，不经过本库的loop
+//
+// bench_slow_reader --flow_control=1 --high_water_kb=1024 --low_water_kb=256
+//                   --seconds=3 --port=9913 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "EventLoop.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static const size_t kChunkSize = 64 * 1024;
+static const size_t kReadSize = 4 * 1024;
+static const int kReadIntervalMicros = 10000;
+
+static int64_t peakRssKb()
+{
+    FILE *fp = ::fopen("/proc/self/status", "r");
+    if(fp == nullptr)
+    {
+        return -1;
+    }
+    char line[256];
+    int64_t kb = -1;
+    while(::fgets(line, sizeof line, fp))
+    {
+        if(::strncmp(line, "VmHWM:", 6) == 0)
+        {
+            kb = ::atol(line + 6);
+            break;
+        }
+    }
+    ::fclose(fp);
+    return kb;
+}
+
+static void writer(int fd, const std::atomic_bool *stop, std::atomic<uint64_t> *sent)
+{
+    std::string chunk(kChunkSize, 'w');
+    while(!*stop)
+    {
+        ssize_t n = ::send(fd, chunk.data(), chunk.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(n > 0)
+        {
+            *sent += n;
+        }
+        else if(n < 0 && errno != EAGAIN)
+        {
+            break;
+        }
+        else
+        {
+            ::usleep(100);
+        }
+    }
+}
+
+static void slowReader(int fd, const std::atomic_bool *stop, std::atomic<uint64_t> *received)
+{
+    char buf[kReadSize];
+    while(!*stop)
+    {
+        ssize_t n = ::recv(fd, buf, sizeof buf, MSG_DONTWAIT);
+        if(n > 0)
+        {
+            *received += n;
+        }
+        else if(n == 0)
+        {
+            break;
+        }
+        ::usleep(kReadIntervalMicros);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9913));
+    bool flowControl = args.getInt("flow_control", 1) != 0;
+    double seconds = args.getDouble("seconds", 3);
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "slow-reader-server");
+    server.setConnectionCallback([](const TcpConnectionPtr&){});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        conn->send(buf->retrieveAllAsString());
+    });
+    if(flowControl)
+    {
+        server.setFlowControl(args.getInt("high_water_kb", 1024) * 1024,
+                              args.getInt("low_water_kb", 256) * 1024);
+    }
+    server.setThreadNum(1);
+    server.start();
+
+    std::atomic_bool stop(false);
+    std::atomic<uint64_t> sent(0);
+    std::atomic<uint64_t> received(0);
+    std::thread driver([&](){
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        ::memset(&addr, 0, sizeof addr);
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0)
+        {
+            ::perror("connect");
+            ::exit(1);
+        }
+        std::thread w(writer, fd, &stop, &sent);
+        std::thread r(slowReader, fd, &stop, &received);
+        ::usleep(static_cast<useconds_t>(seconds * 1e6));
+        stop = true;
+        w.join();
+        r.join();
+        ::close(fd);
+        loop.queueInLoop(std::bind(&EventLoop::quit, &loop));
+    });
+
+    loop.loop();
+    driver.join();
+
+    output.emit(JsonObject()
+        .add("bench", "slow_reader")
+        .add("flow_control", flowControl ? 1 : 0)
+        .add("seconds", seconds)
+        .add("sent_kb", static_cast<uint64_t>(sent / 1024))
+        .add("received_kb", static_cast<uint64_t>(received / 1024))
+        .add("peak_rss_kb", peakRssKb())
+        .str());
+    return 0;
+}
@@ -0,0 +1,291 @@
+// TLS：启动时生成自签名证书，本地测握手速率和加密后的吞吐量
+//   --mode=handshake  concurrency个客户端循环地建连、完成握手、收到服务端的一个小回复后断开重连，统计每秒握手数
+//                     --resume=1时客户端共享一个带会话缓存的TlsContext，重连时恢复会话
+//   --mode=bulk       connections个连接，服务端持续发送block大小的数据块，统计客户端每秒收到的字节数
+//                     --tls=0是明文对照，--ktls=1尝试把服务端发送方向的加密交给内核
+// --key=ec(P-256)|rsa(2048)，--tls_version=1.2|1.3
+//
+// bench_tls --mode=handshake --concurrency=16 --resume=0 --seconds=5 --server_threads=1 --client_threads=1
+// bench_tls --mode=bulk --connections=4 --block=65536 --seconds=5 [--tls=1] [--ktls=0] --port=9908 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "TlsContext.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// 临时生成的自签名证书，有效期一天
+static bool makeSelfSignedCertificate(bool rsa, EVP_PKEY **key, X509 **cert)
+{
+    EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(rsa ? EVP_PKEY_RSA : EVP_PKEY_EC, nullptr);
+    *key = nullptr;
+    bool ok = kctx != nullptr && EVP_PKEY_keygen_init(kctx) > 0
+        && (rsa ? EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 2048) > 0
+                : EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1) > 0)
+        && EVP_PKEY_keygen(kctx, key) > 0;
+    EVP_PKEY_CTX_free(kctx);
+    if(!ok)
+    {
+        return false;
+    }
+
+    X509 *x509 = X509_new();
+    X509_set_version(x509, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x509), 24 * 3600);
+    X509_set_pubkey(x509, *key);
+    X509_NAME *name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    if(X509_sign(x509, *key, EVP_sha256()) <= 0)
+    {
+        X509_free(x509);
+        return false;
+    }
+    *cert = x509;
+    return true;
+}
+
+// 握手测试的一个客户端：连上后发一个字节，收到回复说明握手已经完成，关闭写端，断开后自动重连
+class HandshakeSession : noncopyable
+{
+public:
+    HandshakeSession(EventLoop *loop, const InetAddress &serverAddr, const std::string &name,
+                     const std::shared_ptr<TlsContext> &context, std::atomic<uint64_t> *completed)
+        : client_(loop, serverAddr, name)
+        , completed_(completed)
+    {
+        client_.setTlsContext(context, "localhost");
+        client_.enableRetry();
+        client_.setConnectionCallback([](const TcpConnectionPtr &conn){
+            if(conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+                conn->send(std::string("h"));
+            }
+        });
+        client_.setMessageCallback([this](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+            buf->retrieveAll();
+            ++*completed_;
+            conn->shutdown();
+        });
+    }
+
+    void start() { client_.connect(); }
+    void stop() { client_.disconnect(); }
+
+private:
+    TcpClient client_;
+    std::atomic<uint64_t> *completed_;
+};
+
+// 吞吐量测试的一个客户端，只收不发
+class BulkSession : noncopyable
+{
+public:
+    BulkSession(EventLoop *loop, const InetAddress &serverAddr, const std::string &name,
+                const std::shared_ptr<TlsContext> &context, std::atomic<uint64_t> *bytes)
+        : client_(loop, serverAddr, name)
+        , bytes_(bytes)
+    {
+        if(context)
+        {
+            client_.setTlsContext(context, "localhost");
+        }
+        client_.setConnectionCallback([](const TcpConnectionPtr&){});
+        client_.setMessageCallback([this](const TcpConnectionPtr&, Buffer *buf, Timestamp){
+            *bytes_ += buf->readableBytes();
+            buf->retrieveAll();
+        });
+    }
+
+    void start() { client_.connect(); }
+    void stop() { client_.disconnect(); }
+
+private:
+    TcpClient client_;
+    std::atomic<uint64_t> *bytes_;
+};
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    std::string mode = args.getString("mode", "handshake");
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9908));
+    double seconds = args.getDouble("seconds", 5);
+    bool useTls = mode == "handshake" || args.getInt("tls", 1) != 0;
+    bool resume = args.getInt("resume", 0) != 0;
+    bool kernelTls = args.getInt("ktls", 0) != 0;
+    std::string keyType = args.getString("key", "ec");
+    std::string tlsVersion = args.getString("tls_version", "1.3");
+    int version = tlsVersion == "1.2" ? TLS1_2_VERSION : TLS1_3_VERSION;
+
+    std::shared_ptr<TlsContext> serverContext;
+    std::shared_ptr<TlsContext> clientContext;
+    if(useTls)
+    {
+        EVP_PKEY *key = nullptr;
+        X509 *cert = nullptr;
+        if(!makeSelfSignedCertificate(keyType == "rsa", &key, &cert))
+        {
+            fprintf(stderr, "generate self-signed certificate fail\n");
+            return 1;
+        }
+        serverContext = std::make_shared<TlsContext>(TlsContext::kServer);
+        serverContext->useCertificate(cert, key);
+        serverContext->setMinVersion(version);
+        SSL_CTX_set_max_proto_version(serverContext->nativeHandle(), version);
+        serverContext->setKernelTls(kernelTls);
+        X509_free(cert);
+        EVP_PKEY_free(key);
+
+        clientContext = std::make_shared<TlsContext>(TlsContext::kClient);
+        clientContext->setMinVersion(version);
+        if(!resume)
+        {
+            clientContext->setSessionCacheSize(0);
+        }
+    }
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port, "127.0.0.1"), "tls-server");
+    server.setThreadNum(args.getInt("server_threads", 1));
+    if(serverContext)
+    {
+        server.setTlsContext(serverContext);
+    }
+    std::atomic_bool sending(true);
+    std::string block(static_cast<size_t>(args.getInt("block", 65536)), 't');
+    if(mode == "handshake")
+    {
+        server.setConnectionCallback([](const TcpConnectionPtr &conn){
+            if(conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+            }
+        });
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+            conn->send(buf->retrieveAllAsString());
+        });
+    }
+    else
+    {
+        // 上一块写完再发下一块，outputBuffer_里始终只有一块
+        server.setConnectionCallback([&](const TcpConnectionPtr &conn){
+            if(conn->connected())
+            {
+                conn->send(block);
+            }
+        });
+        server.setWriteCompleteCallback([&](const TcpConnectionPtr &conn){
+            if(sending && conn->connected())
+            {
+                conn->send(block);
+            }
+        });
+        server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp){
+            buf->retrieveAll();
+        });
+    }
+    server.start();
+
+    EventLoopThreadPool clientPool(&loop, "tls-client");
+    clientPool.setThreadNum(args.getInt("client_threads", 1));
+    clientPool.start();
+    InetAddress serverAddr(port, "127.0.0.1");
+
+    std::atomic<uint64_t> counter(0);
+    std::vector<std::unique_ptr<HandshakeSession>> handshakeSessions;
+    std::vector<std::unique_ptr<BulkSession>> bulkSessions;
+    int numClients = mode == "handshake" ? args.getInt("concurrency", 16) : args.getInt("connections", 4);
+    for(int i = 0; i < numClients; ++i)
+    {
+        std::string name = "tls-" + std::to_string(i);
+        if(mode == "handshake")
+        {
+            handshakeSessions.emplace_back(new HandshakeSession(clientPool.getNextLoop(), serverAddr, name,
+                clientContext, &counter));
+        }
+        else
+        {
+            bulkSessions.emplace_back(new BulkSession(clientPool.getNextLoop(), serverAddr, name,
+                clientContext, &counter));
+        }
+    }
+
+    // 预热一秒再计时，主线程运行baseloop
+    uint64_t measured = 0;
+    double elapsed = 0;
+    Thread driver([&](){
+        for(auto &session : handshakeSessions)
+        {
+            session->start();
+        }
+        for(auto &session : bulkSessions)
+        {
+            session->start();
+        }
+        ::usleep(1000 * 1000);
+        uint64_t begin = counter;
+        int64_t start = Timestamp::monotonicMicros();
+        ::usleep(static_cast<useconds_t>(seconds * 1e6));
+        measured = counter - begin;
+        elapsed = (Timestamp::monotonicMicros() - start) / 1e6;
+
+        sending = false;
+        for(auto &session : handshakeSessions)
+        {
+            session->stop();
+        }
+        for(auto &session : bulkSessions)
+        {
+            session->stop();
+        }
+        ::usleep(500 * 1000);
+        loop.quit();
+    }, "tls-driver");
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    JsonObject json;
+    json.add("bench", "tls")
+        .add("mode", mode)
+        .add("tls", useTls ? tlsVersion : std::string("off"))
+        .add("key", keyType)
+        .add("server_threads", args.getInt("server_threads", 1))
+        .add("client_threads", args.getInt("client_threads", 1))
+        .add("seconds", elapsed);
+    if(mode == "handshake")
+    {
+        json.add("concurrency", numClients)
+            .add("resume", resume)
+            .add("handshakes", measured)
+            .add("handshakes_per_sec", elapsed > 0 ? measured / elapsed : 0.0)
+            .add("server_handshakes", serverContext->handshakes())
+            .add("server_resumed", serverContext->resumedHandshakes());
+    }
+    else
+    {
+        json.add("connections", numClients)
+            .add("block", static_cast<int64_t>(block.size()))
+            .add("ktls_requested", kernelTls)
+            .add("ktls_connections", serverContext ? serverContext->kernelTlsConnections() : static_cast<uint64_t>(0))
+            .add("bytes", measured)
+            .add("mib_per_sec", elapsed > 0 ? measured / elapsed / (1024.0 * 1024.0) : 0.0);
+    }
+    output.emit(json.str());
+    return 0;
+}
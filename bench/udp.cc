@@ -0,0 +1,274 @@
+// UDP收包：对比UdpServer（每个loop一个SO_REUSEPORT socket，recvmmsg批量读）
+// 和每个线程一个阻塞socket逐个recvfrom的朴素实现
+// 发送端线程用sendmmsg尽量快地发，统计服务端每秒收到的数据报数，
+// 以及服务端线程每消耗一个cpu秒能处理的数据报数（pps per core）
+//
+// bench_udp --mode=mmsg|naive --server_threads=1 --senders=1 --size=64 --batch=64
+//           --echo=0 --warmup=1 --seconds=5 --port=9904 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "UdpServer.h"
+#include "EventLoop.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+
+static int64_t threadCpuMicros(pthread_t thread)
+{
+    clockid_t clock;
+    timespec ts;
+    if(::pthread_getcpuclockid(thread, &clock) != 0 || ::clock_gettime(clock, &ts) != 0)
+    {
+        return 0;
+    }
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 服务端线程，用来汇总cpu时间
+class ServerThreads
+{
+public:
+    void add(pthread_t thread)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(thread);
+    }
+
+    int64_t cpuMicros()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t total = 0;
+        for(pthread_t thread : threads_)
+        {
+            total += threadCpuMicros(thread);
+        }
+        return total;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<pthread_t> threads_;
+};
+
+// 朴素实现：每个线程一个阻塞socket，一次recvfrom读一个数据报
+class NaiveServer
+{
+public:
+    NaiveServer(const InetAddress &addr, int numThreads, bool echo, ServerThreads *threads)
+        : running_(true)
+        , received_(0)
+    {
+        for(int i = 0; i < numThreads; ++i)
+        {
+            int fd = ::socket(addr.family(), SOCK_DGRAM | SOCK_CLOEXEC, 0);
+            int on = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on);
+            timeval timeout = { 0, 100 * 1000 };  // 定期检查running_
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+            if(::bind(fd, addr.getSockAddr(), addr.getSockAddrLen()) < 0)
+            {
+                ::perror("bind");
+                ::exit(1);
+            }
+            fds_.push_back(fd);
+        }
+        for(int fd : fds_)
+        {
+            threads_.emplace_back([this, fd, echo, threads](){
+                threads->add(::pthread_self());
+                char buf[65536];
+                sockaddr_storage peer;
+                while(running_.load(std::memory_order_relaxed))
+                {
+                    socklen_t len = sizeof peer;
+                    ssize_t n = ::recvfrom(fd, buf, sizeof buf, 0, (sockaddr*)&peer, &len);
+                    if(n < 0)
+                    {
+                        continue;
+                    }
+                    received_.fetch_add(1, std::memory_order_relaxed);
+                    if(echo)
+                    {
+                        ::sendto(fd, buf, n, MSG_DONTWAIT, (sockaddr*)&peer, len);
+                    }
+                }
+            });
+        }
+    }
+
+    ~NaiveServer()
+    {
+        running_ = false;
+        for(auto &thread : threads_)
+        {
+            thread.join();
+        }
+        for(int fd : fds_)
+        {
+            ::close(fd);
+        }
+    }
+
+    uint64_t received() const { return received_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic_bool running_;
+    std::atomic<uint64_t> received_;
+    std::vector<int> fds_;
+    std::vector<std::thread> threads_;
+};
+
+// 发送端：每个线程一个connect过的socket，每次sendmmsg发batch个数据报
+// 每个线程用不同的源端口，内核才能把它们分到不同的SO_REUSEPORT socket上
+class Senders
+{
+public:
+    Senders(const InetAddress &serverAddr, int numThreads, size_t size, size_t batch)
+        : running_(true)
+        , sent_(0)
+    {
+        for(int i = 0; i < numThreads; ++i)
+        {
+            threads_.emplace_back([this, serverAddr, size, batch](){
+                int fd = ::socket(serverAddr.family(), SOCK_DGRAM | SOCK_CLOEXEC, 0);
+                int sndbuf = 4 << 20;
+                ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+                if(::connect(fd, serverAddr.getSockAddr(), serverAddr.getSockAddrLen()) < 0)
+                {
+                    ::perror("connect");
+                    ::exit(1);
+                }
+                std::string payload(size, 'u');
+                std::vector<iovec> iov(batch);
+                std::vector<mmsghdr> msgs(batch);
+                for(size_t j = 0; j < batch; ++j)
+                {
+                    iov[j].iov_base = &payload[0];
+                    iov[j].iov_len = size;
+                    ::memset(&msgs[j], 0, sizeof(mmsghdr));
+                    msgs[j].msg_hdr.msg_iov = &iov[j];
+                    msgs[j].msg_hdr.msg_iovlen = 1;
+                }
+                char drain[65536];
+                while(running_.load(std::memory_order_relaxed))
+                {
+                    int n = ::sendmmsg(fd, msgs.data(), static_cast<unsigned int>(batch), 0);
+                    if(n > 0)
+                    {
+                        sent_.fetch_add(n, std::memory_order_relaxed);
+                    }
+                    // 开了echo时丢掉回复，不让接收缓冲区一直满着
+                    while(::recv(fd, drain, sizeof drain, MSG_DONTWAIT) > 0)
+                    {
+                    }
+                }
+                ::close(fd);
+            });
+        }
+    }
+
+    ~Senders()
+    {
+        running_ = false;
+        for(auto &thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    uint64_t sent() const { return sent_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic_bool running_;
+    std::atomic<uint64_t> sent_;
+    std::vector<std::thread> threads_;
+};
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    std::string mode = args.getString("mode", "mmsg");
+    int serverThreads = args.getInt("server_threads", 1);
+    int numSenders = args.getInt("senders", 1);
+    size_t size = static_cast<size_t>(args.getInt("size", 64));
+    size_t batch = static_cast<size_t>(args.getInt("batch", 64));
+    bool echo = args.getInt("echo", 0) != 0;
+    double warmupSeconds = args.getDouble("warmup", 1);
+    double seconds = args.getDouble("seconds", 5);
+    InetAddress serverAddr(static_cast<uint16_t>(args.getInt("port", 9904)));
+
+    ServerThreads threads;
+    EventLoop loop;
+    std::unique_ptr<UdpServer> udpServer;
+    std::unique_ptr<NaiveServer> naiveServer;
+    if(mode == "naive")
+    {
+        naiveServer.reset(new NaiveServer(serverAddr, serverThreads, echo, &threads));
+    }
+    else
+    {
+        udpServer.reset(new UdpServer(&loop, serverAddr, "udp-server"));
+        udpServer->setThreadNum(serverThreads);
+        udpServer->setBatchSize(batch);
+        // 接收缓冲区放得下--size的数据报，否则会被当作截断丢掉
+        udpServer->setMaxDatagramSize(std::max<size_t>(size, 2048));
+        udpServer->setThreadInitCallback([&threads](EventLoop*){ threads.add(::pthread_self()); });
+        udpServer->setMessageCallback([echo](UdpSocket *socket, const char *data, size_t len,
+                                             const InetAddress &peer, Timestamp){
+            if(echo)
+            {
+                socket->send(peer, data, len);
+            }
+        });
+        udpServer->start();
+    }
+    auto received = [&]() -> uint64_t {
+        return udpServer ? udpServer->datagramsReceived() : naiveServer->received();
+    };
+
+    std::unique_ptr<Senders> senders(new Senders(serverAddr, numSenders, size, batch));
+    ::usleep(static_cast<useconds_t>(warmupSeconds * 1e6));
+
+    uint64_t received0 = received();
+    uint64_t recvCalls0 = udpServer ? udpServer->recvCalls() : 0;
+    uint64_t sent0 = senders->sent();
+    int64_t cpu0 = threads.cpuMicros();
+    int64_t start = Timestamp::monotonicMicros();
+    ::usleep(static_cast<useconds_t>(seconds * 1e6));
+    uint64_t datagrams = received() - received0;
+    uint64_t recvCalls = udpServer ? udpServer->recvCalls() - recvCalls0 : datagrams;
+    uint64_t sent = senders->sent() - sent0;
+    double cpuSeconds = (threads.cpuMicros() - cpu0) / 1e6;
+    double elapsed = (Timestamp::monotonicMicros() - start) / 1e6;
+    senders.reset();
+
+    output.emit(JsonObject()
+        .add("bench", "udp")
+        .add("mode", mode)
+        .add("server_threads", serverThreads)
+        .add("senders", numSenders)
+        .add("size", static_cast<int64_t>(size))
+        .add("batch", mode == "naive" ? 1 : static_cast<int64_t>(batch))
+        .add("echo", echo ? 1 : 0)
+        .add("seconds", elapsed)
+        .add("sent", sent)
+        .add("received", datagrams)
+        .add("loss_ratio", sent > 0 ? 1.0 - static_cast<double>(datagrams) / sent : 0.0)
+        .add("received_pps", datagrams / elapsed)
+        .add("truncated", udpServer ? udpServer->truncatedDrops() : 0)
+        .add("datagrams_per_recv_call", recvCalls > 0 ? static_cast<double>(datagrams) / recvCalls : 0.0)
+        .add("server_cpu_seconds", cpuSeconds)
+        .add("pps_per_core", cpuSeconds > 0 ? datagrams / cpuSeconds : 0.0)
+        .str());
+    return 0;
+}
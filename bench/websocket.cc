@@ -0,0 +1,326 @@
+// WebSocket广播：connections个本地客户端完成握手后，服务端每一轮把一个预先编码好的帧
+// 广播给所有连接，测量从调用broadcast到最后一个客户端收到完整帧的时间(time-to-last-byte)
+// 连接数超过一个目标地址可用的本地端口时，客户端轮流连接127.0.0.1、127.0.0.2……
+// 每个连接在同一个进程里占两个fd，启动时把RLIMIT_NOFILE提到硬限制
+//
+// bench_websocket --connections=100000 --rounds=20 --size=128 --server_threads=2
+//                 --client_threads=2 --port=9906 [--verbose]
+
+#include "BenchCommon.h"
+
+#include "WebSocketServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <sys/resource.h>
+
+static const size_t kConnectionsPerAddress = 25000;
+
+class FanoutClient;
+
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, FanoutClient *owner);
+
+    void start() { client_.connect(); }
+    void stop() { client_.disconnect(); }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+
+    TcpClient client_;
+    FanoutClient *owner_;
+    bool upgraded_;
+};
+
+class FanoutClient : noncopyable
+{
+public:
+    FanoutClient(EventLoop *loop, uint16_t port, const BenchArgs &args)
+        : threadPool_(loop, "ws-client")
+        , numConnections_(args.getInt("connections", 100000))
+        , numUpgraded_(0)
+        , numDisconnected_(0)
+        , numReceived_(0)
+        , roundStart_(0)
+        , allUpgraded_(false)
+    {
+        threadPool_.setThreadNum(args.getInt("client_threads", 2));
+        threadPool_.start();
+        for(int i = 0; i < numConnections_; ++i)
+        {
+            std::string ip = "127.0.0." + std::to_string(1 + i / kConnectionsPerAddress);
+            sessions_.emplace_back(new Session(threadPool_.getNextLoop(), InetAddress(port, ip),
+                "ws-" + std::to_string(i), this));
+        }
+    }
+
+    void start()
+    {
+        for(auto &session : sessions_)
+        {
+            session->start();
+        }
+    }
+
+    void stop()
+    {
+        for(auto &session : sessions_)
+        {
+            session->stop();
+        }
+    }
+
+    int numConnections() const { return numConnections_; }
+
+    void onUpgraded()
+    {
+        if(++numUpgraded_ == numConnections_)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            allUpgraded_ = true;
+            cond_.notify_all();
+        }
+    }
+
+    void onDisconnect() { ++numDisconnected_; }
+    int numDisconnected() const { return numDisconnected_; }
+
+    // 每收到一个完整的帧调用一次，最后一个连接收到时记下这一轮的耗时
+    void onFrame()
+    {
+        if(++numReceived_ == numConnections_)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            lastByteMicros_.push_back(Timestamp::monotonicMicros() - roundStart_);
+            cond_.notify_all();
+        }
+    }
+
+    void waitUpgraded(double timeoutSeconds)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait_for(lock, std::chrono::milliseconds(static_cast<int64_t>(timeoutSeconds * 1000)),
+            [this](){ return allUpgraded_; });
+    }
+
+    int upgraded() const { return numUpgraded_; }
+
+    // 开始新的一轮，返回开始时间
+    void beginRound()
+    {
+        numReceived_ = 0;
+        roundStart_ = Timestamp::monotonicMicros();
+    }
+
+    bool waitRound(size_t round, double timeoutSeconds)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cond_.wait_for(lock, std::chrono::milliseconds(static_cast<int64_t>(timeoutSeconds * 1000)),
+            [this, round](){ return lastByteMicros_.size() > round; });
+    }
+
+    const std::vector<int64_t>& lastByteMicros() const { return lastByteMicros_; }
+
+private:
+    EventLoopThreadPool threadPool_;
+    int numConnections_;
+    std::atomic_int numUpgraded_;
+    std::atomic_int numDisconnected_;
+    std::atomic_int numReceived_;
+    std::atomic<int64_t> roundStart_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool allUpgraded_;
+    std::vector<int64_t> lastByteMicros_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+};
+
+Session::Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name, FanoutClient *owner)
+    : client_(loop, serverAddr, name)
+    , owner_(owner)
+    , upgraded_(false)
+{
+    client_.setConnectionCallback(std::bind(&Session::onConnection, this, std::placeholders::_1));
+    client_.setMessageCallback(std::bind(&Session::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void Session::onConnection(const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        conn->send("GET /fanout HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                   "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+    }
+    else
+    {
+        owner_->onDisconnect();
+    }
+}
+
+// 服务端的帧不带掩码，只需要解析出长度把帧切开
+void Session::onMessage(const TcpConnectionPtr&, Buffer *buf, Timestamp)
+{
+    if(!upgraded_)
+    {
+        const char *begin = buf->peek();
+        const char *end = begin + buf->readableBytes();
+        static const char kHeaderEnd[] = "\r\n\r\n";
+        const char *headerEnd = std::search(begin, end, kHeaderEnd, kHeaderEnd + 4);
+        if(headerEnd == end)
+        {
+            return;
+        }
+        buf->retrieve(headerEnd + 4 - begin);
+        upgraded_ = true;
+        owner_->onUpgraded();
+    }
+    while(buf->readableBytes() >= 2)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(buf->peek());
+        size_t headerSize = 2;
+        uint64_t length = p[1] & 0x7F;
+        if(length == 126)
+        {
+            if(buf->readableBytes() < 4)
+            {
+                break;
+            }
+            length = (p[2] << 8) | p[3];
+            headerSize = 4;
+        }
+        else if(length == 127)
+        {
+            if(buf->readableBytes() < 10)
+            {
+                break;
+            }
+            length = 0;
+            for(int i = 2; i < 10; ++i)
+            {
+                length = (length << 8) | p[i];
+            }
+            headerSize = 10;
+        }
+        if(buf->readableBytes() < headerSize + length)
+        {
+            break;
+        }
+        bool data = (p[0] & 0x0F) == WebSocketCodec::kBinary;
+        buf->retrieve(headerSize + length);
+        if(data)
+        {
+            owner_->onFrame();
+        }
+    }
+}
+
+static void raiseFdLimit()
+{
+    rlimit limit;
+    if(::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static double percentile(std::vector<int64_t> values, double p)
+{
+    if(values.empty())
+    {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t i = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    return static_cast<double>(values[i]);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchArgs args(argc, argv);
+    BenchOutput output(args);
+    raiseFdLimit();
+    uint16_t port = static_cast<uint16_t>(args.getInt("port", 9906));
+    int rounds = args.getInt("rounds", 20);
+    std::string payload(static_cast<size_t>(args.getInt("size", 128)), 'w');
+
+    EventLoop loop;
+    WebSocketServer server(&loop, InetAddress(port, "0.0.0.0"), "ws-server");
+    server.setThreadNum(args.getInt("server_threads", 2));
+    server.start();
+    FanoutClient client(&loop, port, args);
+
+    // 连接、广播和收尾在单独的线程中按顺序进行，主线程运行baseloop
+    double connectSeconds = 0;
+    std::vector<int64_t> postMicros;
+    int completed = 0;
+    size_t serverConnections = 0;
+    Thread driver([&](){
+        int64_t connectStart = Timestamp::monotonicMicros();
+        client.start();
+        client.waitUpgraded(args.getDouble("connect_timeout", 120));
+        connectSeconds = (Timestamp::monotonicMicros() - connectStart) / 1e6;
+
+        // 编码一次，所有连接共享
+        WebSocketServer::Frame frame = WebSocketServer::makeFrame(WebSocketCodec::kBinary, payload);
+        if(client.upgraded() == client.numConnections())
+        {
+            for(int round = 0; round < rounds; ++round)
+            {
+                client.beginRound();
+                int64_t start = Timestamp::monotonicMicros();
+                server.broadcast(frame);
+                postMicros.push_back(Timestamp::monotonicMicros() - start);
+                if(!client.waitRound(round, 30))
+                {
+                    break;
+                }
+                ++completed;
+            }
+        }
+
+        serverConnections = server.numConnections();
+        client.stop();
+        for(int i = 0; i < 200 && client.numDisconnected() < client.upgraded(); ++i)
+        {
+            ::usleep(50 * 1000);
+        }
+        loop.quit();
+    }, "ws-driver");
+    driver.start();
+    loop.loop();
+    driver.join();
+
+    const std::vector<int64_t> &lastByte = client.lastByteMicros();
+    double meanLastByte = 0;
+    for(int64_t us : lastByte)
+    {
+        meanLastByte += us;
+    }
+    meanLastByte = lastByte.empty() ? 0 : meanLastByte / lastByte.size();
+    output.emit(JsonObject()
+        .add("bench", "websocket")
+        .add("connections", client.numConnections())
+        .add("upgraded", client.upgraded())
+        .add("server_connections", static_cast<uint64_t>(serverConnections))
+        .add("connect_seconds", connectSeconds)
+        .add("size", static_cast<int64_t>(payload.size()))
+        .add("rounds", completed)
+        .add("server_threads", args.getInt("server_threads", 2))
+        .add("client_threads", args.getInt("client_threads", 2))
+        .add("broadcast_call_p50_us", percentile(postMicros, 0.5))
+        .add("last_byte_mean_us", meanLastByte)
+        .add("last_byte_p50_us", percentile(lastByte, 0.5))
+        .add("last_byte_max_us", percentile(lastByte, 1.0))
+        .add("frames_per_sec", meanLastByte > 0 ? client.numConnections() / (meanLastByte / 1e6) : 0.0)
+        .str());
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Logger.h>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// echo压测，结束时输出吞吐量和所有subloop汇总的运行指标
+// 用来观察loop的运行情况，以及对比开启指标统计前后的吞吐量
+//
+// ./echo_metrics [秒数] [subloop个数] [连接数]
+
+const size_t kMessageSize = 64;
+
+std::atomic_bool g_stop(false);
+std::atomic<uint64_t> g_roundTrips(0);
+
+static void client(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(::connect(fd, (sockaddr*)&addr, sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+    char buf[kMessageSize];
+    ::memset(buf, 'e', sizeof buf);
+    uint64_t trips = 0;
+    while(!g_stop)
+    {
+        if(::write(fd, buf, sizeof buf) != (ssize_t)sizeof buf)
+        {
+            break;
+        }
+        size_t got = 0;
+        while(got < sizeof buf)
+        {
+            ssize_t n = ::read(fd, buf + got, sizeof buf - got);
+            if(n <= 0)
+            {
+                break;
+            }
+            got += n;
+        }
+        ++trips;
+    }
+    g_roundTrips += trips;
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    int numLoops = argc > 2 ? atoi(argv[2]) : 2;
+    int numConnections = argc > 3 ? atoi(argv[3]) : 8;
+    const uint16_t port = 9989;
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "EchoMetrics");
+    server.setConnectionCallback([](const TcpConnectionPtr&){});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.setThreadNum(numLoops);
+    server.start();
+
+    std::thread driver([&](){
+        std::vector<std::thread> clients;
+        for(int i = 0; i < numConnections; ++i)
+        {
+            clients.emplace_back(client, port);
+        }
+        ::sleep(seconds);
+        // 连接还在的时候取快照，connections才有意义
+        std::vector<LoopMetricsSnapshot> perLoop;
+        LoopMetricsSnapshot total = server.metricsSnapshot(&perLoop);
+        g_stop = true;
+        for(std::thread &t : clients)
+        {
+            t.join();
+        }
+
+        printf("round_trips_per_sec=%.0f\n", static_cast<double>(g_roundTrips) / seconds);
+        for(size_t i = 0; i < perLoop.size(); ++i)
+        {
+            printf("loop%zu %s\n", i, perLoop[i].toJson().c_str());
+        }
+        printf("total %s\n", total.toJson().c_str());
+        loop.quit();
+    });
+
+    loop.loop();
+    driver.join();
+    return 0;
+}
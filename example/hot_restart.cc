@@ -0,0 +1,220 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/ListenFdExporter.h>
+#include <mymuduo/Logger.h>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// 热重启的两进程测试：客户端持续用短连接发请求，中途把服务进程换成新进程
+//   rebind  : 旧进程关闭listenfd后，新进程重新bind/listen
+//   handoff : 新进程通过unix域socket取走旧进程的listenfd，旧进程随后排空退出
+// 统计升级期间被拒绝的连接数和失败的请求数
+//
+// ./hot_restart                           运行两种方式并输出对比
+// ./hot_restart server old <port> <path>  旧进程
+// ./hot_restart server new <port> <path>  新进程，从path取listenfd
+// ./hot_restart server bind <port> <path> 新进程，重新bind
+
+const size_t kMessageSize = 64;
+const int kClients = 8;
+const int kDrainTimeoutMs = 2000;
+
+static volatile sig_atomic_t g_stopRequested = 0;
+
+static void onStopSignal(int)
+{
+    g_stopRequested = 1;
+}
+
+static void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    while(buf->readableBytes() >= kMessageSize)
+    {
+        conn->send(buf->retrieveAsString(kMessageSize));
+    }
+}
+
+static int runServer(const std::string &mode, uint16_t port, const std::string &path)
+{
+    EventLoop loop;
+    std::unique_ptr<TcpServer> server;
+    if(mode == "new")
+    {
+        std::vector<int> fds = ListenFdExporter::fetch(path);
+        if(fds.empty())
+        {
+            return 1;
+        }
+        server.reset(new TcpServer(&loop, fds[0], "HotRestart-new"));
+    }
+    else
+    {
+        server.reset(new TcpServer(&loop, InetAddress(port), "HotRestart-" + mode));
+    }
+    server->setConnectionCallback([](const TcpConnectionPtr&){});
+    server->setMessageCallback(onMessage);
+    server->setThreadNum(2);
+
+    auto drainAndQuit = [&](){
+        server->stop(kDrainTimeoutMs, [&loop](size_t remaining){
+            if(remaining == 0)
+            {
+                loop.quit();
+            }
+        });
+    };
+
+    if(mode == "old")
+    {
+        // listenfd被新进程取走后开始排空
+        server->exportListenFd(path, drainAndQuit);
+    }
+    // 收到SIGUSR1时直接停止（rebind方式）
+    ::signal(SIGUSR1, onStopSignal);
+    loop.runEvery(0.01, [&](){
+        if(g_stopRequested)
+        {
+            g_stopRequested = 0;
+            drainAndQuit();
+        }
+    });
+
+    server->start();
+    loop.loop();
+    return 0;
+}
+
+struct Stats
+{
+    std::atomic_int ok{0};
+    std::atomic_int refused{0};     // connect被拒绝
+    std::atomic_int failed{0};      // 连接建立了但没有拿到完整回复
+};
+
+std::atomic_bool g_stop(false);
+
+static void client(uint16_t port, Stats *stats)
+{
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    char buf[kMessageSize];
+    while(!g_stop)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if(::connect(fd, (sockaddr*)&addr, sizeof addr) < 0)
+        {
+            ++stats->refused;
+            ::close(fd);
+            ::usleep(1000);
+            continue;
+        }
+        ::memset(buf, 'h', sizeof buf);
+        size_t got = 0;
+        if(::send(fd, buf, sizeof buf, MSG_NOSIGNAL) == (ssize_t)sizeof buf)
+        {
+            while(got < sizeof buf)
+            {
+                ssize_t n = ::recv(fd, buf + got, sizeof buf - got, 0);
+                if(n <= 0)
+                {
+                    break;
+                }
+                got += n;
+            }
+        }
+        if(got == sizeof buf)
+        {
+            ++stats->ok;
+        }
+        else
+        {
+            ++stats->failed;
+        }
+        ::close(fd);
+    }
+}
+
+static pid_t spawn(const char *self, const char *mode, uint16_t port, const std::string &path)
+{
+    ::fflush(stdout);
+    pid_t pid = ::fork();
+    if(pid == 0)
+    {
+        // 服务进程的日志不关心，避免和结果混在一起
+        freopen("/dev/null", "w", stdout);
+        std::string portStr = std::to_string(port);
+        ::execl(self, "hot_restart", "server", mode, portStr.c_str(), path.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void runScenario(const char *self, bool handoff, uint16_t port)
+{
+    std::string path = "/tmp/mymuduo-hot-restart-" + std::to_string(::getpid()) + ".sock";
+    Stats stats;
+    g_stop = false;
+
+    pid_t oldPid = spawn(self, "old", port, path);
+    ::usleep(300 * 1000);   // 等待旧进程开始监听
+
+    std::vector<std::thread> clients;
+    for(int i = 0; i < kClients; ++i)
+    {
+        clients.emplace_back(client, port, &stats);
+    }
+    ::sleep(1);
+
+    pid_t newPid;
+    if(handoff)
+    {
+        newPid = spawn(self, "new", port, path);
+    }
+    else
+    {
+        ::kill(oldPid, SIGUSR1);
+        newPid = spawn(self, "bind", port, path);
+    }
+    ::waitpid(oldPid, nullptr, 0);
+    ::sleep(1);
+
+    g_stop = true;
+    for(std::thread &t : clients)
+    {
+        t.join();
+    }
+    ::kill(newPid, SIGUSR1);
+    ::waitpid(newPid, nullptr, 0);
+
+    printf("mode=%-8s ok=%d refused=%d failed=%d\n",
+        handoff ? "handoff" : "rebind", (int)stats.ok, (int)stats.refused, (int)stats.failed);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc == 5 && strcmp(argv[1], "server") == 0)
+    {
+        return runServer(argv[2], static_cast<uint16_t>(atoi(argv[3])), argv[4]);
+    }
+
+    const char *self = "/proc/self/exe";
+    runScenario(self, false, 9985);
+    runScenario(self, true, 9986);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Logger.h>
+
+#include <string>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// 卡顿检测的演示：echo服务器收到 "slow" 时在回调里阻塞200ms，
+// loop的卡顿报告会指出是哪个连接，看门狗线程在阻塞期间就会报告
+//
+// ./stall_detect [阈值ms] [看门狗ms]
+
+const int kSlowHandlerMs = 200;
+
+static int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(::connect(fd, (sockaddr*)&addr, sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+static void request(int fd, const char *msg)
+{
+    char buf[64];
+    size_t len = ::strlen(msg);
+    if(::write(fd, msg, len) != (ssize_t)len)
+    {
+        return;
+    }
+    size_t got = 0;
+    while(got < len)
+    {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if(n <= 0)
+        {
+            break;
+        }
+        got += n;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int thresholdMs = argc > 1 ? atoi(argv[1]) : 50;
+    int watchdogMs = argc > 2 ? atoi(argv[2]) : 100;
+    const uint16_t port = 9990;
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "StallServer");
+    server.setConnectionCallback([](const TcpConnectionPtr&){});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        std::string msg = buf->retrieveAllAsString();
+        if(msg == "slow")
+        {
+            ::usleep(kSlowHandlerMs * 1000);
+        }
+        conn->send(msg);
+    });
+    server.setThreadNum(2);
+    server.start();
+    server.enableStallDetection(thresholdMs, watchdogMs);
+
+    std::thread driver([&](){
+        int fast = connectTo(port);
+        int slow = connectTo(port);
+        for(int i = 0; i < 100; ++i)
+        {
+            request(fast, "fast");
+        }
+        request(slow, "slow");
+        ::usleep(100 * 1000);
+
+        printf("%s\n", server.metricsSnapshot().toJson().c_str());
+        ::close(fast);
+        ::close(slow);
+        loop.quit();
+    });
+
+    loop.loop();
+    driver.join();
+    return 0;
+}
@@ -0,0 +1,389 @@
+// 协议解析器的自检：HttpContext、WebSocketCodec、RespParser
+// 每个用例分别按1字节、7字节和一次性整段喂给解析器，三种切法得到的事件序列都要和预期一致，
+// 覆盖读被拆开、分片中夹控制帧、超长的长度字段、同时有Content-Length和chunked等畸形输入
+// 有失败时打印用例名并返回1，由ctest运行
+
+#include "Buffer.h"
+#include "HttpContext.h"
+#include "WebSocketCodec.h"
+#include "RespCodec.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <stdio.h>
+#include <stdint.h>
+
+using Events = std::vector<std::string>;
+
+static int g_failures = 0;
+
+static std::string join(const Events &events)
+{
+    std::string s;
+    for(const std::string &e : events)
+    {
+        s += "[" + e + "]";
+    }
+    return s;
+}
+
+// feed把一段新数据交给解析器，返回false表示已经出错，后面的数据不再喂
+static void check(const char *name, const std::string &input, const Events &expected,
+                  const std::function<std::function<bool(Buffer*, Events*)>()> &makeParser)
+{
+    const size_t chunks[] = { 1, 7, input.size() };
+    for(size_t chunk : chunks)
+    {
+        std::function<bool(Buffer*, Events*)> feed = makeParser();
+        Buffer buf;
+        Events events;
+        for(size_t i = 0; i < input.size(); i += chunk)
+        {
+            buf.append(input.data() + i, std::min(chunk, input.size() - i));
+            if(!feed(&buf, &events))
+            {
+                break;
+            }
+        }
+        if(events != expected)
+        {
+            ++g_failures;
+            ::printf("FAIL %s (chunk=%zu)\n  expected %s\n  got      %s\n",
+                name, chunk, join(expected).c_str(), join(events).c_str());
+        }
+    }
+}
+
+// ---------------------------------------------------------------- HTTP
+
+static std::function<bool(Buffer*, Events*)> httpParser(size_t maxHeader = 8 * 1024, size_t maxBody = 1024 * 1024)
+{
+    std::shared_ptr<HttpContext> context = std::make_shared<HttpContext>();
+    context->setMaxHeaderBytes(maxHeader);
+    context->setMaxBodyBytes(maxBody);
+    return [context](Buffer *buf, Events *events){
+        while(true)
+        {
+            HttpContext::ParseResult result = context->parse(buf);
+            if(result == HttpContext::kNeedMore)
+            {
+                return true;
+            }
+            if(result == HttpContext::kError)
+            {
+                events->push_back("error " + std::to_string(context->errorStatus()));
+                return false;
+            }
+            const HttpRequest &request = context->request();
+            events->push_back(request.methodString().asString() + " " + request.path().asString()
+                + (request.keepAlive() ? "" : " close") + " body=" + request.body().asString());
+            context->consume(buf);
+        }
+    };
+}
+
+static void testHttp()
+{
+    auto http = [](){ return httpParser(); };
+
+    check("http pipelined", "GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+                            "\r\n"
+                            "GET /b?q=1 HTTP/1.0\r\n\r\n",
+        { "GET /a body=", "GET /b close body=" }, http);
+    check("http content-length", "POST /p HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+                                 "POST /q HTTP/1.1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+        { "POST /p body=hello", "POST /q close body=" }, http);
+    check("http chunked", "POST /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                          "5;ext=1\r\nhello\r\n6\r\n world\r\n0\r\nTrailer: t\r\n\r\n"
+                          "GET /next HTTP/1.1\r\n\r\n",
+        { "POST /c body=hello world", "GET /next body=" }, http);
+    // \r\n\r\n被拆在两次读之间时不能漏掉
+    check("http header end split", "GET /s HTTP/1.1\r\nA: b\r\n\r\n", { "GET /s body=" }, http);
+
+    // 请求走私：两种长度同时出现，先后顺序都要拒绝
+    check("http cl+te", "POST / HTTP/1.1\r\nContent-Length: 4\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n",
+        { "error 400" }, http);
+    check("http te+cl", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 4\r\n\r\n0\r\n\r\n",
+        { "error 400" }, http);
+    check("http duplicate cl", "POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 1\r\n\r\na",
+        { "error 400" }, http);
+    check("http bad cl", "POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\na", { "error 400" }, http);
+    check("http te not chunked", "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", { "error 501" }, http);
+    check("http space before colon", "GET / HTTP/1.1\r\nHost : x\r\n\r\n", { "error 400" }, http);
+    check("http obs-fold", "GET / HTTP/1.1\r\nA: b\r\n c\r\n\r\n", { "error 400" }, http);
+    check("http bad method", "BREW / HTTP/1.1\r\n\r\n", { "error 501" }, http);
+    check("http bad version", "GET / HTTP/2.0\r\n\r\n", { "error 505" }, http);
+    check("http no target", "GET  HTTP/1.1\r\n\r\n", { "error 400" }, http);
+
+    // 超长：长度字段本身超限时不等请求体到达就报错，溢出size_t的长度也一样
+    auto small = [](){ return httpParser(64, 16); };
+    check("http cl too big", "POST / HTTP/1.1\r\nContent-Length: 17\r\n\r\n", { "error 413" }, small);
+    check("http cl overflow", "POST / HTTP/1.1\r\nContent-Length: 99999999999999999999999999\r\n\r\n",
+        { "error 413" }, http);
+    check("http header too big", "GET / HTTP/1.1\r\nA: " + std::string(100, 'a'), { "error 431" }, small);
+    check("http chunk too big", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n11\r\n",
+        { "error 413" }, small);
+    check("http chunks sum too big", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                     "8\r\n12345678\r\n9\r\n", { "error 413" }, small);
+    check("http chunk size overflow", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nffffffffffffffffffff\r\n",
+        { "error 413" }, http);
+    std::string trailers;
+    for(int i = 0; i < 8; ++i)
+    {
+        trailers += "X-Trailer: " + std::string(10, 'a') + "\r\n";
+    }
+    check("http trailers too big", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n" + trailers + "\r\n",
+        { "error 400" }, small);
+    check("http trailers fit", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n"
+                               "X-Trailer: aaaaaaaaaa\r\n\r\n", { "POST / body=" }, small);
+    check("http bad chunk size", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", { "error 400" }, http);
+    check("http chunk without crlf", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n1\r\naXX",
+        { "error 400" }, http);
+}
+
+// ---------------------------------------------------------------- WebSocket
+
+static const unsigned char kMaskKey[4] = { 0x12, 0x34, 0x56, 0x78 };
+
+// 客户端发出的帧：带掩码，按长度选7位、16位或64位长度
+static std::string frameHeader(int firstByte, uint64_t length)
+{
+    std::string header(1, static_cast<char>(firstByte));
+    if(length < 126)
+    {
+        header += static_cast<char>(0x80 | length);
+    }
+    else if(length <= 0xFFFF)
+    {
+        header += static_cast<char>(0x80 | 126);
+        header += static_cast<char>(length >> 8);
+        header += static_cast<char>(length);
+    }
+    else
+    {
+        header += static_cast<char>(0x80 | 127);
+        for(int i = 0; i < 8; ++i)
+        {
+            header += static_cast<char>(length >> (56 - 8 * i));
+        }
+    }
+    return header;
+}
+
+static std::string clientFrame(int opcode, const std::string &payload, bool fin = true)
+{
+    std::string frame = frameHeader((fin ? 0x80 : 0) | opcode, payload.size());
+    frame.append(reinterpret_cast<const char*>(kMaskKey), 4);
+    std::string masked = payload;
+    WebSocketCodec::applyMask(&masked[0], masked.size(), kMaskKey);
+    return frame + masked;
+}
+
+static std::function<bool(Buffer*, Events*)> wsParser(size_t maxMessage = 1024 * 1024)
+{
+    std::shared_ptr<WebSocketCodec> codec = std::make_shared<WebSocketCodec>(maxMessage);
+    return [codec](Buffer *buf, Events *events){
+        while(true)
+        {
+            WebSocketCodec::ParseResult result = codec->parse(buf);
+            if(result == WebSocketCodec::kNeedMore)
+            {
+                return true;
+            }
+            if(result == WebSocketCodec::kError)
+            {
+                events->push_back("error " + std::to_string(codec->errorCode()));
+                return false;
+            }
+            const char *kind = "";
+            switch(codec->opcode())
+            {
+            case WebSocketCodec::kText: kind = "text"; break;
+            case WebSocketCodec::kBinary: kind = "binary"; break;
+            case WebSocketCodec::kPing: kind = "ping"; break;
+            case WebSocketCodec::kPong: kind = "pong"; break;
+            case WebSocketCodec::kClose: kind = "close"; break;
+            default: kind = "?"; break;
+            }
+            std::string payload = codec->payload().asString();
+            // 长消息只记长度和首尾，便于比较
+            if(payload.size() > 32)
+            {
+                payload = std::to_string(payload.size()) + ":" + payload.front() + payload.back();
+            }
+            events->push_back(std::string(kind) + " " + payload);
+            codec->consume(buf);
+        }
+    };
+}
+
+static void testWebSocket()
+{
+    using WS = WebSocketCodec;
+    auto ws = [](){ return wsParser(); };
+
+    check("ws single", clientFrame(WS::kText, "hello") + clientFrame(WS::kBinary, ""),
+        { "text hello", "binary " }, ws);
+    check("ws extended lengths",
+        clientFrame(WS::kBinary, "a" + std::string(198, 'x') + "b")
+        + clientFrame(WS::kText, "c" + std::string(70000, 'y') + "d"),
+        { "binary 200:ab", "text 70002:cd" }, ws);
+    // 控制帧夹在分片中间时先交出去，分片拼接的结果不受影响，之后的消息照常解析
+    check("ws fragments with control frames",
+        clientFrame(WS::kText, "Hel", false)
+        + clientFrame(WS::kPing, "p1")
+        + clientFrame(WS::kContinuation, "lo", false)
+        + clientFrame(WS::kPong, "")
+        + clientFrame(WS::kPing, "p2")
+        + clientFrame(WS::kContinuation, " world", true)
+        + clientFrame(WS::kBinary, "next")
+        + clientFrame(WS::kClose, std::string("\x03\xe8", 2)),
+        { "ping p1", "pong ", "ping p2", "text Hello world", "binary next", std::string("close \x03\xe8", 8) }, ws);
+    check("ws fragment sizes",
+        clientFrame(WS::kBinary, std::string(300, 'm'), false)
+        + clientFrame(WS::kContinuation, "", false)
+        + clientFrame(WS::kContinuation, std::string(70000, 'n'), true),
+        { "binary 70300:mn" }, ws);
+
+    check("ws unmasked", "\x81\x02hi", { "error 1002" }, ws);
+    check("ws rsv", clientFrame(0xC0 | WS::kText, "x"), { "error 1002" }, ws);
+    check("ws reserved opcode", clientFrame(0x3, "x"), { "error 1002" }, ws);
+    check("ws control too long", clientFrame(WS::kPing, std::string(126, 'p')), { "error 1002" }, ws);
+    check("ws fragmented control", clientFrame(WS::kPing, "p", false), { "error 1002" }, ws);
+    check("ws continuation first", clientFrame(WS::kContinuation, "x"), { "error 1002" }, ws);
+    check("ws new message inside fragments",
+        clientFrame(WS::kText, "a", false) + clientFrame(WS::kText, "b"), { "error 1002" }, ws);
+
+    // 超长：看到长度字段就拒绝，不等数据到达，64位长度的最高位也不能绕过
+    auto small = [](){ return wsParser(1024); };
+    check("ws too big 16", frameHeader(0x80 | WS::kBinary, 1025), { "error 1009" }, small);
+    check("ws too big 64", frameHeader(0x80 | WS::kBinary, UINT64_MAX), { "error 1009" }, ws);
+    check("ws control huge length", frameHeader(0x80 | WS::kPing, 1ULL << 63), { "error 1002" }, ws);
+    check("ws fragments sum too big",
+        clientFrame(WS::kBinary, std::string(1000, 'a'), false) + frameHeader(WS::kContinuation, 25),
+        { "error 1009" }, small);
+    check("ws max size exact", clientFrame(WS::kBinary, std::string(1024, 'a')), { "binary 1024:aa" }, small);
+
+    // RFC 6455 1.3节的例子
+    if(WebSocketCodec::acceptKey("dGhlIHNhbXBsZSBub25jZQ==") != "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=")
+    {
+        ++g_failures;
+        ::printf("FAIL ws accept key\n");
+    }
+}
+
+// ---------------------------------------------------------------- RESP
+
+static std::function<bool(Buffer*, Events*)> respCommandParser(size_t maxBulk = 512 * 1024 * 1024,
+                                                              size_t maxElements = 1024 * 1024)
+{
+    std::shared_ptr<RespParser> parser = std::make_shared<RespParser>();
+    parser->setMaxBulkLength(maxBulk);
+    parser->setMaxElements(maxElements);
+    return [parser](Buffer *buf, Events *events){
+        while(true)
+        {
+            RespParser::ParseResult result = parser->parseCommand(buf);
+            if(result == RespParser::kNeedMore)
+            {
+                return true;
+            }
+            if(result == RespParser::kError)
+            {
+                events->push_back(std::string("error ") + parser->error());
+                return false;
+            }
+            std::string command;
+            for(const StringPiece &arg : parser->command().args())
+            {
+                command += (command.empty() ? "" : " ") + arg.asString();
+            }
+            events->push_back(command);
+            parser->consume(buf);
+        }
+    };
+}
+
+// 任意值，事件是前序展开后每个值的类型和内容
+static std::function<bool(Buffer*, Events*)> respValueParser()
+{
+    std::shared_ptr<RespParser> parser = std::make_shared<RespParser>();
+    return [parser](Buffer *buf, Events *events){
+        while(true)
+        {
+            RespParser::ParseResult result = parser->parse(buf);
+            if(result == RespParser::kNeedMore)
+            {
+                return true;
+            }
+            if(result == RespParser::kError)
+            {
+                events->push_back(std::string("error ") + parser->error());
+                return false;
+            }
+            std::string value;
+            for(const RespValue &v : parser->values())
+            {
+                value += static_cast<char>(v.type);
+                value += v.str.empty() ? std::to_string(v.integer) : v.str.asString();
+                value += " ";
+            }
+            events->push_back(value);
+            parser->consume(buf);
+        }
+    };
+}
+
+static void testResp()
+{
+    auto command = [](){ return respCommandParser(); };
+
+    check("resp commands", "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$5\r\nhello\r\n"
+                           "PING\r\n"
+                           "  get   k \n"
+                           "*1\r\n$4\r\nPING\r\n",
+        { "SET k hello", "PING", "get k", "PING" }, command);
+    // bulk string里的\r\n不能被当成行尾
+    check("resp bulk with crlf", "*2\r\n$4\r\nECHO\r\n$6\r\na\r\nb\r\n\r\n", { "ECHO a\r\nb\r\n" }, command);
+    check("resp values", "*2\r\n*1\r\n:-12\r\n%1\r\n+a\r\n#t\r\n"
+                         "$-1\r\n"
+                         "|1\r\n+key\r\n:1\r\n,1.5\r\n",
+        { "*2 *1 :-12 %1 +a #t ", "_0 ", "|1 +key :1 ,1.5 " }, [](){ return respValueParser(); });
+
+    check("resp not bulk", "*1\r\n:1\r\n", { "error expected bulk strings in command" }, command);
+    check("resp bad bulk length", "*1\r\n$-2\r\n", { "error invalid bulk length" }, command);
+    check("resp bulk overflow", "*1\r\n$99999999999999999999\r\n", { "error invalid bulk length" }, command);
+    check("resp bulk not terminated", "*1\r\n$3\r\nabcXY", { "error bulk string not terminated by CRLF" }, command);
+    check("resp bad aggregate", "*-2\r\n", { "error invalid aggregate length" }, command);
+    check("resp unknown type", "*1\r\n?x\r\n", { "error unknown type" }, command);
+    check("resp bad integer", ":12a\r\n", { "error invalid integer" }, [](){ return respValueParser(); });
+    check("resp bad boolean", "#x\r\n", { "error invalid boolean" }, [](){ return respValueParser(); });
+
+    // 超长：长度行一到就拒绝，不等数据
+    check("resp bulk too long", "*1\r\n$5\r\n", { "error bulk string too long" },
+        [](){ return respCommandParser(4); });
+    check("resp too many elements", "*3\r\n", { "error too many elements" },
+        [](){ return respCommandParser(512, 2); });
+    check("resp nested too many elements", "*2\r\n*3\r\n", { "error too many elements" },
+        [](){ return respCommandParser(512, 3); });
+    check("resp line too long", "+" + std::string(70 * 1024, 'a'), { "error line too long" },
+        [](){ return respValueParser(); });
+    check("resp inline too long", std::string(70 * 1024, 'a'), { "error inline command too long" }, command);
+}
+
+int main()
+{
+    testHttp();
+    testWebSocket();
+    testResp();
+    if(g_failures > 0)
+    {
+        ::printf("%d failure(s)\n", g_failures);
+        return 1;
+    }
+    ::printf("all passed\n");
+    return 0;
+}